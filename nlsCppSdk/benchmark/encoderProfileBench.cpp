@@ -0,0 +1,182 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 编码预设性能测试: 对同一段16bit单声道PCM, 按各ENCODER_PRESET分别以
+ * opu/opus格式编码, 输出每秒音频消耗的CPU时间及编码后每秒字节数.
+ *
+ * 用法: encoderProfileBench [pcm文件] [采样率] [秒数]
+ *   不指定pcm文件时生成含静音段的合成语音信号, 默认16000Hz, 60秒.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include "nlsGlobal.h"
+#include "nlsEncoder.h"
+
+using namespace AlibabaNls;
+
+static const double kPi = 3.14159265358979323846;
+
+/* 1.2秒有声段与0.8秒静音段交替, 有声段为基频缓变的谐波加噪声 */
+static void generateSpeechLike(std::vector<uint8_t>& pcm,
+                               int sampleRate, int seconds) {
+  size_t samples = (size_t)sampleRate * seconds;
+  pcm.resize(samples * 2);
+  unsigned int seed = 12345;
+  double phase = 0;
+  for (size_t i = 0; i < samples; i++) {
+    double t = (double)i / sampleRate;
+    double cycle = fmod(t, 2.0);
+    seed = seed * 1103515245 + 12345;
+    double noise = ((double)((seed >> 16) & 0x7fff) / 16384.0 - 1.0);
+
+    double value = noise * 30;
+    if (cycle < 1.2) {
+      double pitch = 150 + 50 * sin(2 * kPi * 0.7 * t);
+      phase += 2 * kPi * pitch / sampleRate;
+      double voiced = 0;
+      for (int h = 1; h <= 10; h++) {
+        voiced += sin(phase * h) / h;
+      }
+      double envelope = sin(kPi * cycle / 1.2);
+      value += 6000 * envelope * voiced + noise * 300;
+    }
+
+    short s = (short)(value > 32767 ? 32767 : (value < -32768 ? -32768 : value));
+    pcm[2 * i] = (uint8_t)(s & 0xff);
+    pcm[2 * i + 1] = (uint8_t)((s >> 8) & 0xff);
+  }
+}
+
+static int loadPcm(const char* path, std::vector<uint8_t>& pcm) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return -1;
+  }
+  uint8_t buffer[4096];
+  size_t n = 0;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    pcm.insert(pcm.end(), buffer, buffer + n);
+  }
+  fclose(fp);
+  return 0;
+}
+
+static int runProfile(ENCODER_TYPE type, const NlsEncoderProfile& profile,
+                      const std::vector<uint8_t>& pcm, int sampleRate,
+                      double* cpuMsPerSecond, double* bytesPerSecond) {
+  NlsEncoder encoder;
+  int errorCode = 0;
+  if (encoder.createNlsEncoder(type, 1, sampleRate, &errorCode,
+                               profile.frameMs) < 0) {
+    fprintf(stderr, "createNlsEncoder failed: %d\n", errorCode);
+    return -1;
+  }
+  if (encoder.setEncoderProfile(profile) < 0) {
+    encoder.destroyNlsEncoder();
+    return -1;
+  }
+
+  int frameBytes = encoder.getFrameBytes();
+  std::vector<unsigned char> output(frameBytes + 4096);
+  size_t frames = pcm.size() / frameBytes;
+  size_t encoded = 0;
+
+  clock_t begin = clock();
+  for (size_t i = 0; i < frames; i++) {
+    int n = encoder.nlsEncoding(&pcm[i * frameBytes], frameBytes,
+                                &output[0], (int)output.size());
+    if (n > 0) {
+      encoded += n;
+    }
+  }
+  clock_t end = clock();
+  encoder.destroyNlsEncoder();
+
+  double audioSeconds = (double)(frames * frameBytes) / (sampleRate * 2);
+  double cpuMs = (double)(end - begin) * 1000.0 / CLOCKS_PER_SEC;
+  *cpuMsPerSecond = cpuMs / audioSeconds;
+  *bytesPerSecond = encoded / audioSeconds;
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  int sampleRate = argc > 2 ? atoi(argv[2]) : 16000;
+  int seconds = argc > 3 ? atoi(argv[3]) : 60;
+  if ((sampleRate != 8000 && sampleRate != 16000) || seconds <= 0) {
+    fprintf(stderr, "usage: %s [pcm file] [8000|16000] [seconds]\n", argv[0]);
+    return -1;
+  }
+
+  std::vector<uint8_t> pcm;
+  if (argc > 1 && strcmp(argv[1], "-") != 0) {
+    if (loadPcm(argv[1], pcm) < 0) {
+      fprintf(stderr, "open %s failed\n", argv[1]);
+      return -1;
+    }
+  } else {
+    generateSpeechLike(pcm, sampleRate, seconds);
+  }
+
+  struct {
+    ENCODER_PRESET preset;
+    const char* name;
+  } presets[] = {
+    {ENCODER_PRESET_DEFAULT, "default"},
+    {ENCODER_PRESET_LOW_BANDWIDTH, "low_bandwidth"},
+    {ENCODER_PRESET_LOW_CPU, "low_cpu"},
+    {ENCODER_PRESET_DTX, "dtx"},
+  };
+  struct {
+    ENCODER_TYPE type;
+    const char* name;
+  } types[] = {
+    {ENCODER_OPU, "opu"},
+    {ENCODER_OPUS, "opus"},
+  };
+
+  printf("audio: %.1fs, %dHz\n",
+         (double)pcm.size() / (sampleRate * 2), sampleRate);
+  printf("%-6s %-14s %8s %4s %4s %4s %6s %14s %10s %8s\n",
+         "format", "preset", "bitrate", "cplx", "vbr", "dtx", "frame",
+         "cpu_ms/stream_s", "bytes/s", "kbps");
+
+  for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    for (size_t p = 0; p < sizeof(presets) / sizeof(presets[0]); p++) {
+      NlsEncoderProfile profile;
+      NlsEncoder::getPresetProfile(presets[p].preset, &profile);
+
+      double cpuMsPerSecond = 0;
+      double bytesPerSecond = 0;
+      if (runProfile(types[t].type, profile, pcm, sampleRate,
+                     &cpuMsPerSecond, &bytesPerSecond) < 0) {
+        printf("%-6s %-14s failed\n", types[t].name, presets[p].name);
+        continue;
+      }
+      printf("%-6s %-14s %8d %4d %4d %4d %4dms %14.3f %10.0f %8.2f\n",
+             types[t].name, presets[p].name, profile.bitrate,
+             profile.complexity, profile.vbr, profile.dtx, profile.frameMs,
+             cpuMsPerSecond, bytesPerSecond, bytesPerSecond * 8 / 1000);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,829 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 端到端并发性能测试: 通过SDK对本地模拟网关(tools/nlsMockGateway)
+ * 逐级增加并发会话数, 每个会话一个线程, 依次发起请求.
+ * 识别类请求按100ms一帧发送16k PCM, 可按实时或加速节拍发送.
+ * 每一级统计:
+ *   connect_ms       start至收到WebSocket升级响应
+ *   first_result_ms  start至首个结果(中间结果、音频数据等)
+ *   completion_ms    识别类为stop至Completed, 合成为start至SynthesisCompleted
+ *   cpu_ms_per_request 进程CPU时间(用户+内核)/请求数
+ *   sessions_per_core 单核可承载的会话数, 并发数/(CPU时间/墙钟时间),
+ *                     仅在实时节拍下有意义
+ *   bytes_per_send/bytes_per_recv 每次send/recv系统调用的平均字节数
+ *
+ * 用法: nlsBench [选项]
+ *   -u <url>               网关地址, 默认ws://127.0.0.1:<端口>/ws/v1
+ *   -t <类型>              请求类型, 逗号分隔: st,sr,sy,da, 默认全部
+ *   -c <并发>              并发会话数阶梯, 逗号分隔, 默认1,8,32
+ *   -n <次数>              每个会话的请求数, 默认4
+ *   --audio-seconds <s>    识别类请求每次的音频时长, 默认2
+ *   --speed <倍数>         发送节拍, 1为实时, 0为不限速, 默认1
+ *   --threads <n>          SDK事件线程数, 默认-1(与CPU核数相同)
+ *   --tts-text <文本>      合成文本, 默认"北京今天天气晴"
+ *   --timeout <s>          单个请求等待关闭的超时, 超时后cancel, 默认30
+ *   --gateway <路径>       启动nlsMockGateway子进程, 结束时以SIGTERM退出
+ *   --gateway-args <参数>  传给模拟网关的附加参数, 空格分隔
+ *   --port <端口>          模拟网关端口, 默认8101
+ *   --log <文件>           SDK日志文件, 默认不输出日志
+ *   --json <文件>          输出JSON格式结果, "-"为标准输出
+ *   --compare <文件>       与基线JSON比较, 发现回退时返回2
+ *   --tolerance <百分比>   比较时允许的时延及CPU增幅, 默认20
+ *   --min-delta-ms <ms>    时延增量小于此值时不视为回退, 默认2
+ *
+ * CI中典型用法:
+ *   nlsBench --gateway ./nlsMockGateway --speed 0 --json current.json \
+ *            --compare baseline.json
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "json/json.h"
+#include "nlsClient.h"
+#include "nlsEvent.h"
+#include "nlsMetrics.h"
+#include "speechTranscriberRequest.h"
+#include "speechRecognizerRequest.h"
+#include "speechSynthesizerRequest.h"
+#include "dialogAssistantRequest.h"
+
+using namespace AlibabaNls;
+
+#define BENCH_SAMPLE_RATE 16000
+#define BENCH_FRAME_MS 100
+#define BENCH_FRAME_BYTES (BENCH_SAMPLE_RATE / 1000 * BENCH_FRAME_MS * 2)
+#define BENCH_TYPE_NUM 4
+
+enum BenchType {
+  BenchTranscriber = 0,
+  BenchRecognizer,
+  BenchSynthesizer,
+  BenchDialog
+};
+
+/* 单个请求的结果 */
+enum BenchOutcome {
+  BenchClosed = 0,
+  BenchStartFailed,
+  BenchTimeout
+};
+
+static const char* typeNames[BENCH_TYPE_NUM] = {"st", "sr", "sy", "da"};
+
+struct BenchConfig {
+  std::string url;
+  std::vector<int> types;
+  std::vector<int> sessions;
+  int requestsPerSession;
+  double audioSeconds;
+  double speed;
+  int threads;
+  std::string ttsText;
+  int timeoutSeconds;
+  const char* gatewayPath;
+  std::string gatewayArgs;
+  int port;
+  const char* logFile;
+  const char* jsonFile;
+  const char* baselineFile;
+  double tolerance;
+  double minDeltaMs;
+};
+
+/* 单级测试的汇总, 由各会话线程加锁写入 */
+struct BenchStep {
+  int type;
+  int sessions;
+  pthread_mutex_t mtx;
+  std::vector<double> connectMs;
+  std::vector<double> firstResultMs;
+  std::vector<double> completionMs;
+  int requests;
+  int completed;
+  int failed;
+  int timeouts;
+  double audioSeconds;
+};
+
+/* 单个请求的状态, 由SDK回调写入 */
+struct BenchRequestState {
+  pthread_mutex_t mtx;
+  pthread_cond_t cv;
+  bool closed;
+  bool failed;
+};
+
+struct BenchWorker {
+  BenchStep* step;
+  pthread_t thread;
+};
+
+static BenchConfig config;
+static std::vector<char> audioFrame;
+
+static uint64_t getMonotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static double getCpuMs() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+static void sleepUntil(uint64_t deadlineUs) {
+  uint64_t now = getMonotonicUs();
+  if (deadlineUs > now) {
+    usleep((useconds_t)(deadlineUs - now));
+  }
+}
+
+static void onTaskFailed(NlsEvent* ev, void* arg) {
+  BenchRequestState* state = (BenchRequestState*)arg;
+  pthread_mutex_lock(&state->mtx);
+  state->failed = true;
+  pthread_mutex_unlock(&state->mtx);
+}
+
+static void onChannelClosed(NlsEvent* ev, void* arg) {
+  BenchRequestState* state = (BenchRequestState*)arg;
+  pthread_mutex_lock(&state->mtx);
+  state->closed = true;
+  pthread_cond_signal(&state->cv);
+  pthread_mutex_unlock(&state->mtx);
+}
+
+/* 等待连接关闭, 超时返回false */
+static bool waitClosed(BenchRequestState* state, int timeoutSeconds) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeoutSeconds;
+  pthread_mutex_lock(&state->mtx);
+  while (!state->closed) {
+    if (pthread_cond_timedwait(&state->cv, &state->mtx, &deadline) ==
+        ETIMEDOUT) {
+      break;
+    }
+  }
+  bool closed = state->closed;
+  pthread_mutex_unlock(&state->mtx);
+  return closed;
+}
+
+template <typename T>
+static void setupRequest(T* request, BenchRequestState* state) {
+  request->setUrl(config.url.c_str());
+  request->setAppKey("nlsBench");
+  request->setToken("nlsBench");
+  request->setOnTaskFailed(onTaskFailed, state);
+  request->setOnChannelClosed(onChannelClosed, state);
+}
+
+/* 按节拍发送音频, 返回已发送的音频秒数 */
+template <typename T>
+static double streamAudio(T* request) {
+  int frames = (int)(config.audioSeconds * 1000 / BENCH_FRAME_MS + 0.5);
+  uint64_t begin = getMonotonicUs();
+  int sent = 0;
+  for (; sent < frames; ++sent) {
+    if (config.speed > 0) {
+      sleepUntil(begin + (uint64_t)(sent * BENCH_FRAME_MS * 1000 /
+                                    config.speed));
+    }
+    if (request->sendAudio((const uint8_t*)&audioFrame[0],
+                           audioFrame.size()) < 0) {
+      break;
+    }
+  }
+  return sent * BENCH_FRAME_MS / 1000.0;
+}
+
+/* 等待连接关闭, 超时则cancel */
+template <typename T>
+static int finishRequest(T* request, BenchRequestState* state) {
+  if (!waitClosed(state, config.timeoutSeconds)) {
+    request->cancel();
+    waitClosed(state, config.timeoutSeconds);
+    return BenchTimeout;
+  }
+  return BenchClosed;
+}
+
+/* 识别类请求: start, 发送音频, stop, 等待连接关闭 */
+template <typename T>
+static int runRequest(T* request, BenchRequestState* state,
+                      double* audioSeconds) {
+  if (request->start() < 0) {
+    return BenchStartFailed;
+  }
+  *audioSeconds = streamAudio(request);
+  request->stop();
+  return finishRequest(request, state);
+}
+
+/* 合成请求: start后等待合成结束 */
+static int runRequest(SpeechSynthesizerRequest* request,
+                      BenchRequestState* state, double* audioSeconds) {
+  if (request->start() < 0) {
+    return BenchStartFailed;
+  }
+  return finishRequest(request, state);
+}
+
+static void recordRequest(BenchStep* step, int outcome,
+                          const BenchRequestState& state,
+                          const NlsLatencyTrace& trace, double audioSeconds) {
+  pthread_mutex_lock(&step->mtx);
+  step->requests++;
+  step->audioSeconds += audioSeconds;
+  if (outcome == BenchTimeout) {
+    step->timeouts++;
+  }
+  if (outcome == BenchClosed && !state.failed && trace.completedUs != 0) {
+    step->completed++;
+    if (trace.upgradedUs != 0) {
+      step->connectMs.push_back((trace.upgradedUs - trace.startUs) / 1000.0);
+    }
+    if (trace.firstResultUs != 0) {
+      step->firstResultMs.push_back(
+          (trace.firstResultUs - trace.startUs) / 1000.0);
+    }
+    uint64_t from = trace.stopSentUs != 0 ? trace.stopSentUs : trace.startUs;
+    if (trace.completedUs >= from) {
+      step->completionMs.push_back((trace.completedUs - from) / 1000.0);
+    }
+  } else {
+    step->failed++;
+  }
+  pthread_mutex_unlock(&step->mtx);
+}
+
+static void runOnce(BenchStep* step) {
+  NlsClient* client = NlsClient::getInstance();
+  BenchRequestState state;
+  pthread_mutex_init(&state.mtx, NULL);
+  pthread_cond_init(&state.cv, NULL);
+  state.closed = false;
+  state.failed = false;
+
+  NlsLatencyTrace trace;
+  memset(&trace, 0, sizeof(trace));
+  double audioSeconds = 0;
+  int outcome = BenchStartFailed;
+
+  switch (step->type) {
+    case BenchTranscriber: {
+      SpeechTranscriberRequest* request = client->createTranscriberRequest();
+      if (request == NULL) break;
+      setupRequest(request, &state);
+      request->setIntermediateResult(true);
+      outcome = runRequest(request, &state, &audioSeconds);
+      request->getLatencyTrace(&trace);
+      client->releaseTranscriberRequest(request);
+      break;
+    }
+    case BenchRecognizer: {
+      SpeechRecognizerRequest* request = client->createRecognizerRequest();
+      if (request == NULL) break;
+      setupRequest(request, &state);
+      request->setIntermediateResult(true);
+      outcome = runRequest(request, &state, &audioSeconds);
+      request->getLatencyTrace(&trace);
+      client->releaseRecognizerRequest(request);
+      break;
+    }
+    case BenchSynthesizer: {
+      SpeechSynthesizerRequest* request = client->createSynthesizerRequest();
+      if (request == NULL) break;
+      setupRequest(request, &state);
+      request->setText(config.ttsText.c_str());
+      outcome = runRequest(request, &state, &audioSeconds);
+      request->getLatencyTrace(&trace);
+      client->releaseSynthesizerRequest(request);
+      break;
+    }
+    case BenchDialog: {
+      DialogAssistantRequest* request = client->createDialogAssistantRequest();
+      if (request == NULL) break;
+      setupRequest(request, &state);
+      outcome = runRequest(request, &state, &audioSeconds);
+      request->getLatencyTrace(&trace);
+      client->releaseDialogAssistantRequest(request);
+      break;
+    }
+  }
+
+  recordRequest(step, outcome, state, trace, audioSeconds);
+  pthread_cond_destroy(&state.cv);
+  pthread_mutex_destroy(&state.mtx);
+}
+
+static void* sessionThread(void* arg) {
+  BenchWorker* worker = (BenchWorker*)arg;
+  for (int i = 0; i < config.requestsPerSession; ++i) {
+    runOnce(worker->step);
+  }
+  return NULL;
+}
+
+/* nearest-rank百分位 */
+static double percentile(std::vector<double>& values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  size_t rank = (size_t)ceil(p * values.size());
+  if (rank == 0) {
+    rank = 1;
+  }
+  return values[rank - 1];
+}
+
+static Json::Value summarize(std::vector<double>& values) {
+  std::sort(values.begin(), values.end());
+  Json::Value summary(Json::objectValue);
+  summary["count"] = (int)values.size();
+  summary["p50"] = percentile(values, 0.50);
+  summary["p90"] = percentile(values, 0.90);
+  summary["p99"] = percentile(values, 0.99);
+  summary["max"] = values.empty() ? 0.0 : values.back();
+  return summary;
+}
+
+static Json::Value runStep(int type, int sessions) {
+  BenchStep step;
+  step.type = type;
+  step.sessions = sessions;
+  pthread_mutex_init(&step.mtx, NULL);
+  step.requests = 0;
+  step.completed = 0;
+  step.failed = 0;
+  step.timeouts = 0;
+  step.audioSeconds = 0;
+
+  int64_t bytesSent = utility::NlsMetrics::bytesSent.value();
+  int64_t bytesReceived = utility::NlsMetrics::bytesReceived.value();
+  int64_t writes = utility::NlsMetrics::socketWrites.value();
+  int64_t reads = utility::NlsMetrics::socketReads.value();
+  double cpuBegin = getCpuMs();
+  uint64_t wallBegin = getMonotonicUs();
+
+  std::vector<BenchWorker> workers(sessions);
+  int started = 0;
+  for (; started < sessions; ++started) {
+    workers[started].step = &step;
+    if (pthread_create(&workers[started].thread, NULL, sessionThread,
+                       &workers[started]) != 0) {
+      fprintf(stderr, "pthread_create failed at session %d.\n", started);
+      break;
+    }
+  }
+  for (int i = 0; i < started; ++i) {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  double wallMs = (getMonotonicUs() - wallBegin) / 1000.0;
+  double cpuMs = getCpuMs() - cpuBegin;
+  bytesSent = utility::NlsMetrics::bytesSent.value() - bytesSent;
+  bytesReceived = utility::NlsMetrics::bytesReceived.value() - bytesReceived;
+  writes = utility::NlsMetrics::socketWrites.value() - writes;
+  reads = utility::NlsMetrics::socketReads.value() - reads;
+
+  Json::Value result(Json::objectValue);
+  result["type"] = typeNames[type];
+  result["sessions"] = started;
+  result["requests"] = step.requests;
+  result["completed"] = step.completed;
+  result["failed"] = step.failed;
+  result["timeouts"] = step.timeouts;
+  result["wall_ms"] = wallMs;
+  result["cpu_ms"] = cpuMs;
+  result["requests_per_s"] = wallMs > 0 ? step.requests * 1000.0 / wallMs : 0;
+  result["cpu_ms_per_request"] =
+      step.requests > 0 ? cpuMs / step.requests : 0;
+  result["cpu_ms_per_audio_s"] =
+      step.audioSeconds > 0 ? cpuMs / step.audioSeconds : 0;
+  result["sessions_per_core"] = cpuMs > 0 ? started * wallMs / cpuMs : 0;
+  result["bytes_sent"] = (double)bytesSent;
+  result["bytes_received"] = (double)bytesReceived;
+  result["bytes_per_send"] = writes > 0 ? (double)bytesSent / writes : 0;
+  result["bytes_per_recv"] = reads > 0 ? (double)bytesReceived / reads : 0;
+  result["connect_ms"] = summarize(step.connectMs);
+  result["first_result_ms"] = summarize(step.firstResultMs);
+  result["completion_ms"] = summarize(step.completionMs);
+
+  pthread_mutex_destroy(&step.mtx);
+  return result;
+}
+
+static void printHeader() {
+  printf("%-4s %6s %6s %6s %9s %9s %9s %9s %9s %9s %8s %8s %8s %8s\n",
+         "type", "sess", "req", "fail", "conn50", "conn99", "first50",
+         "first99", "done50", "done99", "cpu/req", "sess/cpu", "B/send",
+         "B/recv");
+}
+
+static void printStep(const Json::Value& step) {
+  printf("%-4s %6d %6d %6d %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f "
+         "%8.3f %8.1f %8.1f %8.1f\n",
+         step["type"].asCString(), step["sessions"].asInt(),
+         step["requests"].asInt(), step["failed"].asInt(),
+         step["connect_ms"]["p50"].asDouble(),
+         step["connect_ms"]["p99"].asDouble(),
+         step["first_result_ms"]["p50"].asDouble(),
+         step["first_result_ms"]["p99"].asDouble(),
+         step["completion_ms"]["p50"].asDouble(),
+         step["completion_ms"]["p99"].asDouble(),
+         step["cpu_ms_per_request"].asDouble(),
+         step["sessions_per_core"].asDouble(),
+         step["bytes_per_send"].asDouble(),
+         step["bytes_per_recv"].asDouble());
+  fflush(stdout);
+}
+
+static std::string stepKey(const Json::Value& step) {
+  std::ostringstream key;
+  key << step["type"].asString() << ":" << step["sessions"].asInt();
+  return key.str();
+}
+
+/* 与基线比较, 返回回退项数量 */
+static int compareBaseline(const Json::Value& current, const char* file) {
+  std::ifstream input(file);
+  Json::Value baseline;
+  Json::Reader reader;
+  if (!input || !reader.parse(input, baseline) || !baseline.isObject() ||
+      !baseline["steps"].isArray()) {
+    fprintf(stderr, "Cannot read baseline %s.\n", file);
+    return -1;
+  }
+
+  std::map<std::string, Json::Value> base;
+  for (Json::ArrayIndex i = 0; i < baseline["steps"].size(); ++i) {
+    base[stepKey(baseline["steps"][i])] = baseline["steps"][i];
+  }
+
+  static const char* latencies[] = {"connect_ms", "first_result_ms",
+                                    "completion_ms"};
+  static const char* ranks[] = {"p50", "p99"};
+  double ratio = 1 + config.tolerance / 100;
+  int regressions = 0;
+
+  printf("\ncompare with %s (tolerance %.1f%%, min delta %.1fms)\n", file,
+         config.tolerance, config.minDeltaMs);
+  const Json::Value& steps = current["steps"];
+  for (Json::ArrayIndex i = 0; i < steps.size(); ++i) {
+    const Json::Value& step = steps[i];
+    std::string key = stepKey(step);
+    std::map<std::string, Json::Value>::iterator it = base.find(key);
+    if (it == base.end()) {
+      printf("  %-8s not in baseline\n", key.c_str());
+      continue;
+    }
+    const Json::Value& old = it->second;
+
+    for (size_t l = 0; l < sizeof(latencies) / sizeof(latencies[0]); ++l) {
+      for (size_t r = 0; r < sizeof(ranks) / sizeof(ranks[0]); ++r) {
+        double now = step[latencies[l]][ranks[r]].asDouble();
+        double was = old[latencies[l]][ranks[r]].asDouble();
+        if (now > was * ratio && now - was > config.minDeltaMs) {
+          printf("  %-8s %s.%s regressed: %.2f -> %.2f\n", key.c_str(),
+                 latencies[l], ranks[r], was, now);
+          regressions++;
+        }
+      }
+    }
+
+    double cpuNow = step["cpu_ms_per_request"].asDouble();
+    double cpuWas = old["cpu_ms_per_request"].asDouble();
+    if (cpuNow > cpuWas * ratio) {
+      printf("  %-8s cpu_ms_per_request regressed: %.3f -> %.3f\n",
+             key.c_str(), cpuWas, cpuNow);
+      regressions++;
+    }
+
+    if (step["failed"].asInt() > old["failed"].asInt()) {
+      printf("  %-8s failed requests: %d -> %d\n", key.c_str(),
+             old["failed"].asInt(), step["failed"].asInt());
+      regressions++;
+    }
+  }
+
+  printf("%d regression(s)\n", regressions);
+  return regressions;
+}
+
+static bool parseList(const char* value, std::vector<int>& list) {
+  list.clear();
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    int number = atoi(item.c_str());
+    if (number <= 0) {
+      return false;
+    }
+    list.push_back(number);
+  }
+  return !list.empty();
+}
+
+static bool parseTypes(const char* value, std::vector<int>& types) {
+  types.clear();
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    int type = 0;
+    for (; type < BENCH_TYPE_NUM; ++type) {
+      if (item == typeNames[type]) break;
+    }
+    if (type == BENCH_TYPE_NUM) {
+      return false;
+    }
+    types.push_back(type);
+  }
+  return !types.empty();
+}
+
+static bool waitPort(int port, int timeoutMs) {
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  for (int waited = 0; waited < timeoutMs; waited += 50) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+      return false;
+    }
+    int ret = connect(fd, (struct sockaddr*)&address, sizeof(address));
+    close(fd);
+    if (ret == 0) {
+      return true;
+    }
+    usleep(50 * 1000);
+  }
+  return false;
+}
+
+/* 启动模拟网关, 其输出重定向到stderr, 不影响结果输出 */
+static pid_t startGateway() {
+  std::vector<std::string> args;
+  args.push_back(config.gatewayPath);
+  args.push_back("-p");
+  std::ostringstream port;
+  port << config.port;
+  args.push_back(port.str());
+  std::istringstream extra(config.gatewayArgs);
+  std::string arg;
+  while (extra >> arg) {
+    args.push_back(arg);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    std::vector<char*> argv;
+    for (size_t i = 0; i < args.size(); ++i) {
+      argv.push_back(const_cast<char*>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    execv(config.gatewayPath, &argv[0]);
+    perror("execv");
+    _exit(127);
+  }
+
+  if (!waitPort(config.port, 5000)) {
+    fprintf(stderr, "Mock gateway did not listen on port %d.\n", config.port);
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  return pid;
+}
+
+static void stopGateway(pid_t pid) {
+  if (pid > 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [-u url] [-t st,sr,sy,da] [-c 1,8,32] [-n requests]\n"
+          "       [--audio-seconds s] [--speed x] [--threads n]"
+          " [--tts-text text]\n"
+          "       [--timeout s] [--gateway path] [--gateway-args args]"
+          " [--port n]\n"
+          "       [--log file] [--json file] [--compare baseline.json]\n"
+          "       [--tolerance pct] [--min-delta-ms ms]\n",
+          name);
+}
+
+enum {
+  OptionAudioSeconds = 256,
+  OptionSpeed,
+  OptionThreads,
+  OptionTtsText,
+  OptionTimeout,
+  OptionGateway,
+  OptionGatewayArgs,
+  OptionPort,
+  OptionLog,
+  OptionJson,
+  OptionCompare,
+  OptionTolerance,
+  OptionMinDelta
+};
+
+int main(int argc, char* argv[]) {
+  static const struct option options[] = {
+    {"audio-seconds", required_argument, NULL, OptionAudioSeconds},
+    {"speed", required_argument, NULL, OptionSpeed},
+    {"threads", required_argument, NULL, OptionThreads},
+    {"tts-text", required_argument, NULL, OptionTtsText},
+    {"timeout", required_argument, NULL, OptionTimeout},
+    {"gateway", required_argument, NULL, OptionGateway},
+    {"gateway-args", required_argument, NULL, OptionGatewayArgs},
+    {"port", required_argument, NULL, OptionPort},
+    {"log", required_argument, NULL, OptionLog},
+    {"json", required_argument, NULL, OptionJson},
+    {"compare", required_argument, NULL, OptionCompare},
+    {"tolerance", required_argument, NULL, OptionTolerance},
+    {"min-delta-ms", required_argument, NULL, OptionMinDelta},
+    {NULL, 0, NULL, 0}
+  };
+
+  parseTypes("st,sr,sy,da", config.types);
+  parseList("1,8,32", config.sessions);
+  config.requestsPerSession = 4;
+  config.audioSeconds = 2;
+  config.speed = 1;
+  config.threads = -1;
+  config.ttsText = "北京今天天气晴";
+  config.timeoutSeconds = 30;
+  config.gatewayPath = NULL;
+  config.port = 8101;
+  config.logFile = NULL;
+  config.jsonFile = NULL;
+  config.baselineFile = NULL;
+  config.tolerance = 20;
+  config.minDeltaMs = 2;
+
+  int option = 0;
+  while ((option = getopt_long(argc, argv, "u:t:c:n:h", options, NULL)) !=
+         -1) {
+    bool valid = true;
+    switch (option) {
+      case 'u': config.url = optarg; break;
+      case 't': valid = parseTypes(optarg, config.types); break;
+      case 'c': valid = parseList(optarg, config.sessions); break;
+      case 'n': config.requestsPerSession = atoi(optarg); break;
+      case OptionAudioSeconds: config.audioSeconds = atof(optarg); break;
+      case OptionSpeed: config.speed = atof(optarg); break;
+      case OptionThreads: config.threads = atoi(optarg); break;
+      case OptionTtsText: config.ttsText = optarg; break;
+      case OptionTimeout: config.timeoutSeconds = atoi(optarg); break;
+      case OptionGateway: config.gatewayPath = optarg; break;
+      case OptionGatewayArgs: config.gatewayArgs = optarg; break;
+      case OptionPort: config.port = atoi(optarg); break;
+      case OptionLog: config.logFile = optarg; break;
+      case OptionJson: config.jsonFile = optarg; break;
+      case OptionCompare: config.baselineFile = optarg; break;
+      case OptionTolerance: config.tolerance = atof(optarg); break;
+      case OptionMinDelta: config.minDeltaMs = atof(optarg); break;
+      default: valid = false; break;
+    }
+    if (!valid) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (config.requestsPerSession <= 0 || config.audioSeconds <= 0 ||
+      config.speed < 0 || config.timeoutSeconds <= 0 ||
+      config.port <= 0 || config.port > 65535 || config.tolerance < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (config.url.empty()) {
+    std::ostringstream url;
+    url << "ws://127.0.0.1:" << config.port << "/ws/v1";
+    config.url = url.str();
+  }
+
+  /* 100ms 440Hz正弦波, 所有会话共用 */
+  audioFrame.resize(BENCH_FRAME_BYTES);
+  int16_t* samples = (int16_t*)&audioFrame[0];
+  for (int i = 0; i < BENCH_FRAME_BYTES / 2; ++i) {
+    samples[i] = (int16_t)(8000 * sin(2 * M_PI * 440 * i / BENCH_SAMPLE_RATE));
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  pid_t gateway = -1;
+  if (config.gatewayPath) {
+    gateway = startGateway();
+    if (gateway < 0) {
+      return 1;
+    }
+  }
+
+  NlsClient* client = NlsClient::getInstance();
+  if (config.logFile) {
+    client->setLogConfig(config.logFile, LogInfo);
+  }
+  client->startWorkThread(config.threads);
+
+  Json::Value report(Json::objectValue);
+  report["url"] = config.url;
+  report["requests_per_session"] = config.requestsPerSession;
+  report["audio_seconds"] = config.audioSeconds;
+  report["speed"] = config.speed;
+  report["threads"] = config.threads;
+  report["cpus"] = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  report["steps"] = Json::Value(Json::arrayValue);
+
+  printf("url %s, %d request(s) per session, audio %.1fs, speed %s\n",
+         config.url.c_str(), config.requestsPerSession, config.audioSeconds,
+         config.speed > 0 ? "paced" : "unpaced");
+  printHeader();
+  for (size_t t = 0; t < config.types.size(); ++t) {
+    for (size_t s = 0; s < config.sessions.size(); ++s) {
+      Json::Value step = runStep(config.types[t], config.sessions[s]);
+      printStep(step);
+      report["steps"].append(step);
+    }
+  }
+
+  NlsClient::releaseInstance();
+  stopGateway(gateway);
+
+  if (config.jsonFile) {
+    Json::StyledWriter writer;
+    std::string text = writer.write(report);
+    if (strcmp(config.jsonFile, "-") == 0) {
+      fputs(text.c_str(), stdout);
+    } else {
+      FILE* file = fopen(config.jsonFile, "w");
+      if (file == NULL) {
+        fprintf(stderr, "Cannot write %s.\n", config.jsonFile);
+        return 1;
+      }
+      fputs(text.c_str(), file);
+      fclose(file);
+    }
+  }
+
+  if (config.baselineFile) {
+    int regressions = compareBaseline(report, config.baselineFile);
+    if (regressions < 0) {
+      return 1;
+    }
+    return regressions > 0 ? 2 : 0;
+  }
+  return 0;
+}
@@ -0,0 +1,678 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 热点函数微基准, 作为性能优化的对比基线:
+ *   framePackage/...      WebSocket帧封装(含掩码), 帧内存随后释放
+ *   receiveFrame/...      receiveFullWebSocketFrame解析网关下行帧
+ *   parseJsonMsg/...      NlsEvent解析网关应答, 含构造NlsEvent的拷贝
+ *   nlsEncoding/...       16k PCM编码一帧(20ms), OPU及OGG-OPUS
+ *   DataBase/...          DataBase<uint8_t>写入并读出一块
+ *   utf8ToGbk/...         结果文本转码
+ *   getStartCommand/...   生成各请求的开始指令
+ *
+ * 每项先以少量迭代预热, 再按上一轮耗时放大迭代次数,
+ * 直到单轮耗时超过--min-time, 输出最后一轮的ns/op及allocs/op、alloc_bytes/op.
+ * 分配次数通过替换malloc/calloc/realloc统计(仅glibc), new经由malloc同样计入.
+ *
+ * 用法: nlsMicroBench [选项]
+ *   --filter <子串>       只运行名称包含子串的项
+ *   --min-time <秒>       单项最短计时, 默认0.5
+ *   --responses <文件>    每行一条录制的网关应答JSON, 替换内置样本,
+ *                         名称为应答的header.name
+ *   --json <文件>         输出JSON格式结果, "-"为标准输出
+ *   --list                只列出名称
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "json/json.h"
+#include "nlsGlobal.h"
+#include "nlsEvent.h"
+#include "nlsEncoder.h"
+#include "thread_data.h"
+#include "webSocketTcp.h"
+#include "connectNode.h"
+#include "speechTranscriberParam.h"
+#include "speechRecognizerParam.h"
+#include "speechSynthesizerParam.h"
+#include "dialogAssistantParam.h"
+
+using namespace AlibabaNls;
+
+/* 分配统计 */
+static volatile long allocCount = 0;
+static volatile long allocBytes = 0;
+
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCS 1
+
+extern "C" {
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+  __sync_fetch_and_add(&allocCount, 1);
+  __sync_fetch_and_add(&allocBytes, (long)size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  __sync_fetch_and_add(&allocCount, 1);
+  __sync_fetch_and_add(&allocBytes, (long)(count * size));
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  if (size > 0) {
+    __sync_fetch_and_add(&allocCount, 1);
+    __sync_fetch_and_add(&allocBytes, (long)size);
+  }
+  return __libc_realloc(ptr, size);
+}
+}  // extern "C"
+#else
+#define BENCH_COUNT_ALLOCS 0
+#endif
+
+static uint64_t getMonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 防止被测结果被优化掉 */
+static volatile uintptr_t benchSink = 0;
+template <typename T>
+static inline void doNotOptimize(const T& value) {
+  benchSink += (uintptr_t)value;
+}
+
+/*
+ * 单轮计时状态, 被测函数形如:
+ *   准备数据...
+ *   while (state.keepRunning()) { 被测代码 }
+ * keepRunning第一次调用时开始计时, 准备代码不计入.
+ */
+class BenchState {
+ public:
+  explicit BenchState(uint64_t iterations)
+      : _iterations(iterations), _remaining(iterations), _started(false),
+        _beginNs(0), _endNs(0), _allocs(0), _allocBytes(0), _failed(false) {}
+
+  inline bool keepRunning() {
+    if (!_started) {
+      _started = true;
+      _allocs = allocCount;
+      _allocBytes = allocBytes;
+      _beginNs = getMonotonicNs();
+    }
+    if (_remaining > 0) {
+      _remaining--;
+      return true;
+    }
+    _endNs = getMonotonicNs();
+    _allocs = allocCount - _allocs;
+    _allocBytes = allocBytes - _allocBytes;
+    return false;
+  }
+
+  void fail(const char* reason) {
+    fprintf(stderr, "  %s\n", reason);
+    _failed = true;
+  }
+
+  uint64_t _iterations;
+  uint64_t _remaining;
+  bool _started;
+  uint64_t _beginNs;
+  uint64_t _endNs;
+  long _allocs;
+  long _allocBytes;
+  bool _failed;
+};
+
+typedef void (*BenchFunction)(BenchState& state, const void* arg);
+
+struct BenchEntry {
+  std::string name;
+  BenchFunction function;
+  const void* arg;
+};
+
+static std::vector<BenchEntry> benchmarks;
+
+static void registerBench(const std::string& name, BenchFunction function,
+                          const void* arg) {
+  BenchEntry entry;
+  entry.name = name;
+  entry.function = function;
+  entry.arg = arg;
+  benchmarks.push_back(entry);
+}
+
+/* 16bit单声道正弦波 */
+static void generatePcm(std::vector<uint8_t>& pcm, size_t bytes) {
+  pcm.resize(bytes);
+  int16_t* samples = (int16_t*)&pcm[0];
+  for (size_t i = 0; i < bytes / 2; ++i) {
+    samples[i] = (int16_t)(8000 * sin(2 * 3.14159265358979 * 440 * i / 16000));
+  }
+}
+
+/*----------------------------- WebSocket -----------------------------*/
+
+struct FrameArg {
+  WebSocketHeaderType::OpCodeType type;
+  size_t length;
+};
+
+static const FrameArg frameText = {WebSocketHeaderType::TEXT_FRAME, 400};
+static const FrameArg frameOpus = {WebSocketHeaderType::BINARY_FRAME, 120};
+static const FrameArg framePcm = {WebSocketHeaderType::BINARY_FRAME, 3200};
+static const FrameArg frameLarge = {WebSocketHeaderType::BINARY_FRAME, 70000};
+
+static void benchFramePackage(BenchState& state, const void* arg) {
+  const FrameArg* frameArg = (const FrameArg*)arg;
+  std::vector<uint8_t> payload;
+  generatePcm(payload, frameArg->length);
+  WebSocketTcp webSocket;
+
+  while (state.keepRunning()) {
+    uint8_t* frame = NULL;
+    size_t frameSize = 0;
+    webSocket.framePackage(frameArg->type, &payload[0], payload.size(),
+                           &frame, &frameSize);
+    doNotOptimize(frame[frameSize - 1]);
+    free(frame);
+  }
+}
+
+/* 构造网关下行帧: 不带掩码 */
+static void buildServerFrame(WebSocketHeaderType::OpCodeType type,
+                             const uint8_t* payload, size_t length,
+                             std::vector<uint8_t>& frame) {
+  frame.clear();
+  frame.push_back((uint8_t)(0x80 | type));
+  if (length < 126) {
+    frame.push_back((uint8_t)length);
+  } else if (length < 65536) {
+    frame.push_back(126);
+    frame.push_back((uint8_t)(length >> 8));
+    frame.push_back((uint8_t)length);
+  } else {
+    frame.push_back(127);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      frame.push_back((uint8_t)((uint64_t)length >> shift));
+    }
+  }
+  frame.insert(frame.end(), payload, payload + length);
+}
+
+static void benchReceiveFrame(BenchState& state, const void* arg) {
+  const FrameArg* frameArg = (const FrameArg*)arg;
+  std::vector<uint8_t> payload;
+  generatePcm(payload, frameArg->length);
+  std::vector<uint8_t> frame;
+  buildServerFrame(frameArg->type, &payload[0], payload.size(), frame);
+  WebSocketTcp webSocket;
+  WebSocketHeaderType wsType;
+
+  while (state.keepRunning()) {
+    WebSocketFrame received;
+    memset(&received, 0, sizeof(received));
+    if (webSocket.receiveFullWebSocketFrame(&frame[0], frame.size(), &wsType,
+                                            &received) != 0) {
+      state.fail("receiveFullWebSocketFrame failed");
+      return;
+    }
+    doNotOptimize(received.length);
+  }
+}
+
+/*----------------------------- JSON -----------------------------*/
+
+/* 网关应答样本, 取自实时转写、一句话识别、合成及对话的实际应答 */
+static const char* builtinResponses[] = {
+  "{\"header\":{\"namespace\":\"SpeechTranscriber\",\"name\":"
+  "\"TranscriptionStarted\",\"status\":20000000,\"message_id\":"
+  "\"a4bd9ad1d1c7477a9ba2d17b8a7f1f59\",\"task_id\":"
+  "\"5ec521b5aa104e3abccf3d361822c6d1\",\"status_text\":\"Gateway:SUCCESS:"
+  "Success.\"},\"payload\":{\"session_id\":\"1231231dfdf\"}}",
+
+  "{\"header\":{\"namespace\":\"SpeechTranscriber\",\"name\":"
+  "\"TranscriptionResultChanged\",\"status\":20000000,\"message_id\":"
+  "\"dc21193fada84380a3b6137875ab9178\",\"task_id\":"
+  "\"5ec521b5aa104e3abccf3d361822c6d1\",\"status_text\":\"Gateway:SUCCESS:"
+  "Success.\"},\"payload\":{\"index\":1,\"time\":1835,\"result\":"
+  "\"北京的天气\",\"confidence\":0.0,\"words\":[],\"status\":0,"
+  "\"fixed_result\":\"\",\"unfixed_result\":\"\"}}",
+
+  "{\"header\":{\"namespace\":\"SpeechTranscriber\",\"name\":\"SentenceEnd\","
+  "\"status\":20000000,\"message_id\":\"c3a9ae4b231649d5ae05d4af36fd1c8a\","
+  "\"task_id\":\"5ec521b5aa104e3abccf3d361822c6d1\",\"status_text\":"
+  "\"Gateway:SUCCESS:Success.\"},\"payload\":{\"index\":1,\"time\":1820,"
+  "\"begin_time\":0,\"result\":\"北京的天气。\",\"confidence\":0.7,"
+  "\"words\":[{\"text\":\"北京\",\"startTime\":120,\"endTime\":660,"
+  "\"punc\":\"\"},{\"text\":\"的\",\"startTime\":660,\"endTime\":840,"
+  "\"punc\":\"\"},{\"text\":\"天气\",\"startTime\":840,\"endTime\":1530,"
+  "\"punc\":\"。\"}],\"status\":0,\"gender\":\"\",\"emo_tag\":\"\","
+  "\"emo_confidence\":0.0,\"stash_result\":{\"sentenceId\":2,"
+  "\"beginTime\":1820,\"text\":\"\",\"currentTime\":1820}}}",
+
+  "{\"header\":{\"namespace\":\"SpeechRecognizer\",\"name\":"
+  "\"RecognitionCompleted\",\"status\":20000000,\"message_id\":"
+  "\"10490c992aef44eaa4246614838f****\",\"task_id\":"
+  "\"0ee97ab4e8d54ba5b2c8bc3e8a3d6e46\",\"status_text\":\"Gateway:SUCCESS:"
+  "Success.\"},\"payload\":{\"result\":\"北京的天气。\",\"duration\":2000}}",
+
+  "{\"header\":{\"namespace\":\"SpeechSynthesizer\",\"name\":"
+  "\"SynthesisCompleted\",\"status\":20000000,\"message_id\":"
+  "\"4b2c4c4f9f6c4a14a1c9e1c0a5d4c5b8\",\"task_id\":"
+  "\"64a8a1b3d7f44cc9bc1f6e7c2a1d3e4f\",\"status_text\":\"Gateway:SUCCESS:"
+  "Success.\"}}",
+
+  "{\"header\":{\"namespace\":\"DialogAssistant\",\"name\":"
+  "\"DialogResultGenerated\",\"status\":20000000,\"message_id\":"
+  "\"9d52b7e1b2a44b9f8a7c2e6f3b1d0c4a\",\"task_id\":"
+  "\"3c5e7a9b1d2f4e6a8b0c2d4e6f8a0b2c\",\"status_text\":\"Gateway:SUCCESS:"
+  "Success.\"},\"payload\":{\"session_id\":\"d3a5b7c9e1f3\",\"action\":"
+  "\"Speak\",\"action_params\":{\"text\":\"北京今天晴，最高气温二十五度。\"},"
+  "\"dialog_result\":{\"domain\":\"weather\",\"intent\":\"query_weather\","
+  "\"slots\":[{\"name\":\"city\",\"value\":\"北京\"},{\"name\":\"date\","
+  "\"value\":\"今天\"}]}}}",
+
+  "{\"header\":{\"namespace\":\"Default\",\"name\":\"TaskFailed\",\"status\":"
+  "40000001,\"message_id\":\"aabbccddeeff00112233445566778899\",\"task_id\":"
+  "\"5ec521b5aa104e3abccf3d361822c6d1\",\"status_text\":\"Gateway:"
+  "ACCESS_DENIED:The token 'xxx' is invalid!\"}}"
+};
+
+static std::vector<std::string> responses;
+static std::vector<std::string> responseNames;
+
+static void loadBuiltinResponses() {
+  for (size_t i = 0;
+       i < sizeof(builtinResponses) / sizeof(builtinResponses[0]); ++i) {
+    responses.push_back(builtinResponses[i]);
+  }
+}
+
+static int loadResponses(const char* path) {
+  std::ifstream input(path);
+  if (!input) {
+    return -1;
+  }
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line[0] == '{') {
+      responses.push_back(line);
+    }
+  }
+  return responses.empty() ? -1 : 0;
+}
+
+/* 以header.name命名, 同名应答加序号区分 */
+static void nameResponses() {
+  Json::Reader reader;
+  for (size_t i = 0; i < responses.size(); ++i) {
+    Json::Value root;
+    std::string name = "unknown";
+    if (reader.parse(responses[i], root) && root.isObject() &&
+        root["header"]["name"].isString()) {
+      name = root["header"]["name"].asString();
+    }
+    int count = 0;
+    for (size_t j = 0; j < responseNames.size(); ++j) {
+      if (responseNames[j] == name ||
+          responseNames[j].compare(0, name.size() + 1, name + "#") == 0) {
+        count++;
+      }
+    }
+    if (count > 0) {
+      char suffix[16];
+      snprintf(suffix, sizeof(suffix), "#%d", count + 1);
+      name += suffix;
+    }
+    responseNames.push_back(name);
+  }
+}
+
+static void benchParseJsonMsg(BenchState& state, const void* arg) {
+  std::string msg = *(const std::string*)arg;
+  while (state.keepRunning()) {
+    NlsEvent event(msg);
+    if (event.parseJsonMsg() != 0 && event.getStatusCode() == 0) {
+      state.fail("parseJsonMsg failed");
+      return;
+    }
+    doNotOptimize(event.getMsgType());
+  }
+}
+
+/*----------------------------- 编码 -----------------------------*/
+
+static const ENCODER_TYPE encoderOpu = ENCODER_OPU;
+static const ENCODER_TYPE encoderOggOpus = ENCODER_OPUS;
+
+static void benchEncoding(BenchState& state, const void* arg) {
+  ENCODER_TYPE type = *(const ENCODER_TYPE*)arg;
+  NlsEncoder encoder;
+  int errorCode = 0;
+  if (encoder.createNlsEncoder(type, 1, 16000, &errorCode) < 0) {
+    state.fail("createNlsEncoder failed");
+    return;
+  }
+  int frameBytes = encoder.getFrameBytes();
+  std::vector<uint8_t> pcm;
+  generatePcm(pcm, frameBytes);
+  std::vector<unsigned char> output(frameBytes + 4096);
+
+  while (state.keepRunning()) {
+    int encoded = encoder.nlsEncoding(&pcm[0], frameBytes, &output[0],
+                                      (int)output.size());
+    doNotOptimize(encoded);
+  }
+  encoder.destroyNlsEncoder();
+}
+
+/*----------------------------- 缓冲 -----------------------------*/
+
+static const size_t dataBlock = 320;
+static const size_t dataBlockOgg = 160;
+
+static void benchDataBase(BenchState& state, const void* arg) {
+  size_t block = *(const size_t*)arg;
+  DataBase<uint8_t> data;
+  std::vector<uint8_t> input(block, 0x5a);
+  std::vector<uint8_t> output(block);
+  int arrayIndex = 0;
+  int elementIndex = 0;
+
+  while (state.keepRunning()) {
+    data.Pushback(&input[0], (int)block);
+    int got = data.Get(&output[0], (int)block, &arrayIndex, &elementIndex,
+                       true);
+    doNotOptimize(got);
+  }
+}
+
+/*----------------------------- 转码 -----------------------------*/
+
+static const std::string textShort = "北京的天气。";
+static const std::string textLong =
+    "阿里云智能语音交互提供语音识别、语音合成等能力，"
+    "可用于会议记录、客服质检、智能硬件等多种场景，"
+    "实时转写服务支持长时间音频流的识别并返回每句话的起止时间。";
+
+static void benchUtf8ToGbk(BenchState& state, const void* arg) {
+  const std::string& text = *(const std::string*)arg;
+  while (state.keepRunning()) {
+    std::string converted = ConnectNode::utf8ToGbk(text);
+    doNotOptimize(converted.size());
+  }
+}
+
+/*----------------------------- 指令 -----------------------------*/
+
+static void setupParam(INlsRequestParam* param) {
+  param->setAppKey("default");
+  param->setFormat("pcm");
+  param->setSampleRate(16000);
+}
+
+static void benchStartCommand(BenchState& state, const void* arg) {
+  NlsType type = *(const NlsType*)arg;
+  INlsRequestParam* param = NULL;
+  switch (type) {
+    case TypeRealTime:
+      param = new SpeechTranscriberParam();
+      break;
+    case TypeAsr:
+      param = new SpeechRecognizerParam();
+      break;
+    case TypeTts: {
+      SpeechSynthesizerParam* synthesizer = new SpeechSynthesizerParam(0);
+      synthesizer->setText(textLong.c_str());
+      param = synthesizer;
+      break;
+    }
+    default:
+      param = new DialogAssistantParam(0);
+      break;
+  }
+  setupParam(param);
+
+  while (state.keepRunning()) {
+    const char* command = param->getStartCommand();
+    doNotOptimize(command[0]);
+  }
+  delete param;
+}
+
+static const NlsType typeTranscriber = TypeRealTime;
+static const NlsType typeRecognizer = TypeAsr;
+static const NlsType typeSynthesizer = TypeTts;
+static const NlsType typeDialog = TypeDialog;
+
+/*----------------------------- 运行 -----------------------------*/
+
+struct BenchResult {
+  std::string name;
+  uint64_t iterations;
+  double nsPerOp;
+  double allocsPerOp;
+  double allocBytesPerOp;
+};
+
+static bool runBench(const BenchEntry& entry, double minSeconds,
+                     BenchResult* result) {
+  uint64_t minNs = (uint64_t)(minSeconds * 1e9);
+  uint64_t iterations = 1;
+
+  /* 预热 */
+  {
+    BenchState state(16);
+    entry.function(state, entry.arg);
+    if (state._failed) {
+      return false;
+    }
+  }
+
+  for (;;) {
+    BenchState state(iterations);
+    entry.function(state, entry.arg);
+    if (state._failed || !state._started || state._remaining != 0) {
+      return false;
+    }
+    uint64_t elapsed = state._endNs - state._beginNs;
+    if (elapsed >= minNs || iterations >= (1ULL << 40)) {
+      result->name = entry.name;
+      result->iterations = iterations;
+      result->nsPerOp = (double)elapsed / iterations;
+      result->allocsPerOp = (double)state._allocs / iterations;
+      result->allocBytesPerOp = (double)state._allocBytes / iterations;
+      return true;
+    }
+    /* 按已用时间估算, 每轮最多放大10倍 */
+    uint64_t next = elapsed > 0 ?
+        (uint64_t)(iterations * 1.4 * minNs / elapsed) : iterations * 10;
+    if (next > iterations * 10) next = iterations * 10;
+    if (next <= iterations) next = iterations + 1;
+    iterations = next;
+  }
+}
+
+static void registerAll() {
+  registerBench("framePackage/text_400", benchFramePackage, &frameText);
+  registerBench("framePackage/opus_120", benchFramePackage, &frameOpus);
+  registerBench("framePackage/pcm_3200", benchFramePackage, &framePcm);
+  registerBench("framePackage/binary_70000", benchFramePackage, &frameLarge);
+
+  registerBench("receiveFrame/text_400", benchReceiveFrame, &frameText);
+  registerBench("receiveFrame/pcm_3200", benchReceiveFrame, &framePcm);
+  registerBench("receiveFrame/binary_70000", benchReceiveFrame, &frameLarge);
+
+  for (size_t i = 0; i < responses.size(); ++i) {
+    registerBench("parseJsonMsg/" + responseNames[i], benchParseJsonMsg,
+                  &responses[i]);
+  }
+
+  registerBench("nlsEncoding/opu", benchEncoding, &encoderOpu);
+  registerBench("nlsEncoding/ogg_opus", benchEncoding, &encoderOggOpus);
+
+  registerBench("DataBase/push_get_320", benchDataBase, &dataBlock);
+  registerBench("DataBase/push_get_160", benchDataBase, &dataBlockOgg);
+
+  registerBench("utf8ToGbk/short", benchUtf8ToGbk, &textShort);
+  registerBench("utf8ToGbk/long", benchUtf8ToGbk, &textLong);
+
+  registerBench("getStartCommand/st", benchStartCommand, &typeTranscriber);
+  registerBench("getStartCommand/sr", benchStartCommand, &typeRecognizer);
+  registerBench("getStartCommand/sy", benchStartCommand, &typeSynthesizer);
+  registerBench("getStartCommand/da", benchStartCommand, &typeDialog);
+}
+
+static void usage(const char* name) {
+  fprintf(stderr,
+          "usage: %s [--filter substr] [--min-time seconds]"
+          " [--responses file]\n"
+          "       [--json file] [--list]\n",
+          name);
+}
+
+enum {
+  OptionFilter = 256,
+  OptionMinTime,
+  OptionResponses,
+  OptionJson,
+  OptionList
+};
+
+int main(int argc, char* argv[]) {
+  static const struct option options[] = {
+    {"filter", required_argument, NULL, OptionFilter},
+    {"min-time", required_argument, NULL, OptionMinTime},
+    {"responses", required_argument, NULL, OptionResponses},
+    {"json", required_argument, NULL, OptionJson},
+    {"list", no_argument, NULL, OptionList},
+    {NULL, 0, NULL, 0}
+  };
+
+  const char* filter = NULL;
+  double minSeconds = 0.5;
+  const char* responseFile = NULL;
+  const char* jsonFile = NULL;
+  bool listOnly = false;
+
+  int option = 0;
+  while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+    switch (option) {
+      case OptionFilter: filter = optarg; break;
+      case OptionMinTime: minSeconds = atof(optarg); break;
+      case OptionResponses: responseFile = optarg; break;
+      case OptionJson: jsonFile = optarg; break;
+      case OptionList: listOnly = true; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (minSeconds <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (responseFile) {
+    if (loadResponses(responseFile) < 0) {
+      fprintf(stderr, "Cannot read responses from %s.\n", responseFile);
+      return 1;
+    }
+  } else {
+    loadBuiltinResponses();
+  }
+  nameResponses();
+  registerAll();
+
+  if (listOnly) {
+    for (size_t i = 0; i < benchmarks.size(); ++i) {
+      printf("%s\n", benchmarks[i].name.c_str());
+    }
+    return 0;
+  }
+
+  Json::Value report(Json::objectValue);
+  report["min_time_s"] = minSeconds;
+  report["allocs_counted"] = BENCH_COUNT_ALLOCS ? true : false;
+  report["benchmarks"] = Json::Value(Json::arrayValue);
+
+  printf("%-40s %14s %12s %10s %12s\n", "benchmark", "iterations", "ns/op",
+         "allocs/op", "bytes/op");
+  int failures = 0;
+  for (size_t i = 0; i < benchmarks.size(); ++i) {
+    if (filter && benchmarks[i].name.find(filter) == std::string::npos) {
+      continue;
+    }
+    BenchResult result;
+    if (!runBench(benchmarks[i], minSeconds, &result)) {
+      printf("%-40s %14s\n", benchmarks[i].name.c_str(), "FAILED");
+      failures++;
+      continue;
+    }
+    if (BENCH_COUNT_ALLOCS) {
+      printf("%-40s %14llu %12.1f %10.2f %12.1f\n", result.name.c_str(),
+             (unsigned long long)result.iterations, result.nsPerOp,
+             result.allocsPerOp, result.allocBytesPerOp);
+    } else {
+      printf("%-40s %14llu %12.1f %10s %12s\n", result.name.c_str(),
+             (unsigned long long)result.iterations, result.nsPerOp, "-", "-");
+    }
+    fflush(stdout);
+
+    Json::Value item(Json::objectValue);
+    item["name"] = result.name;
+    item["iterations"] = (double)result.iterations;
+    item["ns_per_op"] = result.nsPerOp;
+    item["allocs_per_op"] = result.allocsPerOp;
+    item["alloc_bytes_per_op"] = result.allocBytesPerOp;
+    report["benchmarks"].append(item);
+  }
+
+  if (jsonFile) {
+    Json::StyledWriter writer;
+    std::string text = writer.write(report);
+    if (strcmp(jsonFile, "-") == 0) {
+      fputs(text.c_str(), stdout);
+    } else {
+      FILE* file = fopen(jsonFile, "w");
+      if (file == NULL) {
+        fprintf(stderr, "Cannot write %s.\n", jsonFile);
+        return 1;
+      }
+      fputs(text.c_str(), file);
+      fclose(file);
+    }
+  }
+  return failures > 0 ? 1 : 0;
+}
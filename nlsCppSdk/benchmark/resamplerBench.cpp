@@ -0,0 +1,177 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 音频前处理性能测试: 对常见输入格式做混音及重采样, 输出单核每秒处理的
+ * 输入采样帧数与实时倍率, 并以1kHz及高于目标奈奎斯特频率的单音
+ * 检查通带增益与混叠抑制.
+ *
+ * 用法: resamplerBench [秒数] [每次输入毫秒数]
+ *   默认60秒音频, 每次输入10ms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include "nlsGlobal.h"
+#include "nlsAudioConverter.h"
+
+using namespace AlibabaNls;
+
+static const double kPi = 3.14159265358979323846;
+
+static void writeSample(uint8_t* p, AUDIO_SAMPLE_FORMAT format, double v) {
+  if (format == SAMPLE_FORMAT_F32) {
+    float f = (float)v;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(bits >> (8 * i));
+  } else if (format == SAMPLE_FORMAT_S32) {
+    int32_t s = (int32_t)(v * 2147483647.0);
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)((uint32_t)s >> (8 * i));
+  } else {
+    int16_t s = (int16_t)(v * 32767.0);
+    p[0] = (uint8_t)(s & 0xff);
+    p[1] = (uint8_t)((s >> 8) & 0xff);
+  }
+}
+
+/* 各声道为同频单音, 幅度0.5 */
+static void generateTone(std::vector<uint8_t>& pcm,
+                         const NlsAudioInputFormat& format,
+                         double frequency, double seconds) {
+  size_t bytes = format.sampleFormat == SAMPLE_FORMAT_S16 ? 2 : 4;
+  size_t frames = (size_t)(format.sampleRate * seconds);
+  pcm.resize(frames * bytes * format.channels);
+  for (size_t i = 0; i < frames; i++) {
+    double v = 0.5 * sin(2 * kPi * frequency * i / format.sampleRate);
+    for (int c = 0; c < format.channels; c++) {
+      writeSample(&pcm[(i * format.channels + c) * bytes],
+                  format.sampleFormat, v);
+    }
+  }
+}
+
+static int convert(const NlsAudioInputFormat& format, int outputRate,
+                   const std::vector<uint8_t>& pcm, size_t chunkBytes,
+                   std::vector<uint8_t>& output) {
+  NlsAudioConverter converter;
+  if (converter.init(format, outputRate) < 0) {
+    return -1;
+  }
+  output.clear();
+  output.reserve(pcm.size());
+  for (size_t off = 0; off < pcm.size(); off += chunkBytes) {
+    size_t n = pcm.size() - off < chunkBytes ? pcm.size() - off : chunkBytes;
+    converter.process(&pcm[off], n, output);
+  }
+  return 0;
+}
+
+/* 跳过开头的滤波器暖机段, 计算输出相对于0.5满幅的增益(dB) */
+static double outputGainDb(const std::vector<uint8_t>& output) {
+  size_t samples = output.size() / 2;
+  size_t skip = samples / 10;
+  double sum = 0;
+  size_t count = 0;
+  for (size_t i = skip; i < samples; i++) {
+    int16_t s = (int16_t)(output[2 * i] | (output[2 * i + 1] << 8));
+    sum += (double)s * s;
+    count++;
+  }
+  double rms = count > 0 ? sqrt(sum / count) : 0;
+  double reference = 0.5 * 32767.0 / sqrt(2.0);
+  return 20 * log10((rms + 1e-9) / reference);
+}
+
+int main(int argc, char* argv[]) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 60;
+  int chunkMs = argc > 2 ? atoi(argv[2]) : 10;
+  if (seconds <= 0 || chunkMs <= 0) {
+    fprintf(stderr, "usage: %s [seconds] [chunk ms]\n", argv[0]);
+    return -1;
+  }
+
+  struct {
+    AUDIO_SAMPLE_FORMAT format;
+    int sampleRate;
+    int channels;
+    int outputRate;
+    const char* name;
+  } cases[] = {
+    {SAMPLE_FORMAT_F32, 48000, 2, 16000, "f32 48k stereo"},
+    {SAMPLE_FORMAT_S16, 44100, 2, 16000, "s16 44.1k stereo"},
+    {SAMPLE_FORMAT_S16, 48000, 1, 16000, "s16 48k mono"},
+    {SAMPLE_FORMAT_S32, 32000, 1, 16000, "s32 32k mono"},
+    {SAMPLE_FORMAT_S16, 44100, 1, 8000, "s16 44.1k mono"},
+    {SAMPLE_FORMAT_F32, 16000, 6, 16000, "f32 16k 5.1"},
+    {SAMPLE_FORMAT_S16, 8000, 1, 16000, "s16 8k mono"},
+  };
+
+  printf("audio: %ds, chunk: %dms\n", seconds, chunkMs);
+  printf("%-18s %6s %16s %10s %10s %12s\n", "input", "output",
+         "Msamples/s/core", "realtime", "1kHz(dB)", "alias(dB)");
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    NlsAudioInputFormat format;
+    format.sampleFormat = cases[i].format;
+    format.sampleRate = cases[i].sampleRate;
+    format.channels = cases[i].channels;
+    int outputRate = cases[i].outputRate;
+    size_t frameBytes = (format.sampleFormat == SAMPLE_FORMAT_S16 ? 2 : 4) *
+                        format.channels;
+    size_t chunkBytes = (size_t)format.sampleRate * chunkMs / 1000 * frameBytes;
+
+    std::vector<uint8_t> pcm;
+    std::vector<uint8_t> output;
+    generateTone(pcm, format, 1000, seconds);
+
+    clock_t begin = clock();
+    if (convert(format, outputRate, pcm, chunkBytes, output) < 0) {
+      printf("%-18s init failed\n", cases[i].name);
+      continue;
+    }
+    clock_t end = clock();
+    double cpuSeconds = (double)(end - begin) / CLOCKS_PER_SEC;
+    double inputFrames = (double)pcm.size() / frameBytes;
+    double passband = outputGainDb(output);
+
+    /* 高于目标奈奎斯特频率的单音, 输出能量越低混叠抑制越好 */
+    double alias = 0;
+    double aliasFrequency = outputRate * 0.5 * 1.25;
+    if (aliasFrequency < format.sampleRate * 0.5) {
+      std::vector<uint8_t> tone;
+      generateTone(tone, format, aliasFrequency, 2);
+      convert(format, outputRate, tone, chunkBytes, output);
+      alias = outputGainDb(output);
+    }
+
+    printf("%-18s %6d %16.2f %9.0fx %10.2f ",
+           cases[i].name, outputRate,
+           inputFrames / cpuSeconds / 1e6,
+           seconds / cpuSeconds, passband);
+    if (aliasFrequency < format.sampleRate * 0.5) {
+      printf("%12.1f\n", alias);
+    } else {
+      printf("%12s\n", "-");
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,373 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 数据队列性能测试: 对比原分块链表DataBase(每次Pushback分配拷贝,
+ * 每次消费性Get做vector::erase, 全程加锁)与基于ByteRing的DataBase,
+ * 以及直接使用ByteRing连续区间的吞吐.
+ * 写入为60~300字节的随机长度块(近似ogg页), 读出为固定320字节.
+ *   single  : 单线程交替写入读出, 队列积压depth块
+ *   spsc    : 生产者与消费者各一个线程
+ *
+ * 用法: ringBufferBench [总MB数] [积压块数]
+ *   默认32MB, 积压64块. 原实现在双线程下消费跟不上时erase开销随积压增长,
+ *   数据量过大时耗时很长.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+#include <utility>
+#include "thread_data.h"
+
+using namespace AlibabaNls;
+
+/* 原实现, 仅保留测试用到的接口 */
+template <typename T>
+class LegacyDataBase {
+ public:
+  LegacyDataBase() {
+    pthread_mutex_init(&data_mutex_, NULL);
+  }
+  ~LegacyDataBase() {
+    for (size_t i = 0; i < data_.size(); ++i) {
+      delete [](data_[i].first);
+    }
+    pthread_mutex_destroy(&data_mutex_);
+  }
+  int Pushback(const T *data, int element_num) {
+    T *data_for_insert = new T[element_num];
+    memcpy(data_for_insert, data, sizeof(T) * element_num);
+    pthread_mutex_lock(&data_mutex_);
+    data_.push_back(std::make_pair(data_for_insert, element_num));
+    pthread_mutex_unlock(&data_mutex_);
+    return 0;
+  }
+  int Get(T *data, int element_num, int *start_array_idx,
+          int *start_element_idx, bool is_delete_after_get = false) {
+    int num_shift = 0;
+    pthread_mutex_lock(&data_mutex_);
+    for (; (*start_array_idx < (int)data_.size()) &&
+           (num_shift < element_num);) {
+      if (*start_element_idx + element_num - num_shift >=
+          data_[*start_array_idx].second) {
+        int cur_copy_num = data_[*start_array_idx].second - *start_element_idx;
+        memcpy(data + num_shift,
+               data_[*start_array_idx].first + *start_element_idx,
+               sizeof(T) * cur_copy_num);
+        num_shift += cur_copy_num;
+        *start_element_idx = 0;
+        if (is_delete_after_get) {
+          delete [](data_[*start_array_idx].first);
+          data_.erase(data_.begin() + *start_array_idx);
+        } else {
+          (*start_array_idx)++;
+        }
+        continue;
+      } else {
+        int cur_copy_num = element_num - num_shift;
+        memcpy(data + num_shift,
+               data_[*start_array_idx].first + *start_element_idx,
+               sizeof(T) * cur_copy_num);
+        num_shift += cur_copy_num;
+        *start_element_idx += cur_copy_num;
+        break;
+      }
+    }
+    pthread_mutex_unlock(&data_mutex_);
+    return num_shift;
+  }
+
+ private:
+  std::vector< std::pair<T *, int> > data_;
+  pthread_mutex_t data_mutex_;
+};
+
+static const int kReadSize = 320;
+static const int kMinChunk = 60;
+static const int kMaxChunk = 300;
+
+static double nowSeconds() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void makeChunkSizes(std::vector<int>& sizes, size_t totalBytes) {
+  size_t sum = 0;
+  srand(1);
+  while (sum < totalBytes) {
+    int n = kMinChunk + rand() % (kMaxChunk - kMinChunk + 1);
+    sizes.push_back(n);
+    sum += n;
+  }
+}
+
+/* ---------------- single thread ---------------- */
+
+template <class Queue>
+static double runSingle(Queue& queue, const std::vector<int>& sizes,
+                        int depth, uint64_t* checksum) {
+  uint8_t src[kMaxChunk];
+  uint8_t dst[kReadSize];
+  for (int i = 0; i < kMaxChunk; i++) src[i] = (uint8_t)i;
+  size_t queued = 0;
+  int arrayIdx = 0;
+  int elementIdx = 0;
+  uint64_t sum = 0;
+
+  double begin = nowSeconds();
+  for (size_t i = 0; i < sizes.size(); i++) {
+    queue.Pushback(src, sizes[i]);
+    queued += sizes[i];
+    /* 保持约depth块积压 */
+    while (queued > (size_t)depth * (kMinChunk + kMaxChunk) / 2 + kReadSize) {
+      int got = queue.Get(dst, kReadSize, &arrayIdx, &elementIdx, true);
+      queued -= got;
+      sum += dst[got - 1];
+    }
+  }
+  while (queued > 0) {
+    int got = queue.Get(dst, kReadSize, &arrayIdx, &elementIdx, true);
+    if (got <= 0) break;
+    queued -= got;
+    sum += dst[got - 1];
+  }
+  double end = nowSeconds();
+  *checksum = sum;
+  return end - begin;
+}
+
+/* ---------------- two threads ---------------- */
+
+template <class Queue>
+struct SpscContext {
+  Queue* queue;
+  const std::vector<int>* sizes;
+  volatile long done;
+  uint64_t consumed;
+};
+
+template <class Queue>
+static void* producer(void* arg) {
+  SpscContext<Queue>* ctx = static_cast<SpscContext<Queue>*>(arg);
+  uint8_t src[kMaxChunk];
+  for (int i = 0; i < kMaxChunk; i++) src[i] = (uint8_t)i;
+  const std::vector<int>& sizes = *ctx->sizes;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    while (ctx->queue->Pushback(src, sizes[i]) < 0) {
+      sched_yield();
+    }
+  }
+  utility::atomicStore(&ctx->done, 1);
+  return NULL;
+}
+
+template <class Queue>
+static void* consumer(void* arg) {
+  SpscContext<Queue>* ctx = static_cast<SpscContext<Queue>*>(arg);
+  uint8_t dst[kReadSize];
+  int arrayIdx = 0;
+  int elementIdx = 0;
+  while (true) {
+    int got = ctx->queue->Get(dst, kReadSize, &arrayIdx, &elementIdx, true);
+    if (got > 0) {
+      ctx->consumed += got;
+      continue;
+    }
+    if (utility::atomicLoad(&ctx->done)) {
+      got = ctx->queue->Get(dst, kReadSize, &arrayIdx, &elementIdx, true);
+      if (got <= 0) break;
+      ctx->consumed += got;
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+template <class Queue>
+static double runSpsc(Queue& queue, const std::vector<int>& sizes,
+                      uint64_t* consumed) {
+  SpscContext<Queue> ctx;
+  ctx.queue = &queue;
+  ctx.sizes = &sizes;
+  ctx.done = 0;
+  ctx.consumed = 0;
+  pthread_t p;
+  pthread_t c;
+  double begin = nowSeconds();
+  pthread_create(&c, NULL, consumer<Queue>, &ctx);
+  pthread_create(&p, NULL, producer<Queue>, &ctx);
+  pthread_join(p, NULL);
+  pthread_join(c, NULL);
+  double end = nowSeconds();
+  *consumed = ctx.consumed;
+  return end - begin;
+}
+
+/* 直接在ByteRing连续区间上读写, 不经过中间缓冲 */
+struct SpanContext {
+  ByteRing* ring;
+  const std::vector<int>* sizes;
+  volatile long done;
+  uint64_t consumed;
+};
+
+static void* spanProducer(void* arg) {
+  SpanContext* ctx = static_cast<SpanContext*>(arg);
+  const std::vector<int>& sizes = *ctx->sizes;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    size_t left = sizes[i];
+    while (left > 0) {
+      uint8_t* span = NULL;
+      size_t n = ctx->ring->WriteSpan(&span);
+      if (n == 0) {
+        sched_yield();
+        continue;
+      }
+      if (n > left) n = left;
+      memset(span, (int)i, n);
+      ctx->ring->CommitWrite(n);
+      left -= n;
+    }
+  }
+  utility::atomicStore(&ctx->done, 1);
+  return NULL;
+}
+
+static void* spanConsumer(void* arg) {
+  SpanContext* ctx = static_cast<SpanContext*>(arg);
+  uint64_t sum = 0;
+  while (true) {
+    const uint8_t* span = NULL;
+    size_t n = ctx->ring->ReadSpan(&span);
+    if (n > 0) {
+      sum += span[n - 1];
+      ctx->ring->CommitRead(n);
+      ctx->consumed += n;
+      continue;
+    }
+    if (utility::atomicLoad(&ctx->done) && ctx->ring->Size() == 0) break;
+    sched_yield();
+  }
+  return (void*)(size_t)sum;
+}
+
+static double runSpan(ByteRing& ring, const std::vector<int>& sizes,
+                      uint64_t* consumed) {
+  SpanContext ctx;
+  ctx.ring = &ring;
+  ctx.sizes = &sizes;
+  ctx.done = 0;
+  ctx.consumed = 0;
+  pthread_t p;
+  pthread_t c;
+  double begin = nowSeconds();
+  pthread_create(&c, NULL, spanConsumer, &ctx);
+  pthread_create(&p, NULL, spanProducer, &ctx);
+  pthread_join(p, NULL);
+  pthread_join(c, NULL);
+  double end = nowSeconds();
+  *consumed = ctx.consumed;
+  return end - begin;
+}
+
+static void report(const char* mode, const char* name, size_t chunks,
+                   uint64_t bytes, double seconds) {
+  printf("%-8s %-20s %10.1f %14.2f %10.1f\n", mode, name,
+         bytes / seconds / (1024.0 * 1024.0),
+         chunks / seconds / 1e6, seconds * 1e9 / chunks);
+}
+
+int main(int argc, char* argv[]) {
+  int totalMb = argc > 1 ? atoi(argv[1]) : 32;
+  int depth = argc > 2 ? atoi(argv[2]) : 64;
+  if (totalMb <= 0 || depth <= 0) {
+    fprintf(stderr, "usage: %s [total MB] [backlog chunks]\n", argv[0]);
+    return -1;
+  }
+
+  std::vector<int> sizes;
+  makeChunkSizes(sizes, (size_t)totalMb * 1024 * 1024);
+  uint64_t total = 0;
+  for (size_t i = 0; i < sizes.size(); i++) total += sizes[i];
+
+  printf("data: %dMB in %lu chunks, backlog: %d chunks\n",
+         totalMb, (unsigned long)sizes.size(), depth);
+  printf("%-8s %-20s %10s %14s %10s\n", "mode", "queue", "MB/s",
+         "Mchunks/s", "ns/chunk");
+
+  uint64_t checkLegacy = 0;
+  uint64_t checkRing = 0;
+  {
+    LegacyDataBase<uint8_t> legacy;
+    double s = runSingle(legacy, sizes, 1, &checkLegacy);
+    report("single", "legacy depth=1", sizes.size(), total, s);
+  }
+  {
+    DataBase<uint8_t> ring;
+    double s = runSingle(ring, sizes, 1, &checkRing);
+    report("single", "ring depth=1", sizes.size(), total, s);
+  }
+  if (checkLegacy != checkRing) {
+    printf("checksum mismatch: %llu %llu\n",
+           (unsigned long long)checkLegacy, (unsigned long long)checkRing);
+  }
+  {
+    LegacyDataBase<uint8_t> legacy;
+    double s = runSingle(legacy, sizes, depth, &checkLegacy);
+    report("single", "legacy backlog", sizes.size(), total, s);
+  }
+  {
+    /* 容量需容纳积压数据 */
+    DataBase<uint8_t> ring((size_t)depth * kMaxChunk + 2 * kReadSize);
+    double s = runSingle(ring, sizes, depth, &checkRing);
+    report("single", "ring backlog", sizes.size(), total, s);
+  }
+  if (checkLegacy != checkRing) {
+    printf("checksum mismatch: %llu %llu\n",
+           (unsigned long long)checkLegacy, (unsigned long long)checkRing);
+  }
+
+  uint64_t consumed = 0;
+  {
+    LegacyDataBase<uint8_t> legacy;
+    double s = runSpsc(legacy, sizes, &consumed);
+    report("spsc", "legacy", sizes.size(), consumed, s);
+  }
+  {
+    DataBase<uint8_t> ring;
+    double s = runSpsc(ring, sizes, &consumed);
+    report("spsc", "ring", sizes.size(), consumed, s);
+  }
+  {
+    ByteRing ring(DataBase<uint8_t>::kDefaultCapacity);
+    double s = runSpan(ring, sizes, &consumed);
+    report("spsc", "ring span", sizes.size(), consumed, s);
+  }
+  if (consumed != total) {
+    printf("lost data: %llu of %llu\n",
+           (unsigned long long)consumed, (unsigned long long)total);
+  }
+
+  return 0;
+}
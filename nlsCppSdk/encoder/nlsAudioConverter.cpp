@@ -0,0 +1,367 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "nlog.h"
+#include "nlsAudioConverter.h"
+
+#if !defined(NLS_DISABLE_SIMD)
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define NLS_RESAMPLER_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NLS_RESAMPLER_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+/* 每个输出采样周期对应的滤波器阶数, 降采样时按倍率放大 */
+#define RESAMPLER_BASE_TAPS 32
+/* 相位数上限, 超过时按最近相位取系数, 限制系数表大小 */
+#define RESAMPLER_MAX_PHASES 512
+/* 截止频率相对于输入输出较低采样率的比例 */
+#define RESAMPLER_CUTOFF 0.45
+#define MAX_INPUT_CHANNELS 8
+#define MIN_INPUT_SAMPLE_RATE 8000
+#define MAX_INPUT_SAMPLE_RATE 192000
+
+namespace AlibabaNls {
+
+static const double kPi = 3.14159265358979323846;
+
+static int greatestCommonDivisor(int a, int b) {
+  while (b != 0) {
+    int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+/* n须为4的倍数 */
+static inline float dotProduct(const float* a, const float* b, int n) {
+#if defined(NLS_RESAMPLER_SSE)
+  __m128 acc = _mm_setzero_ps();
+  for (int i = 0; i < n; i += 4) {
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i),
+                                     _mm_loadu_ps(b + i)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, acc);
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(NLS_RESAMPLER_NEON)
+  float32x4_t acc = vdupq_n_f32(0.0f);
+  for (int i = 0; i < n; i += 4) {
+    acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+  }
+  return (vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1)) +
+         (vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3));
+#else
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (int i = 0; i < n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  return (s0 + s1) + (s2 + s3);
+#endif
+}
+
+static inline int16_t floatToS16(float value) {
+  if (value >= 32767.0f) return 32767;
+  if (!(value > -32768.0f)) return -32768;  // 含NaN
+  return (int16_t)(value >= 0 ? value + 0.5f : value - 0.5f);
+}
+
+/* 按小端读取一个样本, 统一换算到16bit幅度范围 */
+static inline float readSample(const uint8_t* p, AUDIO_SAMPLE_FORMAT format) {
+  switch (format) {
+    case SAMPLE_FORMAT_S32:
+      {
+        int32_t v = (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                              ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        return (float)v * (1.0f / 65536.0f);
+      }
+    case SAMPLE_FORMAT_F32:
+      {
+        uint32_t bits = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                        ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        return v * 32768.0f;
+      }
+    default:
+      return (float)(int16_t)(p[0] | (p[1] << 8));
+  }
+}
+
+static inline size_t sampleBytes(AUDIO_SAMPLE_FORMAT format) {
+  return format == SAMPLE_FORMAT_S16 ? 2 : 4;
+}
+
+NlsAudioConverter::NlsAudioConverter() : output_rate_(0),
+                                         enabled_(false),
+                                         frame_bytes_(2),
+                                         up_(1),
+                                         down_(1),
+                                         phases_(1),
+                                         taps_(0),
+                                         mono_size_(0),
+                                         position_(0),
+                                         fraction_(0),
+                                         pending_size_(0) {}
+
+NlsAudioConverter::~NlsAudioConverter() {}
+
+int NlsAudioConverter::init(const NlsAudioInputFormat& format,
+                            int outputRate) {
+  int inputRate = format.sampleRate > 0 ? format.sampleRate : outputRate;
+  if (outputRate <= 0 ||
+      format.sampleFormat < SAMPLE_FORMAT_S16 ||
+      format.sampleFormat > SAMPLE_FORMAT_F32 ||
+      format.channels < 1 || format.channels > MAX_INPUT_CHANNELS ||
+      inputRate < MIN_INPUT_SAMPLE_RATE || inputRate > MAX_INPUT_SAMPLE_RATE) {
+    LOG_ERROR("invalid input audio format, format:%d rate:%d channels:%d",
+              format.sampleFormat, format.sampleRate, format.channels);
+    enabled_ = false;
+    return -1;
+  }
+
+  format_ = format;
+  format_.sampleRate = inputRate;
+  output_rate_ = outputRate;
+  frame_bytes_ = sampleBytes(format.sampleFormat) * format.channels;
+  enabled_ = !(format.sampleFormat == SAMPLE_FORMAT_S16 &&
+               format.channels == 1 && inputRate == outputRate);
+
+  int divisor = greatestCommonDivisor(inputRate, outputRate);
+  int up = outputRate / divisor;
+  int down = inputRate / divisor;
+  if (up != up_ || down != down_ || coefs_.empty()) {
+    up_ = up;
+    down_ = down;
+    if (up_ != down_ && buildFilter() < 0) {
+      enabled_ = false;
+      return -1;
+    }
+  }
+
+  reset();
+  return 0;
+}
+
+/*
+ * 以phases_倍上采样率设计Blackman窗sinc低通原型, 再拆分为多相系数,
+ * 每相系数倒序存放, 使滤波内积按输入顺序连续访问.
+ */
+int NlsAudioConverter::buildFilter() {
+  phases_ = up_ < RESAMPLER_MAX_PHASES ? up_ : RESAMPLER_MAX_PHASES;
+
+  int taps = RESAMPLER_BASE_TAPS;
+  if (down_ > up_) {
+    taps = (int)ceil((double)RESAMPLER_BASE_TAPS * down_ / up_);
+  }
+  taps_ = (taps + 3) & ~3;
+
+  size_t length = (size_t)phases_ * taps_;
+  std::vector<double> prototype(length);
+  double ratio = up_ < down_ ? (double)up_ / down_ : 1.0;
+  double cutoff = 2.0 * RESAMPLER_CUTOFF * ratio / phases_;
+  double center = (length - 1) / 2.0;
+  double sum = 0;
+  for (size_t i = 0; i < length; i++) {
+    double x = cutoff * (i - center);
+    double sinc = fabs(x) < 1e-12 ? 1.0 : sin(kPi * x) / (kPi * x);
+    double w = 2.0 * kPi * i / (length - 1);
+    double window = 0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+    prototype[i] = cutoff * sinc * window;
+    sum += prototype[i];
+  }
+  if (sum <= 0) {
+    LOG_ERROR("build resampler filter failed.");
+    return -1;
+  }
+
+  double gain = phases_ / sum;
+  coefs_.resize(length);
+  for (int p = 0; p < phases_; p++) {
+    for (int j = 0; j < taps_; j++) {
+      coefs_[p * taps_ + j] =
+          (float)(prototype[p + (taps_ - 1 - j) * phases_] * gain);
+    }
+  }
+
+  LOG_DEBUG("resampler %d->%d, up:%d down:%d phases:%d taps:%d",
+            format_.sampleRate, output_rate_, up_, down_, phases_, taps_);
+  return 0;
+}
+
+void NlsAudioConverter::reset() {
+  pending_size_ = 0;
+  position_ = 0;
+  fraction_ = 0;
+  mono_size_ = 0;
+  if (up_ != down_) {
+    /* 预置半个滤波器长度的零样本, 抵消滤波器群延迟 */
+    mono_size_ = taps_ / 2;
+    if (mono_.size() < mono_size_) {
+      mono_.resize(mono_size_);
+    }
+    memset(&mono_[0], 0, mono_size_ * sizeof(float));
+  }
+}
+
+size_t NlsAudioConverter::downmix(const uint8_t* data, size_t frames) {
+  if (mono_.size() < mono_size_ + frames) {
+    mono_.resize(mono_size_ + frames);
+  }
+
+  AUDIO_SAMPLE_FORMAT format = format_.sampleFormat;
+  int channels = format_.channels;
+  size_t bytes = sampleBytes(format);
+  float* out = &mono_[mono_size_];
+  if (channels == 1) {
+    for (size_t i = 0; i < frames; i++) {
+      out[i] = readSample(data + i * bytes, format);
+    }
+  } else {
+    float scale = 1.0f / channels;
+    for (size_t i = 0; i < frames; i++) {
+      const uint8_t* frame = data + i * frame_bytes_;
+      float sum = 0;
+      for (int c = 0; c < channels; c++) {
+        sum += readSample(frame + c * bytes, format);
+      }
+      out[i] = sum * scale;
+    }
+  }
+
+  mono_size_ += frames;
+  return frames;
+}
+
+size_t NlsAudioConverter::resample(std::vector<uint8_t>& output) {
+  size_t before = output.size();
+
+  if (up_ == down_) {
+    output.resize(before + mono_size_ * 2);
+    uint8_t* out = &output[before];
+    for (size_t i = 0; i < mono_size_; i++) {
+      int16_t s = floatToS16(mono_[i]);
+      out[2 * i] = (uint8_t)(s & 0xff);
+      out[2 * i + 1] = (uint8_t)((s >> 8) & 0xff);
+    }
+    mono_size_ = 0;
+    return output.size() - before;
+  }
+
+  if (position_ + taps_ > mono_size_) {
+    return 0;
+  }
+
+  /* 输出样本数上限, 多余部分最后截掉 */
+  size_t available = mono_size_ - position_ - taps_ + 1;
+  size_t maxOutput = available * up_ / down_ + 2;
+  output.resize(before + maxOutput * 2);
+  uint8_t* out = &output[before];
+  size_t count = 0;
+
+  while (position_ + taps_ <= mono_size_ && count < maxOutput) {
+    int phase = fraction_;
+    if (phases_ != up_) {
+      phase = (int)((int64_t)fraction_ * phases_ / up_);
+    }
+    float value = dotProduct(&coefs_[phase * taps_], &mono_[position_], taps_);
+    int16_t s = floatToS16(value);
+    out[2 * count] = (uint8_t)(s & 0xff);
+    out[2 * count + 1] = (uint8_t)((s >> 8) & 0xff);
+    count++;
+
+    fraction_ += down_;
+    position_ += fraction_ / up_;
+    fraction_ %= up_;
+  }
+  output.resize(before + count * 2);
+
+  /* 已消费的样本移出, 保留滤波所需的历史 */
+  if (position_ >= mono_size_) {
+    position_ -= mono_size_;
+    mono_size_ = 0;
+  } else if (position_ > 0) {
+    memmove(&mono_[0], &mono_[position_],
+            (mono_size_ - position_) * sizeof(float));
+    mono_size_ -= position_;
+    position_ = 0;
+  }
+
+  return count * 2;
+}
+
+size_t NlsAudioConverter::process(const uint8_t* data, size_t dataSize,
+                                  std::vector<uint8_t>& output) {
+  if (pending_size_ > 0) {
+    size_t copy = frame_bytes_ - pending_size_;
+    if (copy > dataSize) copy = dataSize;
+    memcpy(pending_ + pending_size_, data, copy);
+    pending_size_ += copy;
+    data += copy;
+    dataSize -= copy;
+    if (pending_size_ < frame_bytes_) {
+      return 0;
+    }
+    downmix(pending_, 1);
+    pending_size_ = 0;
+  }
+
+  size_t frames = dataSize / frame_bytes_;
+  if (frames > 0) {
+    downmix(data, frames);
+  }
+
+  size_t rest = dataSize - frames * frame_bytes_;
+  if (rest > 0) {
+    memcpy(pending_, data + frames * frame_bytes_, rest);
+    pending_size_ = rest;
+  }
+
+  return resample(output);
+}
+
+/*
+ * reset时预置了taps_/2个零样本, 补入taps_-taps_/2-1个零样本后,
+ * 最后一个输出样本的滤波中心正好落在最后一个输入样本上.
+ */
+size_t NlsAudioConverter::flush(std::vector<uint8_t>& output) {
+  size_t size = 0;
+  if (up_ != down_ && taps_ > 0) {
+    size_t zeros = taps_ - taps_ / 2 - 1;
+    if (mono_.size() < mono_size_ + zeros) {
+      mono_.resize(mono_size_ + zeros);
+    }
+    memset(&mono_[mono_size_], 0, zeros * sizeof(float));
+    mono_size_ += zeros;
+    size = resample(output);
+  }
+
+  reset();
+  return size;
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ALIBABA_NLS_AUDIO_CONVERTER_H
+#define ALIBABA_NLS_AUDIO_CONVERTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "nlsGlobal.h"
+
+namespace AlibabaNls {
+
+/*
+ * 音频前处理: 将S16/S32/F32交错多声道、任意采样率的小端PCM
+ * 转换为16bit单声道目标采样率PCM.
+ * 各声道取平均混为单声道后, 经多相FIR滤波器完成有理数倍率重采样,
+ * 滤波内积在支持SSE/NEON的平台上使用SIMD指令.
+ * 缓冲在init及首次处理时分配, 之后按最大输入长度复用.
+ */
+class NlsAudioConverter {
+ public:
+  NlsAudioConverter();
+  ~NlsAudioConverter();
+
+  /*
+   * @brief 按输入格式及目标采样率初始化, 并清空状态
+   * @param format 输入格式, sampleRate为0时表示与目标采样率一致
+   * @param outputRate 目标采样率
+   * @return 成功返回0，参数非法返回-1
+   */
+  int init(const NlsAudioInputFormat& format, int outputRate);
+
+  /* @brief 清空未处理的数据及滤波器历史, 保留参数 */
+  void reset();
+
+  /* 输入已是目标采样率的16bit单声道PCM时无需转换 */
+  inline bool isEnabled() { return enabled_; };
+
+  /*
+   * @brief 转换一段输入, 结果追加到output. 不足一个采样帧的数据留待下次.
+   * @return 追加到output的字节数
+   */
+  size_t process(const uint8_t* data, size_t dataSize,
+                 std::vector<uint8_t>& output);
+
+  /*
+   * @brief 输入结束时调用, 以零样本补足滤波器长度, 输出滤波器中剩余的
+   *        约taps/2个样本, 之后清空状态. 不足一个采样帧的数据丢弃.
+   * @return 追加到output的字节数
+   */
+  size_t flush(std::vector<uint8_t>& output);
+
+ private:
+  int buildFilter();
+  size_t downmix(const uint8_t* data, size_t frames);
+  size_t resample(std::vector<uint8_t>& output);
+
+  NlsAudioInputFormat format_;
+  int output_rate_;
+  bool enabled_;
+  size_t frame_bytes_;
+
+  /* 重采样倍率为up_/down_, 相位数超过上限时按最近相位取系数 */
+  int up_;
+  int down_;
+  int phases_;
+  int taps_;
+  std::vector<float> coefs_;
+
+  /* 混音后的单声道样本, [0, position_)已处理, 末尾保留taps_-1个历史样本 */
+  std::vector<float> mono_;
+  size_t mono_size_;
+  size_t position_;
+  int fraction_;
+
+  /* 不足一个采样帧的输入 */
+  uint8_t pending_[64];
+  size_t pending_size_;
+};
+
+}
+
+#endif //ALIBABA_NLS_AUDIO_CONVERTER_H
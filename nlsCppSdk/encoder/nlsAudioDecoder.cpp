@@ -0,0 +1,378 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "nlog.h"
+#include "nlsAudioDecoder.h"
+
+#ifdef ENABLE_OGGOPUS
+#include "opus/opus.h"
+#include "ogg/ogg.h"
+#endif
+
+/* wav头部最大缓存长度, 超过仍未找到data块视为无法解析 */
+#define WAV_HEADER_MAX_SIZE 4096
+/* opus单包最长120ms */
+#define OPUS_MAX_PACKET_MS 120
+
+namespace AlibabaNls {
+
+#ifdef ENABLE_OGGOPUS
+struct OggOpusDecodeState {
+  ogg_sync_state sync;
+  ogg_stream_state stream;
+  bool streamInit;
+  int packets;
+  /* 尚需丢弃的起始样本数, 已换算为输出采样率 */
+  int preSkip;
+  OpusDecoder* decoder;
+  std::vector<int16_t> pcm;
+};
+#else
+struct OggOpusDecodeState {};
+#endif
+
+static inline uint16_t readLe16(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+NlsAudioDecoder::NlsAudioDecoder() : type_(DecoderNone), request_rate_(0),
+    sample_rate_(0), header_parsed_(false), channels_(1), pending_size_(0),
+    opus_(NULL) {}
+
+NlsAudioDecoder::~NlsAudioDecoder() {
+  releaseOpus();
+}
+
+int NlsAudioDecoder::init(const std::string& format, int sampleRate) {
+  releaseOpus();
+  type_ = DecoderNone;
+  request_rate_ = sampleRate;
+
+  if (sampleRate <= 0) {
+    LOG_ERROR("invalid sample rate %d.", sampleRate);
+    return -1;
+  }
+
+  if (format == "pcm") {
+    type_ = DecoderPcm;
+  } else if (format == "wav") {
+    type_ = DecoderWav;
+  } else if (format == "opus") {
+#ifdef ENABLE_OGGOPUS
+    if (sampleRate != 8000 && sampleRate != 12000 && sampleRate != 16000 &&
+        sampleRate != 24000 && sampleRate != 48000) {
+      LOG_ERROR("opus decoder doesn't support sample rate %d.", sampleRate);
+      return -1;
+    }
+    opus_ = new OggOpusDecodeState();
+    opus_->streamInit = false;
+    opus_->packets = 0;
+    opus_->preSkip = 0;
+    opus_->decoder = NULL;
+    ogg_sync_init(&opus_->sync);
+    type_ = DecoderOpus;
+#else
+    LOG_ERROR("opus decoder requires ENABLE_OGGOPUS.");
+    return -1;
+#endif
+  } else {
+    LOG_ERROR("format %s can't be decoded.", format.c_str());
+    return -1;
+  }
+
+  reset();
+  return 0;
+}
+
+void NlsAudioDecoder::reset() {
+  header_.clear();
+  header_parsed_ = false;
+  channels_ = 1;
+  pending_size_ = 0;
+  sample_rate_ = (type_ == DecoderWav) ? 0 : request_rate_;
+
+#ifdef ENABLE_OGGOPUS
+  if (opus_) {
+    ogg_sync_reset(&opus_->sync);
+    if (opus_->streamInit) {
+      ogg_stream_clear(&opus_->stream);
+    }
+    opus_->streamInit = false;
+    opus_->packets = 0;
+    opus_->preSkip = 0;
+    if (opus_->decoder) {
+      opus_decoder_destroy(opus_->decoder);
+      opus_->decoder = NULL;
+    }
+  }
+#endif
+}
+
+void NlsAudioDecoder::releaseOpus() {
+#ifdef ENABLE_OGGOPUS
+  if (opus_) {
+    if (opus_->streamInit) {
+      ogg_stream_clear(&opus_->stream);
+    }
+    if (opus_->decoder) {
+      opus_decoder_destroy(opus_->decoder);
+    }
+    ogg_sync_clear(&opus_->sync);
+    delete opus_;
+  }
+#endif
+  opus_ = NULL;
+}
+
+int NlsAudioDecoder::decode(const uint8_t* data, size_t dataSize,
+                            std::vector<uint8_t>& output) {
+  if (data == NULL || dataSize == 0) {
+    return 0;
+  }
+
+  switch (type_) {
+    case DecoderPcm:
+      return (int)appendPcm(data, dataSize, output);
+    case DecoderWav:
+      return decodeWav(data, dataSize, output);
+    case DecoderOpus:
+      return decodeOpus(data, dataSize, output);
+    default:
+      return -1;
+  }
+}
+
+/*
+ * 将交错的16bit PCM混为单声道追加到output, 不足一个采样帧的数据留待下次.
+ */
+size_t NlsAudioDecoder::appendPcm(const uint8_t* data, size_t dataSize,
+                                  std::vector<uint8_t>& output) {
+  size_t frameBytes = 2 * channels_;
+  size_t begin = output.size();
+
+  if (pending_size_ > 0) {
+    size_t need = frameBytes - pending_size_;
+    if (need > dataSize) need = dataSize;
+    memcpy(pending_ + pending_size_, data, need);
+    pending_size_ += need;
+    data += need;
+    dataSize -= need;
+    if (pending_size_ < frameBytes) {
+      return 0;
+    }
+    pending_size_ = 0;
+    appendPcm(pending_, frameBytes, output);
+  }
+
+  size_t frames = dataSize / frameBytes;
+  if (channels_ == 1) {
+    output.insert(output.end(), data, data + frames * 2);
+  } else {
+    size_t offset = output.size();
+    output.resize(offset + frames * 2);
+    uint8_t* out = &output[offset];
+    for (size_t i = 0; i < frames; i++) {
+      const uint8_t* frame = data + i * frameBytes;
+      int sum = 0;
+      for (int c = 0; c < channels_; c++) {
+        sum += (int16_t)readLe16(frame + 2 * c);
+      }
+      int16_t mono = (int16_t)(sum / channels_);
+      out[2 * i] = (uint8_t)(mono & 0xff);
+      out[2 * i + 1] = (uint8_t)((mono >> 8) & 0xff);
+    }
+  }
+
+  size_t rest = dataSize - frames * frameBytes;
+  if (rest > 0) {
+    memcpy(pending_, data + frames * frameBytes, rest);
+    pending_size_ = rest;
+  }
+  return output.size() - begin;
+}
+
+int NlsAudioDecoder::decodeWav(const uint8_t* data, size_t dataSize,
+                               std::vector<uint8_t>& output) {
+  if (header_parsed_) {
+    return (int)appendPcm(data, dataSize, output);
+  }
+
+  header_.insert(header_.end(), data, data + dataSize);
+  size_t offset = 0;
+  int ret = parseWavHeader(&offset);
+  if (ret <= 0) {
+    return ret;
+  }
+
+  header_parsed_ = true;
+  ret = 0;
+  if (offset < header_.size()) {
+    ret = (int)appendPcm(&header_[offset], header_.size() - offset, output);
+  }
+  header_.clear();
+  return ret;
+}
+
+/*
+ * 解析RIFF头部, 成功返回1并将PCM数据在header_中的起始位置写入offset.
+ * 数据不足返回0, 无法解析返回-1. 流式返回的wav长度字段可能无效, 不做校验.
+ * 不以RIFF开头时按请求采样率的单声道pcm处理.
+ */
+int NlsAudioDecoder::parseWavHeader(size_t* offset) {
+  const uint8_t* p = header_.empty() ? NULL : &header_[0];
+  size_t size = header_.size();
+
+  if (size < 12) {
+    return 0;
+  }
+  if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) {
+    LOG_WARN("wav stream without RIFF header, treat as pcm.");
+    sample_rate_ = request_rate_;
+    channels_ = 1;
+    *offset = 0;
+    return 1;
+  }
+
+  bool fmtFound = false;
+  size_t pos = 12;
+  while (pos + 8 <= size) {
+    uint32_t chunkSize = readLe32(p + pos + 4);
+    if (memcmp(p + pos, "data", 4) == 0) {
+      if (!fmtFound) {
+        LOG_ERROR("wav data chunk before fmt chunk.");
+        return -1;
+      }
+      *offset = pos + 8;
+      return 1;
+    }
+    if (memcmp(p + pos, "fmt ", 4) == 0) {
+      if (pos + 8 + 16 > size) {
+        break;
+      }
+      const uint8_t* fmt = p + pos + 8;
+      uint16_t audioFormat = readLe16(fmt);
+      uint16_t channels = readLe16(fmt + 2);
+      uint32_t sampleRate = readLe32(fmt + 4);
+      uint16_t bits = readLe16(fmt + 14);
+      /* 1为PCM, 0xFFFE为WAVE_FORMAT_EXTENSIBLE */
+      if ((audioFormat != 1 && audioFormat != 0xFFFE) || bits != 16 ||
+          channels < 1 || channels > 8 || sampleRate == 0) {
+        LOG_ERROR("unsupported wav format:%d bits:%d channels:%d.",
+            audioFormat, bits, channels);
+        return -1;
+      }
+      channels_ = channels;
+      sample_rate_ = (int)sampleRate;
+      fmtFound = true;
+    }
+    if (chunkSize > WAV_HEADER_MAX_SIZE) {
+      LOG_ERROR("wav chunk too large:%u.", chunkSize);
+      return -1;
+    }
+    pos += 8 + chunkSize + (chunkSize & 1);
+  }
+
+  if (size > WAV_HEADER_MAX_SIZE) {
+    LOG_ERROR("wav data chunk not found in %d bytes.", (int)size);
+    return -1;
+  }
+  return 0;
+}
+
+int NlsAudioDecoder::decodeOpus(const uint8_t* data, size_t dataSize,
+                                std::vector<uint8_t>& output) {
+#ifdef ENABLE_OGGOPUS
+  char* buffer = ogg_sync_buffer(&opus_->sync, (long)dataSize);
+  if (buffer == NULL) {
+    return -1;
+  }
+  memcpy(buffer, data, dataSize);
+  ogg_sync_wrote(&opus_->sync, (long)dataSize);
+
+  size_t begin = output.size();
+  ogg_page page;
+  while (ogg_sync_pageout(&opus_->sync, &page) == 1) {
+    if (!opus_->streamInit) {
+      ogg_stream_init(&opus_->stream, ogg_page_serialno(&page));
+      opus_->streamInit = true;
+    }
+    if (ogg_stream_pagein(&opus_->stream, &page) < 0) {
+      LOG_WARN("ogg page of another stream is ignored.");
+      continue;
+    }
+
+    ogg_packet packet;
+    int ret = 0;
+    while ((ret = ogg_stream_packetout(&opus_->stream, &packet)) != 0) {
+      if (ret < 0) {
+        /* 丢页, 跳过缺失部分继续解码 */
+        continue;
+      }
+
+      if (opus_->packets == 0) {
+        if (packet.bytes < 19 || memcmp(packet.packet, "OpusHead", 8) != 0) {
+          LOG_ERROR("invalid OpusHead.");
+          return -1;
+        }
+        int error = OPUS_OK;
+        /* 按单声道创建, 多声道流由libopus直接混为单声道 */
+        opus_->decoder = opus_decoder_create(sample_rate_, 1, &error);
+        if (error != OPUS_OK || opus_->decoder == NULL) {
+          LOG_ERROR("opus_decoder_create failed:%s.", opus_strerror(error));
+          return -1;
+        }
+        opus_->preSkip = (int)((int64_t)readLe16(packet.packet + 10) *
+                               sample_rate_ / 48000);
+        opus_->pcm.resize(sample_rate_ * OPUS_MAX_PACKET_MS / 1000);
+      } else if (opus_->packets > 1) {
+        int samples = opus_decode(opus_->decoder, packet.packet,
+                                  (opus_int32)packet.bytes, &opus_->pcm[0],
+                                  (int)opus_->pcm.size(), 0);
+        if (samples < 0) {
+          LOG_WARN("opus_decode failed:%s.", opus_strerror(samples));
+        } else {
+          int skip = samples < opus_->preSkip ? samples : opus_->preSkip;
+          opus_->preSkip -= skip;
+          size_t offset = output.size();
+          output.resize(offset + (samples - skip) * 2);
+          for (int i = skip; i < samples; i++) {
+            int16_t s = opus_->pcm[i];
+            output[offset++] = (uint8_t)(s & 0xff);
+            output[offset++] = (uint8_t)((s >> 8) & 0xff);
+          }
+        }
+      }
+      /* 第二个包为OpusTags, 跳过 */
+      opus_->packets++;
+    }
+  }
+  return (int)(output.size() - begin);
+#else
+  (void)data;
+  (void)dataSize;
+  (void)output;
+  return -1;
+#endif
+}
+
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ALIBABA_NLS_AUDIO_DECODER_H
+#define ALIBABA_NLS_AUDIO_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "nlsGlobal.h"
+
+namespace AlibabaNls {
+
+struct OggOpusDecodeState;
+
+/*
+ * 语音合成音频流式解码, 将服务端分段返回的pcm/wav/opus(Ogg封装)数据
+ * 解码为16bit单声道小端PCM. 输入可在任意位置分段.
+ * wav仅支持16bit PCM, 多声道取平均; opus需以ENABLE_OGGOPUS编译.
+ */
+class NlsAudioDecoder {
+ public:
+  NlsAudioDecoder();
+  ~NlsAudioDecoder();
+
+  /*
+   * @brief 按格式初始化, 并清空状态
+   * @param format 合成请求的音频格式, pcm/wav/opus
+   * @param sampleRate 合成请求的采样率, 作为pcm/opus的输出采样率
+   * @return 成功返回0，格式不支持返回-1
+   */
+  int init(const std::string& format, int sampleRate);
+
+  /* @brief 清空状态, 以便解码下一段音频流 */
+  void reset();
+
+  /*
+   * @brief 解码一段输入, 结果追加到output
+   * @return 追加到output的字节数, 数据无法解析返回-1
+   */
+  int decode(const uint8_t* data, size_t dataSize,
+             std::vector<uint8_t>& output);
+
+  /* 输出采样率, wav在解析到头部之前返回0 */
+  inline int getSampleRate() { return sample_rate_; };
+
+ private:
+  enum DecoderType {
+    DecoderNone = 0,
+    DecoderPcm,
+    DecoderWav,
+    DecoderOpus
+  };
+
+  int decodeWav(const uint8_t* data, size_t dataSize,
+                std::vector<uint8_t>& output);
+  int parseWavHeader(size_t* offset);
+  size_t appendPcm(const uint8_t* data, size_t dataSize,
+                   std::vector<uint8_t>& output);
+  int decodeOpus(const uint8_t* data, size_t dataSize,
+                 std::vector<uint8_t>& output);
+  void releaseOpus();
+
+  DecoderType type_;
+  int request_rate_;
+  int sample_rate_;
+
+  /* wav头部解析前的缓存 */
+  std::vector<uint8_t> header_;
+  bool header_parsed_;
+  int channels_;
+  /* 不足一个采样帧的数据 */
+  uint8_t pending_[16];
+  size_t pending_size_;
+
+  OggOpusDecodeState* opus_;
+};
+
+}
+
+#endif //ALIBABA_NLS_AUDIO_DECODER_H
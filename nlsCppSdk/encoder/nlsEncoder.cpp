@@ -26,6 +26,7 @@
 #include "nlog.h"
 #include "nlsGlobal.h"
 #include "nlsEncoder.h"
+#include "thread_data.h"
 #ifdef ENABLE_OGGOPUS
 #include "nlsEncoderCommon.h"
 #include "oggopusEncoder.h"
@@ -33,10 +34,64 @@
 
 
 #define DEFAULT_CHANNELS 1
+/* ogg头页(OpusHead+OpusTags)预留空间 */
+#define OGG_HEADER_RESERVE 1024
 //#define OPU_DEBUG
 
 namespace AlibabaNls {
 
+static inline bool isLittleEndianHost() {
+  const uint16_t probe = 1;
+  return *(const uint8_t *)&probe == 1;
+}
+
+NlsEncoder::NlsEncoder() : nlsEncoder_(NULL),
+                           encoder_type_(ENCODER_NONE),
+                           sample_rate_(0),
+                           frame_ms_(DEFAULT_FRAME_DURATION_MS),
+                           frame_bytes_(DEFAULT_FRAME_NORMAL_SIZE),
+                           pcm_scratch_(NULL)
+#ifdef ENABLE_OGGOPUS
+                           , encoded_data_(NULL)
+#endif
+                           {}
+
+NlsEncoder::~NlsEncoder() {
+  freeScratch();
+}
+
+/*
+ * 按帧长预分配编码过程中用到的缓冲, 之后每帧编码不再申请内存.
+ */
+int NlsEncoder::allocScratch() {
+  freeScratch();
+
+  pcm_scratch_ = (int16_t *)malloc(frame_bytes_);
+  if (pcm_scratch_ == NULL) {
+    return -1;
+  }
+#ifdef ENABLE_OGGOPUS
+  if (encoder_type_ == ENCODER_OPUS) {
+    /* 调用者每帧取走全部数据, 两帧PCM长度足以容纳一帧的ogg页 */
+    encoded_data_ =
+        new DataBase<uint8_t>(frame_bytes_ * 2 + OGG_HEADER_RESERVE);
+    if (encoded_data_->Capacity() == 0) {
+      return -1;
+    }
+  }
+#endif
+  return 0;
+}
+
+void NlsEncoder::freeScratch() {
+  if (pcm_scratch_) free(pcm_scratch_);
+  pcm_scratch_ = NULL;
+#ifdef ENABLE_OGGOPUS
+  delete encoded_data_;
+  encoded_data_ = NULL;
+#endif
+}
+
 #ifdef ENABLE_OGGOPUS
 static size_t oggopusEncodedData(const uint8_t *encoded_data, int len,
                                  void *user_data) {
@@ -49,13 +104,23 @@ static size_t oggopusEncodedData(const uint8_t *encoded_data, int len,
 
 int NlsEncoder::pushbackEncodedData(
     const uint8_t *encoded_data, int data_len) {
-  encoded_data_.Pushback(encoded_data, data_len);
+  if (data_len <= 0) {
+    return kNlsOk;
+  }
+
+  if (encoded_data_ == NULL ||
+      encoded_data_->Pushback(encoded_data, data_len) < 0) {
+    /* 调用者未及时取走数据, 丢弃本次输出 */
+    LOG_ERROR("encoded data queue full, drop %d bytes", data_len);
+    return -1;
+  }
   return kNlsOk;
 }
 #endif
 
 int NlsEncoder::createNlsEncoder(ENCODER_TYPE type, int channels,
-                                 const int sampleRate, int *errorCode) {
+                                 const int sampleRate, int *errorCode,
+                                 int frameMs) {
   int ret = 0;
   int tmpCode = 0;
   int channel_num = channels;
@@ -67,25 +132,32 @@ int NlsEncoder::createNlsEncoder(ENCODER_TYPE type, int channels,
     LOG_WARN("nlsEncoder_ is existent, pls destroy first");
     return -1;
   }
+  if (frameMs != 20 && frameMs != 40 && frameMs != 60) {
+    LOG_ERROR("invalid frame duration %dms", frameMs);
+    return -1;
+  }
+  frame_ms_ = frameMs;
+  frame_bytes_ = sampleRate / 1000 * frameMs * 2;
 
   if (type == ENCODER_OPU) {
     nlsEncoder_ = opus_encoder_create(sampleRate, channel_num,
                                       OPUS_APPLICATION_VOIP, &tmpCode);
     if (nlsEncoder_) {
-      opus_encoder_ctl(
-          (OpusEncoder*)nlsEncoder_,
-          OPUS_SET_VBR(1)); //动态码率:OPUS_SET_VBR(1), 固定码率:OPUS_SET_VBR(0)
-      opus_encoder_ctl(
-          (OpusEncoder*)nlsEncoder_,
-          OPUS_SET_BITRATE(27800)); //指定opus编码码率,比特率从 6kb/s 到 510 kb/s,想要压缩比大一些就设置码率小一点
-      opus_encoder_ctl(
-          (OpusEncoder*)nlsEncoder_,
-          OPUS_SET_COMPLEXITY(8)); //计算复杂度
+      encoder_type_ = type;
+      sample_rate_ = sampleRate;
+      if (allocScratch() < 0) {
+        LOG_ERROR("encoder scratch alloc failed");
+        opus_encoder_destroy((OpusEncoder*)nlsEncoder_);
+        nlsEncoder_ = NULL;
+        encoder_type_ = ENCODER_NONE;
+        *errorCode = tmpCode;
+        return -2;
+      }
+      applyProfile(); //码率、计算复杂度、VBR及DTX, 见NlsEncoderProfile
       opus_encoder_ctl(
           (OpusEncoder*)nlsEncoder_,
           OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE)); //设置针对语音优化
 
-      encoder_type_ = type;
       ret = 0;
 
       LOG_DEBUG("opus_encoder_create for OPU mode success");
@@ -106,10 +178,9 @@ int NlsEncoder::createNlsEncoder(ENCODER_TYPE type, int channels,
     ret = ((OggOpusDataEncoder *)nlsEncoder_)->OggopusEncoderCreate(
         oggopusEncodedData, this, sampleRate);
     if (ret == kNlsOk) {
-      /* 这里暂时未开放编码码率和计算复杂度的设置 */
-      ((OggOpusDataEncoder *)nlsEncoder_)->SetBitrate(27800);
       ((OggOpusDataEncoder *)nlsEncoder_)->SetSampleRate(sampleRate);
-      ((OggOpusDataEncoder *)nlsEncoder_)->SetComplexity(8);
+      ((OggOpusDataEncoder *)nlsEncoder_)->SetFrameSampleBytes(frame_bytes_);
+      applyProfile();
 
       LOG_DEBUG("OggopusEncoderCreate for OPUS mode success");
     } else {
@@ -117,6 +188,11 @@ int NlsEncoder::createNlsEncoder(ENCODER_TYPE type, int channels,
     }
 #endif
     encoder_type_ = type;
+    sample_rate_ = sampleRate;
+    if (allocScratch() < 0) {
+      LOG_ERROR("encoder scratch alloc failed");
+      ret = -2;
+    }
   }
 
   return ret;
@@ -130,53 +206,54 @@ int NlsEncoder::nlsEncoding(const uint8_t* frameBuff, const int frameLen,
     return 0;
   }
 
-  unsigned char* outputTmp = NULL;
-  outputTmp = (unsigned char*)malloc(outputSize);
-  if (!outputTmp) {
-    return 0;
-  }
-  memset(outputTmp, 0x0, outputSize);
-
   int encoderSize = -1;
   /* 1. 灌入数据开始编码 */
   if (encoder_type_ == ENCODER_OPU) {
-    //uint8 to int16
-    int16_t *interBuffer = (int16_t *)malloc(frameLen);
-    if (interBuffer == NULL) {
-      LOG_ERROR("interBuffer malloc failed");
-      free(outputTmp);
+    if (frameLen > frame_bytes_ || pcm_scratch_ == NULL) {
+      LOG_ERROR("frameLen %d exceeds frame size %d", frameLen, frame_bytes_);
       return 0;
     }
-    int i = 0;
-    for (i = 0; i < frameLen; i += 2) {
-      interBuffer[i / 2] =
-          (int16_t) ((frameBuff[i + 1] << 8 & 0xff00) |
-          (frameBuff[i] & 0xff));
+
+    /* 小端主机上16bit PCM即为int16数组, 对齐时直接编码 */
+    const int16_t *interBuffer = NULL;
+    if (isLittleEndianHost() && ((uintptr_t)frameBuff & 0x1) == 0) {
+      interBuffer = (const int16_t *)frameBuff;
+    } else if (isLittleEndianHost()) {
+      memcpy(pcm_scratch_, frameBuff, frameLen);
+      interBuffer = pcm_scratch_;
+    } else {
+      for (int i = 0; i < frameLen; i += 2) {
+        pcm_scratch_[i / 2] =
+            (int16_t) ((frameBuff[i + 1] << 8 & 0xff00) |
+            (frameBuff[i] & 0xff));
+      }
+      interBuffer = pcm_scratch_;
     }
 
+    /* OPU每帧以1字节长度开头, 单帧编码结果不能超过255字节 */
+    int maxPacket = outputSize - 1;
+    if (maxPacket > 255) maxPacket = 255;
+    if (maxPacket <= 0) {
+      LOG_ERROR("outputSize %d is too small", outputSize);
+      return 0;
+    }
     encoderSize = opus_encode((OpusEncoder*)nlsEncoder_,
                               interBuffer,
                               frameLen / 2,
-                              outputTmp,
-                              outputSize);
+                              outputBuffer + 1,
+                              maxPacket);
 //    LOG_DEBUG("frameLen:%d, outputSize:%d, encoderSize:%d\n",
 //        frameLen, outputSize, encoderSize);
 
     if (encoderSize < 0) {
-      free(interBuffer);
-      free(outputTmp);
       return encoderSize;
     }
-
-    if (interBuffer) free(interBuffer);
-    interBuffer = NULL;
   } else if (encoder_type_ == ENCODER_OPUS) {
 #ifdef ENABLE_OGGOPUS
     encoderSize = ((OggOpusDataEncoder *)nlsEncoder_)->OggopusEncode(
         (const char *)frameBuff, frameLen);
     if (encoderSize != kNlsOk) {
       LOG_ERROR("OggopusEncode failed, ret %d", encoderSize);
-      free(outputTmp);
       return 0;
     }
 #endif
@@ -185,24 +262,16 @@ int NlsEncoder::nlsEncoding(const uint8_t* frameBuff, const int frameLen,
   /* 2. 取出编码后数据 */
   if (encoder_type_ == ENCODER_OPU) {
     *(outputBuffer + 0) = (unsigned char) encoderSize;
-    memcpy((outputBuffer + 1), outputTmp, encoderSize);
     encoderSize += 1;
   } else if (encoder_type_ == ENCODER_OPUS) {
 #ifdef ENABLE_OGGOPUS
     encoderSize = 0;
-    int data_len = 0;
-    data_len = encoded_data_.ElementNum();
-    if (data_len > 0) {
-      int array_idx = 0;
-      int element_idx = 0;
-      data_len = (data_len > outputSize) ? outputSize : data_len;
-      encoderSize = encoded_data_.Get(
-              outputTmp, data_len,
-              &array_idx, &element_idx, true);
-      if (encoderSize > 0) {
-//        LOG_DEBUG("opus encoded %dbytes", encoderSize);
-        memcpy(outputBuffer, outputTmp, encoderSize);
-      }
+    if (encoded_data_) {
+      int arrayIdx = 0;
+      int elementIdx = 0;
+      encoderSize = encoded_data_->Get(outputBuffer, outputSize,
+                                       &arrayIdx, &elementIdx, true);
+//      LOG_DEBUG("opus encoded %dbytes", encoderSize);
     }
 #endif
   }
@@ -223,9 +292,6 @@ int NlsEncoder::nlsEncoding(const uint8_t* frameBuff, const int frameLen,
   }
 #endif
 
-  if (outputTmp) free(outputTmp);
-  outputTmp = NULL;
-
   return encoderSize;
 }
 
@@ -241,13 +307,107 @@ int NlsEncoder::destroyNlsEncoder() {
   } else if (encoder_type_ == ENCODER_OPUS) {
 #ifdef ENABLE_OGGOPUS
     ((OggOpusDataEncoder *)nlsEncoder_)->OggopusDestroy();
-    encoded_data_.Clear();
     delete (OggOpusDataEncoder *)nlsEncoder_;
     nlsEncoder_ = NULL;
 #endif
   }
 
+  freeScratch();
   encoder_type_ = ENCODER_NONE;
+  sample_rate_ = 0;
+
+  return 0;
+}
+
+int NlsEncoder::getPresetProfile(ENCODER_PRESET preset,
+                                 NlsEncoderProfile* profile) {
+  if (profile == NULL) {
+    return -1;
+  }
+
+  *profile = NlsEncoderProfile();
+  switch (preset) {
+    case ENCODER_PRESET_DEFAULT:
+      break;
+    case ENCODER_PRESET_LOW_BANDWIDTH:
+      profile->bitrate = 12000;
+      profile->frameMs = 40;
+      break;
+    case ENCODER_PRESET_LOW_CPU:
+      profile->complexity = 2;
+      break;
+    case ENCODER_PRESET_DTX:
+      profile->dtx = true;
+      break;
+    default:
+      return -1;
+  }
+  return 0;
+}
+
+int NlsEncoder::setEncoderProfile(const NlsEncoderProfile& profile) {
+  profile_ = profile;
+  profile_.frameMs = frame_ms_;
+  return applyProfile();
+}
+
+int NlsEncoder::applyProfile() {
+  if (!nlsEncoder_) {
+    return 0;
+  }
+
+  if (encoder_type_ == ENCODER_OPU) {
+    OpusEncoder *encoder = (OpusEncoder*)nlsEncoder_;
+    if (opus_encoder_ctl(encoder, OPUS_SET_VBR(profile_.vbr ? 1 : 0)) != OPUS_OK ||
+        opus_encoder_ctl(encoder, OPUS_SET_BITRATE(profile_.bitrate)) != OPUS_OK ||
+        opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(profile_.complexity)) != OPUS_OK ||
+        opus_encoder_ctl(encoder, OPUS_SET_DTX(profile_.dtx ? 1 : 0)) != OPUS_OK) {
+      LOG_ERROR("apply encoder profile failed, bitrate %d complexity %d",
+          profile_.bitrate, profile_.complexity);
+      return -1;
+    }
+  } else if (encoder_type_ == ENCODER_OPUS) {
+#ifdef ENABLE_OGGOPUS
+    OggOpusDataEncoder *encoder = (OggOpusDataEncoder *)nlsEncoder_;
+    encoder->SetBitrate(profile_.bitrate);
+    encoder->SetComplexity(profile_.complexity);
+    encoder->SetVbr(profile_.vbr);
+    encoder->SetDtx(profile_.dtx);
+#endif
+  }
+  return 0;
+}
+
+int NlsEncoder::resetNlsEncoder() {
+  if (!nlsEncoder_) {
+    return -1;
+  }
+
+  int ret = 0;
+  if (encoder_type_ == ENCODER_OPU) {
+    ret = opus_encoder_ctl((OpusEncoder*)nlsEncoder_, OPUS_RESET_STATE);
+    if (ret != OPUS_OK) {
+      LOG_ERROR("opus_encoder_ctl reset failed, errorcode:%d", ret);
+      return -1;
+    }
+  } else if (encoder_type_ == ENCODER_OPUS) {
+#ifdef ENABLE_OGGOPUS
+    /* ogg流需要重新输出头信息, 因此重建ogg状态, 复用OggOpusDataEncoder对象 */
+    OggOpusDataEncoder *encoder = (OggOpusDataEncoder *)nlsEncoder_;
+    encoder->OggopusDestroy();
+    if (encoded_data_) {
+      encoded_data_->Clear();
+    }
+    ret = encoder->OggopusEncoderCreate(oggopusEncodedData, this, sample_rate_);
+    if (ret != kNlsOk) {
+      LOG_ERROR("OggopusEncoderCreate failed, errorcode:%d", ret);
+      return -1;
+    }
+    encoder->SetSampleRate(sample_rate_);
+    encoder->SetFrameSampleBytes(frame_bytes_);
+    applyProfile();
+#endif
+  }
 
   return 0;
 }
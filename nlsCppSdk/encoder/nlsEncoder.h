@@ -17,31 +17,38 @@
 #ifndef ALIBABA_NLS_ENCODER_H
 #define ALIBABA_NLS_ENCODER_H
 
+#include <stddef.h>
 #include <stdint.h>
-#ifdef ENABLE_OGGOPUS
-#include "thread_data.h"
-#endif
+#include "nlsGlobal.h"
 
 #define DEFAULT_FRAME_NORMAL_SIZE 640
 #define DEFAULT_FRAME_INTER_SIZE 320
+#define DEFAULT_FRAME_DURATION_MS 20
 
 namespace AlibabaNls {
 
+template <typename T> class DataBase;
+
 class NlsEncoder {
  public:
+  NlsEncoder();
+  ~NlsEncoder();
+
   /*
    * @brief 建立编码器
    * @param _event sampleRate 采样率
    * @param errorCode 错误代码
+   * @param frameMs 编码帧时长, 支持20/40/60毫秒
    * @return 成功返回0，失败返回负值，查看errorCode
    */
   int createNlsEncoder(ENCODER_TYPE type, int channels,
-                       const int sampleRate, int *errorCode);
+                       const int sampleRate, int *errorCode,
+                       int frameMs = DEFAULT_FRAME_DURATION_MS);
 
   /*
    * @brief 对数据进行编码
    * @param frameBuff 原始PCM音频数据
-   * @param frameLen 原始PCM音频数据长度。目前仅支持640字节。
+   * @param frameLen 原始PCM音频数据长度, 须为一帧长度, 见getFrameBytes()
    * @param outputBuffer 装载编码后音频数据的数组
    * @param outputSize outputBuffer长度
    * @return 成功返回opu编码后的数据长度，失败返回opus错误代码
@@ -55,15 +62,55 @@ class NlsEncoder {
    */
   int destroyNlsEncoder();
 
+  /*
+   * @brief 重置编码器状态, 保留已创建的编码器供下一轮请求复用
+   * @return 成功返回0，失败返回负值
+   */
+  int resetNlsEncoder();
+
+  /*
+   * @brief 设置码率、复杂度、VBR及DTX, 已创建的编码器立即生效,
+   *        resetNlsEncoder后保持. 帧时长由createNlsEncoder指定, 此处忽略.
+   * @return 成功返回0，失败返回负值
+   */
+  int setEncoderProfile(const NlsEncoderProfile& profile);
+  inline const NlsEncoderProfile& getEncoderProfile() { return profile_; };
+
+  /*
+   * @brief 获取预设对应的编码参数
+   * @return 成功返回0，预设不存在返回-1
+   */
+  static int getPresetProfile(ENCODER_PRESET preset,
+                              NlsEncoderProfile* profile);
+
+  inline ENCODER_TYPE getEncoderType() { return encoder_type_; };
+  inline int getSampleRate() { return sample_rate_; };
+  inline int getFrameDuration() { return frame_ms_; };
+  /* 一帧16bit单声道PCM的字节数 */
+  inline int getFrameBytes() { return frame_bytes_; };
+
 #ifdef ENABLE_OGGOPUS
   int pushbackEncodedData(const uint8_t *encoded_data, int data_len);
 #endif
 
  private:
+  int allocScratch();
+  void freeScratch();
+  int applyProfile();
+
   void* nlsEncoder_;
   ENCODER_TYPE encoder_type_;
+  int sample_rate_;
+  int frame_ms_;
+  int frame_bytes_;
+  NlsEncoderProfile profile_;
+
+  /* 大端主机或输入未对齐时用于转换PCM, 按帧长预分配 */
+  int16_t* pcm_scratch_;
+
 #ifdef ENABLE_OGGOPUS
-  DataBase<uint8_t> encoded_data_;
+  /* ogg页队列, 编码回调写入, nlsEncoding读出 */
+  DataBase<uint8_t>* encoded_data_;
 #endif
 };
 
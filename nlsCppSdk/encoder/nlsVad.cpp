@@ -0,0 +1,307 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "nlog.h"
+#include "nlsVad.h"
+
+#define VAD_FRAME_MS 10
+#define VAD_KEEP_ALIVE_FRAMES 2
+/* 能量低于门限10dB以内时参考过零率判决清音 */
+#define VAD_UNVOICED_ENERGY_RATIO 0.1
+
+namespace AlibabaNls {
+
+using utility::atomicAdd64;
+using utility::atomicLoad64;
+using utility::atomicStore64;
+
+NlsVad::NlsVad() : sample_rate_(0),
+                   frame_bytes_(0),
+                   energy_threshold_(0),
+                   pending_size_(0),
+                   silence_ms_(0),
+                   keep_alive_ms_(0),
+                   uploaded_bytes_(0),
+                   has_gaps_(0) {
+#if defined(_MSC_VER)
+  mtx_gaps_ = CreateMutex(NULL, FALSE, NULL);
+#else
+  pthread_mutex_init(&mtx_gaps_, NULL);
+#endif
+  clearStats();
+}
+
+NlsVad::~NlsVad() {
+#if defined(_MSC_VER)
+  CloseHandle(mtx_gaps_);
+#else
+  pthread_mutex_destroy(&mtx_gaps_);
+#endif
+}
+
+int NlsVad::init(int sampleRate, const NlsVadParam& param) {
+  if (sampleRate <= 0 ||
+      param.energyThresholdDb < -90 || param.energyThresholdDb > 0 ||
+      param.zcrThreshold < 0 || param.zcrThreshold > 1000 ||
+      param.hangoverMs < 0 || param.keepAliveMs < 0) {
+    LOG_ERROR("invalid vad param, sampleRate:%d threshold:%ddB zcr:%d",
+              sampleRate, param.energyThresholdDb, param.zcrThreshold);
+    param_.mode = VAD_MODE_NONE;
+    return -1;
+  }
+
+  param_ = param;
+  sample_rate_ = sampleRate;
+  frame_bytes_ = (size_t)sampleRate * VAD_FRAME_MS / 1000 * 2;
+
+  double amplitude = 32768.0 * pow(10.0, param.energyThresholdDb / 20.0);
+  energy_threshold_ = amplitude * amplitude;
+
+  /* 帧缓存仅在帧长变化时重新分配 */
+  if (pending_.size() != frame_bytes_) {
+    pending_.resize(frame_bytes_);
+  }
+  clearStats();
+  reset();
+  return 0;
+}
+
+void NlsVad::reset() {
+  pending_size_ = 0;
+  silence_ms_ = 0;
+  keep_alive_ms_ = 0;
+
+  uploaded_bytes_ = 0;
+#if defined(_MSC_VER)
+  WaitForSingleObject(mtx_gaps_, INFINITE);
+#else
+  pthread_mutex_lock(&mtx_gaps_);
+#endif
+  gaps_.clear();
+  utility::atomicStore(&has_gaps_, 0);
+#if defined(_MSC_VER)
+  ReleaseMutex(mtx_gaps_);
+#else
+  pthread_mutex_unlock(&mtx_gaps_);
+#endif
+}
+
+/*
+ * 在当前上传位置累加丢弃时长, 连续丢弃的帧合并为一段.
+ * 保活帧不属于原始音频, 以负值扣除. 每帧至多取一次锁.
+ */
+void NlsVad::recordDropped(int64_t droppedMs) {
+  int64_t offsetMs =
+      (int64_t)uploaded_bytes_ * 1000 / ((int64_t)sample_rate_ * 2);
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(mtx_gaps_, INFINITE);
+#else
+  pthread_mutex_lock(&mtx_gaps_);
+#endif
+  if (!gaps_.empty() && gaps_.back().offsetMs == offsetMs) {
+    gaps_.back().droppedMs += droppedMs;
+  } else {
+    Gap gap;
+    gap.offsetMs = offsetMs;
+    gap.droppedMs = droppedMs + (gaps_.empty() ? 0 : gaps_.back().droppedMs);
+    gaps_.push_back(gap);
+  }
+  utility::atomicStore(&has_gaps_, 1);
+#if defined(_MSC_VER)
+  ReleaseMutex(mtx_gaps_);
+#else
+  pthread_mutex_unlock(&mtx_gaps_);
+#endif
+}
+
+int NlsVad::rebaseTime(int uploadedMs) {
+  if (uploadedMs < 0) {
+    return uploadedMs;
+  }
+
+  int64_t droppedMs = 0;
+#if defined(_MSC_VER)
+  WaitForSingleObject(mtx_gaps_, INFINITE);
+#else
+  pthread_mutex_lock(&mtx_gaps_);
+#endif
+  /* 二分查找最后一个offsetMs不大于uploadedMs的丢弃段 */
+  size_t low = 0;
+  size_t high = gaps_.size();
+  while (low < high) {
+    size_t middle = (low + high) / 2;
+    if (gaps_[middle].offsetMs <= uploadedMs) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  if (low > 0) {
+    droppedMs = gaps_[low - 1].droppedMs;
+  }
+#if defined(_MSC_VER)
+  ReleaseMutex(mtx_gaps_);
+#else
+  pthread_mutex_unlock(&mtx_gaps_);
+#endif
+  return (int)(uploadedMs + droppedMs);
+}
+
+bool NlsVad::isSpeechFrame(const uint8_t* frame, size_t frameSize) {
+  size_t samples = frameSize / 2;
+  if (samples == 0) {
+    return false;
+  }
+
+  double sum = 0;
+  size_t crossings = 0;
+  int16_t last = 0;
+  for (size_t i = 0; i < samples; i++) {
+    int16_t sample = (int16_t)(frame[2 * i] | (frame[2 * i + 1] << 8));
+    sum += (double)sample * sample;
+    if (i > 0 && ((sample >= 0) != (last >= 0))) {
+      crossings++;
+    }
+    last = sample;
+  }
+
+  double energy = sum / samples;
+  if (energy > energy_threshold_) {
+    return true;
+  }
+  if (energy > energy_threshold_ * VAD_UNVOICED_ENERGY_RATIO &&
+      samples > 1) {
+    size_t zcr = crossings * 1000 / (samples - 1);
+    return zcr > (size_t)param_.zcrThreshold;
+  }
+  return false;
+}
+
+/*
+ * 语音帧及hangover内的静音帧原样上传;
+ * 超过hangover的静音帧, MUTE模式置零上传, DROP模式丢弃并定期补发保活帧.
+ */
+void NlsVad::processFrame(const uint8_t* frame, size_t frameSize,
+                          std::vector<uint8_t>& output) {
+  if (frameSize == frame_bytes_) {
+    if (isSpeechFrame(frame, frameSize)) {
+      silence_ms_ = 0;
+      atomicAdd64(&speech_frames_, 1);
+    } else {
+      silence_ms_ += VAD_FRAME_MS;
+      atomicAdd64(&silence_frames_, 1);
+    }
+  }
+
+  if (silence_ms_ <= param_.hangoverMs) {
+    output.insert(output.end(), frame, frame + frameSize);
+    atomicAdd64(&speech_bytes_, (int64_t)frameSize);
+    uploaded_bytes_ += frameSize;
+    keep_alive_ms_ = 0;
+    return;
+  }
+
+  if (param_.mode == VAD_MODE_MUTE) {
+    output.resize(output.size() + frameSize, 0);
+    atomicAdd64(&muted_bytes_, (int64_t)frameSize);
+    uploaded_bytes_ += frameSize;
+    return;
+  }
+
+  atomicAdd64(&dropped_bytes_, (int64_t)frameSize);
+  recordDropped((int64_t)frameSize * 1000 / ((int64_t)sample_rate_ * 2));
+  keep_alive_ms_ += VAD_FRAME_MS;
+  if (param_.keepAliveMs > 0 && keep_alive_ms_ >= param_.keepAliveMs) {
+    size_t keepAliveBytes = frame_bytes_ * VAD_KEEP_ALIVE_FRAMES;
+    output.resize(output.size() + keepAliveBytes, 0);
+    atomicAdd64(&keep_alive_bytes_, (int64_t)keepAliveBytes);
+    uploaded_bytes_ += keepAliveBytes;
+    /* 保活帧占用上传时间轴但不属于原始音频 */
+    recordDropped(-(int64_t)VAD_FRAME_MS * VAD_KEEP_ALIVE_FRAMES);
+    keep_alive_ms_ = 0;
+  }
+}
+
+size_t NlsVad::process(const uint8_t* data, size_t dataSize,
+                       std::vector<uint8_t>& output) {
+  size_t before = output.size();
+  atomicAdd64(&input_bytes_, (int64_t)dataSize);
+
+  if (pending_size_ > 0) {
+    size_t copy = frame_bytes_ - pending_size_;
+    if (copy > dataSize) copy = dataSize;
+    memcpy(&pending_[pending_size_], data, copy);
+    pending_size_ += copy;
+    data += copy;
+    dataSize -= copy;
+    if (pending_size_ < frame_bytes_) {
+      return 0;
+    }
+    processFrame(&pending_[0], frame_bytes_, output);
+    pending_size_ = 0;
+  }
+
+  while (dataSize >= frame_bytes_) {
+    processFrame(data, frame_bytes_, output);
+    data += frame_bytes_;
+    dataSize -= frame_bytes_;
+  }
+
+  if (dataSize > 0) {
+    memcpy(&pending_[0], data, dataSize);
+    pending_size_ = dataSize;
+  }
+
+  return output.size() - before;
+}
+
+size_t NlsVad::flush(std::vector<uint8_t>& output) {
+  size_t before = output.size();
+  if (pending_size_ > 0) {
+    /* 尾部不足一帧, 沿用上一帧的判决 */
+    processFrame(&pending_[0], pending_size_, output);
+    pending_size_ = 0;
+  }
+  return output.size() - before;
+}
+
+void NlsVad::clearStats() {
+  atomicStore64(&input_bytes_, 0);
+  atomicStore64(&speech_bytes_, 0);
+  atomicStore64(&muted_bytes_, 0);
+  atomicStore64(&dropped_bytes_, 0);
+  atomicStore64(&keep_alive_bytes_, 0);
+  atomicStore64(&speech_frames_, 0);
+  atomicStore64(&silence_frames_, 0);
+}
+
+void NlsVad::getStats(NlsVadStats* stats) {
+  if (stats) {
+    stats->inputBytes = (uint64_t)atomicLoad64(&input_bytes_);
+    stats->speechBytes = (uint64_t)atomicLoad64(&speech_bytes_);
+    stats->mutedBytes = (uint64_t)atomicLoad64(&muted_bytes_);
+    stats->droppedBytes = (uint64_t)atomicLoad64(&dropped_bytes_);
+    stats->keepAliveBytes = (uint64_t)atomicLoad64(&keep_alive_bytes_);
+    stats->speechFrames = (uint64_t)atomicLoad64(&speech_frames_);
+    stats->silenceFrames = (uint64_t)atomicLoad64(&silence_frames_);
+  }
+}
+
+}
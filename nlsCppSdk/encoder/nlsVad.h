@@ -0,0 +1,130 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ALIBABA_NLS_VAD_H
+#define ALIBABA_NLS_VAD_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "nlsGlobal.h"
+#include "nlsAtomic.h"
+
+namespace AlibabaNls {
+
+/*
+ * 基于短时能量与过零率的客户端静音检测, 输入为16bit单声道小端PCM.
+ * 按10ms分帧判决, 不足一帧的数据留待下次输入, 输出始终按帧对齐.
+ */
+class NlsVad {
+ public:
+  NlsVad();
+  ~NlsVad();
+
+  /*
+   * @brief 按采样率及参数初始化, 并清空状态与统计
+   * @return 成功返回0，参数非法返回-1并关闭检测
+   */
+  int init(int sampleRate, const NlsVadParam& param);
+
+  /* @brief 清空帧缓存与检测状态, 保留参数与统计 */
+  void reset();
+
+  inline bool isEnabled() { return param_.mode != VAD_MODE_NONE; }
+
+  /*
+   * @brief 检测一段PCM, 需上传的数据追加到output
+   * @return 追加到output的字节数
+   */
+  size_t process(const uint8_t* data, size_t dataSize,
+                 std::vector<uint8_t>& output);
+
+  /*
+   * @brief 处理缓存中不足一帧的尾部数据, 在stop前调用
+   * @return 追加到output的字节数
+   */
+  size_t flush(std::vector<uint8_t>& output);
+
+  /* 可在其他线程调用, 各项计数单独原子读取 */
+  void getStats(NlsVadStats* stats);
+
+  /* @brief 是否有被丢弃的静音段, 仅VAD_MODE_DROP下为true */
+  inline bool hasDropped() {
+    return utility::atomicLoadRelaxed(&has_gaps_) != 0;
+  }
+
+  /*
+   * @brief 将服务端时间(上传音频中的毫秒)换算为原始音频中的毫秒,
+   *        加上该时刻之前被丢弃的静音时长. 可在其他线程调用.
+   */
+  int rebaseTime(int uploadedMs);
+
+ private:
+  /* 上传音频offsetMs处之前累计丢弃了droppedMs */
+  struct Gap {
+    int64_t offsetMs;
+    int64_t droppedMs;
+  };
+
+  void recordDropped(int64_t droppedMs);
+
+  bool isSpeechFrame(const uint8_t* frame, size_t frameSize);
+  void processFrame(const uint8_t* frame, size_t frameSize,
+                    std::vector<uint8_t>& output);
+  void clearStats();
+
+  NlsVadParam param_;
+  int sample_rate_;
+  size_t frame_bytes_;
+  /* 10ms帧能量门限, 即帧内样本平方和均值 */
+  double energy_threshold_;
+
+  /* 不足一帧的缓存 */
+  std::vector<uint8_t> pending_;
+  size_t pending_size_;
+
+  int silence_ms_;
+  int keep_alive_ms_;
+
+  /* 已上传的字节数及丢弃段, 处理线程写入, rebaseTime在事件线程读取 */
+  uint64_t uploaded_bytes_;
+  std::vector<Gap> gaps_;
+  volatile long has_gaps_;
+#if defined(_MSC_VER)
+  HANDLE mtx_gaps_;
+#else
+  pthread_mutex_t mtx_gaps_;
+#endif
+
+  /* 统计计数, 处理线程原子累加, getStats可在其他线程读取 */
+  volatile int64_t input_bytes_;
+  volatile int64_t speech_bytes_;
+  volatile int64_t muted_bytes_;
+  volatile int64_t dropped_bytes_;
+  volatile int64_t keep_alive_bytes_;
+  volatile int64_t speech_frames_;
+  volatile int64_t silence_frames_;
+};
+
+}
+
+#endif //ALIBABA_NLS_VAD_H
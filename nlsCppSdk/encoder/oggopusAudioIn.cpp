@@ -35,6 +35,7 @@
 namespace AlibabaNls {
 
 // return: sample number actually read
+// src_buffer由调用者持有, 这里只前移读位置, 读完置为NULL
 int ReadBuffer(char *requested_buffer, int requested_len, char **src_buffer,
                int *length) {
   if (*length == 0 || NULL == *src_buffer)
@@ -42,26 +43,16 @@ int ReadBuffer(char *requested_buffer, int requested_len, char **src_buffer,
 
   // input length is smaller than the length requested
   if (*length < requested_len) {
-    memcpy(requested_buffer, *src_buffer, *length);
     requested_len = *length;
-    *length = 0;
-    free(*src_buffer);
-    *src_buffer = NULL;
-    return requested_len / 2;
   }
 
   memcpy(requested_buffer, *src_buffer, requested_len);
 
-  // save the left data to tmp buffer
   *length = *length - requested_len;
   if (*length > 0) {
-    char *tmp_buffer = (char *)malloc(*length);
-    memcpy(tmp_buffer, *src_buffer + requested_len, *length);
-    free(*src_buffer);
-    *src_buffer = tmp_buffer;
+    *src_buffer = *src_buffer + requested_len;
   } else {
     *length = 0;
-    free(*src_buffer);
     *src_buffer = NULL;
   }
 
@@ -102,9 +102,37 @@ OggOpusDataEncoder::OggOpusDataEncoder() :
   sample_rate_(16000),
   frame_sample_num_(320),
   frame_sample_bytes_(640),
+  zero_frame_(NULL),
+  zero_frame_bytes_(0),
   encoder_bitrate_(16000),
   channel_num_(1),
-  encoder_complexity_(8) {
+  encoder_complexity_(8),
+  encoder_vbr_(true),
+  encoder_dtx_(false) {
+}
+
+int OggOpusDataEncoder::ApplyEncoderCtl() {
+  if (ogg_opus_para_ == NULL ||
+      ogg_opus_para_->opus_multistream_encoder == NULL) {
+    return 0;
+  }
+
+  OpusMSEncoder *encoder = ogg_opus_para_->opus_multistream_encoder;
+  ogg_opus_para_->bitrate = encoder_bitrate_;
+  ogg_opus_para_->complexity = encoder_complexity_;
+  if (opus_multistream_encoder_ctl(
+          encoder, OPUS_SET_BITRATE(encoder_bitrate_)) != OPUS_OK ||
+      opus_multistream_encoder_ctl(
+          encoder, OPUS_SET_VBR(encoder_vbr_ ? 1 : 0)) != OPUS_OK ||
+      opus_multistream_encoder_ctl(
+          encoder, OPUS_SET_COMPLEXITY(encoder_complexity_)) != OPUS_OK ||
+      opus_multistream_encoder_ctl(
+          encoder, OPUS_SET_DTX(encoder_dtx_ ? 1 : 0)) != OPUS_OK) {
+    LOG_ERROR("apply encoder ctl failed, bitrate %d complexity %d vbr %d dtx %d",
+        encoder_bitrate_, encoder_complexity_, encoder_vbr_, encoder_dtx_);
+    return -1;
+  }
+  return 0;
 }
 
 void OggOpusDataEncoder::ResetParameters(
@@ -238,7 +266,7 @@ int OggOpusDataEncoder::OggopusEncoderCreate(
 
   ret = opus_multistream_encoder_ctl(
       ogg_opus_para_->opus_multistream_encoder,
-      OPUS_SET_VBR(true));
+      OPUS_SET_VBR(encoder_vbr_ ? 1 : 0));
   if (ret != OPUS_OK) {
     LOG_ERROR("error OPUS_SET_VBR returned: %s", opus_strerror(ret));
     exit(1);
@@ -262,6 +290,14 @@ int OggOpusDataEncoder::OggopusEncoderCreate(
     exit(1);
   }
 
+  ret = opus_multistream_encoder_ctl(
+      ogg_opus_para_->opus_multistream_encoder,
+      OPUS_SET_DTX(encoder_dtx_ ? 1 : 0));
+  if (ret != OPUS_OK) {
+    LOG_ERROR("error OPUS_SET_DTX returned: %s", opus_strerror(ret));
+    exit(1);
+  }
+
   ret = opus_multistream_encoder_ctl(
       ogg_opus_para_->opus_multistream_encoder,
       OPUS_SET_PACKET_LOSS_PERC(0));
@@ -322,15 +358,14 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
   }
 
   int ret = 0;
+  /* read_func只读取并前移该指针, 不再拷贝输入数据 */
   char *tmp_buf = NULL;
   // short *tmp_2 = (short *)input_data;
   int tmp_length = 0;
   if (is_first_frame_processed_ && (length > 0)) {
     // the first frame has been processed
     tmp_length = length;
-    tmp_buf = reinterpret_cast<char *>(malloc(tmp_length));
-    memset(tmp_buf, 0, tmp_length);
-    memcpy(tmp_buf, input_data, tmp_length);
+    tmp_buf = const_cast<char *>(input_data);
   } else {
     // 第一帧
     if (length == frame_sample_bytes_) {
@@ -384,10 +419,14 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
         }
       } // while
 
-      tmp_length = length * 2;
-      tmp_buf = reinterpret_cast<char *>(malloc(tmp_length));
-      memset(tmp_buf, 0, tmp_length);
-      memcpy(tmp_buf + length, input_data, length); // 音频数据封入
+      // 第一帧编码一帧静音, 与头信息一起输出
+      if (zero_frame_bytes_ < length) {
+        free(zero_frame_);
+        zero_frame_ = reinterpret_cast<char *>(calloc(length, 1));
+        zero_frame_bytes_ = zero_frame_ ? length : 0;
+      }
+      tmp_length = zero_frame_bytes_ < length ? zero_frame_bytes_ : length;
+      tmp_buf = zero_frame_;
       is_first_frame_processed_ = true;
     } else {  // input length is invalid
       ogg_opus_para_->op.e_o_s = 1;
@@ -417,7 +456,8 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
     /*Avoid making the final packet 20ms or more longer than needed.*/
     cur_frame_size -= ((cur_frame_size -
                         (ogg_opus_para_->nb_samples >= 0 ?
-                         ogg_opus_para_->nb_samples : 1)) / 320) * 320;
+                         ogg_opus_para_->nb_samples : 1)) / (sample_rate_ / 50)) *
+                      (sample_rate_ / 50);
     /*No fancy end padding, just fill with zeros for now.*/
     for (int i = ogg_opus_para_->nb_samples * channel_num_;
          i < cur_frame_size * channel_num_; i++) {
@@ -428,10 +468,6 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
   if (cur_frame_size <= 0) {
     LOG_WARN("cur_frame_size = %d, nb_samples = %d", cur_frame_size,
          ogg_opus_para_->nb_samples);
-    if (tmp_buf) {
-      free(tmp_buf);
-      tmp_buf = NULL;
-    }
     return kNlsOpusEncodeFailed;
   }
 
@@ -447,13 +483,10 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
          ogg_opus_para_->nbBytes, opus_strerror(ogg_opus_para_->nbBytes));
     LOG_INFO("cur_frame_size = %d", cur_frame_size);
     LOG_INFO("ogg_opus_para_->nbBytes = %d", ogg_opus_para_->nbBytes);
-    if (tmp_buf) {
-      free(tmp_buf);
-      tmp_buf = NULL;
-    }
     return kNlsOpusEncodeFailed;
   }
-  ogg_opus_para_->enc_granulepos += 320 * 3;
+  /* granulepos以48kHz计数 */
+  ogg_opus_para_->enc_granulepos += frame_sample_num_ * 48000 / sample_rate_;
   size_segments = (ogg_opus_para_->nbBytes + 255) / 255;
 
   /*Flush early if adding this packet would make us end up with a
@@ -473,10 +506,6 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
     ret = ogg_opus_para_->WritePage();
     if (ret != ogg_opus_para_->og.header_len + ogg_opus_para_->og.body_len) {
       LOG_ERROR("error: failed writing data to output stream");
-      if (tmp_buf) {
-        free(tmp_buf);
-        tmp_buf = NULL;
-      }
       return kNlsOpusEncodeFailed;
     }
   }
@@ -514,7 +543,8 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
   /*If the stream is over or we're sure that the delayed flush will fire,
     go ahead and flush now to avoid adding delay.*/
   while ((ogg_opus_para_->op.e_o_s ||
-          (ogg_opus_para_->enc_granulepos + (320 * 3) -
+          (ogg_opus_para_->enc_granulepos +
+           (frame_sample_num_ * 48000 / sample_rate_) -
            ogg_opus_para_->last_granulepos > ogg_opus_para_->max_ogg_delay) ||
           (ogg_opus_para_->last_segments >= 255)) ?
          ogg_stream_flush_fill(&ogg_opus_para_->os, &ogg_opus_para_->og,
@@ -530,17 +560,9 @@ int OggOpusDataEncoder::OggopusEncode(const char *input_data, int length) {
     ret = ogg_opus_para_->WritePage();
     if (ret != ogg_opus_para_->og.header_len + ogg_opus_para_->og.body_len) {
       LOG_ERROR("error: failed writing data to output stream");
-      if (tmp_buf) {
-        free(tmp_buf);
-        tmp_buf = NULL;
-      }
       return kNlsOpusEncodeFailed;
     }
   }
-  if (tmp_buf) {
-    free(tmp_buf);
-    tmp_buf = NULL;
-  }
 
   return kNlsOk;
 }
@@ -581,7 +603,12 @@ int OggOpusDataEncoder::OggopusDestroy() {
   return kNlsOk;
 }
 
-OggOpusDataEncoder::~OggOpusDataEncoder() {}
+OggOpusDataEncoder::~OggOpusDataEncoder() {
+  if (zero_frame_) {
+    free(zero_frame_);
+    zero_frame_ = NULL;
+  }
+}
 
 }  // namespace AlibabaNls
 
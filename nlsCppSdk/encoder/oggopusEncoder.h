@@ -102,23 +102,39 @@ class OggOpusDataEncoder {
     frame_sample_bytes_ = frame_sample_num_ * 2;
   }
 
+  /* 以下编码参数在编码器已创建时立即生效, 否则在创建时生效 */
   void SetBitrate(int bitrate) {
     encoder_bitrate_ = bitrate;
+    ApplyEncoderCtl();
   }
   int GetBitrate() const { return encoder_bitrate_; }
   
   void SetComplexity(int complexity) {
     encoder_complexity_ = complexity;
+    ApplyEncoderCtl();
   }
   int GetComplexity() const { return encoder_complexity_; }
 
+  void SetVbr(bool vbr) {
+    encoder_vbr_ = vbr;
+    ApplyEncoderCtl();
+  }
+  bool GetVbr() const { return encoder_vbr_; }
+
+  void SetDtx(bool dtx) {
+    encoder_dtx_ = dtx;
+    ApplyEncoderCtl();
+  }
+  bool GetDtx() const { return encoder_dtx_; }
+
   void SetFrameSampleBytes(int bytes) {
-    if (bytes != frame_sample_bytes_) {
-      frame_sample_bytes_ = bytes;
-      frame_sample_num_ = bytes / 2;
+    frame_sample_bytes_ = bytes;
+    frame_sample_num_ = bytes / 2;
+    /* SetSampleRate()会把帧长复位为20ms, 因此这里总是按新帧长重新分配 */
+    if (ogg_opus_para_) {
       if (frame_sample_bytes_ > ogg_opus_para_->max_frame_bytes) {
         ogg_opus_para_->max_frame_bytes = frame_sample_bytes_ * 2;
-        if (ogg_opus_para_ && ogg_opus_para_->packet) {
+        if (ogg_opus_para_->packet) {
           ogg_opus_para_->packet = reinterpret_cast<unsigned char *>(
               realloc(ogg_opus_para_->packet,
                       sizeof(unsigned char) * ogg_opus_para_->max_frame_bytes));
@@ -141,6 +157,7 @@ class OggOpusDataEncoder {
  private:
   void ResetParameters(EncodedDataCallback encoded_data_callback,
                        void *user_data);
+  int ApplyEncoderCtl();
 
  private:
   OggOpusDataEncoderPara *ogg_opus_para_;
@@ -148,9 +165,13 @@ class OggOpusDataEncoder {
   int sample_rate_;
   int frame_sample_num_;
   int frame_sample_bytes_;
+  char *zero_frame_;
+  int zero_frame_bytes_;
   int channel_num_;
   int encoder_bitrate_;
   int encoder_complexity_;
+  bool encoder_vbr_;
+  bool encoder_dtx_;
 };
 
 } // namespace AlibabaNls
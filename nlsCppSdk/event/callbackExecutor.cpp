@@ -0,0 +1,792 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#ifdef _MSC_VER
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sys/prctl.h>
+#endif
+
+#include "nlsGlobal.h"
+#include "nlsAtomic.h"
+#include "utility.h"
+#include "nlog.h"
+#include "workThread.h"
+#include "connectNode.h"
+#include "nlsRequestPool.h"
+#include "callbackExecutor.h"
+
+namespace AlibabaNls {
+
+#define CALLBACK_RING_BATCH 32
+#define CALLBACK_SLOW_THRESHOLD_US 100000
+#define CALLBACK_MAX_THREADS 64
+
+CallbackWorker* CallbackExecutor::_workerArray = NULL;
+size_t CallbackExecutor::_workersNumber = 0;
+volatile long CallbackExecutor::_roundRobin = 0;
+
+bool CallbackExecutor::_configured = false;
+int CallbackExecutor::_configThreads = 1;
+int CallbackExecutor::_configQueueSize = 1024;
+int CallbackExecutor::_configMaxOverflow = 16384;
+CallbackOverflowPolicy CallbackExecutor::_policy = CallbackOverflowQueue;
+
+volatile int64_t CallbackExecutor::_dispatchedCount = 0;
+volatile int64_t CallbackExecutor::_executedCount = 0;
+volatile int64_t CallbackExecutor::_droppedCount = 0;
+volatile int64_t CallbackExecutor::_overflowCount = 0;
+volatile int64_t CallbackExecutor::_slowCount = 0;
+volatile int64_t CallbackExecutor::_totalDurationUs = 0;
+volatile int64_t CallbackExecutor::_maxDurationUs = 0;
+volatile int64_t CallbackExecutor::_queueDepth = 0;
+volatile int64_t CallbackExecutor::_peakQueueDepth = 0;
+
+#if defined(_MSC_VER)
+HANDLE CallbackExecutor::_mtxExecutor = CreateMutex(NULL, FALSE, NULL);
+#else
+pthread_mutex_t CallbackExecutor::_mtxExecutor = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* 溢出任务计入内存统计的字节数, 按事件内容估算 */
+static size_t overflowBytes(NlsEvent* event) {
+  size_t bytes = sizeof(CallbackTask);
+  if (event) {
+    bytes += sizeof(NlsEvent);
+    if (event->getMsgType() == NlsEvent::Binary) {
+      int size = 0;
+      event->getBinaryDataBuffer(&size);
+      bytes += (size_t)size;
+    } else {
+      bytes += strlen(event->getAllResponse());
+    }
+  }
+  return bytes;
+}
+
+CallbackRing::CallbackRing()
+    : _slots(NULL), _mask(0), _head(0), _tail(0), _overflowSize(0),
+      _maxOverflow(0) {
+#if defined(_MSC_VER)
+  _mtxOverflow = CreateMutex(NULL, FALSE, NULL);
+#else
+  pthread_mutex_init(&_mtxOverflow, NULL);
+#endif
+}
+
+CallbackRing::~CallbackRing() {
+  if (_slots) {
+    delete [] _slots;
+    _slots = NULL;
+  }
+#if defined(_MSC_VER)
+  CloseHandle(_mtxOverflow);
+#else
+  pthread_mutex_destroy(&_mtxOverflow);
+#endif
+}
+
+bool CallbackRing::init(size_t capacity, size_t maxOverflow) {
+  size_t realCapacity = 2;
+  while (realCapacity < capacity) {
+    realCapacity <<= 1;
+  }
+
+  _slots = new CallbackTask[realCapacity];
+  _mask = realCapacity - 1;
+  _head = 0;
+  _tail = 0;
+  _maxOverflow = maxOverflow;
+  return _slots != NULL;
+}
+
+bool CallbackRing::push(const CallbackTask& task) {
+  // 只有生产者会增加_overflowSize, 读到旧值只会多走一次溢出队列
+  if (utility::atomicLoadRelaxed(&_overflowSize) > 0) {
+    return false;
+  }
+
+  size_t tail = _tail;
+  size_t head = _head;
+  utility::memoryBarrier();
+  if (tail - head > _mask) {
+    return false;
+  }
+
+  _slots[tail & _mask] = task;
+  utility::memoryBarrier();
+  _tail = tail + 1;
+  return true;
+}
+
+long CallbackRing::pushOverflow(CallbackTask& task, bool dropOldest,
+                                CallbackTask* evicted) {
+  evicted->node = NULL;
+  evicted->event = NULL;
+  evicted->bytes = 0;
+  task.bytes = overflowBytes(task.event);
+
+  long size = -1;
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxOverflow, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxOverflow);
+#endif
+  bool full = _maxOverflow > 0 && _overflow.size() >= _maxOverflow &&
+              !CallbackExecutor::isTerminalTask(task);
+  bool replaced = false;
+  if (full && dropOldest) {
+    // 已被discardNode清除的任务(node为NULL)也可直接移出
+    std::deque<CallbackTask>::iterator it;
+    for (it = _overflow.begin(); it != _overflow.end(); ++it) {
+      if (it->node == NULL || !CallbackExecutor::isTerminalTask(*it)) {
+        *evicted = *it;
+        _overflow.erase(it);
+        _overflowAccount.add(-(int64_t)evicted->bytes);
+        replaced = true;
+        full = false;
+        break;
+      }
+    }
+  }
+  if (!full) {
+    _overflow.push_back(task);
+    _overflowAccount.add((int64_t)task.bytes);
+    if (replaced) {
+      size = utility::atomicLoadRelaxed(&_overflowSize);
+    } else {
+      size = utility::atomicAdd(&_overflowSize, 1);
+    }
+  }
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxOverflow);
+#else
+  pthread_mutex_unlock(&_mtxOverflow);
+#endif
+  return size;
+}
+
+bool CallbackRing::pop(CallbackTask* task) {
+  size_t head = _head;
+  size_t tail = _tail;
+  utility::memoryBarrier();
+  if (head != tail) {
+    *task = _slots[head & _mask];
+    utility::memoryBarrier();
+    _head = head + 1;
+    return true;
+  }
+
+  if (utility::atomicLoadRelaxed(&_overflowSize) == 0) {
+    return false;
+  }
+
+  // 环形队列已取空, 溢出队列中的任务均晚于其中的任务
+  bool found = false;
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxOverflow, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxOverflow);
+#endif
+  if (!_overflow.empty()) {
+    *task = _overflow.front();
+    _overflow.pop_front();
+    _overflowAccount.add(-(int64_t)task->bytes);
+    task->bytes = 0;
+    utility::atomicAdd(&_overflowSize, -1);
+    found = true;
+  }
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxOverflow);
+#else
+  pthread_mutex_unlock(&_mtxOverflow);
+#endif
+  return found;
+}
+
+int CallbackRing::discardNode(ConnectNode* node) {
+  int count = 0;
+  size_t tail = _tail;
+  utility::memoryBarrier();
+  for (size_t i = _head; i != tail; i++) {
+    CallbackTask& task = _slots[i & _mask];
+    if (task.node == node) {
+      delete task.event;
+      task.event = NULL;
+      task.node = NULL;
+      count++;
+    }
+  }
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxOverflow, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxOverflow);
+#endif
+  std::deque<CallbackTask>::iterator it;
+  for (it = _overflow.begin(); it != _overflow.end(); ++it) {
+    if (it->node == node) {
+      delete it->event;
+      it->event = NULL;
+      it->node = NULL;
+      count++;
+    }
+  }
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxOverflow);
+#else
+  pthread_mutex_unlock(&_mtxOverflow);
+#endif
+  return count;
+}
+
+CallbackWorker::CallbackWorker() {
+  _rings = NULL;
+  _ringsNumber = 0;
+  _pending = 0;
+  _sleeping = 0;
+  _running = 0;
+  _currentNode = NULL;
+  _currentNodeReleased = false;
+
+#if defined(_MSC_VER)
+  _wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+  pthread_mutex_init(&_mtxWake, NULL);
+  pthread_cond_init(&_cvWake, NULL);
+#endif
+}
+
+CallbackWorker::~CallbackWorker() {
+  shutdown();
+
+  if (_rings) {
+    delete [] _rings;
+    _rings = NULL;
+  }
+
+#if defined(_MSC_VER)
+  CloseHandle(_wakeEvent);
+#else
+  pthread_mutex_destroy(&_mtxWake);
+  pthread_cond_destroy(&_cvWake);
+#endif
+}
+
+int CallbackWorker::init(size_t ringsNumber, size_t queueSize,
+                         size_t maxOverflow) {
+  _ringsNumber = ringsNumber;
+  _rings = new CallbackRing[_ringsNumber];
+  for (size_t i = 0; i < _ringsNumber; i++) {
+    if (!_rings[i].init(queueSize, maxOverflow)) {
+      LOG_ERROR("CallbackRing init failed.");
+      return -1;
+    }
+  }
+
+  _running = 1;
+#if defined(_MSC_VER)
+  _workerHandle = (HANDLE)_beginthreadex(
+      NULL, 0, loopCallback, (LPVOID)this, 0, &_workerId);
+#else
+  if (pthread_create(&_workerId, NULL, loopCallback, (void*)this) != 0) {
+    LOG_ERROR("Create callback thread failed.");
+    _running = 0;
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+void CallbackWorker::wakeup() {
+  if (utility::atomicLoad(&_sleeping) == 0) {
+    return;
+  }
+
+#if defined(_MSC_VER)
+  SetEvent(_wakeEvent);
+#else
+  pthread_mutex_lock(&_mtxWake);
+  pthread_cond_signal(&_cvWake);
+  pthread_mutex_unlock(&_mtxWake);
+#endif
+}
+
+void CallbackWorker::waitTask() {
+#if defined(_MSC_VER)
+  utility::atomicStore(&_sleeping, 1);
+  if (utility::atomicLoad(&_pending) == 0 &&
+      utility::atomicLoad(&_running)) {
+    WaitForSingleObject(_wakeEvent, INFINITE);
+  }
+  utility::atomicStore(&_sleeping, 0);
+#else
+  pthread_mutex_lock(&_mtxWake);
+  utility::atomicStore(&_sleeping, 1);
+  if (utility::atomicLoad(&_pending) == 0 &&
+      utility::atomicLoad(&_running)) {
+    pthread_cond_wait(&_cvWake, &_mtxWake);
+  }
+  utility::atomicStore(&_sleeping, 0);
+  pthread_mutex_unlock(&_mtxWake);
+#endif
+}
+
+bool CallbackWorker::runOnce() {
+  bool executed = false;
+  CallbackTask task;
+
+  for (size_t i = 0; i < _ringsNumber; i++) {
+    int batch = 0;
+    while (batch < CALLBACK_RING_BATCH && _rings[i].pop(&task)) {
+      CallbackExecutor::executeTask(this, task);
+      executed = true;
+      batch++;
+    }
+  }
+
+  return executed;
+}
+
+void CallbackWorker::discardNode(ConnectNode* node) {
+  int count = 0;
+  for (size_t i = 0; i < _ringsNumber; i++) {
+    count += _rings[i].discardNode(node);
+  }
+  if (node->_eventThread) {
+    count += WorkThread::discardCallbackTasks(node->_eventThread, node);
+  }
+
+  if (_currentNode == node) {
+    _currentNodeReleased = true;
+  }
+
+  if (count > 0) {
+    LOG_WARN("Node:%p released in its own callback, discard %d callbacks.",
+        node, count);
+  }
+}
+
+void CallbackWorker::shutdown() {
+  if (!utility::atomicCompareSwap(&_running, 1, 0)) {
+    return;
+  }
+
+#if defined(_MSC_VER)
+  SetEvent(_wakeEvent);
+  WaitForSingleObject(_workerHandle, INFINITE);
+  CloseHandle(_workerHandle);
+#else
+  pthread_mutex_lock(&_mtxWake);
+  pthread_cond_signal(&_cvWake);
+  pthread_mutex_unlock(&_mtxWake);
+  pthread_join(_workerId, NULL);
+#endif
+
+  // 退出时剩余未执行的回调直接丢弃
+  CallbackTask task;
+  for (size_t i = 0; i < _ringsNumber; i++) {
+    while (_rings[i].pop(&task)) {
+      delete task.event;
+    }
+  }
+}
+
+#if defined(_MSC_VER)
+unsigned __stdcall CallbackWorker::loopCallback(LPVOID arg) {
+#else
+void* CallbackWorker::loopCallback(void* arg) {
+#endif
+  CallbackWorker* worker = (CallbackWorker*)arg;
+
+#if defined(__ANDROID__) || defined (__linux__)
+  sigset_t signal_mask;
+  sigemptyset(&signal_mask);
+  sigaddset(&signal_mask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &signal_mask, NULL);
+
+  prctl(PR_SET_NAME, "callbackThread");
+#endif
+
+  while (utility::atomicLoad(&worker->_running)) {
+    if (!worker->runOnce()) {
+      worker->waitTask();
+    }
+  }
+
+#if defined(_MSC_VER)
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+int CallbackExecutor::setConfig(int threadsNumber, int queueSize,
+                               CallbackOverflowPolicy policy,
+                               int maxOverflowSize) {
+  if (threadsNumber <= 0 || threadsNumber > CALLBACK_MAX_THREADS ||
+      queueSize <= 0 || maxOverflowSize < 0 ||
+      policy < CallbackOverflowQueue || policy > CallbackOverflowDropOldest) {
+    LOG_ERROR("Invalid callback executor config: %d %d %d %d.",
+        threadsNumber, queueSize, (int)policy, maxOverflowSize);
+    return -1;
+  }
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxExecutor, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxExecutor);
+#endif
+
+  int ret = -1;
+  if (!_configured) {
+    _configured = true;
+    _configThreads = threadsNumber;
+    _configQueueSize = queueSize;
+    _configMaxOverflow = maxOverflowSize;
+    _policy = policy;
+    ret = 0;
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxExecutor);
+#else
+  pthread_mutex_unlock(&_mtxExecutor);
+#endif
+  return ret;
+}
+
+int CallbackExecutor::initCallbackExecutor(size_t loopsNumber) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxExecutor, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxExecutor);
+#endif
+
+  int ret = 0;
+  if (_configured && _workerArray == NULL && loopsNumber > 0) {
+    _workerArray = new CallbackWorker[_configThreads];
+    _workersNumber = _configThreads;
+    for (size_t i = 0; i < _workersNumber; i++) {
+      if (_workerArray[i].init(loopsNumber, _configQueueSize,
+                               _configMaxOverflow) < 0) {
+        ret = -1;
+      }
+    }
+
+    if (ret < 0) {
+      delete [] _workerArray;
+      _workerArray = NULL;
+      _workersNumber = 0;
+    } else {
+      LOG_INFO("Callback executor threads:%d, queue size:%d, policy:%d, "
+          "max overflow:%d.", _configThreads, _configQueueSize, _policy,
+          _configMaxOverflow);
+    }
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxExecutor);
+#else
+  pthread_mutex_unlock(&_mtxExecutor);
+#endif
+  return ret;
+}
+
+void CallbackExecutor::destroyCallbackExecutor() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxExecutor, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxExecutor);
+#endif
+
+  if (_workerArray) {
+    LOG_INFO("destroy CallbackExecutor begin.");
+    CallbackWorker* workers = _workerArray;
+    _workerArray = NULL;
+    delete [] workers;
+    _workersNumber = 0;
+  }
+  _configured = false;
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxExecutor);
+#else
+  pthread_mutex_unlock(&_mtxExecutor);
+#endif
+}
+
+bool CallbackExecutor::isEnabled() {
+  return _workerArray != NULL;
+}
+
+CallbackWorker* CallbackExecutor::currentWorker() {
+  for (size_t i = 0; i < _workersNumber; i++) {
+#if defined(_MSC_VER)
+    if (GetCurrentThreadId() == _workerArray[i]._workerId) {
+#else
+    if (pthread_equal(pthread_self(), _workerArray[i]._workerId)) {
+#endif
+      return &_workerArray[i];
+    }
+  }
+  return NULL;
+}
+
+int CallbackExecutor::dispatch(ConnectNode* node, NlsEvent* event) {
+  if (_workerArray == NULL || node == NULL || event == NULL) {
+    return -1;
+  }
+
+  WorkThread* loop = node->_eventThread;
+  if (loop == NULL || loop->_threadIndex >= _workerArray[0]._ringsNumber) {
+    return -1;
+  }
+
+  long index = utility::atomicLoad(&node->_callbackWorker);
+  if (index < 0) {
+    long chosen = (utility::atomicAdd(&_roundRobin, 1) - 1) % _workersNumber;
+    if (node->_affinityNode != NULL) {
+      // 与关联node共用回调线程, 保证多路事件按到达顺序回调
+      ConnectNode* owner = node->_affinityNode;
+      utility::atomicCompareSwap(&owner->_callbackWorker, -1, chosen);
+      long shared = utility::atomicLoad(&owner->_callbackWorker);
+      if (shared >= 0) chosen = shared;
+    }
+    utility::atomicCompareSwap(&node->_callbackWorker, -1, chosen);
+  }
+
+  CallbackTask task;
+  task.node = node;
+  task.event = event;
+  task.bytes = 0;
+
+  utility::atomicAdd(&node->_pendingCallbacks, 1);
+
+#if defined(_MSC_VER)
+  bool onLoop = (GetCurrentThreadId() == loop->_workThreadId);
+#else
+  bool onLoop = pthread_equal(pthread_self(), loop->_workThreadId);
+#endif
+  if (onLoop) {
+    enqueue(loop, task);
+  } else {
+    // 交给事件线程入队, 排在事件线程此前产生的回调之后
+    WorkThread::insertCallbackTask(loop, task);
+  }
+  return 0;
+}
+
+void CallbackExecutor::dispatchLoopTasks(WorkThread* loop) {
+  if (_workerArray == NULL) {
+    return;
+  }
+
+  CallbackTask task;
+  while (WorkThread::getCallbackTask(loop, &task)) {
+    enqueue(loop, task);
+  }
+}
+
+int CallbackExecutor::dispatchRecycle(ConnectNode* node) {
+  if (_workerArray == NULL || node == NULL) {
+    return -1;
+  }
+
+  WorkThread* loop = node->_eventThread;
+  long index = utility::atomicLoad(&node->_callbackWorker);
+  if (loop == NULL || loop->_threadIndex >= _workerArray[0]._ringsNumber ||
+      index < 0 || !utility::atomicLoad(&_workerArray[index]._running)) {
+    return -1;
+  }
+
+  // 非事件线程已投递的回调先入队, 回收任务排在其后
+  dispatchLoopTasks(loop);
+  if (utility::atomicLoad(&node->_pendingCallbacks) <= 0) {
+    return -1;
+  }
+
+  CallbackTask task;
+  task.node = node;
+  task.event = NULL;
+  task.bytes = 0;
+  enqueue(loop, task);
+  return 0;
+}
+
+void CallbackExecutor::enqueue(WorkThread* loop, CallbackTask& task) {
+  ConnectNode* node = task.node;
+  NlsEvent* event = task.event;
+  CallbackWorker* worker =
+      &_workerArray[utility::atomicLoad(&node->_callbackWorker)];
+  CallbackRing* ring = &worker->_rings[loop->_threadIndex];
+
+  if (!utility::atomicLoad(&worker->_running)) {
+    if (event) {
+      delete event;
+      node->finishCallback();
+    }
+    return;
+  }
+
+  // 队列满时事件线程不等待: 按策略丢弃中间结果, 其余转入限长的溢出队列
+  if (!ring->push(task)) {
+    if (event && _policy == CallbackOverflowDropIntermediate &&
+        (event->getMsgType() == NlsEvent::TranscriptionResultChanged ||
+         event->getMsgType() == NlsEvent::RecognitionResultChanged)) {
+      delete event;
+      node->finishCallback();
+      utility::atomicAdd64(&_droppedCount, 1);
+      return;
+    }
+
+    CallbackTask evicted;
+    long size = ring->pushOverflow(
+        task, _policy == CallbackOverflowDropOldest, &evicted);
+    if (size < 0) {
+      // 溢出队列已满, 丢弃新到的非结束类事件
+      delete event;
+      node->finishCallback();
+      if (utility::atomicAdd64(&_droppedCount, 1) == 1) {
+        LOG_WARN("Node:%p callback overflow queue is full, drop callbacks.",
+            node);
+      }
+      return;
+    }
+
+    utility::atomicAdd64(&_overflowCount, 1);
+    if (size == 1) {
+      LOG_WARN("Node:%p callback queue is full, use overflow queue.", node);
+    }
+    if (evicted.bytes > 0) {
+      // 移出的任务不再执行, 已计入的队列深度及待执行数一并扣除
+      if (evicted.node) {
+        delete evicted.event;
+        evicted.node->finishCallback();
+        utility::atomicAdd64(&_droppedCount, 1);
+      }
+      utility::atomicAdd64(&_queueDepth, -1);
+      utility::atomicAdd(&worker->_pending, -1);
+    }
+  }
+
+  int64_t depth = utility::atomicAdd64(&_queueDepth, 1);
+  utility::atomicMax64(&_peakQueueDepth, depth);
+  if (event) {
+    utility::atomicAdd64(&_dispatchedCount, 1);
+  }
+
+  utility::atomicAdd(&worker->_pending, 1);
+  worker->wakeup();
+}
+
+void CallbackExecutor::executeTask(CallbackWorker* worker, CallbackTask& task) {
+  if (task.node != NULL && task.event == NULL) {
+    // 回收任务, node之前的回调均已执行
+    NlsRequestPool::recycle(task.node->_request);
+  } else if (task.node != NULL) {
+    ConnectNode* node = task.node;
+    worker->_currentNode = node;
+    worker->_currentNodeReleased = false;
+
+    uint64_t begin = utility::getMonotonicUs();
+    if (node->getExitStatus() != ExitCancel) {
+      node->_handler->handlerFrame(*task.event);
+    }
+    int64_t duration = (int64_t)(utility::getMonotonicUs() - begin);
+
+    delete task.event;
+    task.event = NULL;
+
+    // node已在自身回调中被释放, 不可再访问
+    if (!worker->_currentNodeReleased) {
+      node->finishCallback();
+    }
+    worker->_currentNode = NULL;
+
+    utility::atomicAdd64(&_executedCount, 1);
+    utility::atomicAdd64(&_totalDurationUs, duration);
+    utility::atomicMax64(&_maxDurationUs, duration);
+    if (duration >= CALLBACK_SLOW_THRESHOLD_US) {
+      utility::atomicAdd64(&_slowCount, 1);
+      LOG_WARN("Slow callback cost %lldus.", (long long)duration);
+    }
+  }
+
+  utility::atomicAdd64(&_queueDepth, -1);
+  utility::atomicAdd(&worker->_pending, -1);
+}
+
+void CallbackExecutor::drainNode(ConnectNode* node) {
+  if (_workerArray == NULL || node == NULL) {
+    return;
+  }
+
+  if (utility::atomicLoad(&node->_pendingCallbacks) <= 0) {
+    return;
+  }
+
+  long index = utility::atomicLoad(&node->_callbackWorker);
+  CallbackWorker* self = currentWorker();
+  if (self != NULL && index >= 0 && self == &_workerArray[index]) {
+    // 在该request自身的回调线程中释放, 无法等待, 丢弃剩余回调
+    self->discardNode(node);
+    return;
+  }
+
+  LOG_DEBUG("Node:%p wait %ld callbacks done.",
+      node, utility::atomicLoad(&node->_pendingCallbacks));
+  node->waitCallbacks();
+}
+
+bool CallbackExecutor::isTerminalTask(const CallbackTask& task) {
+  if (task.event == NULL) {
+    return true;
+  }
+  switch (task.event->getMsgType()) {
+    case NlsEvent::TaskFailed:
+    case NlsEvent::RecognitionCompleted:
+    case NlsEvent::WakeWordVerificationCompleted:
+    case NlsEvent::TranscriptionCompleted:
+    case NlsEvent::SynthesisCompleted:
+    case NlsEvent::DialogResultGenerated:
+    case NlsEvent::Close:
+      return true;
+    default:
+      return false;
+  }
+}
+
+int CallbackExecutor::getStats(NlsCallbackExecutorStats* stats) {
+  if (stats == NULL || _workerArray == NULL) {
+    return -1;
+  }
+
+  stats->dispatchedCount = utility::atomicLoad64(&_dispatchedCount);
+  stats->executedCount = utility::atomicLoad64(&_executedCount);
+  stats->droppedCount = utility::atomicLoad64(&_droppedCount);
+  stats->overflowCount = utility::atomicLoad64(&_overflowCount);
+  stats->slowCount = utility::atomicLoad64(&_slowCount);
+  stats->totalDurationUs = utility::atomicLoad64(&_totalDurationUs);
+  stats->maxDurationUs = utility::atomicLoad64(&_maxDurationUs);
+  stats->queueDepth = utility::atomicLoad64(&_queueDepth);
+  stats->peakQueueDepth = utility::atomicLoad64(&_peakQueueDepth);
+  return 0;
+}
+
+}  // namespace AlibabaNls
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_CALLBACK_EXECUTOR_H
+#define NLS_SDK_CALLBACK_EXECUTOR_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <deque>
+#include <stdint.h>
+#include "nlsClient.h"
+#include "nlsEvent.h"
+#include "nlsMemory.h"
+
+namespace AlibabaNls {
+
+class ConnectNode;
+class WorkThread;
+
+/* event为NULL时为回收任务, 排在node最后一个回调之后回收request */
+struct CallbackTask {
+  ConnectNode* node;
+  NlsEvent* event;
+  size_t bytes;  // 在溢出队列中时计入内存统计的字节数
+};
+
+/*
+ * 单生产者单消费者环形队列.
+ * 生产者为某一个WorkThread, 消费者为某一个CallbackWorker.
+ * 环形队列满时任务转入带锁的溢出队列, 生产者不等待;
+ * 溢出队列非空期间新任务也进入溢出队列, 消费者取空环形队列后再取溢出队列,
+ * 整体仍按入队顺序执行. 溢出队列限长, 占用的内存计入进程缓冲总量.
+ */
+class CallbackRing {
+ public:
+  CallbackRing();
+  ~CallbackRing();
+
+  /* @param maxOverflow 溢出队列长度上限, 0为不限制 */
+  bool init(size_t capacity, size_t maxOverflow);
+  /* 环形队列已满或溢出队列非空时返回false */
+  bool push(const CallbackTask& task);
+  /*
+   * 放入溢出队列, 返回溢出队列长度; 队列已满时返回-1, 任务未入队.
+   * dropOldest时改为移出最早的非结束类任务至evicted再入队,
+   * evicted->bytes为0表示未移出任务.
+   */
+  long pushOverflow(CallbackTask& task, bool dropOldest,
+                    CallbackTask* evicted);
+  bool pop(CallbackTask* task);
+
+  /* 仅允许消费者线程调用, 将node尚未执行的任务置为空任务, 返回清除数量 */
+  int discardNode(ConnectNode* node);
+
+ private:
+  CallbackTask* _slots;
+  size_t _mask;
+  volatile size_t _head;  // 消费者写
+  volatile size_t _tail;  // 生产者写
+
+  std::deque<CallbackTask> _overflow;
+  volatile long _overflowSize;  // 生产者增, 消费者减
+  size_t _maxOverflow;
+  utility::NlsMemoryAccount _overflowAccount;
+#if defined(_MSC_VER)
+  HANDLE _mtxOverflow;
+#else
+  pthread_mutex_t _mtxOverflow;
+#endif
+};
+
+/*
+ * 回调线程, 每个WorkThread对应一条CallbackRing.
+ * 非事件线程产生的回调(如sendAudio失败)经所属WorkThread放入CallbackRing,
+ * 同一request的回调均经同一条队列, 按事件线程中的先后顺序执行.
+ */
+class CallbackWorker {
+ public:
+  CallbackWorker();
+  ~CallbackWorker();
+
+  int init(size_t ringsNumber, size_t queueSize, size_t maxOverflow);
+  void wakeup();
+  void waitTask();
+  bool runOnce();
+  void discardNode(ConnectNode* node);
+  void shutdown();
+
+#if defined(_MSC_VER)
+  static unsigned __stdcall loopCallback(LPVOID arg);
+#else
+  static void* loopCallback(void* arg);
+#endif
+
+  CallbackRing* _rings;
+  size_t _ringsNumber;
+
+  volatile long _pending;
+  volatile long _sleeping;
+  volatile long _running;
+
+  ConnectNode* _currentNode;
+  bool _currentNodeReleased;
+
+#if defined(_MSC_VER)
+  HANDLE _wakeEvent;
+  HANDLE _workerHandle;
+  unsigned _workerId;
+#else
+  pthread_mutex_t _mtxWake;
+  pthread_cond_t _cvWake;
+  pthread_t _workerId;
+#endif
+};
+
+class CallbackExecutor {
+ public:
+  static int setConfig(int threadsNumber, int queueSize,
+                       CallbackOverflowPolicy policy, int maxOverflowSize);
+  static int initCallbackExecutor(size_t loopsNumber);
+  static void destroyCallbackExecutor();
+  static bool isEnabled();
+
+  /*
+   * 投递回调, 成功后event所有权转移给执行器.
+   * 返回-1表示执行器未开启或node尚未分配事件线程,
+   * 调用者需同步执行并释放event.
+   */
+  static int dispatch(ConnectNode* node, NlsEvent* event);
+
+  /* 在事件线程中将非事件线程投递的回调放入回调队列 */
+  static void dispatchLoopTasks(WorkThread* loop);
+
+  /*
+   * 在事件线程中投递node的回收任务, 由回调线程在node已投递的回调
+   * 全部执行后回收request, 事件线程不等待用户回调.
+   * 返回-1表示无需等待回调, 调用者直接回收.
+   */
+  static int dispatchRecycle(ConnectNode* node);
+
+  /* 结束类事件及回收任务, 溢出时不丢弃 */
+  static bool isTerminalTask(const CallbackTask& task);
+
+  /*
+   * 等待node所有已投递的回调执行完毕, 在request析构前调用.
+   * 事件线程中的回收经dispatchRecycle, 不会在此等待.
+   */
+  static void drainNode(ConnectNode* node);
+
+  static int getStats(NlsCallbackExecutorStats* stats);
+
+  static void executeTask(CallbackWorker* worker, CallbackTask& task);
+
+ private:
+  static CallbackWorker* currentWorker();
+  /* 仅在loop事件线程中调用 */
+  static void enqueue(WorkThread* loop, CallbackTask& task);
+
+  static CallbackWorker* _workerArray;
+  static size_t _workersNumber;
+  static volatile long _roundRobin;
+
+  static bool _configured;
+  static int _configThreads;
+  static int _configQueueSize;
+  static int _configMaxOverflow;
+  static CallbackOverflowPolicy _policy;
+
+  static volatile int64_t _dispatchedCount;
+  static volatile int64_t _executedCount;
+  static volatile int64_t _droppedCount;
+  static volatile int64_t _overflowCount;
+  static volatile int64_t _slowCount;
+  static volatile int64_t _totalDurationUs;
+  static volatile int64_t _maxDurationUs;
+  static volatile int64_t _queueDepth;
+  static volatile int64_t _peakQueueDepth;
+
+#if defined(_MSC_VER)
+  static HANDLE _mtxExecutor;
+#else
+  static pthread_mutex_t _mtxExecutor;
+#endif
+};
+
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_CALLBACK_EXECUTOR_H
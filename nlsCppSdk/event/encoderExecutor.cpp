@@ -0,0 +1,414 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#ifdef _MSC_VER
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#endif
+
+#include "nlsGlobal.h"
+#include "nlsAtomic.h"
+#include "utility.h"
+#include "nlog.h"
+#include "workThread.h"
+#include "connectNode.h"
+#include "encoderExecutor.h"
+
+namespace AlibabaNls {
+
+#define ENCODER_BATCH_MAX 64
+#define ENCODER_MAX_THREADS 64
+
+EncoderWorker* EncoderExecutor::_workerArray = NULL;
+size_t EncoderExecutor::_workersNumber = 0;
+volatile long EncoderExecutor::_roundRobin = 0;
+
+volatile int64_t EncoderExecutor::_submittedCount = 0;
+volatile int64_t EncoderExecutor::_encodedBytes = 0;
+volatile int64_t EncoderExecutor::_batchCount = 0;
+volatile int64_t EncoderExecutor::_batchedNodes = 0;
+volatile int64_t EncoderExecutor::_maxBatchNodes = 0;
+volatile int64_t EncoderExecutor::_totalEncodeUs = 0;
+volatile int64_t EncoderExecutor::_queueDepth = 0;
+
+#if defined(_MSC_VER)
+HANDLE EncoderExecutor::_mtxExecutor = CreateMutex(NULL, FALSE, NULL);
+#else
+pthread_mutex_t EncoderExecutor::_mtxExecutor = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+EncoderWorker::EncoderWorker() : _running(0), _cpu(-1) {
+#if defined(_MSC_VER)
+  _mtxQueue = CreateMutex(NULL, FALSE, NULL);
+  _wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  _workerHandle = NULL;
+#else
+  pthread_mutex_init(&_mtxQueue, NULL);
+  pthread_cond_init(&_cvQueue, NULL);
+#endif
+}
+
+EncoderWorker::~EncoderWorker() {
+  shutdown();
+
+#if defined(_MSC_VER)
+  CloseHandle(_mtxQueue);
+  CloseHandle(_wakeEvent);
+#else
+  pthread_mutex_destroy(&_mtxQueue);
+  pthread_cond_destroy(&_cvQueue);
+#endif
+}
+
+int EncoderWorker::init(int cpu) {
+  _cpu = cpu;
+  _running = 1;
+#if defined(_MSC_VER)
+  _workerHandle = (HANDLE)_beginthreadex(
+      NULL, 0, loopEncoder, (LPVOID)this, 0, &_workerId);
+  if (_workerHandle == NULL) {
+    LOG_ERROR("Create encoder thread failed.");
+    _running = 0;
+    return -1;
+  }
+  if (_cpu >= 0) {
+    SetThreadAffinityMask(_workerHandle, (DWORD_PTR)1 << _cpu);
+  }
+#else
+  if (pthread_create(&_workerId, NULL, loopEncoder, (void*)this) != 0) {
+    LOG_ERROR("Create encoder thread failed.");
+    _running = 0;
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+void EncoderWorker::schedule(ConnectNode* node) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxQueue, INFINITE);
+  _nodeQueue.push(node);
+  ReleaseMutex(_mtxQueue);
+  SetEvent(_wakeEvent);
+#else
+  pthread_mutex_lock(&_mtxQueue);
+  _nodeQueue.push(node);
+  pthread_cond_signal(&_cvQueue);
+  pthread_mutex_unlock(&_mtxQueue);
+#endif
+}
+
+void EncoderWorker::shutdown() {
+  if (!utility::atomicCompareSwap(&_running, 1, 0)) {
+    return;
+  }
+
+#if defined(_MSC_VER)
+  SetEvent(_wakeEvent);
+  WaitForSingleObject(_workerHandle, INFINITE);
+  CloseHandle(_workerHandle);
+#else
+  pthread_mutex_lock(&_mtxQueue);
+  pthread_cond_signal(&_cvQueue);
+  pthread_mutex_unlock(&_mtxQueue);
+  pthread_join(_workerId, NULL);
+#endif
+
+  // 退出时尚未编码的数据直接丢弃, 仍交给事件线程结束编码任务
+  while (!_nodeQueue.empty()) {
+    ConnectNode* node = _nodeQueue.front();
+    _nodeQueue.pop();
+    node->discardPendingAudio();
+    if (node->_eventThread) {
+      WorkThread::insertEncodedNode(node->_eventThread, node);
+    } else {
+      utility::atomicAdd(&node->_pendingEncodes, -1);
+    }
+  }
+}
+
+#if defined(_MSC_VER)
+unsigned __stdcall EncoderWorker::loopEncoder(LPVOID arg) {
+#else
+void* EncoderWorker::loopEncoder(void* arg) {
+#endif
+  EncoderWorker* worker = (EncoderWorker*)arg;
+
+#if defined(__ANDROID__) || defined (__linux__)
+  sigset_t signal_mask;
+  sigemptyset(&signal_mask);
+  sigaddset(&signal_mask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &signal_mask, NULL);
+
+  prctl(PR_SET_NAME, "encoderThread");
+
+  if (worker->_cpu >= 0) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(worker->_cpu, &cpuSet);
+    if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+      LOG_WARN("Encoder thread bind cpu %d failed.", worker->_cpu);
+    }
+  }
+#endif
+
+  ConnectNode* batch[ENCODER_BATCH_MAX];
+  while (true) {
+    size_t count = 0;
+#if defined(_MSC_VER)
+    WaitForSingleObject(worker->_mtxQueue, INFINITE);
+    while (worker->_nodeQueue.empty() &&
+           utility::atomicLoad(&worker->_running)) {
+      ReleaseMutex(worker->_mtxQueue);
+      WaitForSingleObject(worker->_wakeEvent, INFINITE);
+      WaitForSingleObject(worker->_mtxQueue, INFINITE);
+    }
+#else
+    pthread_mutex_lock(&worker->_mtxQueue);
+    while (worker->_nodeQueue.empty() &&
+           utility::atomicLoad(&worker->_running)) {
+      pthread_cond_wait(&worker->_cvQueue, &worker->_mtxQueue);
+    }
+#endif
+    if (!utility::atomicLoad(&worker->_running)) {
+#if defined(_MSC_VER)
+      ReleaseMutex(worker->_mtxQueue);
+#else
+      pthread_mutex_unlock(&worker->_mtxQueue);
+#endif
+      break;
+    }
+
+    while (count < ENCODER_BATCH_MAX && !worker->_nodeQueue.empty()) {
+      batch[count++] = worker->_nodeQueue.front();
+      worker->_nodeQueue.pop();
+    }
+#if defined(_MSC_VER)
+    ReleaseMutex(worker->_mtxQueue);
+#else
+    pthread_mutex_unlock(&worker->_mtxQueue);
+#endif
+
+    EncoderExecutor::encodeBatch(batch, count);
+  }
+
+#if defined(_MSC_VER)
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+int EncoderExecutor::initEncoderExecutor(int threadsNumber, int firstCpu) {
+  if (threadsNumber <= 0 || threadsNumber > ENCODER_MAX_THREADS) {
+    LOG_ERROR("Invalid encoder threads number: %d.", threadsNumber);
+    return -1;
+  }
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxExecutor, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxExecutor);
+#endif
+
+  int ret = -1;
+  if (_workerArray == NULL) {
+#if defined(_MSC_VER)
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+    int cpuNumber = (int)sysInfo.dwNumberOfProcessors;
+#else
+    int cpuNumber = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cpuNumber <= 0) {
+      cpuNumber = 1;
+    }
+    EncoderWorker* workers = new EncoderWorker[threadsNumber];
+    ret = 0;
+    for (int i = 0; i < threadsNumber; i++) {
+      int cpu = firstCpu >= 0 ? (firstCpu + i) % cpuNumber : -1;
+      if (workers[i].init(cpu) < 0) {
+        ret = -1;
+      }
+    }
+
+    if (ret < 0) {
+      delete [] workers;
+    } else {
+      _workersNumber = threadsNumber;
+      _workerArray = workers;
+      LOG_INFO("Encoder executor threads:%d, first cpu:%d.",
+          threadsNumber, firstCpu);
+    }
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxExecutor);
+#else
+  pthread_mutex_unlock(&_mtxExecutor);
+#endif
+  return ret;
+}
+
+void EncoderExecutor::destroyEncoderExecutor() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxExecutor, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxExecutor);
+#endif
+
+  if (_workerArray) {
+    LOG_INFO("destroy EncoderExecutor begin.");
+    EncoderWorker* workers = _workerArray;
+    _workerArray = NULL;
+    delete [] workers;
+    _workersNumber = 0;
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxExecutor);
+#else
+  pthread_mutex_unlock(&_mtxExecutor);
+#endif
+}
+
+bool EncoderExecutor::isEnabled() {
+  return _workerArray != NULL;
+}
+
+EncoderWorker* EncoderExecutor::selectWorker(ConnectNode* node) {
+  long index = utility::atomicLoad(&node->_encoderWorker);
+  if (index < 0) {
+    long chosen = (utility::atomicAdd(&_roundRobin, 1) - 1) % _workersNumber;
+    if (node->_affinityNode != NULL) {
+      // 与关联node共用编码线程, 便于同批编码
+      ConnectNode* owner = node->_affinityNode;
+      utility::atomicCompareSwap(&owner->_encoderWorker, -1, chosen);
+      long shared = utility::atomicLoad(&owner->_encoderWorker);
+      if (shared >= 0) chosen = shared;
+    }
+    utility::atomicCompareSwap(&node->_encoderWorker, -1, chosen);
+    index = utility::atomicLoad(&node->_encoderWorker);
+  }
+  return &_workerArray[index];
+}
+
+int EncoderExecutor::submit(ConnectNode* node,
+                            const uint8_t* data, size_t dataSize) {
+  if (_workerArray == NULL || node == NULL) {
+    return -1;
+  }
+
+  int ret = node->appendPendingAudio(data, dataSize, false);
+  if (ret < 0) {
+    return -1;
+  }
+
+  utility::atomicAdd64(&_submittedCount, 1);
+  if (ret == 1) {
+    utility::atomicAdd64(&_queueDepth, 1);
+    selectWorker(node)->schedule(node);
+  }
+  return 0;
+}
+
+int EncoderExecutor::flush(ConnectNode* node) {
+  if (_workerArray == NULL || node == NULL) {
+    return -1;
+  }
+
+  if (node->appendPendingAudio(NULL, 0, true) == 1) {
+    utility::atomicAdd64(&_queueDepth, 1);
+    selectWorker(node)->schedule(node);
+  }
+  return 0;
+}
+
+void EncoderExecutor::encodeBatch(ConnectNode** nodes, size_t count) {
+  uint64_t begin = utility::getMonotonicUs();
+  utility::atomicAdd64(&_queueDepth, -(int64_t)count);
+
+  for (size_t i = 0; i < count; i++) {
+    ConnectNode* node = nodes[i];
+    int encoded = node->encodePendingAudio();
+    if (encoded > 0) {
+      utility::atomicAdd64(&_encodedBytes, encoded);
+    }
+    if (node->_eventThread) {
+      // 计数随节点一起交给事件线程, 发送后递减;
+      // 无数据时也由事件线程递减, 以便事件线程在最后一个编码任务后回收request
+      WorkThread::insertEncodedNode(node->_eventThread, node);
+    } else {
+      utility::atomicAdd(&node->_pendingEncodes, -1);
+    }
+  }
+
+  utility::atomicAdd64(&_totalEncodeUs,
+      (int64_t)(utility::getMonotonicUs() - begin));
+  utility::atomicAdd64(&_batchCount, 1);
+  utility::atomicAdd64(&_batchedNodes, (int64_t)count);
+  utility::atomicMax64(&_maxBatchNodes, (int64_t)count);
+}
+
+void EncoderExecutor::drainNode(ConnectNode* node) {
+  if (node == NULL || utility::atomicLoad(&node->_pendingEncodes) <= 0) {
+    return;
+  }
+
+  WorkThread* loop = node->_eventThread;
+  bool onLoop = false;
+  if (loop) {
+#if defined(_MSC_VER)
+    onLoop = (GetCurrentThreadId() == loop->_workThreadId);
+#else
+    onLoop = pthread_equal(pthread_self(), loop->_workThreadId);
+#endif
+  }
+
+  while (utility::atomicLoad(&node->_pendingEncodes) > 0) {
+    if (onLoop) {
+      // 在所属事件线程中等待, 需自行处理已交接给本线程的编码结果
+      long taken = (long)WorkThread::takeEncodedNode(loop, node);
+      if (taken > 0) {
+        node->sendEncodedAudio();
+        utility::atomicAdd(&node->_pendingEncodes, -taken);
+        continue;
+      }
+    }
+    utility::sleepOneMs();
+  }
+}
+
+int EncoderExecutor::getStats(NlsEncoderPoolStats* stats) {
+  if (stats == NULL || _workerArray == NULL) {
+    return -1;
+  }
+
+  stats->submittedCount = utility::atomicLoad64(&_submittedCount);
+  stats->encodedBytes = utility::atomicLoad64(&_encodedBytes);
+  stats->batchCount = utility::atomicLoad64(&_batchCount);
+  stats->batchedNodes = utility::atomicLoad64(&_batchedNodes);
+  stats->maxBatchNodes = utility::atomicLoad64(&_maxBatchNodes);
+  stats->totalEncodeUs = utility::atomicLoad64(&_totalEncodeUs);
+  stats->queueDepth = utility::atomicLoad64(&_queueDepth);
+  return 0;
+}
+
+}  // namespace AlibabaNls
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_ENCODER_EXECUTOR_H
+#define NLS_SDK_ENCODER_EXECUTOR_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <queue>
+#include <stdint.h>
+#include "nlsClient.h"
+
+namespace AlibabaNls {
+
+class ConnectNode;
+
+/*
+ * 编码线程, 每个request固定绑定一个编码线程, 保证同一路音频按序编码.
+ * 每次唤醒取出所有待编码的request批量处理.
+ */
+class EncoderWorker {
+ public:
+  EncoderWorker();
+  ~EncoderWorker();
+
+  int init(int cpu);
+  void schedule(ConnectNode* node);
+  void shutdown();
+
+#if defined(_MSC_VER)
+  static unsigned __stdcall loopEncoder(LPVOID arg);
+#else
+  static void* loopEncoder(void* arg);
+#endif
+
+  std::queue<ConnectNode*> _nodeQueue;
+  volatile long _running;
+  int _cpu;
+
+#if defined(_MSC_VER)
+  HANDLE _mtxQueue;
+  HANDLE _wakeEvent;
+  HANDLE _workerHandle;
+  unsigned _workerId;
+#else
+  pthread_mutex_t _mtxQueue;
+  pthread_cond_t _cvQueue;
+  pthread_t _workerId;
+#endif
+};
+
+class EncoderExecutor {
+ public:
+  static int initEncoderExecutor(int threadsNumber, int firstCpu);
+  static void destroyEncoderExecutor();
+  static bool isEnabled();
+
+  /*
+   * 提交PCM数据, 由编码线程编码后交给node所属事件线程发送.
+   * 返回-1表示缓冲区已满或执行器未开启.
+   */
+  static int submit(ConnectNode* node, const uint8_t* data, size_t dataSize);
+
+  /* 提交stop前的补零编码请求 */
+  static int flush(ConnectNode* node);
+
+  /* 等待node已提交的音频全部编码并发送, 在stop及request析构前调用 */
+  static void drainNode(ConnectNode* node);
+
+  /* 编码线程中对一批request执行编码 */
+  static void encodeBatch(ConnectNode** nodes, size_t count);
+
+  static int getStats(NlsEncoderPoolStats* stats);
+
+ private:
+  static EncoderWorker* selectWorker(ConnectNode* node);
+
+  static EncoderWorker* _workerArray;
+  static size_t _workersNumber;
+  static volatile long _roundRobin;
+
+  static volatile int64_t _submittedCount;
+  static volatile int64_t _encodedBytes;
+  static volatile int64_t _batchCount;
+  static volatile int64_t _batchedNodes;
+  static volatile int64_t _maxBatchNodes;
+  static volatile int64_t _totalEncodeUs;
+  static volatile int64_t _queueDepth;
+
+#if defined(_MSC_VER)
+  static HANDLE _mtxExecutor;
+#else
+  static pthread_mutex_t _mtxExecutor;
+#endif
+};
+
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_ENCODER_EXECUTOR_H
@@ -0,0 +1,570 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef _MSC_VER
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#endif
+
+#include "nlsGlobal.h"
+#include "nlsAtomic.h"
+#include "utility.h"
+#include "nlog.h"
+#include "nlsLogSink.h"
+#include "Config.h"
+#include "latencyTracer.h"
+
+namespace AlibabaNls {
+
+#define TRACE_QUEUE_MAX 4096
+
+NlsLatencyTraceCallback LatencyTracer::_callback = NULL;
+void* LatencyTracer::_userData = NULL;
+
+volatile long LatencyTracer::_exporting = 0;
+std::deque<LatencyTraceItem> LatencyTracer::_queue;
+FILE* LatencyTracer::_file = NULL;
+evutil_socket_t LatencyTracer::_socket = -1;
+struct sockaddr_storage LatencyTracer::_address;
+int LatencyTracer::_addressLength = 0;
+std::string LatencyTracer::_line;
+
+volatile int64_t LatencyTracer::_exportedCount = 0;
+volatile int64_t LatencyTracer::_droppedCount = 0;
+volatile int64_t LatencyTracer::_errorCount = 0;
+
+#if defined(_MSC_VER)
+HANDLE LatencyTracer::_mtxTracer = CreateMutex(NULL, FALSE, NULL);
+HANDLE LatencyTracer::_wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+HANDLE LatencyTracer::_exporterHandle = NULL;
+unsigned LatencyTracer::_exporterId = 0;
+#else
+pthread_mutex_t LatencyTracer::_mtxTracer = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t LatencyTracer::_cvWake = PTHREAD_COND_INITIALIZER;
+pthread_t LatencyTracer::_exporterId;
+#endif
+
+static const char* traceTypeName(NlsType type) {
+  switch (type) {
+    case TypeAsr:      return "SpeechRecognizer";
+    case TypeRealTime: return "SpeechTranscriber";
+    case TypeTts:      return "SpeechSynthesizer";
+    case TypeDialog:   return "DialogAssistant";
+    default:           return "Unknown";
+  }
+}
+
+static const char* traceStatusName(LATENCY_TRACE_STATUS status) {
+  switch (status) {
+    case TRACE_STATUS_COMPLETED: return "completed";
+    case TRACE_STATUS_FAILED:    return "failed";
+    case TRACE_STATUS_CANCELLED: return "cancelled";
+    default:                     return "running";
+  }
+}
+
+/* span id生成, 仅导出线程使用 */
+static uint64_t _idState = 0;
+
+static uint64_t nextTraceId() {
+  if (_idState == 0) {
+    _idState = utility::NlsLogSink::wallClockUs() ^
+               ((uint64_t)(size_t)&_idState << 16) ^ 0x9E3779B97F4A7C15ULL;
+  }
+  // xorshift64*
+  _idState ^= _idState >> 12;
+  _idState ^= _idState << 25;
+  _idState ^= _idState >> 27;
+  return _idState * 0x2545F4914F6CDD1DULL;
+}
+
+static void appendHex(std::string& output, uint64_t value) {
+  char buffer[17];
+  _ssnprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+  output.append(buffer, 16);
+}
+
+/* task id为32位十六进制时直接作为trace id, 便于与服务端日志关联 */
+static void makeTraceId(const char* taskId, std::string& traceId) {
+  traceId.clear();
+  if (strlen(taskId) == 32) {
+    for (size_t i = 0; i < 32; i++) {
+      char c = taskId[i];
+      if (c >= 'A' && c <= 'F') {
+        c = c - 'A' + 'a';
+      } else if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+        traceId.clear();
+        break;
+      }
+      traceId.push_back(c);
+    }
+  }
+  if (traceId.empty()) {
+    appendHex(traceId, nextTraceId());
+    appendHex(traceId, nextTraceId());
+  }
+}
+
+static void appendJsonString(std::string& output, const char* value) {
+  output.push_back('"');
+  for (const char* p = value; *p; p++) {
+    unsigned char c = (unsigned char)*p;
+    if (c == '"' || c == '\\') {
+      output.push_back('\\');
+      output.push_back((char)c);
+    } else if (c < 0x20) {
+      char buffer[8];
+      _ssnprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      output.append(buffer);
+    } else {
+      output.push_back((char)c);
+    }
+  }
+  output.push_back('"');
+}
+
+static void appendStringAttribute(std::string& output, const char* key,
+                                  const char* value, bool first) {
+  if (!first) {
+    output.push_back(',');
+  }
+  output.append("{\"key\":");
+  appendJsonString(output, key);
+  output.append(",\"value\":{\"stringValue\":");
+  appendJsonString(output, value);
+  output.append("}}");
+}
+
+static void appendIntAttribute(std::string& output, const char* key,
+                               int64_t value, bool first) {
+  char buffer[32];
+  if (!first) {
+    output.push_back(',');
+  }
+  output.append("{\"key\":");
+  appendJsonString(output, key);
+  _ssnprintf(buffer, sizeof(buffer), "%lld", (long long)value);
+  output.append(",\"value\":{\"intValue\":\"");
+  output.append(buffer);
+  output.append("\"}}");
+}
+
+/*
+ * 追加一个span, attributes为已拼好的属性数组内容(可为空),
+ * statusCode: 0 UNSET, 1 OK, 2 ERROR
+ */
+static void appendSpan(std::string& output, const std::string& traceId,
+                       uint64_t spanId, uint64_t parentId, const char* name,
+                       int kind, uint64_t startUs, uint64_t endUs,
+                       const std::string& attributes, int statusCode) {
+  char buffer[64];
+
+  if (output[output.size() - 1] == '}') {
+    output.push_back(',');
+  }
+  output.append("{\"traceId\":\"");
+  output.append(traceId);
+  output.append("\",\"spanId\":\"");
+  appendHex(output, spanId);
+  output.append("\",\"parentSpanId\":\"");
+  if (parentId != 0) {
+    appendHex(output, parentId);
+  }
+  output.append("\",\"name\":");
+  appendJsonString(output, name);
+  _ssnprintf(buffer, sizeof(buffer), ",\"kind\":%d", kind);
+  output.append(buffer);
+  // OTLP/JSON中64位整数以字符串表示
+  _ssnprintf(buffer, sizeof(buffer), ",\"startTimeUnixNano\":\"%llu000\"",
+             (unsigned long long)startUs);
+  output.append(buffer);
+  _ssnprintf(buffer, sizeof(buffer), ",\"endTimeUnixNano\":\"%llu000\"",
+             (unsigned long long)endUs);
+  output.append(buffer);
+  output.append(",\"attributes\":[");
+  output.append(attributes);
+  _ssnprintf(buffer, sizeof(buffer), "],\"status\":{\"code\":%d}}",
+             statusCode);
+  output.append(buffer);
+}
+
+void LatencyTracer::formatSpans(const LatencyTraceItem& item,
+                                std::string& output) {
+  const NlsLatencyTrace& trace = item.trace;
+  std::string traceId;
+  std::string attributes;
+  makeTraceId(trace.taskId, traceId);
+
+  output.clear();
+  output.append("{\"resourceSpans\":[{\"resource\":{\"attributes\":[");
+  appendStringAttribute(output, "service.name", "alibabacloud-nls-cpp-sdk",
+                        true);
+  appendStringAttribute(output, "telemetry.sdk.language", "cpp", false);
+  output.append("]},\"scopeSpans\":[{\"scope\":{\"name\":\"nls-cpp-sdk\","
+                "\"version\":\"" NLS_SDK_VERSION_STR "\"},\"spans\":[");
+
+  /* 根span: start调用至连接关闭 */
+  uint64_t rootId = nextTraceId();
+  appendStringAttribute(attributes, "nls.task_id", trace.taskId, true);
+  appendStringAttribute(attributes, "nls.status",
+                        traceStatusName(trace.status), false);
+  appendIntAttribute(attributes, "nls.connect_attempts",
+                     trace.connectAttempts, false);
+  char name[64];
+  _ssnprintf(name, sizeof(name), "nls.%s", traceTypeName(item.type));
+  int statusCode = 0;
+  if (trace.status == TRACE_STATUS_COMPLETED) {
+    statusCode = 1;
+  } else if (trace.status == TRACE_STATUS_FAILED) {
+    statusCode = 2;
+  }
+  uint64_t offset = item.wallOffsetUs;
+  appendSpan(output, traceId, rootId, 0, name, 3,
+             trace.startUs + offset, trace.closedUs + offset,
+             attributes, statusCode);
+
+  /* 各阶段子span, 起止时间点都到达时才输出 */
+  uint64_t connectedUs = trace.tlsHandshakedUs ?
+      trace.tlsHandshakedUs : trace.tcpConnectedUs;
+  uint64_t resultFromUs = trace.startedUs ?
+      trace.startedUs : trace.startSentUs;
+  struct {
+    const char* name;
+    uint64_t beginUs;
+    uint64_t endUs;
+  } stages[] = {
+    {"nls.dns", trace.dnsStartUs, trace.dnsEndUs},
+    {"nls.tcp_connect", trace.dnsEndUs, trace.tcpConnectedUs},
+    {"nls.tls_handshake", trace.tcpConnectedUs, trace.tlsHandshakedUs},
+    {"nls.ws_upgrade", connectedUs, trace.upgradedUs},
+    {"nls.start", trace.startSentUs, trace.startedUs},
+    {"nls.first_result", resultFromUs, trace.firstResultUs},
+    {"nls.stop", trace.stopSentUs, trace.completedUs},
+  };
+  std::string empty;
+  for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+    if (stages[i].beginUs == 0 || stages[i].endUs < stages[i].beginUs) {
+      continue;
+    }
+    appendSpan(output, traceId, nextTraceId(), rootId, stages[i].name, 1,
+               stages[i].beginUs + offset, stages[i].endUs + offset,
+               empty, 0);
+  }
+
+  output.append("]}]}]}");
+}
+
+int LatencyTracer::setCallback(NlsLatencyTraceCallback callback,
+                               void* userData) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxTracer, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxTracer);
+#endif
+  _callback = callback;
+  _userData = userData;
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxTracer);
+#else
+  pthread_mutex_unlock(&_mtxTracer);
+#endif
+  return 0;
+}
+
+int LatencyTracer::setExporter(const char* target) {
+  if (target == NULL || target[0] == '\0') {
+    stopExporter();
+    return 0;
+  }
+
+  /* 新目标可用后再替换, 失败时保留原有导出 */
+  FILE* file = NULL;
+  evutil_socket_t sock = -1;
+  struct sockaddr_storage address;
+  int addressLength = sizeof(address);
+  memset(&address, 0, sizeof(address));
+
+  if (strncmp(target, "file:", 5) == 0 && target[5] != '\0') {
+    file = fopen(target + 5, "a");
+    if (file == NULL) {
+      LOG_ERROR("Open trace file %s failed.", target + 5);
+      return -1;
+    }
+  } else if (strncmp(target, "udp:", 4) == 0) {
+    if (evutil_parse_sockaddr_port(target + 4, (struct sockaddr*)&address,
+                                   &addressLength) != 0) {
+      LOG_ERROR("Invalid trace collector address %s.", target + 4);
+      return -1;
+    }
+    sock = socket(((struct sockaddr*)&address)->sa_family, SOCK_DGRAM, 0);
+    if (sock < 0) {
+      LOG_ERROR("Create trace socket failed:%d.",
+                utility::getLastErrorCode());
+      return -1;
+    }
+  } else {
+    LOG_ERROR("Invalid trace exporter %s.", target);
+    return -1;
+  }
+
+  stopExporter();
+  _file = file;
+  _socket = sock;
+  _address = address;
+  _addressLength = addressLength;
+
+  utility::atomicStore(&_exporting, 1);
+#if defined(_MSC_VER)
+  _exporterHandle = (HANDLE)_beginthreadex(
+      NULL, 0, loopExporter, NULL, 0, &_exporterId);
+  if (_exporterHandle == NULL) {
+#else
+  if (pthread_create(&_exporterId, NULL, loopExporter, NULL) != 0) {
+#endif
+    LOG_ERROR("Create trace exporter thread failed.");
+    utility::atomicStore(&_exporting, 0);
+    if (_file) {
+      fclose(_file);
+      _file = NULL;
+    }
+    if (_socket >= 0) {
+      evutil_closesocket(_socket);
+      _socket = -1;
+    }
+    return -1;
+  }
+
+  LOG_INFO("Latency trace exporter started: %s.", target);
+  return 0;
+}
+
+void LatencyTracer::stopExporter() {
+  // 在锁内置0, 此后report()不再入队
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxTracer, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxTracer);
+#endif
+  bool exporting = utility::atomicCompareSwap(&_exporting, 1, 0);
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxTracer);
+#else
+  if (exporting) {
+    pthread_cond_signal(&_cvWake);
+  }
+  pthread_mutex_unlock(&_mtxTracer);
+#endif
+  if (!exporting) {
+    return;
+  }
+
+#if defined(_MSC_VER)
+  SetEvent(_wakeEvent);
+  WaitForSingleObject(_exporterHandle, INFINITE);
+  CloseHandle(_exporterHandle);
+  _exporterHandle = NULL;
+#else
+  pthread_join(_exporterId, NULL);
+#endif
+
+  // 导出线程已退出, 写出剩余的时延
+  std::deque<LatencyTraceItem> rest;
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxTracer, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxTracer);
+#endif
+  rest.swap(_queue);
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxTracer);
+#else
+  pthread_mutex_unlock(&_mtxTracer);
+#endif
+  while (!rest.empty()) {
+    exportItem(rest.front());
+    rest.pop_front();
+  }
+
+  if (_file) {
+    fclose(_file);
+    _file = NULL;
+  }
+  if (_socket >= 0) {
+    evutil_closesocket(_socket);
+    _socket = -1;
+  }
+
+  LOG_INFO("Latency trace exporter stopped, exported:%lld dropped:%lld "
+           "errors:%lld.",
+           (long long)utility::atomicLoad64(&_exportedCount),
+           (long long)utility::atomicLoad64(&_droppedCount),
+           (long long)utility::atomicLoad64(&_errorCount));
+}
+
+void LatencyTracer::destroyLatencyTracer() {
+  stopExporter();
+  setCallback(NULL, NULL);
+}
+
+void LatencyTracer::report(const NlsLatencyTrace& trace, NlsType type) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxTracer, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxTracer);
+#endif
+  NlsLatencyTraceCallback callback = _callback;
+  void* userData = _userData;
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxTracer);
+#else
+  pthread_mutex_unlock(&_mtxTracer);
+#endif
+
+  if (callback) {
+    callback(&trace, userData);
+  }
+
+  if (!utility::atomicLoad(&_exporting)) {
+    return;
+  }
+
+  LatencyTraceItem item;
+  item.trace = trace;
+  item.type = type;
+  item.wallOffsetUs =
+      utility::NlsLogSink::wallClockUs() - utility::getMonotonicUs();
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxTracer, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxTracer);
+#endif
+  // stopExporter()在锁内置0, 锁内复查后不会在其取走队列后再入队
+  if (!utility::atomicLoad(&_exporting)) {
+#if defined(_MSC_VER)
+    ReleaseMutex(_mtxTracer);
+#else
+    pthread_mutex_unlock(&_mtxTracer);
+#endif
+    return;
+  }
+  bool full = _queue.size() >= TRACE_QUEUE_MAX;
+  if (!full) {
+    _queue.push_back(item);
+  }
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxTracer);
+  if (!full) {
+    SetEvent(_wakeEvent);
+  }
+#else
+  if (!full) {
+    pthread_cond_signal(&_cvWake);
+  }
+  pthread_mutex_unlock(&_mtxTracer);
+#endif
+
+  if (full) {
+    utility::atomicAdd64(&_droppedCount, 1);
+  }
+}
+
+/* 仅导出线程或导出线程退出后调用 */
+void LatencyTracer::exportItem(const LatencyTraceItem& item) {
+  formatSpans(item, _line);
+
+  if (_file) {
+    _line.push_back('\n');
+    if (fwrite(_line.c_str(), 1, _line.size(), _file) != _line.size()) {
+      utility::atomicAdd64(&_errorCount, 1);
+      return;
+    }
+  } else if (_socket >= 0) {
+    if (sendto(_socket, _line.c_str(), (int)_line.size(), 0,
+               (struct sockaddr*)&_address, _addressLength) < 0) {
+      utility::atomicAdd64(&_errorCount, 1);
+      return;
+    }
+  }
+  utility::atomicAdd64(&_exportedCount, 1);
+}
+
+#if defined(_MSC_VER)
+unsigned __stdcall LatencyTracer::loopExporter(LPVOID arg) {
+#else
+void* LatencyTracer::loopExporter(void* arg) {
+#endif
+
+#if defined(__ANDROID__) || defined (__linux__)
+  sigset_t signal_mask;
+  sigemptyset(&signal_mask);
+  sigaddset(&signal_mask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &signal_mask, NULL);
+
+  prctl(PR_SET_NAME, "traceExporter");
+#endif
+
+  std::deque<LatencyTraceItem> batch;
+  while (true) {
+#if defined(_MSC_VER)
+    WaitForSingleObject(_mtxTracer, INFINITE);
+    while (_queue.empty() && utility::atomicLoad(&_exporting)) {
+      ReleaseMutex(_mtxTracer);
+      WaitForSingleObject(_wakeEvent, INFINITE);
+      WaitForSingleObject(_mtxTracer, INFINITE);
+    }
+#else
+    pthread_mutex_lock(&_mtxTracer);
+    while (_queue.empty() && utility::atomicLoad(&_exporting)) {
+      pthread_cond_wait(&_cvWake, &_mtxTracer);
+    }
+#endif
+    bool running = utility::atomicLoad(&_exporting) != 0;
+    if (running) {
+      batch.swap(_queue);
+    }
+#if defined(_MSC_VER)
+    ReleaseMutex(_mtxTracer);
+#else
+    pthread_mutex_unlock(&_mtxTracer);
+#endif
+    if (!running) {
+      break;
+    }
+
+    while (!batch.empty()) {
+      exportItem(batch.front());
+      batch.pop_front();
+    }
+    if (_file) {
+      fflush(_file);
+    }
+  }
+
+#if defined(_MSC_VER)
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+}  // namespace AlibabaNls
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_LATENCY_TRACER_H
+#define NLS_SDK_LATENCY_TRACER_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <stdio.h>
+#include <deque>
+#include <string>
+#include "nlsGlobal.h"
+#include "iNlsRequestParam.h"
+#include "event2/util.h"
+
+namespace AlibabaNls {
+
+/* 等待导出的请求时延, 时间点已换算为墙上时间 */
+struct LatencyTraceItem {
+  NlsLatencyTrace trace;
+  NlsType type;
+  uint64_t wallOffsetUs;  // 墙上时间(us) - 单调时钟(us)
+};
+
+/*
+ * 请求时延上报. 请求结束时由事件线程调用report:
+ * 同步执行用户设置的回调; 开启导出时将时延放入队列,
+ * 由导出线程转为OpenTelemetry span后写入文件或发往UDP端口,
+ * 事件线程上不做IO. 队列满时丢弃并计数.
+ */
+class LatencyTracer {
+ public:
+  static int setCallback(NlsLatencyTraceCallback callback, void* userData);
+
+  /*
+   * @brief 设置导出目标并启动导出线程, NULL或空串关闭导出
+   * @param target "file:<路径>" 或 "udp:<ip>:<端口>"
+   * @return 成功返回0, 格式错误或无法打开返回-1
+   */
+  static int setExporter(const char* target);
+  static void destroyLatencyTracer();
+
+  static void report(const NlsLatencyTrace& trace, NlsType type);
+
+  /*
+   * @brief 将一次请求转为OTLP/JSON的ExportTraceServiceRequest, 单行无换行.
+   *        根span覆盖start至连接关闭, 各阶段为其子span.
+   */
+  static void formatSpans(const LatencyTraceItem& item, std::string& output);
+
+ private:
+#if defined(_MSC_VER)
+  static unsigned __stdcall loopExporter(LPVOID arg);
+#else
+  static void* loopExporter(void* arg);
+#endif
+  static void exportItem(const LatencyTraceItem& item);
+  static void stopExporter();
+
+  static NlsLatencyTraceCallback _callback;
+  static void* _userData;
+
+  static volatile long _exporting;
+  static std::deque<LatencyTraceItem> _queue;
+  static FILE* _file;
+  static evutil_socket_t _socket;
+  static struct sockaddr_storage _address;
+  static int _addressLength;
+  static std::string _line;
+
+  static volatile int64_t _exportedCount;
+  static volatile int64_t _droppedCount;
+  static volatile int64_t _errorCount;
+
+#if defined(_MSC_VER)
+  static HANDLE _mtxTracer;
+  static HANDLE _wakeEvent;
+  static HANDLE _exporterHandle;
+  static unsigned _exporterId;
+#else
+  static pthread_mutex_t _mtxTracer;
+  static pthread_cond_t _cvWake;
+  static pthread_t _exporterId;
+#endif
+};
+
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_LATENCY_TRACER_H
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "event.h"
+#include "nlog.h"
+#include "nlsMetrics.h"
+#include "workThread.h"
+#include "loopWatchdog.h"
+
+namespace AlibabaNls {
+
+volatile long LoopWatchdog::_thresholdUs = 0;
+volatile long LoopWatchdog::_lagCheckMs = 0;
+volatile long LoopWatchdog::_runningLoops = 0;
+volatile long LoopWatchdog::_armedTimers = 0;
+
+int LoopWatchdog::setConfig(int slowCallbackMs, int lagCheckMs) {
+  if (slowCallbackMs < 0 || lagCheckMs < 0 || slowCallbackMs > 3600 * 1000) {
+    return -1;
+  }
+  utility::atomicStore(&_lagCheckMs, lagCheckMs);
+  utility::atomicStore(&_thresholdUs, (long)slowCallbackMs * 1000);
+  LOG_INFO("Loop watchdog threshold:%dms lag check:%dms.",
+           slowCallbackMs, lagCheckMs);
+
+  // 回调计时即时生效, 已运行的事件线程上未启动的延迟检测则不会补上
+  long running = utility::atomicLoad(&_runningLoops);
+  long armed = utility::atomicLoad(&_armedTimers);
+  if (slowCallbackMs > 0 && lagCheckMs > 0 && armed < running) {
+    LOG_WARN("Loop lag check starts with event threads, "
+             "%ld of %ld running threads are not checked.",
+             running - armed, running);
+  }
+  return 0;
+}
+
+const char* LoopWatchdog::getEventTypeName(LoopEventType type) {
+  switch (type) {
+    case LoopEventConnect: return "connect";
+    case LoopEventRead: return "read";
+    case LoopEventWrite: return "write";
+    case LoopEventDns: return "dns";
+    case LoopEventNotify: return "notify";
+    case LoopEventHandler: return "handler";
+    default: return "unknown";
+  }
+}
+
+static inline int threadIndexOf(const WorkThread* thread) {
+  return thread ? (int)thread->_threadIndex : -1;
+}
+
+static utility::NlsHistogram* callbackHistogram(LoopEventType type) {
+  switch (type) {
+    case LoopEventConnect: return &utility::NlsMetrics::connectCallbackUs;
+    case LoopEventRead: return &utility::NlsMetrics::readCallbackUs;
+    case LoopEventWrite: return &utility::NlsMetrics::writeCallbackUs;
+    case LoopEventDns: return &utility::NlsMetrics::dnsCallbackUs;
+    case LoopEventNotify: return &utility::NlsMetrics::notifyCallbackUs;
+    default: return &utility::NlsMetrics::handlerCallbackUs;
+  }
+}
+
+void LoopWatchdog::recordCallback(WorkThread* thread, LoopEventType type,
+                                  const void* node, int detail,
+                                  uint64_t beginUs) {
+  uint64_t elapsedUs = utility::getMonotonicUs() - beginUs;
+  callbackHistogram(type)->observe(elapsedUs);
+
+  long thresholdUs = utility::atomicLoadRelaxed(&_thresholdUs);
+  if (thresholdUs <= 0 || elapsedUs < (uint64_t)thresholdUs) {
+    return;
+  }
+
+  utility::NlsMetrics::slowCallbacks.add();
+  if (thread) {
+    utility::atomicAdd(&thread->_slowCallbacks, 1);
+  }
+
+  if (type == LoopEventHandler) {
+    LOG_WARN("Node:%p slow %s callback %.1fms on event thread %d, "
+             "msg type:%d.", node, getEventTypeName(type),
+             elapsedUs / 1000.0, threadIndexOf(thread), detail);
+  } else if (type == LoopEventNotify) {
+    LOG_WARN("Node:%p slow %s callback %.1fms on event thread %d, "
+             "cmd:'%c'.", node, getEventTypeName(type),
+             elapsedUs / 1000.0, threadIndexOf(thread), (char)detail);
+  } else {
+    LOG_WARN("Node:%p slow %s callback %.1fms on event thread %d.",
+             node, getEventTypeName(type), elapsedUs / 1000.0,
+             threadIndexOf(thread));
+  }
+}
+
+void LoopWatchdog::scheduleLagTimer(WorkThread* thread, long intervalMs) {
+  struct timeval tv;
+  tv.tv_sec = intervalMs / 1000;
+  tv.tv_usec = (intervalMs % 1000) * 1000;
+  thread->_lagExpectedUs = utility::getMonotonicUs() + intervalMs * 1000;
+  event_add(&thread->_lagEvent, &tv);
+}
+
+void LoopWatchdog::startLagTimer(WorkThread* thread) {
+  utility::atomicAdd(&_runningLoops, 1);
+  long intervalMs = utility::atomicLoad(&_lagCheckMs);
+  if (!enabled() || intervalMs <= 0) {
+    return;
+  }
+  if (event_assign(&thread->_lagEvent, thread->_workBase, -1, 0,
+                   lagTimerCallback, thread) == -1) {
+    LOG_ERROR("Loop watchdog event_assign failed.");
+    return;
+  }
+  thread->_lagArmed = true;
+  utility::atomicAdd(&_armedTimers, 1);
+  scheduleLagTimer(thread, intervalMs);
+}
+
+void LoopWatchdog::stopLagTimer(WorkThread* thread) {
+  if (thread->_lagArmed) {
+    event_del(&thread->_lagEvent);
+    thread->_lagArmed = false;
+    utility::atomicAdd(&_armedTimers, -1);
+  }
+  utility::atomicAdd(&_runningLoops, -1);
+}
+
+void LoopWatchdog::lagTimerCallback(evutil_socket_t fd, short what,
+                                    void* arg) {
+  WorkThread* thread = (WorkThread*)arg;
+  uint64_t now = utility::getMonotonicUs();
+  uint64_t lagUs = now > thread->_lagExpectedUs ?
+      now - thread->_lagExpectedUs : 0;
+  // 取出并清零, 读取与清零之间新增的慢回调计入下一周期
+  long slow = utility::atomicExchange(&thread->_slowCallbacks, 0);
+  (void)slow;  // 编译期去除WARN时仅清零
+
+  utility::NlsMetrics::loopLagUs.observe(lagUs);
+  long thresholdUs = utility::atomicLoadRelaxed(&_thresholdUs);
+  if (thresholdUs > 0 && lagUs >= (uint64_t)thresholdUs) {
+    LOG_WARN("Event thread %d loop lag %.1fms, "
+             "slow callbacks since last check:%ld.",
+             (int)thread->_threadIndex, lagUs / 1000.0, slow);
+  }
+
+  // 关闭看门狗后不再检测
+  long intervalMs = utility::atomicLoad(&_lagCheckMs);
+  if (thresholdUs <= 0 || intervalMs <= 0) {
+    thread->_lagArmed = false;
+    utility::atomicAdd(&_armedTimers, -1);
+    return;
+  }
+  scheduleLagTimer(thread, intervalMs);
+}
+
+}  // namespace AlibabaNls
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_LOOP_WATCHDOG_H
+#define NLS_SDK_LOOP_WATCHDOG_H
+
+#include <stdint.h>
+#include "event2/util.h"
+#include "nlsAtomic.h"
+#include "utility.h"
+
+namespace AlibabaNls {
+
+class WorkThread;
+
+enum LoopEventType {
+  LoopEventConnect = 0,
+  LoopEventRead,
+  LoopEventWrite,
+  LoopEventDns,
+  LoopEventNotify,   /* 主线程及编码线程的通知, detail为指令字符 */
+  LoopEventHandler   /* 同步执行的用户回调, detail为NlsEvent::EventType */
+};
+
+/*
+ * 事件循环看门狗. 用户回调及编码结果发送都在事件线程中执行,
+ * 一次耗时操作会拖慢该线程上的所有请求. 开启后:
+ *   记录每个libevent回调及同步用户回调的执行时长, 超过阈值时告警,
+ *   告警附带node及事件类型;
+ *   每个事件线程以定时器比较预期与实际触发时间, 得到循环延迟,
+ *   超过阈值时告警, 附带本周期内的慢回调数.
+ * 关闭时每个回调只多一次标志读取.
+ */
+class LoopWatchdog {
+ public:
+  /*
+   * @param slowCallbackMs 告警阈值, 0为关闭
+   * @param lagCheckMs     循环延迟检测周期, 0为不检测
+   * @return 成功返回0, 参数错误返回-1
+   */
+  static int setConfig(int slowCallbackMs, int lagCheckMs);
+
+  /* 每个循环回调都会读取, 阈值变化后稍晚生效无害, 不需要屏障 */
+  static inline bool enabled() {
+    return utility::atomicLoadRelaxed(&_thresholdUs) > 0;
+  }
+
+  static void recordCallback(WorkThread* thread, LoopEventType type,
+                             const void* node, int detail, uint64_t beginUs);
+
+  /*
+   * 在事件线程中, 事件循环开始前及结束后调用.
+   * 延迟检测定时器只在此启动, 事件线程运行后再开启检测不会生效
+   */
+  static void startLagTimer(WorkThread* thread);
+  static void stopLagTimer(WorkThread* thread);
+
+  static const char* getEventTypeName(LoopEventType type);
+
+ private:
+  static void lagTimerCallback(evutil_socket_t fd, short what, void* arg);
+  static void scheduleLagTimer(WorkThread* thread, long intervalMs);
+
+  static volatile long _thresholdUs;
+  static volatile long _lagCheckMs;
+  /* 运行中的事件循环数及已启动延迟检测定时器的数量, setConfig据此告警 */
+  static volatile long _runningLoops;
+  static volatile long _armedTimers;
+};
+
+/*
+ * 以作用域计时一次回调. 回调中node可能已被释放, 析构时只使用其地址.
+ */
+class LoopCallbackTimer {
+ public:
+  LoopCallbackTimer(WorkThread* thread, LoopEventType type,
+                    const void* node, int detail = -1)
+      : _thread(thread), _type(type), _node(node), _detail(detail),
+        _beginUs(LoopWatchdog::enabled() ? utility::getMonotonicUs() : 0) {}
+
+  /* 回调中确定处理对象后补充, 用于告警 */
+  inline void setNode(const void* node, int detail) {
+    _node = node;
+    _detail = detail;
+  }
+
+  ~LoopCallbackTimer() {
+    if (_beginUs != 0) {
+      LoopWatchdog::recordCallback(_thread, _type, _node, _detail, _beginUs);
+    }
+  }
+
+ private:
+  LoopCallbackTimer(const LoopCallbackTimer&);
+  LoopCallbackTimer& operator=(const LoopCallbackTimer&);
+
+  WorkThread* _thread;
+  LoopEventType _type;
+  const void* _node;
+  int _detail;
+  uint64_t _beginUs;
+};
+
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_LOOP_WATCHDOG_H
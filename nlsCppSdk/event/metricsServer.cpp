@@ -0,0 +1,248 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <process.h>
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <netinet/in.h>
+#endif
+
+#include "nlsAtomic.h"
+#include "utility.h"
+#include "nlog.h"
+#include "nlsMetrics.h"
+#include "metricsServer.h"
+
+namespace AlibabaNls {
+
+#define METRICS_REQUEST_MAX 4096
+#define METRICS_POLL_MS 200
+#define METRICS_READ_TIMEOUT_MS 2000
+
+volatile long MetricsServer::_running = 0;
+evutil_socket_t MetricsServer::_listenFd = -1;
+
+#if defined(_MSC_VER)
+HANDLE MetricsServer::_serverHandle = NULL;
+unsigned MetricsServer::_serverId = 0;
+#else
+pthread_t MetricsServer::_serverId;
+#endif
+
+int MetricsServer::start(const char* address, int port) {
+  if (port <= 0 || port > 65535 || utility::atomicLoad(&_running)) {
+    return -1;
+  }
+
+#if defined(_MSC_VER)
+  WSADATA wsaData;
+  (void)WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+  char endpoint[128];
+  _ssnprintf(endpoint, sizeof(endpoint), "%s:%d",
+             address ? address : "127.0.0.1", port);
+  struct sockaddr_storage sa;
+  int saLength = sizeof(sa);
+  memset(&sa, 0, sizeof(sa));
+  if (evutil_parse_sockaddr_port(endpoint, (struct sockaddr*)&sa,
+                                 &saLength) != 0) {
+    LOG_ERROR("Invalid metrics address %s.", endpoint);
+    return -1;
+  }
+
+  _listenFd = socket(((struct sockaddr*)&sa)->sa_family, SOCK_STREAM, 0);
+  if (_listenFd < 0) {
+    LOG_ERROR("Create metrics socket failed:%d.",
+              utility::getLastErrorCode());
+    return -1;
+  }
+  evutil_make_listen_socket_reuseable(_listenFd);
+  if (bind(_listenFd, (struct sockaddr*)&sa, saLength) != 0 ||
+      listen(_listenFd, 16) != 0) {
+    LOG_ERROR("Metrics server listen on %s failed:%d.",
+              endpoint, utility::getLastErrorCode());
+    evutil_closesocket(_listenFd);
+    _listenFd = -1;
+    return -1;
+  }
+
+  utility::atomicStore(&_running, 1);
+#if defined(_MSC_VER)
+  _serverHandle = (HANDLE)_beginthreadex(
+      NULL, 0, loopServer, NULL, 0, &_serverId);
+  if (_serverHandle == NULL) {
+#else
+  if (pthread_create(&_serverId, NULL, loopServer, NULL) != 0) {
+#endif
+    LOG_ERROR("Create metrics server thread failed.");
+    utility::atomicStore(&_running, 0);
+    evutil_closesocket(_listenFd);
+    _listenFd = -1;
+    return -1;
+  }
+
+  LOG_INFO("Metrics server listening on %s.", endpoint);
+  return 0;
+}
+
+void MetricsServer::stop() {
+  if (!utility::atomicCompareSwap(&_running, 1, 0)) {
+    return;
+  }
+
+  // 服务线程每METRICS_POLL_MS检查一次退出标志
+#if defined(_MSC_VER)
+  WaitForSingleObject(_serverHandle, INFINITE);
+  CloseHandle(_serverHandle);
+  _serverHandle = NULL;
+#else
+  pthread_join(_serverId, NULL);
+#endif
+
+  evutil_closesocket(_listenFd);
+  _listenFd = -1;
+  LOG_INFO("Metrics server stopped.");
+}
+
+/* 用poll而非select, fd超过FD_SETSIZE时select会越界写fd_set */
+bool MetricsServer::waitReadable(evutil_socket_t fd, int timeoutMs) {
+#if defined(_MSC_VER)
+  WSAPOLLFD pfd;
+  pfd.fd = fd;
+  pfd.events = POLLRDNORM;
+  pfd.revents = 0;
+  return WSAPoll(&pfd, 1, timeoutMs) > 0;
+#else
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, timeoutMs) > 0;
+#endif
+}
+
+static void sendAll(evutil_socket_t fd, const char* data, size_t size) {
+  while (size > 0) {
+#if defined(__ANDROID__) || defined(__linux__)
+    int sent = send(fd, data, size, MSG_NOSIGNAL);
+#else
+    int sent = send(fd, data, (int)size, 0);
+#endif
+    if (sent <= 0) {
+      return;
+    }
+    data += sent;
+    size -= sent;
+  }
+}
+
+static void sendResponse(evutil_socket_t fd, const char* status,
+                         const char* contentType, const std::string& body) {
+  char header[256];
+  int length = _ssnprintf(header, sizeof(header),
+                          "HTTP/1.1 %s\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Length: %d\r\n"
+                          "Connection: close\r\n\r\n",
+                          status, contentType, (int)body.size());
+  sendAll(fd, header, (size_t)length);
+  sendAll(fd, body.c_str(), body.size());
+}
+
+void MetricsServer::serveConnection(evutil_socket_t fd) {
+  char request[METRICS_REQUEST_MAX];
+  size_t size = 0;
+
+  // 读取到请求头结束, 请求体忽略
+  while (size < sizeof(request) - 1) {
+    if (!waitReadable(fd, METRICS_READ_TIMEOUT_MS)) {
+      return;
+    }
+    int received = recv(fd, request + size, (int)(sizeof(request) - 1 - size), 0);
+    if (received <= 0) {
+      return;
+    }
+    size += received;
+    request[size] = '\0';
+    if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+      break;
+    }
+  }
+  request[size] = '\0';
+
+  std::string body;
+  if (strncmp(request, "GET ", 4) != 0) {
+    body = "method not allowed\n";
+    sendResponse(fd, "405 Method Not Allowed", "text/plain", body);
+    return;
+  }
+
+  const char* path = request + 4;
+  size_t pathLength = strcspn(path, " ?\r\n");
+  if (pathLength == 8 && strncmp(path, "/metrics", 8) == 0) {
+    utility::NlsMetricRegistry::dump(body);
+    sendResponse(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+                 body);
+  } else {
+    body = "not found\n";
+    sendResponse(fd, "404 Not Found", "text/plain", body);
+  }
+}
+
+#if defined(_MSC_VER)
+unsigned __stdcall MetricsServer::loopServer(LPVOID arg) {
+#else
+void* MetricsServer::loopServer(void* arg) {
+#endif
+
+#if defined(__ANDROID__) || defined (__linux__)
+  sigset_t signal_mask;
+  sigemptyset(&signal_mask);
+  sigaddset(&signal_mask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &signal_mask, NULL);
+
+  prctl(PR_SET_NAME, "metricsServer");
+#endif
+
+  while (utility::atomicLoad(&_running)) {
+    if (!waitReadable(_listenFd, METRICS_POLL_MS)) {
+      continue;
+    }
+    evutil_socket_t fd = accept(_listenFd, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    serveConnection(fd);
+    evutil_closesocket(fd);
+  }
+
+#if defined(_MSC_VER)
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+}  // namespace AlibabaNls
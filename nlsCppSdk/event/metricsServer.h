@@ -0,0 +1,66 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_METRICS_SERVER_H
+#define NLS_SDK_METRICS_SERVER_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <string>
+#include "event2/util.h"
+
+namespace AlibabaNls {
+
+/*
+ * 内嵌的指标HTTP服务, 单线程依次处理连接,
+ * 仅响应 GET /metrics, 返回Prometheus文本格式的SDK指标.
+ */
+class MetricsServer {
+ public:
+  /*
+   * @brief 监听address:port并启动服务线程
+   * @return 成功返回0, 已启动或监听失败返回-1
+   */
+  static int start(const char* address, int port);
+  static void stop();
+
+ private:
+#if defined(_MSC_VER)
+  static unsigned __stdcall loopServer(LPVOID arg);
+#else
+  static void* loopServer(void* arg);
+#endif
+  static void serveConnection(evutil_socket_t fd);
+  static bool waitReadable(evutil_socket_t fd, int timeoutMs);
+
+  static volatile long _running;
+  static evutil_socket_t _listenFd;
+
+#if defined(_MSC_VER)
+  static HANDLE _serverHandle;
+  static unsigned _serverId;
+#else
+  static pthread_t _serverId;
+#endif
+};
+
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_METRICS_SERVER_H
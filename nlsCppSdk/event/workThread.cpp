@@ -34,6 +34,9 @@
 #include "iNlsRequestParam.h"
 #include "workThread.h"
 #include "connectNode.h"
+#include "nlsRequestPool.h"
+#include "loopWatchdog.h"
+#include "nlsAtomic.h"
 #include "nlog.h"
 #include "utility.h"
 
@@ -49,6 +52,11 @@ int WorkThread::_cpuCurrent = 0;
 
 WorkThread::WorkThread() {
   LOG_DEBUG("Create WorkThread.");
+  _threadIndex = 0;
+  _activeNodes = NULL;
+  _lagArmed = false;
+  _lagExpectedUs = 0;
+  _slowCallbacks = 0;
 #if defined(_MSC_VER)
   _mtxList = CreateMutex(NULL, FALSE, NULL);
 #else
@@ -105,6 +113,18 @@ WorkThread::~WorkThread() {
   int try_count = 500;
 
   LOG_DEBUG("Begin destroy WorkThread list:%p  %d.", this, _nodeList.size());
+
+  // 编码线程池已退出, 未发送的编码结果不再处理
+  ConnectNode* encoded = NULL;
+  while ((encoded = getEncodedNode(this)) != NULL) {
+    utility::atomicAdd(&encoded->_pendingEncodes, -1);
+  }
+  // 事件线程已退出, 尚未放入回调队列的回调直接丢弃
+  CallbackTask task;
+  while (getCallbackTask(this, &task)) {
+    delete task.event;
+    task.node->finishCallback();
+  }
   //must check asr is end
   do {
 #ifdef _MSC_VER
@@ -127,8 +147,8 @@ WorkThread::~WorkThread() {
         request = NULL;
       } else {
         LOG_WARN("destroy WorkThread cStatus:%s, eStatus:%s",
-            request->getConnectNode()->getConnectNodeStatusString().c_str(),
-            request->getConnectNode()->getExitStatusString().c_str());
+            request->getConnectNode()->getConnectNodeStatusString(),
+            request->getConnectNode()->getExitStatusString());
         itList++;
       }
     }  // for
@@ -211,6 +231,9 @@ void WorkThread::insertListNode(WorkThread* thread, INlsRequest * request) {
 #endif
 
   thread->_nodeList.push_back(request);
+  if (thread->_activeNodes) {
+    thread->_activeNodes->add(1);
+  }
 
 #if defined(_MSC_VER)
   ReleaseMutex(thread->_mtxList);
@@ -233,6 +256,9 @@ void WorkThread::freeListNode(WorkThread* thread, INlsRequest* request) {
 
   if (iLocation != thread->_nodeList.end()) {
     thread->_nodeList.remove(*iLocation);
+    if (thread->_activeNodes) {
+      thread->_activeNodes->add(-1);
+    }
     LOG_DEBUG("List requests :%d.", thread->_nodeList.size());
   }
 
@@ -243,6 +269,145 @@ void WorkThread::freeListNode(WorkThread* thread, INlsRequest* request) {
 #endif
 }
 
+void WorkThread::insertEncodedNode(WorkThread* thread, ConnectNode* node) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(thread->_mtxList, INFINITE);
+#else
+  pthread_mutex_lock(&(thread->_mtxList));
+#endif
+
+  bool wasEmpty = thread->_encodedList.empty();
+  thread->_encodedList.push_back(node);
+
+#if defined(_MSC_VER)
+  ReleaseMutex(thread->_mtxList);
+#else
+  pthread_mutex_unlock(&(thread->_mtxList));
+#endif
+
+  // 列表非空时事件线程尚未处理完上一次通知, 无需重复通知
+  if (wasEmpty) {
+    char cmd = 'e';
+    if (send(thread->_notifySendFd, (char *)&cmd, sizeof(char), 0) < 1) {
+      LOG_ERROR("Node:%p encoded notify failed.", node);
+    }
+  }
+}
+
+ConnectNode* WorkThread::getEncodedNode(WorkThread* thread) {
+  ConnectNode* node = NULL;
+#if defined(_MSC_VER)
+  WaitForSingleObject(thread->_mtxList, INFINITE);
+#else
+  pthread_mutex_lock(&(thread->_mtxList));
+#endif
+
+  if (!thread->_encodedList.empty()) {
+    node = thread->_encodedList.front();
+    thread->_encodedList.pop_front();
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(thread->_mtxList);
+#else
+  pthread_mutex_unlock(&(thread->_mtxList));
+#endif
+  return node;
+}
+
+size_t WorkThread::takeEncodedNode(WorkThread* thread, ConnectNode* node) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(thread->_mtxList, INFINITE);
+#else
+  pthread_mutex_lock(&(thread->_mtxList));
+#endif
+
+  size_t before = thread->_encodedList.size();
+  thread->_encodedList.remove(node);
+  size_t count = before - thread->_encodedList.size();
+
+#if defined(_MSC_VER)
+  ReleaseMutex(thread->_mtxList);
+#else
+  pthread_mutex_unlock(&(thread->_mtxList));
+#endif
+  return count;
+}
+
+void WorkThread::insertCallbackTask(WorkThread* thread,
+                                    const CallbackTask& task) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(thread->_mtxList, INFINITE);
+#else
+  pthread_mutex_lock(&(thread->_mtxList));
+#endif
+
+  bool wasEmpty = thread->_callbackList.empty();
+  thread->_callbackList.push_back(task);
+
+#if defined(_MSC_VER)
+  ReleaseMutex(thread->_mtxList);
+#else
+  pthread_mutex_unlock(&(thread->_mtxList));
+#endif
+
+  if (wasEmpty) {
+    char cmd = 'b';
+    if (send(thread->_notifySendFd, (char *)&cmd, sizeof(char), 0) < 1) {
+      LOG_ERROR("Node:%p callback notify failed.", task.node);
+    }
+  }
+}
+
+bool WorkThread::getCallbackTask(WorkThread* thread, CallbackTask* task) {
+  bool found = false;
+#if defined(_MSC_VER)
+  WaitForSingleObject(thread->_mtxList, INFINITE);
+#else
+  pthread_mutex_lock(&(thread->_mtxList));
+#endif
+
+  if (!thread->_callbackList.empty()) {
+    *task = thread->_callbackList.front();
+    thread->_callbackList.pop_front();
+    found = true;
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(thread->_mtxList);
+#else
+  pthread_mutex_unlock(&(thread->_mtxList));
+#endif
+  return found;
+}
+
+int WorkThread::discardCallbackTasks(WorkThread* thread, ConnectNode* node) {
+  int count = 0;
+#if defined(_MSC_VER)
+  WaitForSingleObject(thread->_mtxList, INFINITE);
+#else
+  pthread_mutex_lock(&(thread->_mtxList));
+#endif
+
+  std::list<CallbackTask>::iterator it = thread->_callbackList.begin();
+  while (it != thread->_callbackList.end()) {
+    if (it->node == node) {
+      delete it->event;
+      it = thread->_callbackList.erase(it);
+      count++;
+    } else {
+      ++it;
+    }
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(thread->_mtxList);
+#else
+  pthread_mutex_unlock(&(thread->_mtxList));
+#endif
+  return count;
+}
+
 void WorkThread::destroyConnectNode(ConnectNode* node) {
   if (node == NULL) {
     LOG_DEBUG("Input node is null.");
@@ -250,13 +415,12 @@ void WorkThread::destroyConnectNode(ConnectNode* node) {
   }
 
   LOG_INFO("Node:%p FreeConnectNode begin.", node);
+  node->finishTrace();
   freeListNode(node->_eventThread, node->_request);
   if (node->updateDestroyStatus()) {
     LOG_INFO("Node:%p DestroyConnectNode done.", node);
-    INlsRequest* request = node->_request;
-    if (request) {
-      delete request;
-      request = NULL;
+    if (node->_request) {
+      recycleRequest(node);
     }
   }
 
@@ -265,6 +429,33 @@ void WorkThread::destroyConnectNode(ConnectNode* node) {
   return;
 }
 
+/*
+ * 在事件线程中回收request, 不等待编码线程及回调线程:
+ * 尚有编码结果未发送时, 由本线程发送最后一个编码结果后回收;
+ * 尚有回调未执行时, 交给回调线程在其后回收.
+ */
+void WorkThread::recycleRequest(ConnectNode* node) {
+  // 编码任务只在本线程结束, 计数在此期间只减不增
+  if (utility::atomicLoad(&node->_pendingEncodes) > 0) {
+    LOG_DEBUG("Node:%p recycle after encoded audio sent.", node);
+    node->_recycleOnEncoded = true;
+    return;
+  }
+
+  if (CallbackExecutor::dispatchRecycle(node) < 0) {
+    NlsRequestPool::recycle(node->_request);
+  }
+}
+
+void WorkThread::finishEncodedNode(ConnectNode* node) {
+  // 须在递减前读取: 未等待回收时, 递减后node可能已被其他线程释放
+  bool recycle = node->_recycleOnEncoded;
+  if (utility::atomicAdd(&node->_pendingEncodes, -1) == 0 && recycle) {
+    node->_recycleOnEncoded = false;
+    recycleRequest(node);
+  }
+}
+
 #if defined(_MSC_VER)
 unsigned __stdcall WorkThread::loopEventCallback(LPVOID arg) {
 #else
@@ -294,9 +485,11 @@ void* WorkThread::loopEventCallback(void* arg) {
   prctl(PR_SET_NAME, "eventThread");
 #endif
 
+  LoopWatchdog::startLagTimer(eventParam);
   //LOG_ERROR("event_base_dispatch begin.", _cpuCurrent);
   event_base_dispatch(eventParam->_workBase);
   //LOG_ERROR("event_base_dispatch done.", _cpuCurrent);
+  LoopWatchdog::stopLagTimer(eventParam);
 
   evdns_base_free(eventParam->_dnsBase, 0);
   event_base_free(eventParam->_workBase);
@@ -312,6 +505,7 @@ void WorkThread::connectEventCallback(
     evutil_socket_t socketFd , short event, void *arg) {
   int errorCode = 0;
   ConnectNode *node = (ConnectNode*)arg;
+  LoopCallbackTimer timer(node->_eventThread, LoopEventConnect, node);
 
   if (event == EV_TIMEOUT) {
     LOG_DEBUG("Node:%p connect EV_TIMEOUT.", node);
@@ -327,6 +521,7 @@ void WorkThread::connectEventCallback(
       if (!errorCode) {
         LOG_INFO("Node:%p connect return ev_write, check ok.", node);
         node->setConnectNodeStatus(NodeConnected);
+        node->markTrace(TraceTcpConnected);
 
         #ifndef _MSC_VER
         // get client ip and port from socketFd
@@ -384,6 +579,7 @@ EventProcessFailed:
 void WorkThread::readEventCallBack(
     evutil_socket_t socketFd, short what, void *arg) {
   ConnectNode *node = (ConnectNode*)arg;
+  LoopCallbackTimer timer(node->_eventThread, LoopEventRead, node);
   char tmp_msg[512] = {0};
 
   if (what == EV_READ){
@@ -417,6 +613,7 @@ void WorkThread::writeEventCallBack(
     evutil_socket_t socketFd, short what, void *arg) {
   char tmp_msg[512] = {0};
   ConnectNode *node = (ConnectNode*)arg;
+  LoopCallbackTimer timer(node->_eventThread, LoopEventWrite, node);
 
   if (what == EV_WRITE){
     nodeRequestProcess(node);
@@ -449,6 +646,7 @@ void WorkThread::dnsEventCallback(int errorCode,
                                   struct evutil_addrinfo *address,
                                   void *arg) {
   ConnectNode *node = (ConnectNode *)arg;
+  LoopCallbackTimer timer(node->_eventThread, LoopEventDns, node);
 
   if (errorCode) {
     LOG_ERROR("Node:%p %s dns failed: %s.",
@@ -460,6 +658,8 @@ void WorkThread::dnsEventCallback(int errorCode,
     return ;
   }
 
+  node->markTrace(TraceDnsEnd);
+
   if (address->ai_canonname) {
     LOG_DEBUG("Node:%p ai_canonname: %s", node, address->ai_canonname);
   }
@@ -545,22 +745,33 @@ ConnectRetry:
 
 void WorkThread::notifyEventCallback(evutil_socket_t fd, short which, void *arg) {
   WorkThread *pThread = (WorkThread*)arg;
+  LoopCallbackTimer timer(pThread, LoopEventNotify, NULL);
   char msgCmd;
   if (recv(pThread->_notifyReceiveFd, (char *)&msgCmd, sizeof(char), 0) <= 0) {
     LOG_ERROR("work Thread recv() failed:%d.", utility::getLastErrorCode());
     return;
   }
   LOG_DEBUG("work Thread receive: '%c' from main thread.", msgCmd);
+  timer.setNode(NULL, msgCmd);
 
   if (msgCmd == 'c') {
     INlsRequest *request = getQueueNode(pThread);
     insertListNode(pThread, request);
+    timer.setNode(request->getConnectNode(), msgCmd);
 
     LOG_DEBUG("Node:%p begin dnsprocess.", request->getConnectNode());
 
     if (request->getConnectNode()->dnsProcess() == -1) {
       destroyConnectNode(request->getConnectNode());
     }
+  } else if (msgCmd == 'e') {
+    ConnectNode* node = NULL;
+    while ((node = getEncodedNode(pThread)) != NULL) {
+      node->sendEncodedAudio();
+      finishEncodedNode(node);
+    }
+  } else if (msgCmd == 'b') {
+    CallbackExecutor::dispatchLoopTasks(pThread);
   } else if (msgCmd == 's') {
     event_base_loopbreak(pThread->_workBase);
   } else {
@@ -583,7 +794,7 @@ int WorkThread::nodeRequestProcess(ConnectNode* node) {
 
   ConnectStatus workStatus = node->getConnectNodeStatus();
   LOG_DEBUG("Node:%p workStatus %d(%s).",
-      node, workStatus, node->getConnectNodeStatusString().c_str());
+      node, workStatus, ConnectNode::getConnectStatusName(workStatus));
   switch(workStatus) {
     /*connect to gateWay*/
     case NodeHandshaking:
@@ -646,13 +857,14 @@ int WorkThread::nodeResponseProcess(ConnectNode* node) {
 
   ConnectStatus workStatus = node->getConnectNodeStatus();
   LOG_DEBUG("Node:%p workStatus %d(%s).",
-      node, workStatus, node->getConnectNodeStatusString().c_str());
+      node, workStatus, ConnectNode::getConnectStatusName(workStatus));
   switch(workStatus) {
     /*connect to gateWay*/
     case NodeHandshaking:
     case NodeHandshaked:
       ret = node->gatewayResponse();
       if (ret == 0) {
+        node->markTrace(TraceUpgraded);
         node->setConnectNodeStatus(NodeStarting);
         if (node->_request->getRequestParam()->_requestType == SpeechTextDialog) {
           node->addCmdDataBuffer(CmdTextDialog);
@@ -660,6 +872,9 @@ int WorkThread::nodeResponseProcess(ConnectNode* node) {
           node->addCmdDataBuffer(CmdStart);
         }
         ret = node->nlsSendFrame(node->getCmdEvBuffer());
+        if (ret >= 0) {
+          node->markTrace(TraceStartSent);
+        }
       }
       break;
     /*send start command*/
@@ -23,6 +23,8 @@
 #include "event.h"
 #include "event2/util.h"
 #include "event2/dns.h"
+#include "nlsMetrics.h"
+#include "callbackExecutor.h"
 
 namespace AlibabaNls {
 
@@ -49,6 +51,8 @@ class WorkThread {
 #endif
 
   static void destroyConnectNode(ConnectNode* node);
+  static void recycleRequest(ConnectNode* node);
+  static void finishEncodedNode(ConnectNode* node);
   static int nodeRequestProcess(ConnectNode* node);
   static int nodeResponseProcess(ConnectNode* node);
 
@@ -57,6 +61,23 @@ class WorkThread {
   static void insertListNode(WorkThread* thread, INlsRequest * request);
   static void freeListNode(WorkThread* thread, INlsRequest * request);
 
+  /*
+   * 编码线程池将编码完成的节点交给所属事件线程发送,
+   * 编码任务均在事件线程中结束(finishEncodedNode).
+   */
+  static void insertEncodedNode(WorkThread* thread, ConnectNode* node);
+  static ConnectNode* getEncodedNode(WorkThread* thread);
+  static size_t takeEncodedNode(WorkThread* thread, ConnectNode* node);
+
+  /*
+   * 非事件线程产生的回调(如sendAudio失败)先交给node所属事件线程,
+   * 由事件线程放入回调队列, 与本线程产生的回调保持同一顺序.
+   */
+  static void insertCallbackTask(WorkThread* thread, const CallbackTask& task);
+  static bool getCallbackTask(WorkThread* thread, CallbackTask* task);
+  /* 丢弃node尚未放入回调队列的回调, 返回丢弃数量 */
+  static int discardCallbackTasks(WorkThread* thread, ConnectNode* node);
+
 #ifdef _MSC_VER
   HANDLE _mtxList;
   HANDLE _workThreadHandle;
@@ -70,14 +91,25 @@ class WorkThread {
   static int _cpuNumber;
   static int _cpuCurrent;
 
+  size_t _threadIndex;  // 在NlsEventNetWork工作线程数组中的下标
+  utility::NlsGauge* _activeNodes;  // 本线程的活跃请求数指标
+
   struct event_base * _workBase;
   struct evdns_base *_dnsBase;
   struct event _notifyEvent;
   evutil_socket_t _notifyReceiveFd;
   evutil_socket_t _notifySendFd;
 
+  /* 循环延迟检测, 见LoopWatchdog */
+  struct event _lagEvent;
+  bool _lagArmed;
+  uint64_t _lagExpectedUs;
+  volatile long _slowCallbacks;  // 上次检测以来的慢回调数
+
   std::queue<INlsRequest*> _nodeQueue;
   std::list<INlsRequest*> _nodeList;
+  std::list<ConnectNode*> _encodedList;
+  std::list<CallbackTask> _callbackList;
 
  private:
 
@@ -14,16 +14,29 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include "Config.h"
 #include "nlsClient.h"
 #include "nlog.h"
 #include "connectNode.h"
 #include "SSLconnect.h"
 #include "nlsEventNetWork.h"
+#include "callbackExecutor.h"
+#include "encoderExecutor.h"
+#include "latencyTracer.h"
+#include "loopWatchdog.h"
+#include "trafficCapture.h"
+#include "nlsMemory.h"
+#include "metricsServer.h"
+#include "nlsMetrics.h"
+#include "nlsRequestPool.h"
 
 #include "sr/speechRecognizerRequest.h"
 #include "st/speechTranscriberRequest.h"
+#include "st/speechTranscriberMultiChannel.h"
 #include "sy/speechSynthesizerRequest.h"
+#include "sy/speechSynthesizerLongText.h"
 #include "da/dialogAssistantRequest.h"
 
 namespace AlibabaNls {
@@ -78,11 +91,25 @@ void NlsClient::releaseInstance() {
   if (_instance) {
     LOG_DEBUG("release NlsClient instance:%p.", _instance);
 
+    MetricsServer::stop();
+
+    // 先停止编码线程, 之后不再有编码结果交给事件线程
+    EncoderExecutor::destroyEncoderExecutor();
+
     if (_isInitializeThread) {
       NlsEventNetWork::destroyEventNetWork();
       _isInitializeThread = false;
     }
 
+    // 池中空闲request不属于任何事件线程, 事件线程退出后统一释放
+    NlsRequestPool::clear();
+
+    // 请求均已释放后再停止回调线程
+    CallbackExecutor::destroyCallbackExecutor();
+
+    // 事件线程已退出, 不再有新的时延上报
+    LatencyTracer::destroyLatencyTracer();
+
     if (_isInitializeSSL) {
       LOG_DEBUG("delete NlsClient release ssl.");
       SSLconnect::destroy();
@@ -119,6 +146,9 @@ void NlsClient::startWorkThread(int threadsNumber) {
   if (!_isInitializeThread) {
     NlsEventNetWork::initEventNetWork(threadsNumber);
     _isInitializeThread = true;
+
+    CallbackExecutor::initCallbackExecutor(
+        NlsEventNetWork::getWorkThreadsNumber());
   }
 
 #if defined(_MSC_VER)
@@ -128,6 +158,130 @@ void NlsClient::startWorkThread(int threadsNumber) {
 #endif
 }
 
+int NlsClient::setCallbackExecutor(int threadsNumber, int queueSize,
+                                   CallbackOverflowPolicy policy,
+                                   int maxOverflowSize) {
+  if (CallbackExecutor::setConfig(threadsNumber, queueSize, policy,
+                                  maxOverflowSize) < 0) {
+    return -1;
+  }
+
+  int ret = 0;
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtx, INFINITE);
+#else
+  pthread_mutex_lock(&_mtx);
+#endif
+
+  if (_isInitializeThread) {
+    ret = CallbackExecutor::initCallbackExecutor(
+        NlsEventNetWork::getWorkThreadsNumber());
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtx);
+#else
+  pthread_mutex_unlock(&_mtx);
+#endif
+  return ret;
+}
+
+int NlsClient::getCallbackExecutorStats(NlsCallbackExecutorStats* stats) {
+  return CallbackExecutor::getStats(stats);
+}
+
+int NlsClient::setRequestPoolSize(int maxIdlePerType) {
+  return NlsRequestPool::setMaxIdle(maxIdlePerType);
+}
+
+int NlsClient::getRequestPoolStats(NlsRequestPoolStats* stats) {
+  return NlsRequestPool::getStats(stats);
+}
+
+int NlsClient::setEncoderThreadPool(int threadsNumber, int firstCpu) {
+  return EncoderExecutor::initEncoderExecutor(threadsNumber, firstCpu);
+}
+
+int NlsClient::getEncoderThreadPoolStats(NlsEncoderPoolStats* stats) {
+  return EncoderExecutor::getStats(stats);
+}
+
+int NlsClient::setLatencyTraceCallback(NlsLatencyTraceCallback callback,
+                                       void* userData) {
+  return LatencyTracer::setCallback(callback, userData);
+}
+
+int NlsClient::setLatencyTraceExporter(const char* target) {
+  return LatencyTracer::setExporter(target);
+}
+
+int NlsClient::setEventLoopWatchdog(int slowCallbackMs, int lagCheckMs) {
+  return LoopWatchdog::setConfig(slowCallbackMs, lagCheckMs);
+}
+
+int NlsClient::setTrafficCapture(const char* dir, bool captureSent) {
+  return TrafficRecorder::setCaptureDir(dir, captureSent);
+}
+
+int NlsClient::setMemoryLimit(uint64_t limitBytes) {
+  utility::NlsMemory::setLimit((int64_t)limitBytes);
+  return 0;
+}
+
+int NlsClient::enableLibeventMemoryStats() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtx, INFINITE);
+#else
+  pthread_mutex_lock(&_mtx);
+#endif
+
+  // 与startWorkThread互斥, 保证钩子先于任何libevent对象的创建
+  int ret = utility::NlsMemory::installAllocatorHook();
+  if (ret < 0) {
+    LOG_WARN("libevent memory stats unavailable, "
+             "call it before startWorkThread.");
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtx);
+#else
+  pthread_mutex_unlock(&_mtx);
+#endif
+  return ret;
+}
+
+int NlsClient::getMemoryUsage(NlsMemoryUsage* usage) {
+  if (usage == NULL) {
+    return -1;
+  }
+  usage->bufferedBytes = utility::NlsMemory::getBufferedBytes();
+  usage->peakBufferedBytes = utility::NlsMemory::getPeakBufferedBytes();
+  usage->libeventBytes = utility::NlsMemory::getLibeventBytes();
+  usage->limitBytes = utility::NlsMemory::getLimit();
+  usage->rejectedStarts = utility::NlsMetrics::memoryRejectedStarts.value();
+  usage->rejectedAudio = utility::NlsMetrics::memoryRejectedAudio.value();
+  return 0;
+}
+
+int NlsClient::dumpMetrics(char* buffer, size_t size) {
+  std::string text;
+  utility::NlsMetricRegistry::dump(text);
+  if (buffer && size > 0) {
+    size_t length = text.size() < size ? text.size() : size - 1;
+    memcpy(buffer, text.c_str(), length);
+    buffer[length] = '\0';
+  }
+  return (int)text.size();
+}
+
+int NlsClient::startMetricsServer(int port, const char* address) {
+  return MetricsServer::start(address, port);
+}
+
+void NlsClient::stopMetricsServer() {
+  MetricsServer::stop();
+}
+
 int NlsClient::setLogConfig(const char* logOutputFile,
                             const LogLevel logLevel,
                             unsigned int logFileSize,
@@ -146,34 +300,59 @@ int NlsClient::setLogConfig(const char* logOutputFile,
 	return 0;
 }
 
+int NlsClient::setAsyncLog(int ringSizeKB, int flushIntervalMs,
+                           int fsyncIntervalMs, LogRecordFormat format) {
+  if (ringSizeKB < 4 || ringSizeKB > 4096 ||
+      flushIntervalMs < 10 || flushIntervalMs > 5000 ||
+      fsyncIntervalMs < 0 || fsyncIntervalMs > 60000) {
+    return -1;
+  }
+  if (format != LogRecordText && format != LogRecordBinary) {
+    return -1;
+  }
+
+  return utility::NlsLog::getInstance()->asyncConfig(
+      (size_t)ringSizeKB * 1024, flushIntervalMs, fsyncIntervalMs,
+      format == LogRecordBinary);
+}
+
+int NlsClient::getAsyncLogStats(NlsAsyncLogStats* stats) {
+  return utility::NlsLog::getInstance()->getAsyncStats(stats);
+}
+
 void NlsClient::releaseRequest(INlsRequest* request) {
   LOG_DEBUG("releaseRequest begin. %d:%s",
       request->getConnectNode()->getConnectNodeStatus(),
-      request->getConnectNode()->getConnectNodeStatusString().c_str());
+      request->getConnectNode()->getConnectNodeStatusString());
 
   if (request->getConnectNode()->getConnectNodeStatus() == NodeInitial) {
     LOG_INFO("released the Request -> 0");
-    delete request;
+    NlsRequestPool::recycle(request);
     request = NULL;
     LOG_INFO("released the Request done 0");
     return;
   }
 
+  // 事件线程已完成destroyConnectNode, 连接失败时节点可能仍处于NodeConnecting
   if (request->getConnectNode()->updateDestroyStatus()) {
-    if (request->getConnectNode()->getConnectNodeStatus() == NodeInvalid) {
-      LOG_INFO("released the Request -> 1");
-      delete request;
-      request = NULL;
-      LOG_INFO("released the Request done 1");
-      return;
-    }
+    LOG_INFO("released the Request -> 1");
+    NlsRequestPool::recycle(request);
+    request = NULL;
+    LOG_INFO("released the Request done 1");
+    return;
   }
 
   LOG_DEBUG("releaseRequest done.");
 }
 
 SpeechRecognizerRequest* NlsClient::createRecognizerRequest() {
-  return new SpeechRecognizerRequest();
+  SpeechRecognizerRequest* request = static_cast<SpeechRecognizerRequest*>(
+      NlsRequestPool::acquire(PoolRecognizer));
+  if (request == NULL) {
+    request = new SpeechRecognizerRequest();
+    NlsRequestPool::markCreated();
+  }
+  return request;
 }
 
 void NlsClient::releaseRecognizerRequest(SpeechRecognizerRequest* request) {
@@ -190,7 +369,13 @@ void NlsClient::releaseRecognizerRequest(SpeechRecognizerRequest* request) {
 }
 
 SpeechTranscriberRequest* NlsClient::createTranscriberRequest() {
-  return new SpeechTranscriberRequest();
+  SpeechTranscriberRequest* request = static_cast<SpeechTranscriberRequest*>(
+      NlsRequestPool::acquire(PoolTranscriber));
+  if (request == NULL) {
+    request = new SpeechTranscriberRequest();
+    NlsRequestPool::markCreated();
+  }
+  return request;
 }
 
 void NlsClient::releaseTranscriberRequest(SpeechTranscriberRequest* request) {
@@ -204,8 +389,32 @@ void NlsClient::releaseTranscriberRequest(SpeechTranscriberRequest* request) {
   }
 }
 
+SpeechTranscriberMultiChannel* NlsClient::createTranscriberMultiChannel(
+    int channels) {
+  if (channels < 1 || channels > 8) {
+    LOG_ERROR("invalid channels:%d.", channels);
+    return NULL;
+  }
+  return new SpeechTranscriberMultiChannel(channels);
+}
+
+void NlsClient::releaseTranscriberMultiChannel(
+    SpeechTranscriberMultiChannel* request) {
+  if (request) {
+    delete request;
+    request = NULL;
+  }
+}
+
 SpeechSynthesizerRequest* NlsClient::createSynthesizerRequest(TtsVersion version){
-  return new SpeechSynthesizerRequest((int)version);
+  SpeechSynthesizerRequest* request = static_cast<SpeechSynthesizerRequest*>(
+      NlsRequestPool::acquire(
+          version == ShortTts ? PoolSynthesizer : PoolLongSynthesizer));
+  if (request == NULL) {
+    request = new SpeechSynthesizerRequest((int)version);
+    NlsRequestPool::markCreated();
+  }
+  return request;
 }
 
 void NlsClient::releaseSynthesizerRequest(SpeechSynthesizerRequest* request) {
@@ -219,9 +428,29 @@ void NlsClient::releaseSynthesizerRequest(SpeechSynthesizerRequest* request) {
   }
 }
 
+SpeechSynthesizerLongText* NlsClient::createSynthesizerLongText(
+    TtsVersion version) {
+  return new SpeechSynthesizerLongText(version);
+}
+
+void NlsClient::releaseSynthesizerLongText(
+    SpeechSynthesizerLongText* request) {
+  if (request) {
+    delete request;
+    request = NULL;
+  }
+}
+
 DialogAssistantRequest* NlsClient::createDialogAssistantRequest(
     DaVersion version) {
-  return new DialogAssistantRequest((int) version);
+  DialogAssistantRequest* request = static_cast<DialogAssistantRequest*>(
+      NlsRequestPool::acquire(
+          version == DaV1 ? PoolDialogAssistant : PoolDialogAssistantV2));
+  if (request == NULL) {
+    request = new DialogAssistantRequest((int) version);
+    NlsRequestPool::markCreated();
+  }
+  return request;
 }
 
 void NlsClient::releaseDialogAssistantRequest(DialogAssistantRequest* request) {
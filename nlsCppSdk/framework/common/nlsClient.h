@@ -23,6 +23,7 @@
 #include <pthread.h>
 #endif
 #include <string>
+#include <stdint.h>
 #include "nlsGlobal.h"
 
 namespace AlibabaNls {
@@ -34,8 +35,10 @@ class SpeechRecognizerSyncRequest;
 class SpeechTranscriberCallback;
 class SpeechTranscriberRequest;
 class SpeechTranscriberSyncRequest;
+class SpeechTranscriberMultiChannel;
 class SpeechSynthesizerCallback;
 class SpeechSynthesizerRequest;
+class SpeechSynthesizerLongText;
 class DialogAssistantCallback;
 class DialogAssistantRequest;
 class NlsEventNetWork;
@@ -57,6 +60,87 @@ enum DaVersion {
   DaV2
 };
 
+/*
+ * 异步日志的文件记录格式
+ * LogRecordText : 文本, 与同步写文件的格式一致, 文件名为<logOutputFile>.log
+ * LogRecordBinary : 紧凑二进制, 时间及前缀不做格式化, 文件名为
+ *                   <logOutputFile>.nlog, 需使用nlsLogDecode工具转为文本
+ */
+enum LogRecordFormat {
+  LogRecordText = 0,
+  LogRecordBinary
+};
+
+/*
+ * 异步日志统计信息
+ */
+struct NlsAsyncLogStats {
+  uint64_t records;      // 已写出的日志条数
+  uint64_t dropped;      // 因线程缓冲满被丢弃的日志条数
+  uint64_t bytes;        // 写入文件的字节数
+  uint64_t writes;       // write调用次数
+  uint64_t fsyncs;       // fsync调用次数
+  uint64_t writeErrors;  // 写文件失败的次数
+  uint64_t threads;      // 写过日志的线程数
+};
+
+/*
+ * 异步回调执行器队列满时的处理策略, 任何策略下事件线程均不等待.
+ * 队列满后转入溢出队列, 溢出队列长度受maxOverflowSize限制, 其占用的内存
+ * 计入NlsClient::setMemoryLimit的缓冲总量.
+ * 结束类事件(TaskFailed、XXXCompleted、DialogResultGenerated、ChannelClosed)
+ * 不受长度限制也不会被丢弃, 保证每个请求都能结束.
+ * CallbackOverflowQueue : 溢出队列满时丢弃新到的非结束类事件
+ * CallbackOverflowDropIntermediate : 队列满时即丢弃中间识别结果(ResultChanged),
+ *                                    溢出队列满时同CallbackOverflowQueue
+ * CallbackOverflowDropOldest : 溢出队列满时丢弃其中最早的非结束类事件,
+ *                              保留最新结果
+ */
+enum CallbackOverflowPolicy {
+  CallbackOverflowQueue = 0,
+  CallbackOverflowDropIntermediate,
+  CallbackOverflowDropOldest
+};
+
+/*
+ * 异步回调执行器统计信息
+ */
+struct NlsCallbackExecutorStats {
+  uint64_t dispatchedCount;    // 投递到执行器的回调总数
+  uint64_t executedCount;      // 已执行的回调总数
+  uint64_t droppedCount;       // 因队列满被丢弃的回调数
+  uint64_t overflowCount;      // 因队列满转入溢出队列的回调数
+  uint64_t slowCount;          // 执行耗时超过100ms的回调数
+  uint64_t totalDurationUs;    // 回调累计耗时, 微秒
+  uint64_t maxDurationUs;      // 单次回调最大耗时, 微秒
+  uint64_t queueDepth;         // 当前排队中的回调数
+  uint64_t peakQueueDepth;     // 排队回调数峰值
+};
+
+/*
+ * 请求池统计信息
+ */
+struct NlsRequestPoolStats {
+  uint64_t createdCount;    // 新建的request数
+  uint64_t reusedCount;     // 从池中复用的request数
+  uint64_t recycledCount;   // 释放时回收入池的request数
+  uint64_t discardedCount;  // 释放时未能入池而直接销毁的request数
+  uint64_t idleCount;       // 当前池中空闲request数
+};
+
+/*
+ * 编码线程池统计信息
+ */
+struct NlsEncoderPoolStats {
+  uint64_t submittedCount;  // 提交到编码线程池的sendAudio次数
+  uint64_t encodedBytes;    // 编码后加入发送缓冲的字节数
+  uint64_t batchCount;      // 编码线程被唤醒处理的批次数
+  uint64_t batchedNodes;    // 各批次处理的request累计数
+  uint64_t maxBatchNodes;   // 单批次处理的最大request数
+  uint64_t totalEncodeUs;   // 编码累计耗时, 微秒
+  uint64_t queueDepth;      // 当前等待编码的request数
+};
+
 
 
 class NLS_SDK_CLIENT_EXPORT NlsClient {
@@ -81,6 +165,30 @@ class NLS_SDK_CLIENT_EXPORT NlsClient {
   int setLogConfig(const char* logOutputFile, const LogLevel logLevel,
                    unsigned int logFileSize = 10, unsigned int logFileNum = 10);
 
+  /*
+   * @brief 开启异步日志. 日志在调用线程格式化后写入该线程独占的无锁缓冲,
+   *        由后台日志线程批量写入文件, 事件线程上不再有文件IO
+   * @param ringSizeKB 每个线程的日志缓冲大小(KB), 4~4096, 默认256;
+   *                   缓冲满时日志被丢弃并计数, 文件中随后写出丢弃条数
+   * @param flushIntervalMs 日志线程最长写出间隔(ms), 10~5000, 默认200;
+   *                        缓冲过半或出现ERROR日志时立即写出
+   * @param fsyncIntervalMs fsync间隔(ms), 0~60000, 0为不主动fsync, 默认1000
+   * @param format 文件记录格式, 默认LogRecordText
+   * @return 成功则返回0，参数错误或日志已配置返回-1
+   * @note 须在setLogConfig之前调用, 仅对写文件的日志生效;
+   *       releaseInstance时写出剩余日志
+   */
+  int setAsyncLog(int ringSizeKB = 256, int flushIntervalMs = 200,
+                  int fsyncIntervalMs = 1000,
+                  LogRecordFormat format = LogRecordText);
+
+  /*
+   * @brief 获取异步日志统计信息
+   * @param stats 输出统计信息
+   * @return 成功则返回0，未开启异步日志返回-1
+   */
+  int getAsyncLogStats(NlsAsyncLogStats* stats);
+
   /*
    * @brief 创建一句话识别对象
    * @param onResultReceivedEvent  事件回调接口
@@ -122,6 +230,20 @@ class NLS_SDK_CLIENT_EXPORT NlsClient {
    */
   void releaseTranscriberRequest(SpeechTranscriberRequest* request);
 
+  /*
+   * @brief 创建多声道实时音频流识别对象
+   * @param channels 声道数, 取值1~8
+   * @return 成功返回SpeechTranscriberMultiChannel对象，否则返回NULL
+   */
+  SpeechTranscriberMultiChannel* createTranscriberMultiChannel(int channels);
+
+  /*
+   * @brief 销毁多声道实时音频流识别对象, 未结束的声道将被取消
+   * @param request  createTranscriberMultiChannel所建立的对象
+   * @return
+   */
+  void releaseTranscriberMultiChannel(SpeechTranscriberMultiChannel* request);
+
   /*
    * @brief 创建实时音频流同步识别对象
    * @return 成功返回SpeechTranscriberSyncRequest对象，否则返回NULL
@@ -150,6 +272,21 @@ class NLS_SDK_CLIENT_EXPORT NlsClient {
    */
   void releaseSynthesizerRequest(SpeechSynthesizerRequest* request);
 
+  /*
+   * @brief 创建长文本语音合成对象, 文本切分后由多个合成请求并行合成
+   * @param version tts类型, 各段请求使用该类型
+   * @return 成功则SpeechSynthesizerLongText对象，否则返回NULL
+   */
+  SpeechSynthesizerLongText* createSynthesizerLongText(
+      TtsVersion version = ShortTts);
+
+  /*
+   * @brief 销毁长文本语音合成对象, 未结束的段将被取消
+   * @param request  createSynthesizerLongText所建立的对象
+   * @return
+   */
+  void releaseSynthesizerLongText(SpeechSynthesizerLongText* request);
+
   /*
    * @brief 创建语音助手对象
    * @param onResultReceivedEvent  事件回调接口
@@ -177,6 +314,169 @@ class NLS_SDK_CLIENT_EXPORT NlsClient {
    */
   void startWorkThread(int threadsNumber = 1);
 
+  /*
+   * @brief 开启异步回调执行器, 用户回调将在独立的回调线程中执行,
+   *        避免耗时回调阻塞事件线程上的其他请求
+   * @param threadsNumber 回调线程数量, 默认1;
+   *                      同一个request的所有回调在同一回调线程中按序执行
+   * @param queueSize 每个事件线程到每个回调线程的队列长度, 默认1024
+   * @param policy 队列满时的处理策略, 默认CallbackOverflowQueue
+   * @param maxOverflowSize 每个队列的溢出队列长度上限, 默认16384, 0为不限制
+   * @return 成功则返回0，失败返回-1
+   * @note 可在startWorkThread前后调用, 仅第一次调用生效;
+   *       不调用则回调仍在事件线程中同步执行
+   */
+  int setCallbackExecutor(int threadsNumber = 1, int queueSize = 1024,
+      CallbackOverflowPolicy policy = CallbackOverflowQueue,
+      int maxOverflowSize = 16384);
+
+  /*
+   * @brief 获取异步回调执行器统计信息
+   * @param stats 输出统计信息
+   * @return 成功则返回0，未开启执行器返回-1
+   */
+  int getCallbackExecutorStats(NlsCallbackExecutorStats* stats);
+
+  /*
+   * @brief 设置请求池大小, 开启后release的request在结束后回收入池,
+   *        下次create时复用其连接缓冲区、编码器和参数对象
+   * @param maxIdlePerType 每种请求类型最多缓存的空闲request数, 0表示关闭(默认)
+   * @return 成功则返回0，失败返回-1
+   * @note 从池中取出的request参数和回调均已恢复为默认值, 需重新设置
+   */
+  int setRequestPoolSize(int maxIdlePerType);
+
+  /*
+   * @brief 获取请求池统计信息
+   * @param stats 输出统计信息
+   * @return 成功则返回0，失败返回-1
+   */
+  int getRequestPoolStats(NlsRequestPoolStats* stats);
+
+  /*
+   * @brief 开启音频编码线程池, opu/opus格式下sendAudio只暂存PCM,
+   *        编码在编码线程中批量完成后交给request所属事件线程发送
+   * @param threadsNumber 编码线程数量, 默认1;
+   *                      同一个request的音频始终由同一编码线程按序编码
+   * @param firstCpu 编码线程依次绑定到firstCpu开始的CPU核心, -1表示不绑定(默认)
+   * @return 成功则返回0，失败或已开启返回-1
+   * @note 仅对开启后start的request生效; stop会等待已提交音频编码发送完毕
+   */
+  int setEncoderThreadPool(int threadsNumber = 1, int firstCpu = -1);
+
+  /*
+   * @brief 获取编码线程池统计信息
+   * @param stats 输出统计信息
+   * @return 成功则返回0，未开启编码线程池返回-1
+   */
+  int getEncoderThreadPoolStats(NlsEncoderPoolStats* stats);
+
+  /*
+   * @brief 设置请求时延回调, 每个请求结束(连接关闭)时调用一次,
+   *        传入各阶段时间点, 见NlsLatencyTrace
+   * @param callback 回调函数, 在事件线程中执行, NULL为取消
+   * @param userData 用户传入参数, 默认为NULL
+   * @return 成功则返回0
+   */
+  int setLatencyTraceCallback(NlsLatencyTraceCallback callback,
+                              void* userData = NULL);
+
+  /*
+   * @brief 开启请求时延的span导出, 每个请求结束时导出一个根span及
+   *        DNS、TCP连接、TLS握手、WebSocket升级、start、首个结果、stop等阶段的子span,
+   *        格式为OpenTelemetry OTLP/JSON的ExportTraceServiceRequest.
+   *        task id作为trace id, 便于与服务端日志关联.
+   * @param target 导出目标:
+   *               "file:<路径>" 追加写入文件, 每行一个请求,
+   *                             可由OpenTelemetry Collector的otlpjsonfile接收器读取;
+   *               "udp:<ip>:<端口>" 每个请求发送一个UDP报文到本地采集器;
+   *               NULL或空串关闭导出
+   * @return 成功则返回0，格式错误或无法打开返回-1
+   * @note 导出在独立线程中进行, 积压超过4096个请求时丢弃;
+   *       releaseInstance时写出剩余数据
+   */
+  int setLatencyTraceExporter(const char* target);
+
+  /*
+   * @brief 以Prometheus文本格式(0.0.4)输出SDK指标, 包括
+   *        收发字节数及帧数、各事件线程活跃请求数、请求开始/结束数、
+   *        超出_limitSize被拒绝的sendAudio次数、重连次数、
+   *        发送缓存深度及TLS握手、建连耗时直方图
+   * @param buffer 输出缓存, 内容以'\0'结尾, 可为NULL
+   * @param size   buffer大小
+   * @return 完整输出所需的长度(不含'\0'), 不小于size时输出被截断;
+   *         可传入NULL和0查询所需长度
+   */
+  int dumpMetrics(char* buffer, size_t size);
+
+  /*
+   * @brief 开启事件循环看门狗, 记录事件线程上各回调(连接、读写、DNS、
+   *        通知及同步执行的用户回调)的执行时长和事件循环延迟,
+   *        单次回调或循环延迟超过阈值时输出WARN日志, 附带node及事件类型.
+   *        时长分布见指标nls_event_callback_seconds及nls_event_loop_lag_seconds
+   * @param slowCallbackMs 告警阈值(ms), 0为关闭, 默认关闭
+   * @param lagCheckMs 循环延迟的检测周期(ms), 默认100, 0为不检测
+   * @return 成功则返回0，参数错误返回-1
+   * @note 回调计时即时生效; 循环延迟检测随事件线程启动,
+   *       需在startWorkThread之前调用, 之后开启时已运行的事件线程不检测延迟,
+   *       并输出WARN日志
+   */
+  int setEventLoopWatchdog(int slowCallbackMs, int lagCheckMs = 100);
+
+  /*
+   * @brief 开启收发数据抓包, 用于离线复现及性能回归.
+   *        每次请求在dir下写一个.nlsrec文件, 记录升级应答及之后的
+   *        全部下行数据和时间点, 可由tools/nlsTrafficReplay回放
+   * @param dir 输出目录, NULL或空串为关闭, 默认关闭
+   * @param captureSent 是否同时记录上行数据(含音频, token以'*'替换),
+   *        默认只记录上行长度
+   * @return 成功则返回0，目录不可写返回-1
+   * @note 对调用之后开始的请求生效
+   */
+  int setTrafficCapture(const char* dir, bool captureSent = false);
+
+  /*
+   * @brief 设置SDK缓冲内存的上限. 统计各请求的收发缓冲及待编码PCM,
+   *        总量达到上限的90%后新的start返回-1, 达到上限后sendAudio返回-1,
+   *        调用方可稍后重试; 已开始的请求继续发送及接收结果.
+   *        用于网络抖动时各请求发送缓冲同时堆积的情况
+   * @param limitBytes 上限字节数, 0为不限制, 默认不限制
+   * @return 成功则返回0
+   */
+  int setMemoryLimit(uint64_t limitBytes);
+
+  /*
+   * @brief 启用libevent内存统计, 安装libevent的内存分配钩子,
+   *        之后经libevent的分配计入NlsMemoryUsage::libeventBytes.
+   *        钩子作用于整个进程的libevent, 默认不安装
+   * @return 成功或已启用返回0，
+   *         启用前已调用startWorkThread或libevent禁用内存替换时返回-1
+   * @note 须在startWorkThread之前调用
+   */
+  int enableLibeventMemoryStats();
+
+  /*
+   * @brief 获取SDK内存统计, 单个请求见各request的getMemoryUsage
+   * @param usage 统计输出, 见NlsMemoryUsage
+   * @return 成功则返回0，参数为NULL返回-1
+   */
+  int getMemoryUsage(NlsMemoryUsage* usage);
+
+  /*
+   * @brief 启动内嵌的HTTP服务, 以 GET /metrics 提供dumpMetrics的内容,
+   *        供Prometheus直接抓取
+   * @param port    监听端口
+   * @param address 监听地址, 默认仅本机可访问
+   * @return 成功则返回0，已启动或监听失败返回-1
+   * @note releaseInstance时自动停止
+   */
+  int startMetricsServer(int port, const char* address = "127.0.0.1");
+
+  /*
+   * @brief 停止内嵌的指标HTTP服务
+   */
+  void stopMetricsServer();
+
   /*
    * @brief NlsClient对象实例
    * @param sslInitial 是否初始化openssl 线程安全，默认为true
@@ -15,12 +15,75 @@
  */
 
 #include "nlsEvent.h"
+#include <string.h>
 #include <sstream>
 #include "nlog.h"
+#include "nlsVad.h"
 #include "json/json.h"
 
 namespace AlibabaNls {
 
+NlsSentenceWords::NlsSentenceWords() {}
+NlsSentenceWords::~NlsSentenceWords() {}
+
+void NlsSentenceWords::clear() {
+  _arena.clear();
+  _textOffsets.clear();
+  _textLengths.clear();
+  _startTimes.clear();
+  _endTimes.clear();
+}
+
+void NlsSentenceWords::reserve(size_t wordCount, size_t textBytes) {
+  _arena.reserve(textBytes);
+  _textOffsets.reserve(wordCount);
+  _textLengths.reserve(wordCount);
+  _startTimes.reserve(wordCount);
+  _endTimes.reserve(wordCount);
+}
+
+void NlsSentenceWords::append(const char* text, size_t length,
+                              int startTime, int endTime) {
+  _textOffsets.push_back((unsigned int)_arena.size());
+  _textLengths.push_back((unsigned int)length);
+  _arena.insert(_arena.end(), text, text + length);
+  _arena.push_back('\0');
+  _startTimes.push_back(startTime);
+  _endTimes.push_back(endTime);
+}
+
+void NlsSentenceWords::swap(NlsSentenceWords& other) {
+  _arena.swap(other._arena);
+  _textOffsets.swap(other._textOffsets);
+  _textLengths.swap(other._textLengths);
+  _startTimes.swap(other._startTimes);
+  _endTimes.swap(other._endTimes);
+}
+
+size_t NlsSentenceWords::size() const {
+  return _startTimes.size();
+}
+
+NlsWordSpan NlsSentenceWords::span() const {
+  NlsWordSpan words;
+  words.count = _startTimes.size();
+  words.arenaSize = _arena.size();
+  if (words.count == 0) {
+    words.arena = NULL;
+    words.textOffsets = NULL;
+    words.textLengths = NULL;
+    words.startTimes = NULL;
+    words.endTimes = NULL;
+  } else {
+    words.arena = &_arena[0];
+    words.textOffsets = &_textOffsets[0];
+    words.textLengths = &_textLengths[0];
+    words.startTimes = &_startTimes[0];
+    words.endTimes = &_endTimes[0];
+  }
+  return words;
+}
+
 NlsEvent::NlsEvent(const NlsEvent& ne) {
   this->_statusCode = ne._statusCode;
   this->_taskId = ne._taskId;
@@ -36,17 +99,19 @@ NlsEvent::NlsEvent(const NlsEvent& ne) {
   this->_binaryData = ne._binaryData;
   this->_sentenceBeginTime = ne._sentenceBeginTime;
   this->_sentenceConfidence = ne._sentenceConfidence;
-  this->_sentenceWordsList = ne._sentenceWordsList;
+  this->_sentenceWords = ne._sentenceWords;
 
   this->_stashResultSentenceId = ne._stashResultSentenceId;
   this->_stashResultBeginTime = ne._stashResultBeginTime;
   this->_stashResultCurrentTime = ne._stashResultCurrentTime;
   this->_stashResultText = ne._stashResultText;
+  this->_channel = ne._channel;
 }
 
 NlsEvent::NlsEvent(
     const char * msg, int code, EventType type, std::string & taskId) :
-    _statusCode(code),_msg(msg), _msgType(type), _taskId(taskId) {}
+    _statusCode(code),_msg(msg), _msgType(type), _taskId(taskId),
+    _channel(-1) {}
 
 NlsEvent::NlsEvent(std::string & msg) : _msg(msg) {
   _statusCode = 0;
@@ -59,6 +124,7 @@ NlsEvent::NlsEvent(std::string & msg) : _msg(msg) {
   _stashResultSentenceId = 0;
   _stashResultBeginTime = 0;
   _stashResultCurrentTime = 0;
+  _channel = -1;
 }
 
 NlsEvent::~NlsEvent() {}
@@ -74,7 +140,7 @@ int NlsEvent::parseJsonMsg() {
   Json::Value root(Json::objectValue);
   Json::Value stashResult(Json::objectValue);
 
-  if (!reader.parse(_msg, root)) {
+  if (!reader.parse(_msg, root) || !root.isObject()) {
     LOG_ERROR("_msg:%s", _msg.c_str());
     return -1;
   }
@@ -152,27 +218,28 @@ int NlsEvent::parseJsonMsg() {
 
       //"words":[{"text":"一二三四","startTime":810,"endTime":2460}]
       if (!payload["words"].isNull() && payload["words"].isArray()) {
-        Json::Value wordArray = payload["words"];
+        const Json::Value& wordArray = payload["words"];
         int iSize = wordArray.size();
-        WordInfomation wordInfo;
+        // 中文词平均约6字节utf8, 预留后通常只需一次分配
+        _sentenceWords.reserve(iSize, iSize * 8);
 
         for (int nIndex = 0; nIndex < iSize; nIndex++) {
-          if (wordArray[nIndex].isMember("text") &&
-              wordArray[nIndex]["text"].isString()) {
-            wordInfo.text = wordArray[nIndex]["text"].asCString();
+          const Json::Value& word = wordArray[nIndex];
+          const char* text = "";
+          int startTime = 0;
+          int endTime = 0;
+          if (word.isMember("text") && word["text"].isString()) {
+            text = word["text"].asCString();
           }
-          if (wordArray[nIndex].isMember("startTime") &&
-              wordArray[nIndex]["startTime"].isInt()) {
-            wordInfo.startTime = wordArray[nIndex]["startTime"].asInt();
+          if (word.isMember("startTime") && word["startTime"].isInt()) {
+            startTime = word["startTime"].asInt();
           }
-          if (wordArray[nIndex].isMember("endTime") &&
-              wordArray[nIndex]["endTime"].isInt()) {
-            wordInfo.endTime = wordArray[nIndex]["endTime"].asInt();
+          if (word.isMember("endTime") && word["endTime"].isInt()) {
+            endTime = word["endTime"].asInt();
           }
-          LOG_DEBUG("List Push: %s %d %d",
-              wordInfo.text.c_str(), wordInfo.startTime, wordInfo.endTime);
+          LOG_DEBUG("Word Push: %s %d %d", text, startTime, endTime);
 
-          _sentenceWordsList.push_back(wordInfo);
+          _sentenceWords.append(text, strlen(text), startTime, endTime);
         }  // for
       }
 
@@ -348,7 +415,33 @@ std::list<WordInfomation> NlsEvent::getSentenceWordsList() {
   if (_msgType != SentenceEnd) {
     return tmpList;
   }
-  return _sentenceWordsList;
+
+  NlsWordSpan words = _sentenceWords.span();
+  for (size_t i = 0; i < words.count; i++) {
+    WordInfomation wordInfo;
+    wordInfo.text.assign(words.arena + words.textOffsets[i],
+                         words.textLengths[i]);
+    wordInfo.startTime = words.startTimes[i];
+    wordInfo.endTime = words.endTimes[i];
+    tmpList.push_back(wordInfo);
+  }
+  return tmpList;
+}
+
+NlsWordSpan NlsEvent::getSentenceWords() {
+  if (_msgType != SentenceEnd) {
+    return NlsSentenceWords().span();
+  }
+  return _sentenceWords.span();
+}
+
+int NlsEvent::takeSentenceWords(NlsSentenceWords& words) {
+  if (_msgType != SentenceEnd) {
+    return -1;
+  }
+  words.clear();
+  words.swap(_sentenceWords);
+  return (int)words.size();
 }
 
 NlsEvent::NlsEvent(std::vector<unsigned char> data, int code,
@@ -356,7 +449,8 @@ NlsEvent::NlsEvent(std::vector<unsigned char> data, int code,
     _statusCode(code),
     _msgType(type),
     _taskId(taskId),
-    _binaryData(data) {
+    _binaryData(data),
+    _channel(-1) {
   LOG_DEBUG("Binary data event:%d.", data.size());
   this->_msg = "";
 }
@@ -370,6 +464,17 @@ std::vector<unsigned char> NlsEvent::getBinaryData() {
   }
 }
 
+const unsigned char* NlsEvent::getBinaryDataBuffer(int* size) {
+  if (size) {
+    *size = (int)_binaryData.size();
+  }
+  return _binaryData.empty() ? NULL : &_binaryData[0];
+}
+
+void NlsEvent::setBinaryData(const unsigned char* data, int size) {
+  _binaryData.assign(data, data + size);
+}
+
 const bool NlsEvent::getWakeWordAccepted() {
   if (_msgType != WakeWordVerificationCompleted) {
     return false;
@@ -405,4 +510,40 @@ const char* NlsEvent::getStashResultText() {
   return _stashResultText.c_str();
 }
 
+int NlsEvent::getChannel() {
+  return _channel;
+}
+
+void NlsEvent::setChannel(int channel) {
+  _channel = channel;
+}
+
+void NlsEvent::rebaseTime(NlsVad* vad) {
+  if (vad == NULL || !vad->hasDropped()) {
+    return;
+  }
+
+  switch (_msgType) {
+    case SentenceBegin:
+    case SentenceEnd:
+    case TranscriptionResultChanged:
+      break;
+    default:
+      return;
+  }
+
+  _sentenceTime = vad->rebaseTime(_sentenceTime);
+  _sentenceBeginTime = vad->rebaseTime(_sentenceBeginTime);
+  for (size_t i = 0; i < _sentenceWords._startTimes.size(); i++) {
+    _sentenceWords._startTimes[i] =
+        vad->rebaseTime(_sentenceWords._startTimes[i]);
+    _sentenceWords._endTimes[i] =
+        vad->rebaseTime(_sentenceWords._endTimes[i]);
+  }
+  if (_msgType == SentenceEnd) {
+    _stashResultBeginTime = vad->rebaseTime(_stashResultBeginTime);
+    _stashResultCurrentTime = vad->rebaseTime(_stashResultCurrentTime);
+  }
+}
+
 }  // namespace AlibabaNls
@@ -24,6 +24,8 @@
 
 namespace AlibabaNls {
 
+class NlsVad;
+
 enum AudioDataStatus {
   AUDIO_FIRST = 0, /* 第一块音频数据   */ 
   AUDIO_MIDDLE,    /* 中间音频数据     */
@@ -36,6 +38,51 @@ typedef struct {
   int endTime;
 } WordInfomation;
 
+/*
+ * 句子词信息的只读视图, 指向内部连续存储, 不做拷贝.
+ * 第i个词的文本为arena + textOffsets[i], 以'\0'结尾, 长度为textLengths[i],
+ * 时间范围为startTimes[i] ~ endTimes[i], 单位毫秒.
+ */
+typedef struct {
+  size_t count;
+  const char* arena;
+  size_t arenaSize;
+  const unsigned int* textOffsets;
+  const unsigned int* textLengths;
+  const int* startTimes;
+  const int* endTimes;
+} NlsWordSpan;
+
+/*
+ * 句子词信息的扁平存储, 按列保存各字段, 所有词文本保存在同一块utf8内存中
+ */
+class NLS_SDK_CLIENT_EXPORT NlsSentenceWords {
+ public:
+  NlsSentenceWords();
+  ~NlsSentenceWords();
+
+  void clear();
+  void reserve(size_t wordCount, size_t textBytes);
+  void append(const char* text, size_t length, int startTime, int endTime);
+  void swap(NlsSentenceWords& other);
+
+  size_t size() const;
+
+  /*
+   * @brief 获取只读视图, 在本对象下一次修改前有效
+   */
+  NlsWordSpan span() const;
+
+ private:
+  friend class NlsEvent;
+
+  std::vector<char> _arena;
+  std::vector<unsigned int> _textOffsets;
+  std::vector<unsigned int> _textLengths;
+  std::vector<int> _startTimes;
+  std::vector<int> _endTimes;
+};
+
 class NLS_SDK_CLIENT_EXPORT NlsEvent {
  public:
 
@@ -179,6 +226,21 @@ class NLS_SDK_CLIENT_EXPORT NlsEvent {
    */
   std::list<WordInfomation> getSentenceWordsList();
 
+  /*
+   * @brief 本句话中的词信息, 连续存储, 不拷贝
+   * @note 在实时语音识别SentenceEnd事件回调中使用, 返回的视图仅在回调内有效
+   * @result NlsWordSpan, 非SentenceEnd事件count为0
+   */
+  NlsWordSpan getSentenceWords();
+
+  /*
+   * @brief 取走本句话中的词信息, 与words交换内部存储, 不拷贝词文本
+   * @note 在实时语音识别SentenceEnd事件回调中使用, 调用后本事件中的词信息为空
+   * @param words 接收词信息, 其原有内容先被清空, 清空后的存储交换到本事件中
+   * @result 成功返回词数量, 非SentenceEnd事件返回-1
+   */
+  int takeSentenceWords(NlsSentenceWords& words);
+
   /*
    * @brief 获取云端返回的二进制数据
    * @note 仅用于语音合成功能
@@ -186,6 +248,15 @@ class NLS_SDK_CLIENT_EXPORT NlsEvent {
    */
   std::vector<unsigned char> getBinaryData();
 
+  /*
+   * @brief 获取云端返回的二进制数据或解码后的PCM帧, 不拷贝
+   * @note 仅用于语音合成功能, 返回的地址仅在回调内有效
+   * @param size 数据字节数
+   * @return 数据地址, 无数据时返回NULL
+   */
+  const unsigned char* getBinaryDataBuffer(int* size);
+  void setBinaryData(const unsigned char* data, int size);
+
   /*
    * @brief 获取当前所发生Event的类型
    * @return EventType
@@ -234,6 +305,19 @@ class NLS_SDK_CLIENT_EXPORT NlsEvent {
    */
   const char* getStashResultText();
 
+  /*
+   * @brief 获取事件所属声道, 仅SpeechTranscriberMultiChannel的事件有效
+   * @return 声道序号, 从0开始, 非多声道转写时返回-1
+   */
+  int getChannel();
+  void setChannel(int channel);
+
+  /*
+   * @brief 内部使用, VAD_MODE_DROP时将句子、词及stashResult的时间
+   *        换算回原始音频时间, getAllResponse()的原始json不变
+   */
+  void rebaseTime(NlsVad* vad);
+
  private:
   int parseMsgType(std::string name);
 
@@ -250,7 +334,7 @@ class NLS_SDK_CLIENT_EXPORT NlsEvent {
   int _sentenceTime;
   int _sentenceBeginTime;
   double _sentenceConfidence;
-  std::list<WordInfomation> _sentenceWordsList;
+  NlsSentenceWords _sentenceWords;
   bool _wakeWordAccepted;
   bool _wakeWordKnown;
   std::string _wakeWordUserId;
@@ -262,6 +346,8 @@ class NLS_SDK_CLIENT_EXPORT NlsEvent {
   int _stashResultBeginTime;
   std::string _stashResultText;
   int _stashResultCurrentTime;
+
+  int _channel;
 };
 
 typedef void (*NlsCallbackMethod)(NlsEvent*, void*);
@@ -17,6 +17,8 @@
 #ifndef NLS_SDK_GLOBAL_H
 #define NLS_SDK_GLOBAL_H
 
+#include <stdint.h>
+
 #if defined(_MSC_VER)
 
   #define NLS_SDK_DECL_EXPORT __declspec(dllexport)
@@ -51,4 +53,234 @@ enum ENCODER_TYPE {
   ENCODER_OPU,
 };
 
+/* OPU/OPUS编码预设, 见NlsEncoderProfile */
+enum ENCODER_PRESET {
+  ENCODER_PRESET_DEFAULT = 0,    /* 27.8kbps, 复杂度8, VBR, 20ms */
+  ENCODER_PRESET_LOW_BANDWIDTH,  /* 12kbps, 40ms帧, 适用于带宽受限的场景 */
+  ENCODER_PRESET_LOW_CPU,        /* 复杂度2, 适用于CPU受限的大并发场景 */
+  ENCODER_PRESET_DTX,            /* 开启DTX, 静音段只发送极少数据 */
+};
+
+/*
+ * OPU/OPUS编码参数.
+ * bitrate     码率(bps), 6000~510000
+ * complexity  计算复杂度, 0~10, 越低越省CPU
+ * vbr         true为动态码率, false为固定码率
+ * dtx         静音段不连续传输
+ * frameMs     编码帧时长, 支持20/40/60毫秒
+ */
+struct NlsEncoderProfile {
+  int bitrate;
+  int complexity;
+  bool vbr;
+  bool dtx;
+  int frameMs;
+
+  NlsEncoderProfile() : bitrate(27800), complexity(8),
+                        vbr(true), dtx(false), frameMs(20) {}
+};
+
+/* 客户端静音检测模式, 见NlsVadParam */
+enum VAD_MODE {
+  VAD_MODE_NONE = 0,  /* 不检测, 音频原样上传, 默认 */
+  VAD_MODE_MUTE,      /* 长静音段置零后上传, 音频时间轴不变, 配合DTX预设效果最佳 */
+  VAD_MODE_DROP,      /* 长静音段不上传, 仅按keepAliveMs发送静音保活帧, 服务端时间轴被压缩,
+                       * 回调事件中的句子及词时间戳由SDK换算回原始音频时间 */
+};
+
+/*
+ * 客户端静音检测参数, 按10ms帧计算能量与过零率.
+ * mode               检测模式
+ * energyThresholdDb  能量门限(dBFS), -90~0, 高于门限判为语音
+ * zcrThreshold       过零率门限(千分比), 0~1000, 能量低于门限10dB以内
+ *                    且过零率高于此值时判为清音, 避免丢失擦音等弱语音
+ * hangoverMs         连续静音超过此时长才开始抑制, 保护句尾及词间停顿
+ * keepAliveMs        VAD_MODE_DROP下抑制期间发送20ms静音帧的间隔, 0为不发送
+ */
+struct NlsVadParam {
+  VAD_MODE mode;
+  int energyThresholdDb;
+  int zcrThreshold;
+  int hangoverMs;
+  int keepAliveMs;
+
+  NlsVadParam() : mode(VAD_MODE_NONE), energyThresholdDb(-45),
+                  zcrThreshold(250), hangoverMs(500), keepAliveMs(1000) {}
+};
+
+/*
+ * 客户端静音检测统计, 单位均为PCM字节数
+ */
+struct NlsVadStats {
+  uint64_t inputBytes;      // sendAudio输入的字节数
+  uint64_t speechBytes;     // 判为语音或处于hangover而原样上传的字节数
+  uint64_t mutedBytes;      // VAD_MODE_MUTE下置零上传的字节数
+  uint64_t droppedBytes;    // VAD_MODE_DROP下未上传的字节数
+  uint64_t keepAliveBytes;  // VAD_MODE_DROP下上传的保活静音字节数
+  uint64_t speechFrames;    // 判为语音的10ms帧数
+  uint64_t silenceFrames;   // 判为静音的10ms帧数
+};
+
+/* sendAudio输入PCM的样本格式, 均为小端 */
+enum AUDIO_SAMPLE_FORMAT {
+  SAMPLE_FORMAT_S16 = 0,  /* 16bit有符号整数, 默认 */
+  SAMPLE_FORMAT_S32,      /* 32bit有符号整数 */
+  SAMPLE_FORMAT_F32,      /* 32bit浮点, 幅度范围-1.0~1.0 */
+};
+
+/*
+ * sendAudio输入PCM格式, 与请求的采样率不同或为多声道时,
+ * SDK先混为单声道并重采样为请求的采样率, 再做静音检测及编码.
+ * sampleFormat  样本格式
+ * sampleRate    输入采样率, 8000~192000, 0表示与请求的采样率一致
+ * channels      交错存放的声道数, 1~8
+ */
+struct NlsAudioInputFormat {
+  AUDIO_SAMPLE_FORMAT sampleFormat;
+  int sampleRate;
+  int channels;
+
+  NlsAudioInputFormat() : sampleFormat(SAMPLE_FORMAT_S16),
+                          sampleRate(0), channels(1) {}
+};
+
+/*
+ * 语音合成PCM输出参数. 开启后SDK将服务端返回的pcm/wav/opus音频流解码为
+ * 16bit单声道PCM, 按固定帧长通过OnPcmFrameReceived回调输出.
+ * enable        是否开启, 默认关闭
+ * frameMs       每帧时长(ms), 10~200, 默认20
+ * jitterMs      输出首帧前预缓冲的时长(ms), 0~2000, 默认60,
+ *               之后每凑满一帧立即输出. 越大越能吸收网络抖动, 首帧越晚
+ * padLastFrame  合成结束时不足一帧的尾部是否补静音为整帧, 默认是
+ */
+struct NlsTtsPcmParam {
+  bool enable;
+  int frameMs;
+  int jitterMs;
+  bool padLastFrame;
+
+  NlsTtsPcmParam() : enable(false), frameMs(20), jitterMs(60),
+                     padLastFrame(true) {}
+};
+
+/*
+ * 语音合成PCM输出统计, 时延均从调用start开始计算
+ */
+struct NlsTtsPcmStats {
+  int sampleRate;               // 输出PCM采样率, 尚未解码出数据时为0
+  int64_t firstAudioLatencyMs;  // 收到首个音频数据的时延, 未收到为-1
+  int64_t firstFrameLatencyMs;  // 输出首个PCM帧的时延, 未输出为-1
+  uint64_t inputBytes;          // 收到的音频数据字节数
+  uint64_t pcmBytes;            // 解码得到的PCM字节数
+  uint64_t frames;              // 已输出的PCM帧数
+  uint64_t decodeUs;            // 解码累计耗时(us)
+  uint64_t decodeErrors;        // 无法解码的音频数据段数
+};
+
+/*
+ * 长文本语音合成参数. 文本在句末标点处切分为多段, 各段由独立的合成任务
+ * 并行合成, 音频及字幕按文本顺序拼接后上报.
+ * maxInFlight        同时进行的合成任务数, 1~8, 默认2
+ * maxSegmentChars    每段最大字符数(按unicode字符计), 10~10000, 默认300
+ * firstSegmentChars  首段最大字符数, 首段越短首包越快, 0表示同maxSegmentChars,
+ *                    默认50
+ * remapSubtitle      开启字幕时, 将各段字幕的begin_index/end_index及时间
+ *                    换算为在完整文本及完整音频中的位置, 并增加begin_byte/end_byte
+ *                    表示在完整utf8文本中的字节偏移, 默认关闭
+ */
+struct NlsLongTextTtsParam {
+  int maxInFlight;
+  int maxSegmentChars;
+  int firstSegmentChars;
+  bool remapSubtitle;
+
+  NlsLongTextTtsParam() : maxInFlight(2), maxSegmentChars(300),
+                          firstSegmentChars(50), remapSubtitle(false) {}
+};
+
+/* 请求结束状态, 见NlsLatencyTrace */
+enum LATENCY_TRACE_STATUS {
+  TRACE_STATUS_RUNNING = 0,  /* 请求尚未结束 */
+  TRACE_STATUS_COMPLETED,    /* 收到Completed等结束事件 */
+  TRACE_STATUS_FAILED,       /* 连接失败、TaskFailed或未完成即断开 */
+  TRACE_STATUS_CANCELLED,    /* 调用cancel结束 */
+};
+
+/*
+ * 单次请求各阶段的时间点, 均为单调时钟的微秒数, 未到达的阶段为0.
+ * 与startUs相减即为该阶段相对start调用的时延.
+ * startUs          调用start
+ * dnsStartUs       最后一次发起DNS解析
+ * dnsEndUs         DNS解析完成
+ * tcpConnectedUs   TCP连接建立
+ * tlsHandshakedUs  TLS握手完成, 非wss连接为0
+ * upgradedUs       收到网关WebSocket升级响应
+ * startSentUs      发出StartTranscription等开始指令
+ * startedUs        收到TranscriptionStarted等开始事件, 合成及对话请求为0
+ * firstResultUs    收到首个结果事件(中间结果、句子结束、音频数据等)
+ * stopSentUs       发出StopTranscription等结束指令, 合成请求为0
+ * completedUs      收到Completed等结束事件
+ * closedUs         请求结束, 连接关闭
+ * connectAttempts  建立连接的尝试次数, 大于1表示发生过重连,
+ *                  此时DNS及连接时间点为最后一次尝试的值
+ */
+struct NlsLatencyTrace {
+  uint64_t startUs;
+  uint64_t dnsStartUs;
+  uint64_t dnsEndUs;
+  uint64_t tcpConnectedUs;
+  uint64_t tlsHandshakedUs;
+  uint64_t upgradedUs;
+  uint64_t startSentUs;
+  uint64_t startedUs;
+  uint64_t firstResultUs;
+  uint64_t stopSentUs;
+  uint64_t completedUs;
+  uint64_t closedUs;
+  int connectAttempts;
+  LATENCY_TRACE_STATUS status;
+  char taskId[64];
+};
+
+/*
+ * 请求结束时的时延回调, 在事件线程中执行, 不可阻塞或调用request接口
+ */
+typedef void (*NlsLatencyTraceCallback)(const NlsLatencyTrace* trace,
+                                        void* userData);
+
+/*
+ * SDK内存统计, 见NlsClient::getMemoryUsage
+ * bufferedBytes      各请求收发缓冲及待编码PCM的字节数之和,
+ *                    setMemoryLimit按此值限制
+ * peakBufferedBytes  bufferedBytes的历史峰值, 在读取统计、上限检查及
+ *                    请求开始时采样, 两次采样之间的短暂峰值可能遗漏
+ * libeventBytes      经libevent分配的内存, 含缓冲区块的额外开销;
+ *                    未调用NlsClient::enableLibeventMemoryStats时为0
+ * limitBytes         setMemoryLimit设置的上限, 0为不限制
+ * rejectedStarts     因达到上限被拒绝的start次数
+ * rejectedAudio      因达到上限被拒绝的sendAudio次数
+ */
+struct NlsMemoryUsage {
+  uint64_t bufferedBytes;
+  uint64_t peakBufferedBytes;
+  uint64_t libeventBytes;
+  uint64_t limitBytes;
+  uint64_t rejectedStarts;
+  uint64_t rejectedAudio;
+};
+
+/*
+ * 单个请求的内存统计, 见各request的getMemoryUsage
+ * sendBufferBytes     待发送的音频及指令
+ * receiveBufferBytes  已接收尚未解析的数据
+ * pendingAudioBytes   等待编码线程处理的PCM
+ * peakBytes           本次请求以上三项之和的峰值
+ */
+struct NlsRequestMemoryUsage {
+  uint64_t sendBufferBytes;
+  uint64_t receiveBufferBytes;
+  uint64_t pendingAudioBytes;
+  uint64_t peakBytes;
+};
+
 #endif //NLS_SDK_GLOBAL_H
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nlog.h"
+#include "nlsGlobal.h"
+#include "iNlsRequest.h"
+#include "iNlsRequestParam.h"
+#include "connectNode.h"
+#include "nlsRequestPool.h"
+
+namespace AlibabaNls {
+
+std::list<INlsRequest*> NlsRequestPool::_idleList[PoolTypeMax];
+size_t NlsRequestPool::_maxIdle = 0;
+
+uint64_t NlsRequestPool::_createdCount = 0;
+uint64_t NlsRequestPool::_reusedCount = 0;
+uint64_t NlsRequestPool::_recycledCount = 0;
+uint64_t NlsRequestPool::_discardedCount = 0;
+
+#if defined(_MSC_VER)
+HANDLE NlsRequestPool::_mtxPool = CreateMutex(NULL, FALSE, NULL);
+#else
+pthread_mutex_t NlsRequestPool::_mtxPool = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+int NlsRequestPool::setMaxIdle(int maxIdle) {
+  if (maxIdle < 0) {
+    LOG_ERROR("Invalid request pool size:%d.", maxIdle);
+    return -1;
+  }
+
+  std::list<INlsRequest*> surplus;
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxPool, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxPool);
+#endif
+
+  _maxIdle = (size_t)maxIdle;
+  for (int i = 0; i < PoolTypeMax; i++) {
+    while (_idleList[i].size() > _maxIdle) {
+      surplus.push_back(_idleList[i].front());
+      _idleList[i].pop_front();
+    }
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxPool);
+#else
+  pthread_mutex_unlock(&_mtxPool);
+#endif
+
+  std::list<INlsRequest*>::iterator it;
+  for (it = surplus.begin(); it != surplus.end(); ++it) {
+    delete *it;
+  }
+
+  LOG_INFO("Request pool size:%d.", maxIdle);
+  return 0;
+}
+
+INlsRequest* NlsRequestPool::acquire(NlsRequestPoolType type) {
+  INlsRequest* request = NULL;
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxPool, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxPool);
+#endif
+
+  if (!_idleList[type].empty()) {
+    request = _idleList[type].front();
+    _idleList[type].pop_front();
+    _reusedCount++;
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxPool);
+#else
+  pthread_mutex_unlock(&_mtxPool);
+#endif
+
+  if (request) {
+    LOG_DEBUG("Reuse request:%p from pool.", request);
+  }
+  return request;
+}
+
+void NlsRequestPool::markCreated() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxPool, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxPool);
+#endif
+
+  _createdCount++;
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxPool);
+#else
+  pthread_mutex_unlock(&_mtxPool);
+#endif
+}
+
+int NlsRequestPool::getPoolType(INlsRequest* request) {
+  INlsRequestParam* param = request->getRequestParam();
+  switch (param->_mode) {
+    case TypeAsr:
+      return PoolRecognizer;
+    case TypeRealTime:
+      return PoolTranscriber;
+    case TypeTts:
+      return param->_version == 0 ? PoolSynthesizer : PoolLongSynthesizer;
+    case TypeDialog:
+      return param->_version == 0 ?
+          PoolDialogAssistant : PoolDialogAssistantV2;
+    default:
+      return -1;
+  }
+}
+
+void NlsRequestPool::recycle(INlsRequest* request) {
+  if (request == NULL) {
+    return;
+  }
+
+  int type = getPoolType(request);
+  bool accept = false;
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxPool, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxPool);
+#endif
+
+  accept = (type >= 0 && _idleList[type].size() < _maxIdle);
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxPool);
+#else
+  pthread_mutex_unlock(&_mtxPool);
+#endif
+
+  // 重置可能等待回调线程, 不在池锁内进行
+  if (accept && request->reset(request, true) < 0) {
+    accept = false;
+  }
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxPool, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxPool);
+#endif
+
+  if (accept && _idleList[type].size() < _maxIdle) {
+    _idleList[type].push_back(request);
+    _recycledCount++;
+  } else {
+    accept = false;
+    _discardedCount++;
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxPool);
+#else
+  pthread_mutex_unlock(&_mtxPool);
+#endif
+
+  if (accept) {
+    LOG_DEBUG("Recycle request:%p into pool.", request);
+  } else {
+    delete request;
+    request = NULL;
+  }
+}
+
+void NlsRequestPool::clear() {
+  std::list<INlsRequest*> idle;
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxPool, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxPool);
+#endif
+
+  for (int i = 0; i < PoolTypeMax; i++) {
+    idle.splice(idle.end(), _idleList[i]);
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxPool);
+#else
+  pthread_mutex_unlock(&_mtxPool);
+#endif
+
+  std::list<INlsRequest*>::iterator it;
+  for (it = idle.begin(); it != idle.end(); ++it) {
+    delete *it;
+  }
+}
+
+int NlsRequestPool::getStats(NlsRequestPoolStats* stats) {
+  if (stats == NULL) {
+    return -1;
+  }
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxPool, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxPool);
+#endif
+
+  stats->createdCount = _createdCount;
+  stats->reusedCount = _reusedCount;
+  stats->recycledCount = _recycledCount;
+  stats->discardedCount = _discardedCount;
+  stats->idleCount = 0;
+  for (int i = 0; i < PoolTypeMax; i++) {
+    stats->idleCount += _idleList[i].size();
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxPool);
+#else
+  pthread_mutex_unlock(&_mtxPool);
+#endif
+  return 0;
+}
+
+}  // namespace AlibabaNls
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_REQUEST_POOL_H
+#define NLS_SDK_REQUEST_POOL_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <list>
+#include <stdint.h>
+#include "nlsClient.h"
+
+namespace AlibabaNls {
+
+class INlsRequest;
+
+enum NlsRequestPoolType {
+  PoolRecognizer = 0,
+  PoolTranscriber,
+  PoolSynthesizer,
+  PoolLongSynthesizer,
+  PoolDialogAssistant,
+  PoolDialogAssistantV2,
+  PoolTypeMax
+};
+
+/*
+ * 请求对象池, 按请求类型缓存已结束的request,
+ * 复用ConnectNode缓冲区、编码器和参数JSON, 减少频繁创建释放的开销.
+ */
+class NlsRequestPool {
+ public:
+  static int setMaxIdle(int maxIdle);
+
+  /* 从池中取出一个空闲request, 池为空时返回NULL */
+  static INlsRequest* acquire(NlsRequestPoolType type);
+  static void markCreated();
+
+  /*
+   * 释放request: 池未满且request可重置时回收入池,
+   * 否则直接delete. 调用者需确保事件线程已不再访问该request.
+   * 会等待该request的回调及编码任务完成, 事件线程中须经
+   * WorkThread::recycleRequest在其完成后调用.
+   */
+  static void recycle(INlsRequest* request);
+
+  /* 释放池中所有空闲request */
+  static void clear();
+
+  static int getStats(NlsRequestPoolStats* stats);
+
+ private:
+  static int getPoolType(INlsRequest* request);
+
+  static std::list<INlsRequest*> _idleList[PoolTypeMax];
+  static size_t _maxIdle;
+
+  static uint64_t _createdCount;
+  static uint64_t _reusedCount;
+  static uint64_t _recycledCount;
+  static uint64_t _discardedCount;
+
+#if defined(_MSC_VER)
+  static HANDLE _mtxPool;
+#else
+  static pthread_mutex_t _mtxPool;
+#endif
+};
+
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_REQUEST_POOL_H
@@ -25,7 +25,7 @@ DialogAssistantListener::DialogAssistantListener(
 
 DialogAssistantListener::~DialogAssistantListener() {}
 
-void DialogAssistantListener::handlerFrame(NlsEvent str) {
+void DialogAssistantListener::handlerFrame(NlsEvent& str) {
   NlsEvent::EventType type = str.getMsgType();
 
   if (NULL == _callback) {
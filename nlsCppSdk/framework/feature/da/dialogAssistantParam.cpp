@@ -30,6 +30,8 @@ namespace AlibabaNls {
 
 DialogAssistantParam::DialogAssistantParam(int version) :
     INlsRequestParam(TypeDialog) {
+  _version = version;
+
   if (version == 0) {
     _header[D_NAMESPACE] = D_NAMESPACE_RECOGNITION;
   } else {
@@ -42,6 +44,16 @@ DialogAssistantParam::DialogAssistantParam(int version) :
 
 DialogAssistantParam::~DialogAssistantParam() {}
 
+void DialogAssistantParam::resetParam() {
+  INlsRequestParam::resetParam();
+
+  if (_version != 0) {
+    _header[D_DA_ENABLE_MUTI_GROUP] = true;
+  }
+
+  _payload[D_DA_SESSION_ID] = _task_id.c_str();
+}
+
 const char* DialogAssistantParam::getStartCommand() {
   _header[D_NAME] = D_CMD_START_RECOGNITION;
 
@@ -27,6 +27,8 @@ class DialogAssistantParam : public INlsRequestParam {
    DialogAssistantParam(int version);
    ~DialogAssistantParam();
 
+   virtual void resetParam();
+
    virtual const char*  getStartCommand();
    virtual const char*  getStopCommand();
    virtual const char*  getExecuteDialog();
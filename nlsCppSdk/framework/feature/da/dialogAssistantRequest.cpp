@@ -31,6 +31,7 @@ DialogAssistantCallback::DialogAssistantCallback() {
   this->_onDialogResultGenerated = NULL;
   this->_onRecognitionResultChanged = NULL;
   this->_onChannelClosed = NULL;
+  this->_onWakeWordVerificationCompleted = NULL;
 }
 
 DialogAssistantCallback::~DialogAssistantCallback() {
@@ -149,6 +150,9 @@ DialogAssistantRequest::~DialogAssistantRequest() {
 //  delete _dialogAssistantParam;
 //  _dialogAssistantParam = NULL;
 
+  // 回调可能仍在异步回调线程中排队, 需在释放listener前等待其完成
+  _node->drainCallbacks();
+
   delete _listener;
   _listener = NULL;
 
@@ -181,6 +185,14 @@ int DialogAssistantRequest::cancel() {
   //return INlsRequest::cancel(this);
 }
 
+int DialogAssistantRequest::reset() {
+  return INlsRequest::reset(this);
+}
+
+void DialogAssistantRequest::resetCallback() {
+  *_callback = DialogAssistantCallback();
+}
+
 int DialogAssistantRequest::StopWakeWordVerification() {
   return INlsRequest::stop(this, 2);
 }
@@ -234,6 +246,54 @@ int DialogAssistantRequest::setSampleRate(int value) {
   return 0;
 }
 
+int DialogAssistantRequest::setEncoderFrameDuration(int frameMs) {
+  if (frameMs != 20 && frameMs != 40 && frameMs != 60) {
+    return -1;
+  }
+  _dialogAssistantParam->setEncoderFrameDuration(frameMs);
+  return 0;
+}
+
+int DialogAssistantRequest::setEncoderProfile(const NlsEncoderProfile& profile) {
+  return _dialogAssistantParam->setEncoderProfile(profile);
+}
+
+int DialogAssistantRequest::setEncoderPreset(ENCODER_PRESET preset) {
+  return _dialogAssistantParam->setEncoderPreset(preset);
+}
+
+int DialogAssistantRequest::setVadParam(const NlsVadParam& param) {
+  return _dialogAssistantParam->setVadParam(param);
+}
+
+int DialogAssistantRequest::getVadStats(NlsVadStats* stats) {
+  if (_node == NULL || stats == NULL) {
+    return -1;
+  }
+  _node->getVadStats(stats);
+  return 0;
+}
+
+int DialogAssistantRequest::getLatencyTrace(NlsLatencyTrace* trace) {
+  if (_node == NULL || trace == NULL) {
+    return -1;
+  }
+  _node->getLatencyTrace(trace);
+  return 0;
+}
+
+int DialogAssistantRequest::getMemoryUsage(NlsRequestMemoryUsage* usage) {
+  if (_node == NULL || usage == NULL) {
+    return -1;
+  }
+  _node->getMemoryUsage(usage);
+  return 0;
+}
+
+int DialogAssistantRequest::setInputAudioFormat(const NlsAudioInputFormat& format) {
+  return _dialogAssistantParam->setInputAudioFormat(format);
+}
+
 int DialogAssistantRequest::setTimeout(int value) {
   _dialogAssistantParam->setTimeout(value);
   return 0;
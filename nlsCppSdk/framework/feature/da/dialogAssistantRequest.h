@@ -91,6 +91,79 @@ class NLS_SDK_CLIENT_EXPORT DialogAssistantRequest : public INlsRequest {
    */
   int setSampleRate(int value);
 
+  /**
+   * @brief 设置OPU/OPUS编码帧时长
+   * @note 可选参数, 支持20/40/60毫秒, 默认20. 仅opu/opus格式生效.
+   *       sendAudio可传入任意长度PCM, SDK内部按帧切分编码,
+   *       不足一帧的数据留待下次发送, stop时补零编码.
+   * @param frameMs 帧时长(毫秒)
+   * @return 成功则返回0，否则返回-1
+   */
+  int setEncoderFrameDuration(int frameMs);
+
+  /**
+   * @brief 设置OPU/OPUS编码参数
+   * @note 可选参数, 仅opu/opus格式生效, 在start前调用.
+   *       码率6000~510000bps, 复杂度0~10, 帧时长20/40/60毫秒.
+   *       opu格式每帧编码结果不超过255字节, 超出时编码器自动降低码率.
+   * @param profile 编码参数, 默认值见NlsEncoderProfile
+   * @return 成功则返回0，参数非法返回-1
+   */
+  int setEncoderProfile(const NlsEncoderProfile& profile);
+
+  /**
+   * @brief 按预设设置OPU/OPUS编码参数
+   * @note 可选参数, 预设见ENCODER_PRESET, 会覆盖setEncoderFrameDuration的设置.
+   * @param preset 编码预设
+   * @return 成功则返回0，否则返回-1
+   */
+  int setEncoderPreset(ENCODER_PRESET preset);
+
+  /*
+   * @brief 设置客户端静音检测
+   * @note 可选参数, 在start前调用, 默认不检测. 仅pcm/opu/opus格式生效,
+   *       在setInputAudioFormat的格式转换之后进行.
+   *       VAD_MODE_MUTE将长静音置零上传, 时间戳与原始音频一致;
+   *       VAD_MODE_DROP不上传长静音, 回调中事件的句子及词时间戳已按被丢弃的时长
+   *       换算回原始音频时间, getAllResponse返回的原始JSON仍为服务端时间.
+   * @param param 检测参数, 默认值见NlsVadParam
+   * @return 成功则返回0，参数非法返回-1
+   */
+  int setVadParam(const NlsVadParam& param);
+
+  /*
+   * @brief 获取本次请求的静音检测统计, 可在回调中或stop后调用
+   * @param stats 统计信息输出
+   * @return 成功则返回0，否则返回-1
+   */
+  int getVadStats(NlsVadStats* stats);
+
+  /*
+   * @brief 获取本次请求各阶段的时间点, 可在回调中或stop后调用,
+   *        请求进行中调用时尚未到达的阶段为0, 见NlsLatencyTrace
+   * @param trace 时延信息输出
+   * @return 成功则返回0，否则返回-1
+   */
+  int getLatencyTrace(NlsLatencyTrace* trace);
+
+  /*
+   * @brief 获取本次请求持有的缓冲内存, 可在回调中或stop后调用
+   * @param usage 内存统计输出, 见NlsRequestMemoryUsage
+   * @return 成功则返回0，否则返回-1
+   */
+  int getMemoryUsage(NlsRequestMemoryUsage* usage);
+
+  /*
+   * @brief 设置sendAudio输入的PCM格式
+   * @note 可选参数, 在start前调用, 默认为与请求采样率一致的16bit单声道PCM.
+   *       支持S16/S32/F32交错多声道及8000~192000Hz任意采样率输入,
+   *       SDK混为单声道并重采样为setSampleRate设置的采样率后上传.
+   *       仅pcm/opu/opus格式生效.
+   * @param format 输入格式, 见NlsAudioInputFormat
+   * @return 成功则返回0，参数非法返回-1
+   */
+  int setInputAudioFormat(const NlsAudioInputFormat& format);
+
   /**
    * @brief 设置Socket接收超时时间
    * @param value 超时时间
@@ -204,6 +277,14 @@ class NLS_SDK_CLIENT_EXPORT DialogAssistantRequest : public INlsRequest {
    */
   int cancel();
 
+  /**
+   * @brief 重置请求, 以便在同一个request上发起下一次请求
+   * @note 需在收到ChannelClosed回调后调用, 保留已设置的参数与回调,
+   *       复用连接缓冲区与编码器. 若事件线程尚未完成清理则返回-1, 可稍后重试.
+   * @return 成功则返回0，否则返回-1
+   */
+  int reset();
+
   /**
    * @brief 会与服务端确认关闭，正常停止DialogAssistantRequest链接操作
    * @note 阻塞操作，等待服务端响应才会返回
@@ -223,7 +304,8 @@ class NLS_SDK_CLIENT_EXPORT DialogAssistantRequest : public INlsRequest {
    * @param data 语音数据
    * @param dataSize 语音数据长度(建议每次100ms左右数据)
    * @param type ENCODER_NONE表示原始音频进行传递;
-                 ENCODER_OPU表示以OPUS压缩后进行传递
+                 ENCODER_OPU表示以OPUS压缩后进行传递,
+                 支持任意长度, 帧时长见setEncoderFrameDuration
    * @return 成功则返回0，失败返回-1。
              由于音频格式不确定，传入音频字节数和传出音频字节数
              无法通过比较判断成功与否，故成功返回0。
@@ -295,6 +377,9 @@ class NLS_SDK_CLIENT_EXPORT DialogAssistantRequest : public INlsRequest {
 
   void setEnableMultiGroup(bool value);
 
+ protected:
+  virtual void resetCallback();
+
  private:
   DialogAssistantParam* _dialogAssistantParam;
   DialogAssistantCallback* _callback;
@@ -25,7 +25,7 @@ SpeechRecognizerListener::SpeechRecognizerListener(
 
 SpeechRecognizerListener::~SpeechRecognizerListener() {}
 
-void SpeechRecognizerListener::handlerFrame(NlsEvent str) {
+void SpeechRecognizerListener::handlerFrame(NlsEvent& str) {
   NlsEvent::EventType type = str.getMsgType();
 
   switch(type) {
@@ -141,6 +141,9 @@ SpeechRecognizerRequest::~SpeechRecognizerRequest() {
 //  delete _recognizerParam;
 //  _recognizerParam = NULL;
 
+  // 回调可能仍在异步回调线程中排队, 需在释放listener前等待其完成
+  _node->drainCallbacks();
+
   delete _listener;
   _listener = NULL;
 
@@ -168,6 +171,14 @@ int SpeechRecognizerRequest::cancel() {
   return INlsRequest::stop(this, 1);
 }
 
+int SpeechRecognizerRequest::reset() {
+  return INlsRequest::reset(this);
+}
+
+void SpeechRecognizerRequest::resetCallback() {
+  *_callback = SpeechRecognizerCallback();
+}
+
 int SpeechRecognizerRequest::sendAudio(
     const uint8_t * data, size_t dataSize, ENCODER_TYPE type) {
   return INlsRequest::sendAudio(this, data, dataSize, type);
@@ -212,11 +223,68 @@ int SpeechRecognizerRequest::setSampleRate(int value) {
   return 0;
 }
 
+int SpeechRecognizerRequest::setEncoderFrameDuration(int frameMs) {
+  if (frameMs != 20 && frameMs != 40 && frameMs != 60) {
+    return -1;
+  }
+  _recognizerParam->setEncoderFrameDuration(frameMs);
+  return 0;
+}
+
+int SpeechRecognizerRequest::setEncoderProfile(const NlsEncoderProfile& profile) {
+  return _recognizerParam->setEncoderProfile(profile);
+}
+
+int SpeechRecognizerRequest::setEncoderPreset(ENCODER_PRESET preset) {
+  return _recognizerParam->setEncoderPreset(preset);
+}
+
+int SpeechRecognizerRequest::setVadParam(const NlsVadParam& param) {
+  return _recognizerParam->setVadParam(param);
+}
+
+int SpeechRecognizerRequest::getVadStats(NlsVadStats* stats) {
+  if (_node == NULL || stats == NULL) {
+    return -1;
+  }
+  _node->getVadStats(stats);
+  return 0;
+}
+
+int SpeechRecognizerRequest::getLatencyTrace(NlsLatencyTrace* trace) {
+  if (_node == NULL || trace == NULL) {
+    return -1;
+  }
+  _node->getLatencyTrace(trace);
+  return 0;
+}
+
+int SpeechRecognizerRequest::getMemoryUsage(NlsRequestMemoryUsage* usage) {
+  if (_node == NULL || usage == NULL) {
+    return -1;
+  }
+  _node->getMemoryUsage(usage);
+  return 0;
+}
+
+int SpeechRecognizerRequest::setInputAudioFormat(const NlsAudioInputFormat& format) {
+  return _recognizerParam->setInputAudioFormat(format);
+}
+
 int SpeechRecognizerRequest::setIntermediateResult(bool value) {
   _recognizerParam->setIntermediateResult(value);
   return 0;
 }
 
+int SpeechRecognizerRequest::setIntermediateResultCoalescing(
+    int intervalMs, int textDelta) {
+  if (intervalMs < 0 || textDelta < 0) {
+    return -1;
+  }
+  _recognizerParam->setIntermediateResultCoalescing(intervalMs, textDelta);
+  return 0;
+}
+
 int SpeechRecognizerRequest::setPunctuationPrediction(bool value) {
   _recognizerParam->setPunctuationPrediction(value);
   return 0;
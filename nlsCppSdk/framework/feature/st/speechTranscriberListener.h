@@ -35,7 +35,7 @@ SpeechTranscriberListener(SpeechTranscriberCallback* cb);
 
 ~SpeechTranscriberListener();
 
-virtual void handlerFrame(NlsEvent);
+virtual void handlerFrame(NlsEvent&);
 
 private:
 SpeechTranscriberCallback* _callback;
@@ -0,0 +1,754 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#if defined(_MSC_VER)
+#include <process.h>
+#else
+#include <sys/time.h>
+#endif
+#if defined(__ANDROID__) || defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include "nlog.h"
+#include "utility.h"
+#include "nlsClient.h"
+#include "connectNode.h"
+#include "speechTranscriberMultiChannel.h"
+#include "speechTranscriberListener.h"
+
+#if !defined(NLS_DISABLE_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NLS_DEINTERLEAVE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define NLS_DEINTERLEAVE_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace AlibabaNls {
+
+/*
+ * 双声道拆分的SIMD实现, 返回已处理的采样帧数, 剩余部分由调用者逐帧处理.
+ */
+static size_t deinterleaveStereo16(const uint8_t* in, uint8_t* left,
+                                   uint8_t* right, size_t frames) {
+  size_t i = 0;
+#if defined(NLS_DEINTERLEAVE_SSE2)
+  for (; i + 8 <= frames; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(in + i * 4));
+    __m128i b = _mm_loadu_si128((const __m128i*)(in + i * 4 + 16));
+    // 低16位为左声道, 高16位为右声道, 符号扩展后饱和打包不改变数值
+    __m128i l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                                _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    __m128i r = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    _mm_storeu_si128((__m128i*)(left + i * 2), l);
+    _mm_storeu_si128((__m128i*)(right + i * 2), r);
+  }
+#elif defined(NLS_DEINTERLEAVE_NEON)
+  // 按字节拆分, 不要求地址对齐
+  for (; i + 16 <= frames; i += 16) {
+    uint8x16x4_t v = vld4q_u8(in + i * 4);
+    uint8x16x2_t l;
+    uint8x16x2_t r;
+    l.val[0] = v.val[0];
+    l.val[1] = v.val[1];
+    r.val[0] = v.val[2];
+    r.val[1] = v.val[3];
+    vst2q_u8(left + i * 2, l);
+    vst2q_u8(right + i * 2, r);
+  }
+#endif
+  (void)in;
+  (void)left;
+  (void)right;
+  (void)frames;
+  return i;
+}
+
+static size_t deinterleaveStereo32(const uint8_t* in, uint8_t* left,
+                                   uint8_t* right, size_t frames) {
+  size_t i = 0;
+#if defined(NLS_DEINTERLEAVE_SSE2)
+  for (; i + 4 <= frames; i += 4) {
+    __m128 a = _mm_loadu_ps((const float*)(in + i * 8));
+    __m128 b = _mm_loadu_ps((const float*)(in + i * 8 + 16));
+    _mm_storeu_ps((float*)(left + i * 4),
+                  _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps((float*)(right + i * 4),
+                  _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+#elif defined(NLS_DEINTERLEAVE_NEON)
+  if ((((size_t)in | (size_t)left | (size_t)right) & 3) == 0) {
+    for (; i + 4 <= frames; i += 4) {
+      uint32x4x2_t v = vld2q_u32((const uint32_t*)(in + i * 8));
+      vst1q_u32((uint32_t*)(left + i * 4), v.val[0]);
+      vst1q_u32((uint32_t*)(right + i * 4), v.val[1]);
+    }
+  }
+#endif
+  (void)in;
+  (void)left;
+  (void)right;
+  (void)frames;
+  return i;
+}
+
+static void onChannelEvent(NlsEvent* event, void* para) {
+  MultiChannelContext* context = static_cast<MultiChannelContext*>(para);
+  if (context && context->owner) {
+    context->owner->deliverEvent(event, context->channel);
+  }
+}
+
+SpeechTranscriberMultiChannel::SpeechTranscriberMultiChannel(int channels) :
+    _channels(channels), _sampleBytes(2), _planarFrames(0), _pendingSize(0),
+    _maxReorderDelay(3000), _draining(false), _stopping(false) {
+  _callback = new SpeechTranscriberCallback();
+  _listener = new SpeechTranscriberListener(_callback);
+
+  _requests = new SpeechTranscriberRequest*[_channels];
+  _contexts = new MultiChannelContext[_channels];
+  for (int i = 0; i < _channels; i++) {
+    _contexts[i].owner = this;
+    _contexts[i].channel = i;
+
+    SpeechTranscriberRequest* request =
+        NlsClient::getInstance()->createTranscriberRequest();
+    request->setOnTaskFailed(onChannelEvent, &_contexts[i]);
+    request->setOnTranscriptionStarted(onChannelEvent, &_contexts[i]);
+    request->setOnSentenceBegin(onChannelEvent, &_contexts[i]);
+    request->setOnTranscriptionResultChanged(onChannelEvent, &_contexts[i]);
+    request->setOnSentenceEnd(onChannelEvent, &_contexts[i]);
+    request->setOnTranscriptionCompleted(onChannelEvent, &_contexts[i]);
+    request->setOnChannelClosed(onChannelEvent, &_contexts[i]);
+    request->setOnSentenceSemantics(onChannelEvent, &_contexts[i]);
+    _requests[i] = request;
+  }
+
+  _held = new std::deque<HeldEvent>[_channels];
+  _progress = new int[_channels];
+  _finished = new bool[_channels];
+  for (int i = 0; i < _channels; i++) {
+    _progress[i] = 0;
+    _finished[i] = false;
+  }
+
+#if defined(_MSC_VER)
+  _mtxDeliver = CreateMutex(NULL, FALSE, NULL);
+  _deliverEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  _timerHandle = (HANDLE)_beginthreadex(
+      NULL, 0, loopReorderTimer, this, 0, &_timerId);
+  if (_timerHandle == NULL) {
+#else
+  pthread_mutex_init(&_mtxDeliver, NULL);
+  pthread_cond_init(&_cvDeliver, NULL);
+  _timerStarted =
+      pthread_create(&_timerId, NULL, loopReorderTimer, this) == 0;
+  if (!_timerStarted) {
+#endif
+    // 仅失去按暂存时长上报, 后续事件到达时仍按进度上报
+    LOG_ERROR("Create reorder timer thread failed.");
+  }
+
+  LOG_DEBUG("Create SpeechTranscriberMultiChannel, channels:%d.", _channels);
+}
+
+SpeechTranscriberMultiChannel::~SpeechTranscriberMultiChannel() {
+  lockDeliver();
+  _stopping = true;
+  notifyDeliver();
+  unlockDeliver();
+#if defined(_MSC_VER)
+  if (_timerHandle) {
+    WaitForSingleObject(_timerHandle, INFINITE);
+    CloseHandle(_timerHandle);
+    _timerHandle = NULL;
+  }
+#else
+  if (_timerStarted) {
+    pthread_join(_timerId, NULL);
+    _timerStarted = false;
+  }
+#endif
+
+  // 仍在进行的声道直接取消, 之后不再上报回调
+  for (int i = 0; i < _channels; i++) {
+    ConnectNode* node = _requests[i]->getConnectNode();
+    if (node->getConnectNodeStatus() != NodeInitial &&
+        node->getExitStatus() == ExitInvalid) {
+      _requests[i]->cancel();
+    }
+  }
+
+  // 等待正在上报的回调结束, 暂存的事件不再上报
+  lockDeliver();
+  clearHeld();
+  while (_draining) {
+    waitDeliver(-1);
+  }
+  unlockDeliver();
+
+  // 其余声道与0声道共用线程, 最后释放0声道
+  for (int i = _channels - 1; i >= 0; i--) {
+    _requests[i]->getConnectNode()->_affinityNode = NULL;
+    NlsClient::getInstance()->releaseTranscriberRequest(_requests[i]);
+    _requests[i] = NULL;
+  }
+  delete [] _requests;
+  _requests = NULL;
+  delete [] _contexts;
+  _contexts = NULL;
+  delete [] _held;
+  _held = NULL;
+  delete [] _progress;
+  _progress = NULL;
+  delete [] _finished;
+  _finished = NULL;
+
+  delete _listener;
+  _listener = NULL;
+  delete _callback;
+  _callback = NULL;
+
+#if defined(_MSC_VER)
+  CloseHandle(_mtxDeliver);
+  CloseHandle(_deliverEvent);
+#else
+  pthread_mutex_destroy(&_mtxDeliver);
+  pthread_cond_destroy(&_cvDeliver);
+#endif
+
+  LOG_DEBUG("Destroy SpeechTranscriberMultiChannel.");
+}
+
+int SpeechTranscriberMultiChannel::getChannels() {
+  return _channels;
+}
+
+SpeechTranscriberRequest* SpeechTranscriberMultiChannel::getChannelRequest(
+    int channel) {
+  if (channel < 0 || channel >= _channels) {
+    return NULL;
+  }
+  return _requests[channel];
+}
+
+#define FOR_EACH_CHANNEL(call)                  \
+  int ret = 0;                                  \
+  for (int i = 0; i < _channels; i++) {         \
+    if (_requests[i]->call < 0) {               \
+      ret = -1;                                 \
+    }                                           \
+  }                                             \
+  return ret;
+
+int SpeechTranscriberMultiChannel::setUrl(const char* value) {
+  FOR_EACH_CHANNEL(setUrl(value));
+}
+
+int SpeechTranscriberMultiChannel::setAppKey(const char* value) {
+  FOR_EACH_CHANNEL(setAppKey(value));
+}
+
+int SpeechTranscriberMultiChannel::setToken(const char* value) {
+  FOR_EACH_CHANNEL(setToken(value));
+}
+
+int SpeechTranscriberMultiChannel::setFormat(const char* value) {
+  FOR_EACH_CHANNEL(setFormat(value));
+}
+
+int SpeechTranscriberMultiChannel::setSampleRate(int value) {
+  FOR_EACH_CHANNEL(setSampleRate(value));
+}
+
+int SpeechTranscriberMultiChannel::setIntermediateResult(bool value) {
+  FOR_EACH_CHANNEL(setIntermediateResult(value));
+}
+
+int SpeechTranscriberMultiChannel::setPunctuationPrediction(bool value) {
+  FOR_EACH_CHANNEL(setPunctuationPrediction(value));
+}
+
+int SpeechTranscriberMultiChannel::setInverseTextNormalization(bool value) {
+  FOR_EACH_CHANNEL(setInverseTextNormalization(value));
+}
+
+int SpeechTranscriberMultiChannel::setPayloadParam(const char* value) {
+  FOR_EACH_CHANNEL(setPayloadParam(value));
+}
+
+int SpeechTranscriberMultiChannel::stop() {
+  FOR_EACH_CHANNEL(stop());
+}
+
+int SpeechTranscriberMultiChannel::reset() {
+  _pendingSize = 0;
+  lockDeliver();
+  clearHeld();
+  unlockDeliver();
+  FOR_EACH_CHANNEL(reset());
+}
+
+#undef FOR_EACH_CHANNEL
+
+int SpeechTranscriberMultiChannel::cancel() {
+  int ret = 0;
+  for (int i = 0; i < _channels; i++) {
+    if (_requests[i]->cancel() < 0) {
+      ret = -1;
+    }
+  }
+
+  lockDeliver();
+  clearHeld();
+  unlockDeliver();
+  return ret;
+}
+
+int SpeechTranscriberMultiChannel::setMaxReorderDelay(int value) {
+  if (value < 0) {
+    return -1;
+  }
+  lockDeliver();
+  _maxReorderDelay = value;
+  notifyDeliver();
+  unlockDeliver();
+  return 0;
+}
+
+int SpeechTranscriberMultiChannel::setInputAudioFormat(
+    const NlsAudioInputFormat& format) {
+  if (format.channels != _channels) {
+    LOG_ERROR("input channels %d mismatch %d.", format.channels, _channels);
+    return -1;
+  }
+
+  NlsAudioInputFormat channelFormat = format;
+  channelFormat.channels = 1;
+  for (int i = 0; i < _channels; i++) {
+    if (_requests[i]->setInputAudioFormat(channelFormat) < 0) {
+      return -1;
+    }
+  }
+
+  _sampleBytes = (format.sampleFormat == SAMPLE_FORMAT_S16) ? 2 : 4;
+  _pendingSize = 0;
+  return 0;
+}
+
+int SpeechTranscriberMultiChannel::start() {
+  _pendingSize = 0;
+  lockDeliver();
+  clearHeld();
+  unlockDeliver();
+
+  // 其余声道跟随0声道的事件线程、回调线程及编码线程
+  ConnectNode* leader = _requests[0]->getConnectNode();
+  for (int i = 1; i < _channels; i++) {
+    _requests[i]->getConnectNode()->_affinityNode = leader;
+  }
+
+  for (int i = 0; i < _channels; i++) {
+    if (_requests[i]->start() < 0) {
+      LOG_ERROR("start channel %d failed.", i);
+      for (int j = 0; j < i; j++) {
+        _requests[j]->cancel();
+      }
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void SpeechTranscriberMultiChannel::deinterleave(
+    const uint8_t* data, size_t frames, size_t offset) {
+  size_t frameBytes = _sampleBytes * _channels;
+  size_t done = 0;
+
+  if (_channels == 2) {
+    uint8_t* left = &_planar[offset * _sampleBytes];
+    uint8_t* right = &_planar[(_planarFrames + offset) * _sampleBytes];
+    if (_sampleBytes == 2) {
+      done = deinterleaveStereo16(data, left, right, frames);
+    } else {
+      done = deinterleaveStereo32(data, left, right, frames);
+    }
+  }
+
+  for (int c = 0; c < _channels; c++) {
+    uint8_t* out = &_planar[(c * _planarFrames + offset) * _sampleBytes];
+    const uint8_t* in = data + c * _sampleBytes;
+    for (size_t i = done; i < frames; i++) {
+      memcpy(out + i * _sampleBytes, in + i * frameBytes, _sampleBytes);
+    }
+  }
+}
+
+int SpeechTranscriberMultiChannel::sendAudio(
+    const uint8_t * data, size_t dataSize, ENCODER_TYPE type) {
+  if (data == NULL || dataSize == 0) {
+    return -1;
+  }
+
+  size_t frameBytes = _sampleBytes * _channels;
+  size_t head = 0;
+  if (_pendingSize > 0) {
+    head = frameBytes - _pendingSize;
+    if (head > dataSize) head = dataSize;
+    memcpy(_pending + _pendingSize, data, head);
+    _pendingSize += head;
+    if (_pendingSize < frameBytes) {
+      return 0;
+    }
+  }
+
+  size_t frames = (dataSize - head) / frameBytes;
+  size_t total = frames + (_pendingSize > 0 ? 1 : 0);
+  if (total == 0) {
+    memcpy(_pending, data + head, dataSize - head);
+    _pendingSize = dataSize - head;
+    return 0;
+  }
+
+  // 按本次帧数扩容, 之后复用
+  if (_planarFrames < total) {
+    _planarFrames = total;
+    _planar.resize(_planarFrames * frameBytes);
+  }
+
+  size_t offset = 0;
+  if (_pendingSize > 0) {
+    deinterleave(_pending, 1, 0);
+    offset = 1;
+  }
+  deinterleave(data + head, frames, offset);
+
+  size_t rest = dataSize - head - frames * frameBytes;
+  if (rest > 0) {
+    memcpy(_pending, data + head + frames * frameBytes, rest);
+  }
+  _pendingSize = rest;
+
+  int ret = 0;
+  for (int c = 0; c < _channels; c++) {
+    if (_requests[c]->sendAudio(&_planar[c * _planarFrames * _sampleBytes],
+                                total * _sampleBytes, type) < 0) {
+      ret = -1;
+    }
+  }
+  return ret;
+}
+
+void SpeechTranscriberMultiChannel::lockDeliver() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxDeliver, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxDeliver);
+#endif
+}
+
+void SpeechTranscriberMultiChannel::unlockDeliver() {
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxDeliver);
+#else
+  pthread_mutex_unlock(&_mtxDeliver);
+#endif
+}
+
+/*
+ * 其余未结束的声道进度均不早于time时可上报,
+ * 或time落后于最快声道超过_maxReorderDelay, 视其余声道为静音.
+ */
+bool SpeechTranscriberMultiChannel::deliverable(int time, int channel) {
+  if (_maxReorderDelay <= 0) {
+    return true;
+  }
+
+  bool waiting = false;
+  int fastest = time;
+  for (int i = 0; i < _channels; i++) {
+    if (_progress[i] > fastest) {
+      fastest = _progress[i];
+    }
+    if (i != channel && !_finished[i] && _progress[i] < time) {
+      waiting = true;
+    }
+  }
+  return !waiting || fastest - time >= _maxReorderDelay;
+}
+
+/*
+ * 依次将各声道队首中时间最早的事件移入_outbox, 直到其不可上报.
+ * 各声道内时间递增, 最早者不可上报时其余事件也不可上报.
+ * 任一事件暂存超过_maxReorderDelay时, 按时间顺序上报至其不再超时.
+ */
+void SpeechTranscriberMultiChannel::drainHeld(uint64_t nowMs) {
+  while (true) {
+    int earliest = -1;
+    uint64_t oldest = nowMs;
+    for (int i = 0; i < _channels; i++) {
+      if (_held[i].empty()) {
+        continue;
+      }
+      if (earliest < 0 ||
+          _held[i].front().time < _held[earliest].front().time) {
+        earliest = i;
+      }
+      if (_held[i].front().arrivalMs < oldest) {
+        oldest = _held[i].front().arrivalMs;
+      }
+    }
+    if (earliest < 0) {
+      break;
+    }
+
+    bool expired = _maxReorderDelay > 0 &&
+                   nowMs - oldest >= (uint64_t)_maxReorderDelay;
+    if (!expired && !deliverable(_held[earliest].front().time, earliest)) {
+      break;
+    }
+
+    _outbox.push_back(_held[earliest].front());
+    _held[earliest].pop_front();
+  }
+}
+
+/*
+ * 持锁调用, 返回时仍持锁. 在锁外依次上报_outbox中的事件,
+ * 同一时刻只有一个线程上报, 其余线程入队后直接返回, 由其继续上报.
+ */
+void SpeechTranscriberMultiChannel::drainOutbox() {
+  _draining = true;
+  while (!_outbox.empty()) {
+    HeldEvent item = _outbox.front();
+    _outbox.pop_front();
+    unlockDeliver();
+    _listener->handlerFrame(*item.event);
+    if (item.owned) {
+      delete item.event;
+    }
+    lockDeliver();
+  }
+  _draining = false;
+  if (_stopping) {
+    // 析构中等待上报结束
+    notifyDeliver();
+  }
+}
+
+void SpeechTranscriberMultiChannel::clearHeld() {
+  for (size_t i = 0; i < _outbox.size(); i++) {
+    if (_outbox[i].owned) {
+      delete _outbox[i].event;
+    }
+  }
+  _outbox.clear();
+
+  for (int i = 0; i < _channels; i++) {
+    while (!_held[i].empty()) {
+      delete _held[i].front().event;
+      _held[i].pop_front();
+    }
+    _progress[i] = 0;
+    _finished[i] = false;
+  }
+}
+
+void SpeechTranscriberMultiChannel::deliverEvent(NlsEvent* event,
+                                                 int channel) {
+  event->setChannel(channel);
+  lockDeliver();
+
+  int time = _progress[channel];
+  switch (event->getMsgType()) {
+    case NlsEvent::SentenceBegin:
+    case NlsEvent::TranscriptionResultChanged:
+    case NlsEvent::SentenceEnd:
+      if (event->getSentenceTime() > time) {
+        time = event->getSentenceTime();
+      }
+      break;
+    case NlsEvent::TaskFailed:
+    case NlsEvent::TranscriptionCompleted:
+    case NlsEvent::Close:
+      _finished[channel] = true;
+      break;
+    default:
+      break;
+  }
+  _progress[channel] = time;
+
+  bool held = false;
+  for (int i = 0; i < _channels && !held; i++) {
+    held = !_held[i].empty();
+  }
+
+  HeldEvent item;
+  item.time = time;
+  item.arrivalMs = 0;
+  if (!held && deliverable(time, channel)) {
+    // 无暂存事件且由本线程上报时直接上报, 不复制
+    item.owned = _draining;
+    item.event = _draining ? new NlsEvent(*event) : event;
+    _outbox.push_back(item);
+  } else {
+    uint64_t nowMs = utility::getMonotonicUs() / 1000;
+    item.event = new NlsEvent(*event);
+    item.owned = true;
+    item.arrivalMs = nowMs;
+    _held[channel].push_back(item);
+    drainHeld(nowMs);
+    if (!held) {
+      // 定时线程按新的最早暂存时刻等待
+      notifyDeliver();
+    }
+  }
+
+  if (!_draining) {
+    drainOutbox();
+  }
+  unlockDeliver();
+}
+
+void SpeechTranscriberMultiChannel::notifyDeliver() {
+#if defined(_MSC_VER)
+  SetEvent(_deliverEvent);
+#else
+  pthread_cond_broadcast(&_cvDeliver);
+#endif
+}
+
+/* 持锁调用, 等待期间释放锁, timeoutMs小于0时一直等待 */
+void SpeechTranscriberMultiChannel::waitDeliver(int timeoutMs) {
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxDeliver);
+  WaitForSingleObject(_deliverEvent,
+                      timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+  WaitForSingleObject(_mtxDeliver, INFINITE);
+#else
+  if (timeoutMs < 0) {
+    pthread_cond_wait(&_cvDeliver, &_mtxDeliver);
+    return;
+  }
+  struct timeval now;
+  struct timespec deadline;
+  gettimeofday(&now, NULL);
+  uint64_t nsec = (uint64_t)now.tv_usec * 1000 +
+                  (uint64_t)timeoutMs * 1000000;
+  deadline.tv_sec = now.tv_sec + (time_t)(nsec / 1000000000);
+  deadline.tv_nsec = (long)(nsec % 1000000000);
+  pthread_cond_timedwait(&_cvDeliver, &_mtxDeliver, &deadline);
+#endif
+}
+
+/*
+ * 其余声道断流时不再有事件触发上报, 由本线程在最早暂存的事件
+ * 超过_maxReorderDelay时将其上报.
+ */
+#if defined(_MSC_VER)
+unsigned __stdcall SpeechTranscriberMultiChannel::loopReorderTimer(
+    LPVOID arg) {
+#else
+void* SpeechTranscriberMultiChannel::loopReorderTimer(void* arg) {
+#endif
+#if defined(__ANDROID__) || defined(__linux__)
+  prctl(PR_SET_NAME, "reorderTimer");
+#endif
+
+  SpeechTranscriberMultiChannel* self =
+      static_cast<SpeechTranscriberMultiChannel*>(arg);
+  self->lockDeliver();
+  while (!self->_stopping) {
+    uint64_t nowMs = utility::getMonotonicUs() / 1000;
+    self->drainHeld(nowMs);
+    if (!self->_outbox.empty() && !self->_draining) {
+      self->drainOutbox();
+      continue;
+    }
+
+    int timeoutMs = -1;
+    if (self->_maxReorderDelay > 0) {
+      for (int i = 0; i < self->_channels; i++) {
+        if (self->_held[i].empty()) {
+          continue;
+        }
+        uint64_t deadline =
+            self->_held[i].front().arrivalMs + self->_maxReorderDelay;
+        int remain = deadline > nowMs ? (int)(deadline - nowMs) : 0;
+        if (timeoutMs < 0 || remain < timeoutMs) {
+          timeoutMs = remain;
+        }
+      }
+    }
+    if (timeoutMs != 0) {
+      self->waitDeliver(timeoutMs);
+    }
+  }
+  self->unlockDeliver();
+
+#if defined(_MSC_VER)
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+void SpeechTranscriberMultiChannel::setOnTaskFailed(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnTaskFailed(_event, para);
+}
+
+void SpeechTranscriberMultiChannel::setOnTranscriptionStarted(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnTranscriptionStarted(_event, para);
+}
+
+void SpeechTranscriberMultiChannel::setOnSentenceBegin(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnSentenceBegin(_event, para);
+}
+
+void SpeechTranscriberMultiChannel::setOnTranscriptionResultChanged(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnTranscriptionResultChanged(_event, para);
+}
+
+void SpeechTranscriberMultiChannel::setOnSentenceEnd(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnSentenceEnd(_event, para);
+}
+
+void SpeechTranscriberMultiChannel::setOnTranscriptionCompleted(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnTranscriptionCompleted(_event, para);
+}
+
+void SpeechTranscriberMultiChannel::setOnChannelClosed(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnChannelClosed(_event, para);
+}
+
+void SpeechTranscriberMultiChannel::setOnSentenceSemantics(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnSentenceSemantics(_event, para);
+}
+
+}
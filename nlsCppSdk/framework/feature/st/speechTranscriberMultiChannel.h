@@ -0,0 +1,225 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_SPEECH_TRANSCRIBER_MULTI_CHANNEL_H
+#define NLS_SDK_SPEECH_TRANSCRIBER_MULTI_CHANNEL_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <deque>
+#include <vector>
+#include "nlsGlobal.h"
+#include "nlsEvent.h"
+#include "speechTranscriberRequest.h"
+
+namespace AlibabaNls {
+
+class SpeechTranscriberListener;
+class SpeechTranscriberMultiChannel;
+
+struct MultiChannelContext {
+  SpeechTranscriberMultiChannel* owner;
+  int channel;
+};
+
+/*
+ * 多声道实时音频流识别, 如左声道为坐席、右声道为客户的双声道通话录音.
+ * 输入交错存放的多声道PCM, 拆分后每个声道由一路SpeechTranscriberRequest识别.
+ * 各路请求在同一事件线程上收发, 回调串行上报, 事件的getChannel()为其所属声道.
+ * 各声道的事件按句子时间(SentenceBegin为开始时间, ResultChanged为当前时间,
+ * SentenceEnd为结束时间)合并为一路: 某声道的事件先暂存, 待其余声道的进度
+ * 均超过其时间或已结束后再上报. 不带时间的事件沿用本声道的进度.
+ * 其余声道长时间静音时, 落后于最快声道或暂存超过setMaxReorderDelay的事件不再等待.
+ * 用户回调在内部锁外执行, 可在回调中调用cancel/reset等接口.
+ */
+class NLS_SDK_CLIENT_EXPORT SpeechTranscriberMultiChannel {
+ public:
+  explicit SpeechTranscriberMultiChannel(int channels);
+  ~SpeechTranscriberMultiChannel();
+
+  /* @brief 获取声道数 */
+  int getChannels();
+
+  /*
+   * @brief 获取某一声道的识别请求, 用于设置该声道独有的参数
+   * @note 不可对其调用start/stop/sendAudio/setOnXXX或释放
+   * @param channel 声道序号, 从0开始
+   * @return 成功返回对应request, 序号越界返回NULL
+   */
+  SpeechTranscriberRequest* getChannelRequest(int channel);
+
+  /*
+   * @brief 以下参数设置对所有声道生效, 含义同SpeechTranscriberRequest
+   * @return 成功则返回0，任一声道设置失败返回-1
+   */
+  int setUrl(const char* value);
+  int setAppKey(const char* value);
+  int setToken(const char* value);
+  int setFormat(const char* value);
+  int setSampleRate(int value);
+  int setIntermediateResult(bool value);
+  int setPunctuationPrediction(bool value);
+  int setInverseTextNormalization(bool value);
+  int setPayloadParam(const char* value);
+
+  /*
+   * @brief 设置sendAudio输入的交错PCM格式
+   * @note 可选参数, 在start前调用, 默认为与请求采样率一致的16bit PCM.
+   *       format.channels须与声道数一致, 拆分后各声道按单声道输入,
+   *       样本格式及采样率转换见SpeechTranscriberRequest::setInputAudioFormat.
+   * @return 成功则返回0，否则返回-1
+   */
+  int setInputAudioFormat(const NlsAudioInputFormat& format);
+
+  /*
+   * @brief 设置合并时事件最多等待其余声道的时长
+   * @note 可选参数, 默认3000毫秒. 事件时间落后于最快声道超过该时长,
+   *       或暂存已超过该时长即上报, 避免某一声道静音或断流时其余声道的
+   *       结果一直暂存. 0为按到达顺序上报.
+   * @param value 毫秒
+   * @return 成功则返回0，否则返回-1
+   */
+  int setMaxReorderDelay(int value);
+
+  /*
+   * @brief 启动所有声道的识别
+   * @note 任一声道启动失败时取消已启动的声道
+   * @return 成功则返回0，否则返回-1
+   */
+  int start();
+
+  /*
+   * @brief 停止所有声道的识别
+   * @return 成功则返回0，任一声道失败返回-1
+   */
+  int stop();
+
+  /*
+   * @brief 直接关闭所有声道的识别, 之后不再上报回调
+   * @return 成功则返回0，任一声道失败返回-1
+   */
+  int cancel();
+
+  /*
+   * @brief 重置所有声道的请求, 以便发起下一次识别, 见SpeechTranscriberRequest::reset
+   * @return 成功则返回0，任一声道失败返回-1
+   */
+  int reset();
+
+  /*
+   * @brief 发送交错存放的多声道语音数据
+   * @note 不足一个采样帧的数据留待下次发送
+   * @param data 语音数据
+   * @param dataSize 语音数据长度(字节)
+   * @param type 同SpeechTranscriberRequest::sendAudio
+   * @return 成功则返回0，任一声道失败返回-1
+   */
+  int sendAudio(const uint8_t * data, size_t dataSize,
+                ENCODER_TYPE type = ENCODER_NONE);
+
+  /*
+   * @brief 设置回调函数, 所有声道的事件经由同一组回调串行上报
+   * @note 可通过NlsEvent::getChannel()区分声道, 不可在回调中释放本对象
+   * @param _event 回调方法
+   * @param para 用户传入参数, 默认为NULL
+   */
+  void setOnTaskFailed(NlsCallbackMethod _event, void* para = NULL);
+  void setOnTranscriptionStarted(NlsCallbackMethod _event, void* para = NULL);
+  void setOnSentenceBegin(NlsCallbackMethod _event, void* para = NULL);
+  void setOnTranscriptionResultChanged(
+      NlsCallbackMethod _event, void* para = NULL);
+  void setOnSentenceEnd(NlsCallbackMethod _event, void* para = NULL);
+  void setOnTranscriptionCompleted(NlsCallbackMethod _event, void* para = NULL);
+  void setOnChannelClosed(NlsCallbackMethod _event, void* para = NULL);
+  void setOnSentenceSemantics(NlsCallbackMethod _event, void* para = NULL);
+
+  /* 各声道请求的回调入口, 打上声道标记后按时间合并, 串行转交用户回调 */
+  void deliverEvent(NlsEvent* event, int channel);
+
+ private:
+  struct HeldEvent {
+    NlsEvent* event;
+    int time;
+    uint64_t arrivalMs;  // 暂存时刻, 单调时钟
+    bool owned;          // 否则为上报线程所在deliverEvent的入参
+  };
+
+  void deinterleave(const uint8_t* data, size_t frames, size_t offset);
+
+  void lockDeliver();
+  void unlockDeliver();
+  /* 以下在_mtxDeliver内调用 */
+  bool deliverable(int time, int channel);
+  void drainHeld(uint64_t nowMs);
+  void drainOutbox();
+  void clearHeld();
+  void notifyDeliver();
+  void waitDeliver(int timeoutMs);
+
+  /* 暂存超时的定时线程 */
+#if defined(_MSC_VER)
+  static unsigned __stdcall loopReorderTimer(LPVOID arg);
+#else
+  static void* loopReorderTimer(void* arg);
+#endif
+
+  int _channels;
+  size_t _sampleBytes;
+  SpeechTranscriberRequest** _requests;
+  MultiChannelContext* _contexts;
+
+  SpeechTranscriberCallback* _callback;
+  SpeechTranscriberListener* _listener;
+
+  /* 拆分后的各声道数据, 每声道占_planarFrames个样本, 依次存放 */
+  std::vector<uint8_t> _planar;
+  size_t _planarFrames;
+
+  /* 不足一个采样帧的输入 */
+  uint8_t _pending[64];
+  size_t _pendingSize;
+
+  /* 合并状态: 各声道暂存的事件, 已收到的最大时间(毫秒), 是否已结束 */
+  std::deque<HeldEvent>* _held;
+  int* _progress;
+  bool* _finished;
+  int _maxReorderDelay;
+
+  /* 待上报的事件, 在锁外依次上报 */
+  std::deque<HeldEvent> _outbox;
+  bool _draining;   // 已有线程在上报_outbox
+  bool _stopping;   // 定时线程退出
+
+#if defined(_MSC_VER)
+  HANDLE _mtxDeliver;
+  HANDLE _deliverEvent;
+  HANDLE _timerHandle;
+  unsigned _timerId;
+#else
+  pthread_mutex_t _mtxDeliver;
+  pthread_cond_t _cvDeliver;
+  pthread_t _timerId;
+  bool _timerStarted;
+#endif
+};
+
+}
+
+#endif //NLS_SDK_SPEECH_TRANSCRIBER_MULTI_CHANNEL_H
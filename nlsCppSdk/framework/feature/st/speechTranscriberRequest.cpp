@@ -33,6 +33,7 @@ SpeechTranscriberCallback::SpeechTranscriberCallback() {
   this->_onSentenceEnd = NULL;
   this->_onTranscriptionCompleted = NULL;
   this->_onChannelClosed = NULL;
+  this->_onSentenceSemantics = NULL;
 }
 
 SpeechTranscriberCallback::~SpeechTranscriberCallback() {
@@ -159,6 +160,9 @@ SpeechTranscriberRequest::~SpeechTranscriberRequest() {
 //  delete _transcriberParam;
 //  _transcriberParam = NULL;
 
+  // 回调可能仍在异步回调线程中排队, 需在释放listener前等待其完成
+  _node->drainCallbacks();
+
   delete _listener;
   _listener = NULL;
 
@@ -190,6 +194,14 @@ int SpeechTranscriberRequest::cancel() {
   return INlsRequest::stop(this, 1);
 }
 
+int SpeechTranscriberRequest::reset() {
+  return INlsRequest::reset(this);
+}
+
+void SpeechTranscriberRequest::resetCallback() {
+  *_callback = SpeechTranscriberCallback();
+}
+
 int SpeechTranscriberRequest::sendAudio(
     const uint8_t * data, size_t dataSize, ENCODER_TYPE type) {
   return INlsRequest::sendAudio(this, data, dataSize, type);
@@ -234,11 +246,68 @@ int SpeechTranscriberRequest::setSampleRate(int value) {
   return 0;
 }
 
+int SpeechTranscriberRequest::setEncoderFrameDuration(int frameMs) {
+  if (frameMs != 20 && frameMs != 40 && frameMs != 60) {
+    return -1;
+  }
+  _transcriberParam->setEncoderFrameDuration(frameMs);
+  return 0;
+}
+
+int SpeechTranscriberRequest::setEncoderProfile(const NlsEncoderProfile& profile) {
+  return _transcriberParam->setEncoderProfile(profile);
+}
+
+int SpeechTranscriberRequest::setEncoderPreset(ENCODER_PRESET preset) {
+  return _transcriberParam->setEncoderPreset(preset);
+}
+
+int SpeechTranscriberRequest::setVadParam(const NlsVadParam& param) {
+  return _transcriberParam->setVadParam(param);
+}
+
+int SpeechTranscriberRequest::getVadStats(NlsVadStats* stats) {
+  if (_node == NULL || stats == NULL) {
+    return -1;
+  }
+  _node->getVadStats(stats);
+  return 0;
+}
+
+int SpeechTranscriberRequest::getLatencyTrace(NlsLatencyTrace* trace) {
+  if (_node == NULL || trace == NULL) {
+    return -1;
+  }
+  _node->getLatencyTrace(trace);
+  return 0;
+}
+
+int SpeechTranscriberRequest::getMemoryUsage(NlsRequestMemoryUsage* usage) {
+  if (_node == NULL || usage == NULL) {
+    return -1;
+  }
+  _node->getMemoryUsage(usage);
+  return 0;
+}
+
+int SpeechTranscriberRequest::setInputAudioFormat(const NlsAudioInputFormat& format) {
+  return _transcriberParam->setInputAudioFormat(format);
+}
+
 int SpeechTranscriberRequest::setIntermediateResult(bool value) {
   _transcriberParam->setIntermediateResult(value);
   return 0;
 }
 
+int SpeechTranscriberRequest::setIntermediateResultCoalescing(
+    int intervalMs, int textDelta) {
+  if (intervalMs < 0 || textDelta < 0) {
+    return -1;
+  }
+  _transcriberParam->setIntermediateResultCoalescing(intervalMs, textDelta);
+  return 0;
+}
+
 int SpeechTranscriberRequest::setPunctuationPrediction(bool value) {
   _transcriberParam->setPunctuationPrediction(value);
   return 0;
@@ -96,6 +96,79 @@ class NLS_SDK_CLIENT_EXPORT SpeechTranscriberRequest : public INlsRequest {
    */
   int setSampleRate(int value);
 
+  /*
+   * @brief 设置OPU/OPUS编码帧时长
+   * @note 可选参数, 支持20/40/60毫秒, 默认20. 仅opu/opus格式生效.
+   *       sendAudio可传入任意长度PCM, SDK内部按帧切分编码,
+   *       不足一帧的数据留待下次发送, stop时补零编码.
+   * @param frameMs 帧时长(毫秒)
+   * @return 成功则返回0，否则返回-1
+   */
+  int setEncoderFrameDuration(int frameMs);
+
+  /*
+   * @brief 设置OPU/OPUS编码参数
+   * @note 可选参数, 仅opu/opus格式生效, 在start前调用.
+   *       码率6000~510000bps, 复杂度0~10, 帧时长20/40/60毫秒.
+   *       opu格式每帧编码结果不超过255字节, 超出时编码器自动降低码率.
+   * @param profile 编码参数, 默认值见NlsEncoderProfile
+   * @return 成功则返回0，参数非法返回-1
+   */
+  int setEncoderProfile(const NlsEncoderProfile& profile);
+
+  /*
+   * @brief 按预设设置OPU/OPUS编码参数
+   * @note 可选参数, 预设见ENCODER_PRESET, 会覆盖setEncoderFrameDuration的设置.
+   * @param preset 编码预设
+   * @return 成功则返回0，否则返回-1
+   */
+  int setEncoderPreset(ENCODER_PRESET preset);
+
+  /*
+   * @brief 设置客户端静音检测
+   * @note 可选参数, 在start前调用, 默认不检测. 仅pcm/opu/opus格式生效,
+   *       在setInputAudioFormat的格式转换之后进行.
+   *       VAD_MODE_MUTE将长静音置零上传, 时间戳与原始音频一致;
+   *       VAD_MODE_DROP不上传长静音, 回调中事件的句子及词时间戳已按被丢弃的时长
+   *       换算回原始音频时间, getAllResponse返回的原始JSON仍为服务端时间.
+   * @param param 检测参数, 默认值见NlsVadParam
+   * @return 成功则返回0，参数非法返回-1
+   */
+  int setVadParam(const NlsVadParam& param);
+
+  /*
+   * @brief 获取本次请求的静音检测统计, 可在回调中或stop后调用
+   * @param stats 统计信息输出
+   * @return 成功则返回0，否则返回-1
+   */
+  int getVadStats(NlsVadStats* stats);
+
+  /*
+   * @brief 获取本次请求各阶段的时间点, 可在回调中或stop后调用,
+   *        请求进行中调用时尚未到达的阶段为0, 见NlsLatencyTrace
+   * @param trace 时延信息输出
+   * @return 成功则返回0，否则返回-1
+   */
+  int getLatencyTrace(NlsLatencyTrace* trace);
+
+  /*
+   * @brief 获取本次请求持有的缓冲内存, 可在回调中或stop后调用
+   * @param usage 内存统计输出, 见NlsRequestMemoryUsage
+   * @return 成功则返回0，否则返回-1
+   */
+  int getMemoryUsage(NlsRequestMemoryUsage* usage);
+
+  /*
+   * @brief 设置sendAudio输入的PCM格式
+   * @note 可选参数, 在start前调用, 默认为与请求采样率一致的16bit单声道PCM.
+   *       支持S16/S32/F32交错多声道及8000~192000Hz任意采样率输入,
+   *       SDK混为单声道并重采样为setSampleRate设置的采样率后上传.
+   *       仅pcm/opu/opus格式生效.
+   * @param format 输入格式, 见NlsAudioInputFormat
+   * @return 成功则返回0，参数非法返回-1
+   */
+  int setInputAudioFormat(const NlsAudioInputFormat& format);
+
   /*
    * @brief 设置是否返回中间识别结果
    * @note 可选参数. 默认false
@@ -104,6 +177,18 @@ class NLS_SDK_CLIENT_EXPORT SpeechTranscriberRequest : public INlsRequest {
    */
   int setIntermediateResult(bool value);
 
+  /*
+   * @brief 设置中间识别结果合并策略, 减少中间结果回调次数
+   * @note 可选参数, 仅在setIntermediateResult(true)时生效, 默认不合并.
+   *       距上次回调达到intervalMs毫秒, 或文本变化达到textDelta个字符时才回调,
+   *       其余被后续结果覆盖的中间结果在JSON解析前直接丢弃.
+   *       SentenceEnd、Completed等其他事件始终回调.
+   * @param intervalMs 最小回调间隔, 单位毫秒, 0表示不按时间合并
+   * @param textDelta 最小文本变化字符数, 0表示不按文本合并
+   * @return 成功则返回0，否则返回-1
+   */
+  int setIntermediateResultCoalescing(int intervalMs, int textDelta);
+
   /*
    * @brief 设置是否在后处理中添加标点
    * @note 可选参数. 默认false
@@ -244,6 +329,14 @@ class NLS_SDK_CLIENT_EXPORT SpeechTranscriberRequest : public INlsRequest {
    */
   int cancel();
 
+  /*
+   * @brief 重置请求, 以便在同一个request上发起下一次请求
+   * @note 需在收到ChannelClosed回调后调用, 保留已设置的参数与回调,
+   *       复用连接缓冲区与编码器. 若事件线程尚未完成清理则返回-1, 可稍后重试.
+   * @return 成功则返回0，否则返回-1
+   */
+  int reset();
+
   /*
    * @brief 发送语音数据
    * @note 异步操作。request
@@ -252,9 +345,10 @@ class NLS_SDK_CLIENT_EXPORT SpeechTranscriberRequest : public INlsRequest {
    * @param type ENCODER_NONE 表示原始音频进行传递,
                               建议每次100ms音频数据,支持16K和8K;
                  ENCODER_OPU 表示以定制OPUS压缩后进行传递,
-                             只支持20ms 16K16b1c
+                             支持任意长度 16K16b1c
                  ENCODER_OPUS 表示以OPUS压缩后进行传递,
-                              只支持20ms, 支持16K16b1c和8K16b1c
+                              支持任意长度, 支持16K16b1c和8K16b1c
+                 帧时长见setEncoderFrameDuration
    * @return 成功则返回0，失败返回-1。
              由于音频格式不确定，传入音频字节数和传出音频字节数
              无法通过比较判断成功与否，故成功返回0。
@@ -336,6 +430,9 @@ class NLS_SDK_CLIENT_EXPORT SpeechTranscriberRequest : public INlsRequest {
    */
   void setOnSentenceSemantics(NlsCallbackMethod _event, void* para = NULL);
 
+ protected:
+  virtual void resetCallback();
+
  private:
   SpeechTranscriberParam* _transcriberParam;
   SpeechTranscriberCallback* _callback;
@@ -14,19 +14,207 @@
  * limitations under the License.
  */
 
+#include <string.h>
 #include "speechSynthesizerListener.h"
 #include "speechSynthesizerRequest.h"
+#include "nlsAudioDecoder.h"
+#include "thread_data.h"
+#include "utility.h"
 #include "nlog.h"
 
 
 namespace AlibabaNls {
 
+using utility::atomicAdd64;
+using utility::atomicLoad64;
+using utility::atomicStore64;
+
 SpeechSynthesizerListener::SpeechSynthesizerListener(
-    SpeechSynthesizerCallback* cb) : _callback(cb) {}
+    SpeechSynthesizerCallback* cb) : _callback(cb), _pcmEnabled(false),
+    _decoder(NULL), _jitter(NULL), _jitterRate(0), _frameBytes(0),
+    _jitterBytes(0), _playing(false), _pcmEvent(NULL), _startUs(0) {
+  clearPcmStats();
+}
+
+SpeechSynthesizerListener::~SpeechSynthesizerListener() {
+  delete _decoder;
+  _decoder = NULL;
+  delete _jitter;
+  _jitter = NULL;
+  delete _pcmEvent;
+  _pcmEvent = NULL;
+}
+
+void SpeechSynthesizerListener::preparePcmOutput(const NlsTtsPcmParam& param,
+                                                 const std::string& format,
+                                                 int sampleRate) {
+  _pcmParam = param;
+  _pcmEnabled = false;
+  _playing = false;
+  if (_jitter) {
+    _jitter->Clear();
+  }
+  /* 事件的taskId随每次合成变化, 在收到首个音频数据时重建 */
+  delete _pcmEvent;
+  _pcmEvent = NULL;
+  _startUs = utility::getMonotonicUs();
+  clearPcmStats();
+
+  if (!param.enable) {
+    return;
+  }
+
+  if (_decoder == NULL) {
+    _decoder = new NlsAudioDecoder();
+  }
+  if (_decoder->init(format, sampleRate) < 0) {
+    LOG_WARN("format %s can't be decoded to pcm, pcm output disabled.",
+        format.c_str());
+    return;
+  }
+  _pcmEnabled = true;
+}
 
-SpeechSynthesizerListener::~SpeechSynthesizerListener() {}
+void SpeechSynthesizerListener::clearPcmStats() {
+  atomicStore64(&_statSampleRate, 0);
+  atomicStore64(&_statFirstAudioMs, -1);
+  atomicStore64(&_statFirstFrameMs, -1);
+  atomicStore64(&_statInputBytes, 0);
+  atomicStore64(&_statPcmBytes, 0);
+  atomicStore64(&_statFrames, 0);
+  atomicStore64(&_statDecodeUs, 0);
+  atomicStore64(&_statDecodeErrors, 0);
+}
+
+void SpeechSynthesizerListener::getPcmStats(NlsTtsPcmStats* stats) {
+  stats->sampleRate = (int)atomicLoad64(&_statSampleRate);
+  stats->firstAudioLatencyMs = atomicLoad64(&_statFirstAudioMs);
+  stats->firstFrameLatencyMs = atomicLoad64(&_statFirstFrameMs);
+  stats->inputBytes = (uint64_t)atomicLoad64(&_statInputBytes);
+  stats->pcmBytes = (uint64_t)atomicLoad64(&_statPcmBytes);
+  stats->frames = (uint64_t)atomicLoad64(&_statFrames);
+  stats->decodeUs = (uint64_t)atomicLoad64(&_statDecodeUs);
+  stats->decodeErrors = (uint64_t)atomicLoad64(&_statDecodeErrors);
+}
+
+void SpeechSynthesizerListener::decodeBinary(NlsEvent& event) {
+  int size = 0;
+  const unsigned char* data = event.getBinaryDataBuffer(&size);
+  if (data == NULL || size <= 0) {
+    return;
+  }
+
+  if (atomicLoad64(&_statFirstAudioMs) < 0) {
+    atomicStore64(&_statFirstAudioMs,
+        (int64_t)(utility::getMonotonicUs() - _startUs) / 1000);
+  }
+  atomicAdd64(&_statInputBytes, size);
 
-void SpeechSynthesizerListener::handlerFrame(NlsEvent str) {
+  _decoded.clear();
+  uint64_t begin = utility::getMonotonicUs();
+  int ret = _decoder->decode(data, size, _decoded);
+  atomicAdd64(&_statDecodeUs,
+              (int64_t)(utility::getMonotonicUs() - begin));
+  if (ret < 0) {
+    atomicAdd64(&_statDecodeErrors, 1);
+    _pcmEnabled = false;
+    LOG_ERROR("decode tts audio failed, pcm output disabled.");
+    return;
+  }
+  if (_decoded.empty()) {
+    return;
+  }
+
+  atomicAdd64(&_statPcmBytes, (int64_t)_decoded.size());
+  pushPcm(&_decoded[0], _decoded.size(), event.getTaskId());
+}
+
+/*
+ * 写入抖动缓冲. 预缓冲满jitterMs后开始输出, 之后每凑满一帧立即输出.
+ * 缓冲容量不小于预缓冲加一帧, 写满时先输出再继续写入.
+ */
+void SpeechSynthesizerListener::pushPcm(const uint8_t* data, size_t size,
+                                        const char* taskId) {
+  int rate = _decoder->getSampleRate();
+  if (_jitter == NULL || _jitterRate != rate) {
+    _frameBytes = (size_t)rate * _pcmParam.frameMs / 1000 * 2;
+    _jitterBytes = (size_t)rate * _pcmParam.jitterMs / 1000 * 2;
+    delete _jitter;
+    _jitter = new ByteRing(_jitterBytes + _frameBytes * 2);
+    _jitterRate = rate;
+    _frame.resize(_frameBytes);
+  }
+  atomicStore64(&_statSampleRate, rate);
+
+  if (_pcmEvent == NULL) {
+    _pcmEvent = new NlsEvent(std::vector<unsigned char>(), 0,
+                             NlsEvent::Binary, taskId);
+  }
+
+  while (size > 0) {
+    size_t written = _jitter->Write(data, size);
+    data += written;
+    size -= written;
+
+    if (!_playing && _jitter->Size() >= _jitterBytes &&
+        _jitter->Size() >= _frameBytes) {
+      _playing = true;
+    }
+    if (_playing) {
+      emitFrames(false);
+    } else if (written == 0) {
+      /* 容量足以容纳预缓冲, 不应发生 */
+      _playing = true;
+    }
+  }
+}
+
+void SpeechSynthesizerListener::emitFrames(bool flush) {
+  if (_jitter == NULL || _frameBytes == 0) {
+    return;
+  }
+
+  while (_jitter->Size() >= _frameBytes) {
+    const uint8_t* span = NULL;
+    if (_jitter->ReadSpan(&span) >= _frameBytes) {
+      /* 帧数据连续时直接从缓冲拷入事件 */
+      emitFrame(span, _frameBytes);
+      _jitter->CommitRead(_frameBytes);
+    } else {
+      _jitter->Read(&_frame[0], _frameBytes);
+      emitFrame(&_frame[0], _frameBytes);
+    }
+  }
+
+  if (flush) {
+    size_t rest = _jitter->Read(&_frame[0], _frameBytes);
+    if (rest > 0) {
+      if (_pcmParam.padLastFrame) {
+        memset(&_frame[rest], 0, _frameBytes - rest);
+        rest = _frameBytes;
+      }
+      emitFrame(&_frame[0], rest);
+    }
+  }
+}
+
+void SpeechSynthesizerListener::emitFrame(const uint8_t* data, size_t size) {
+  if (atomicLoad64(&_statFrames) == 0) {
+    int64_t firstFrameMs =
+        (int64_t)(utility::getMonotonicUs() - _startUs) / 1000;
+    atomicStore64(&_statFirstFrameMs, firstFrameMs);
+    LOG_INFO("tts first audio %lldms, first pcm frame %lldms.",
+        (long long)atomicLoad64(&_statFirstAudioMs), (long long)firstFrameMs);
+  }
+  atomicAdd64(&_statFrames, 1);
+
+  if (NULL != _callback->_onPcmFrameReceived) {
+    _pcmEvent->setBinaryData(data, (int)size);
+    _callback->_onPcmFrameReceived(_pcmEvent, _callback->_pcmFramePara);
+  }
+}
+
+void SpeechSynthesizerListener::handlerFrame(NlsEvent& str) {
   NlsEvent::EventType type = str.getMsgType();
 
   if (NULL == _callback) {
@@ -42,6 +230,9 @@ void SpeechSynthesizerListener::handlerFrame(NlsEvent str) {
       }
       break;
     case NlsEvent::SynthesisCompleted:
+      if (_pcmEnabled) {
+        emitFrames(true);
+      }
       if (NULL != _callback->_onSynthesisCompleted) {
         _callback->_onSynthesisCompleted(&str, _callback->_paramap[NlsEvent::SynthesisCompleted]);
       }
@@ -52,6 +243,9 @@ void SpeechSynthesizerListener::handlerFrame(NlsEvent str) {
       }
       break;
     case NlsEvent::Binary:
+      if (_pcmEnabled) {
+        decodeBinary(str);
+      }
       if (NULL != _callback->_onBinaryDataReceived) {
         _callback->_onBinaryDataReceived(
             &str, _callback->_paramap[NlsEvent::Binary]);
@@ -17,11 +17,17 @@
 #ifndef NLS_SDK_SPEECH_SYNTHESIZER_LISTENER_H
 #define NLS_SDK_SPEECH_SYNTHESIZER_LISTENER_H
 
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "nlsGlobal.h"
 #include "iNlsRequestListener.h"
 
 namespace AlibabaNls {
 
 class SpeechSynthesizerCallback;
+class NlsAudioDecoder;
+class ByteRing;
 
 class SpeechSynthesizerListener : public INlsRequestListener {
  public:
@@ -29,11 +35,50 @@ class SpeechSynthesizerListener : public INlsRequestListener {
   SpeechSynthesizerListener(SpeechSynthesizerCallback* cb);
   ~SpeechSynthesizerListener();
 
-  virtual void handlerFrame(NlsEvent);
+  virtual void handlerFrame(NlsEvent&);
+
+  /*
+   * @brief 在start时按请求参数初始化PCM输出, 并清空统计
+   * @note 格式无法解码时关闭PCM输出, 仍按原样回调二进制数据
+   */
+  void preparePcmOutput(const NlsTtsPcmParam& param,
+                        const std::string& format, int sampleRate);
+  /* 可在其他线程调用, 各项统计单独原子读取 */
+  void getPcmStats(NlsTtsPcmStats* stats);
 
  private:
+  void decodeBinary(NlsEvent& event);
+  void pushPcm(const uint8_t* data, size_t size, const char* taskId);
+  void emitFrames(bool flush);
+  void emitFrame(const uint8_t* data, size_t size);
+  void clearPcmStats();
+
   SpeechSynthesizerCallback* _callback;
 
+  /* PCM输出, 解码及分帧均在回调线程(未开启回调执行器时为事件线程)中进行 */
+  NlsTtsPcmParam _pcmParam;
+  bool _pcmEnabled;
+  NlsAudioDecoder* _decoder;
+  /* 抖动缓冲, 在得知输出采样率后按预缓冲时长分配 */
+  ByteRing* _jitter;
+  int _jitterRate;
+  size_t _frameBytes;
+  size_t _jitterBytes;
+  bool _playing;
+  std::vector<uint8_t> _decoded;
+  std::vector<uint8_t> _frame;
+  NlsEvent* _pcmEvent;
+  uint64_t _startUs;
+
+  /* PCM输出统计, 回调线程原子更新, getPcmStats可在其他线程读取 */
+  volatile int64_t _statSampleRate;
+  volatile int64_t _statFirstAudioMs;
+  volatile int64_t _statFirstFrameMs;
+  volatile int64_t _statInputBytes;
+  volatile int64_t _statPcmBytes;
+  volatile int64_t _statFrames;
+  volatile int64_t _statDecodeUs;
+  volatile int64_t _statDecodeErrors;
 };
 
 }
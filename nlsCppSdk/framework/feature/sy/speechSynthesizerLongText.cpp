@@ -0,0 +1,1177 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "json/json.h"
+#include "nlog.h"
+#include "nlsClient.h"
+#include "utility.h"
+#include "speechSynthesizerLongText.h"
+#include "speechSynthesizerListener.h"
+#include "iNlsRequestParam.h"
+#include "connectNode.h"
+
+namespace AlibabaNls {
+
+enum LongTextSettingId {
+  SettingUrl = 0,
+  SettingAppKey,
+  SettingToken,
+  SettingFormat,
+  SettingSampleRate,
+  SettingVoice,
+  SettingVolume,
+  SettingSpeechRate,
+  SettingPitchRate,
+  SettingMethod,
+  SettingEnableSubtitle,
+  SettingPayloadParam,
+  SettingContextParam,
+  SettingTimeout,
+  SettingOutputFormat,
+  SettingHttpHeader
+};
+
+#define LONG_TEXT_WAV_HEADER_MAX 4096
+
+/* 句末标点, 其后的引号括号等归入同一句 */
+static const char* const kStrongBreaks[] = {
+  "\xE3\x80\x82",  // 。
+  "\xEF\xBC\x81",  // ！
+  "\xEF\xBC\x9F",  // ？
+  "\xEF\xBC\x9B",  // ；
+  "\xE2\x80\xA6",  // …
+  "\n", "!", "?", ";", NULL
+};
+
+static const char* const kClosers[] = {
+  "\xE2\x80\x9D",  // ”
+  "\xE2\x80\x99",  // ’
+  "\xE3\x80\x8D",  // 」
+  "\xE3\x80\x8F",  // 』
+  "\xE3\x80\x8B",  // 》
+  "\xE3\x80\x91",  // 】
+  "\xEF\xBC\x89",  // ）
+  ")", "\"", "'", NULL
+};
+
+/* 单句超长时的次级切分点 */
+static const char* const kWeakBreaks[] = {
+  "\xEF\xBC\x8C",  // ，
+  "\xE3\x80\x81",  // 、
+  "\xEF\xBC\x9A",  // ：
+  "\xE3\x80\x80",  // 全角空格
+  ",", ":", " ", "\t", NULL
+};
+
+static size_t utf8CharLength(unsigned char c) {
+  if (c < 0x80) return 1;
+  if ((c & 0xE0) == 0xC0) return 2;
+  if ((c & 0xF0) == 0xE0) return 3;
+  if ((c & 0xF8) == 0xF0) return 4;
+  return 1;
+}
+
+static size_t utf8NextChar(const std::string& text, size_t pos) {
+  size_t len = utf8CharLength((unsigned char)text[pos]);
+  return (pos + len > text.size()) ? text.size() : pos + len;
+}
+
+static size_t utf8CountChars(const std::string& text,
+                             size_t begin, size_t end) {
+  size_t count = 0;
+  while (begin < end) {
+    begin = utf8NextChar(text, begin);
+    count++;
+  }
+  return count;
+}
+
+/* 第charIndex个字符在text中的字节偏移, 越界时返回text长度 */
+static size_t utf8ByteOffset(const std::string& text, size_t charIndex) {
+  size_t pos = 0;
+  while (charIndex > 0 && pos < text.size()) {
+    pos = utf8NextChar(text, pos);
+    charIndex--;
+  }
+  return pos;
+}
+
+static bool matchAny(const std::string& text, size_t pos, size_t len,
+                     const char* const* list) {
+  for (; *list; list++) {
+    if (strlen(*list) == len && text.compare(pos, len, *list) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool isBlankSegment(const std::string& text) {
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t next = utf8NextChar(text, pos);
+    char c = text[pos];
+    if (!(c == ' ' || c == '\t' || c == '\r' || c == '\n') &&
+        !(next - pos == 3 && text.compare(pos, 3, "\xE3\x80\x80") == 0)) {
+      return false;
+    }
+    pos = next;
+  }
+  return true;
+}
+
+static void appendSegment(const std::string& text, size_t begin, size_t end,
+                          size_t charOffset,
+                          std::vector<LongTextSegment*>& out) {
+  std::string segmentText = text.substr(begin, end - begin);
+  if (isBlankSegment(segmentText)) {
+    return;
+  }
+
+  LongTextSegment* segment = new LongTextSegment();
+  segment->owner = NULL;
+  segment->index = (int)out.size();
+  segment->text.swap(segmentText);
+  segment->charOffset = charOffset;
+  segment->byteOffset = begin;
+  segment->request = NULL;
+  segment->completed = false;
+  segment->closed = false;
+  segment->detached = false;
+  segment->headerDone = false;
+  segment->byteRate = 0;
+  segment->audioBytes = 0;
+  segment->lastEndTime = 0;
+  out.push_back(segment);
+}
+
+static uint32_t readLe32(const unsigned char* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void onSegmentEvent(NlsEvent* event, void* para) {
+  LongTextSegment* segment = static_cast<LongTextSegment*>(para);
+  if (segment && segment->owner) {
+    segment->owner->deliverEvent(event, segment);
+  }
+}
+
+SpeechSynthesizerLongText::SpeechSynthesizerLongText(int version) :
+    _version(version), _format("pcm"), _sampleRate(16000),
+    _head(0), _next(0), _inFlight(0), _launching(0), _timeOffset(0),
+    _running(false), _failed(false), _cancelled(false), _completed(false),
+    _releasing(false), _draining(false), _borrowable(NULL) {
+  _callback = new SpeechSynthesizerCallback();
+  _listener = new SpeechSynthesizerListener(_callback);
+
+#if defined(_MSC_VER)
+  _mtxDeliver = CreateMutex(NULL, FALSE, NULL);
+  _launchEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+#else
+  pthread_mutex_init(&_mtxDeliver, NULL);
+  pthread_cond_init(&_cvLaunch, NULL);
+#endif
+
+  LOG_DEBUG("Create SpeechSynthesizerLongText.");
+}
+
+SpeechSynthesizerLongText::~SpeechSynthesizerLongText() {
+  std::vector<LongTextSegment*> segments;
+
+  lock();
+  // 之后到达的事件均被忽略
+  _releasing = true;
+  discardOutbox();
+  waitLaunches();
+  detachSegments(segments);
+  unlock();
+
+  releaseSegments(segments);
+
+  delete _listener;
+  _listener = NULL;
+  delete _callback;
+  _callback = NULL;
+
+#if defined(_MSC_VER)
+  CloseHandle(_launchEvent);
+  CloseHandle(_mtxDeliver);
+#else
+  pthread_cond_destroy(&_cvLaunch);
+  pthread_mutex_destroy(&_mtxDeliver);
+#endif
+
+  LOG_DEBUG("Destroy SpeechSynthesizerLongText.");
+}
+
+void SpeechSynthesizerLongText::lock() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxDeliver, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxDeliver);
+#endif
+}
+
+void SpeechSynthesizerLongText::unlock() {
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxDeliver);
+#else
+  pthread_mutex_unlock(&_mtxDeliver);
+#endif
+}
+
+/* 持锁调用, 移出全部段, 之后到达这些段的事件均被忽略 */
+void SpeechSynthesizerLongText::detachSegments(
+    std::vector<LongTextSegment*>& segments) {
+  for (size_t i = 0; i < _segments.size(); i++) {
+    _segments[i]->detached = true;
+  }
+  segments.swap(_segments);
+  _segments.clear();
+}
+
+/*
+ * 释放已移出的段, 不可持锁调用.
+ * 未关闭的请求先取消, 各请求排队中的回调执行完毕后才可释放段.
+ */
+void SpeechSynthesizerLongText::releaseSegments(
+    std::vector<LongTextSegment*>& segments) {
+  for (size_t i = 0; i < segments.size(); i++) {
+    SpeechSynthesizerRequest* request = segments[i]->request;
+    if (request && !segments[i]->closed) {
+      request->cancel();
+    }
+  }
+
+  for (size_t i = 0; i < segments.size(); i++) {
+    SpeechSynthesizerRequest* request = segments[i]->request;
+    if (request) {
+      request->getConnectNode()->drainCallbacks();
+      NlsClient::getInstance()->releaseSynthesizerRequest(request);
+      segments[i]->request = NULL;
+    }
+    delete segments[i];
+  }
+  segments.clear();
+}
+
+/*
+ * 持锁调用, 等待锁外进行中的段启动完成.
+ * _launching在锁内递减并在归零时通知, 等待期间释放锁.
+ */
+void SpeechSynthesizerLongText::waitLaunches() {
+#if defined(_MSC_VER)
+  while (_launching > 0) {
+    // 在锁内复位, 之后的归零通知不会丢失
+    ResetEvent(_launchEvent);
+    unlock();
+    WaitForSingleObject(_launchEvent, INFINITE);
+    lock();
+  }
+#else
+  while (_launching > 0) {
+    pthread_cond_wait(&_cvLaunch, &_mtxDeliver);
+  }
+#endif
+}
+
+/* 持锁调用, 事件加入待上报队列, 非本线程deliverEvent入参的事件复制后入队 */
+void SpeechSynthesizerLongText::post(NlsEvent* event) {
+  if (event != _borrowable) {
+    postOwned(new NlsEvent(*event));
+    return;
+  }
+  LongTextOutgoing item;
+  item.event = event;
+  item.owned = false;
+  _outbox.push_back(item);
+}
+
+void SpeechSynthesizerLongText::postOwned(NlsEvent* event) {
+  LongTextOutgoing item;
+  item.event = event;
+  item.owned = true;
+  _outbox.push_back(item);
+}
+
+void SpeechSynthesizerLongText::discardOutbox() {
+  for (size_t i = 0; i < _outbox.size(); i++) {
+    if (_outbox[i].owned) {
+      delete _outbox[i].event;
+    }
+  }
+  _outbox.clear();
+}
+
+/*
+ * 持锁调用, 返回时仍持锁. 在锁外依次上报_outbox中的回调,
+ * 同一时刻只有一个线程上报, 其余线程入队后直接返回, 由其继续上报.
+ */
+void SpeechSynthesizerLongText::drainOutbox() {
+  _draining = true;
+  while (!_outbox.empty()) {
+    LongTextOutgoing item = _outbox.front();
+    _outbox.pop_front();
+    unlock();
+    _listener->handlerFrame(*item.event);
+    if (item.owned) {
+      delete item.event;
+    }
+    lock();
+  }
+  _draining = false;
+}
+
+void SpeechSynthesizerLongText::addSetting(int id, const char* value,
+                                           const char* extra, int number) {
+  LongTextSetting setting;
+  setting.id = id;
+  setting.value = value ? value : "";
+  setting.extra = extra ? extra : "";
+  setting.number = number;
+
+  // 同一参数以最后一次设置为准, http头部按key区分
+  for (size_t i = 0; i < _settings.size(); i++) {
+    if (_settings[i].id == id &&
+        (id != SettingHttpHeader || _settings[i].value == setting.value)) {
+      _settings[i] = setting;
+      return;
+    }
+  }
+  _settings.push_back(setting);
+}
+
+int SpeechSynthesizerLongText::applySettings(
+    SpeechSynthesizerRequest* request) {
+  for (size_t i = 0; i < _settings.size(); i++) {
+    const LongTextSetting& s = _settings[i];
+    const char* value = s.value.c_str();
+    int ret = 0;
+    switch (s.id) {
+      case SettingUrl:
+        ret = request->setUrl(value);
+        break;
+      case SettingAppKey:
+        ret = request->setAppKey(value);
+        break;
+      case SettingToken:
+        ret = request->setToken(value);
+        break;
+      case SettingFormat:
+        ret = request->setFormat(value);
+        break;
+      case SettingSampleRate:
+        ret = request->setSampleRate(s.number);
+        break;
+      case SettingVoice:
+        ret = request->setVoice(value);
+        break;
+      case SettingVolume:
+        ret = request->setVolume(s.number);
+        break;
+      case SettingSpeechRate:
+        ret = request->setSpeechRate(s.number);
+        break;
+      case SettingPitchRate:
+        ret = request->setPitchRate(s.number);
+        break;
+      case SettingMethod:
+        ret = request->setMethod(s.number);
+        break;
+      case SettingEnableSubtitle:
+        ret = request->setEnableSubtitle(s.number != 0);
+        break;
+      case SettingPayloadParam:
+        ret = request->setPayloadParam(value);
+        break;
+      case SettingContextParam:
+        ret = request->setContextParam(value);
+        break;
+      case SettingTimeout:
+        ret = request->setTimeout(s.number);
+        break;
+      case SettingOutputFormat:
+        ret = request->setOutputFormat(value);
+        break;
+      case SettingHttpHeader:
+        ret = request->AppendHttpHeaderParam(value, s.extra.c_str());
+        break;
+      default:
+        break;
+    }
+    if (ret < 0) {
+      LOG_ERROR("apply setting %d failed.", s.id);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setUrl(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingUrl, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setAppKey(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingAppKey, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setToken(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingToken, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setFormat(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  _format = value;
+  addSetting(SettingFormat, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setSampleRate(int value) {
+  if (value <= 0) {
+    return -1;
+  }
+  _sampleRate = value;
+  addSetting(SettingSampleRate, NULL, NULL, value);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setVoice(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingVoice, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setVolume(int value) {
+  addSetting(SettingVolume, NULL, NULL, value);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setSpeechRate(int value) {
+  addSetting(SettingSpeechRate, NULL, NULL, value);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setPitchRate(int value) {
+  addSetting(SettingPitchRate, NULL, NULL, value);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setMethod(int value) {
+  addSetting(SettingMethod, NULL, NULL, value);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setEnableSubtitle(bool value) {
+  addSetting(SettingEnableSubtitle, NULL, NULL, value ? 1 : 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setPayloadParam(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingPayloadParam, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setContextParam(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingContextParam, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setTimeout(int value) {
+  addSetting(SettingTimeout, NULL, NULL, value);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setOutputFormat(const char* value) {
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingOutputFormat, value, NULL, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::AppendHttpHeaderParam(
+    const char* key, const char* value) {
+  INPUT_PARAM_STRING_CHECK(key);
+  INPUT_PARAM_STRING_CHECK(value);
+  addSetting(SettingHttpHeader, key, value, 0);
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setText(const char* value) {
+  if (value == NULL) {
+    LOG_ERROR("text is NULL.");
+    return -1;
+  }
+  _text = value;
+  return 0;
+}
+
+int SpeechSynthesizerLongText::setLongTextParam(
+    const NlsLongTextTtsParam& param) {
+  if (param.maxInFlight < 1 || param.maxInFlight > 8 ||
+      param.maxSegmentChars < 10 || param.maxSegmentChars > 10000 ||
+      (param.firstSegmentChars != 0 &&
+       (param.firstSegmentChars < 10 ||
+        param.firstSegmentChars > param.maxSegmentChars))) {
+    LOG_ERROR("invalid long text param: %d %d %d.",
+        param.maxInFlight, param.maxSegmentChars, param.firstSegmentChars);
+    return -1;
+  }
+  _param = param;
+  return 0;
+}
+
+int SpeechSynthesizerLongText::splitText(
+    const std::string& text, int firstSegmentChars, int maxSegmentChars,
+    std::vector<LongTextSegment*>& out) {
+  size_t segStart = 0;
+  size_t segChars = 0;
+  size_t charOffset = 0;
+  size_t strongBreak = 0;
+  size_t weakBreak = 0;
+  bool pendingStrong = false;
+  size_t pos = 0;
+
+  while (pos < text.size()) {
+    size_t limit = (out.empty() && firstSegmentChars > 0) ?
+        (size_t)firstSegmentChars : (size_t)maxSegmentChars;
+
+    // 加入该字符将超长, 依次在句末、次级标点处切分, 都没有则在此截断
+    if (segChars + 1 > limit) {
+      size_t cut = pos;
+      if (!pendingStrong) {
+        if (strongBreak > segStart) {
+          cut = strongBreak;
+        } else if (weakBreak > segStart) {
+          cut = weakBreak;
+        }
+      }
+      size_t cutChars = utf8CountChars(text, segStart, cut);
+      appendSegment(text, segStart, cut, charOffset, out);
+      charOffset += cutChars;
+      segChars -= cutChars;
+      segStart = cut;
+      strongBreak = 0;
+      weakBreak = 0;
+      pendingStrong = false;
+    }
+
+    size_t next = utf8NextChar(text, pos);
+    size_t len = next - pos;
+    bool strong = matchAny(text, pos, len, kStrongBreaks);
+    if (!strong && text[pos] == '.') {
+      // 英文句点后需为空白或文本结束, 避免切开小数及缩写
+      strong = (next == text.size() || text[next] == ' ' ||
+                text[next] == '\n' || text[next] == '\r' ||
+                text[next] == '\t');
+    }
+
+    if (strong) {
+      pendingStrong = true;
+    } else if (!matchAny(text, pos, len, kClosers)) {
+      if (pendingStrong) {
+        strongBreak = pos;
+        pendingStrong = false;
+      }
+      if (matchAny(text, pos, len, kWeakBreaks)) {
+        weakBreak = next;
+      }
+    }
+
+    pos = next;
+    segChars++;
+  }
+  appendSegment(text, segStart, text.size(), charOffset, out);
+
+  return (int)out.size();
+}
+
+int SpeechSynthesizerLongText::getSegmentCount() {
+  lock();
+  int count = (int)_segments.size();
+  unlock();
+  return count;
+}
+
+/*
+ * 锁外启动一个已预留的段. 已取消或启动失败时关闭该段,
+ * reportFailure为true时经OnTaskFailed上报失败.
+ * @return 成功返回0，否则返回-1
+ */
+int SpeechSynthesizerLongText::launchSegment(LongTextSegment* segment,
+                                             bool reportFailure) {
+  SpeechSynthesizerRequest* request =
+      NlsClient::getInstance()->createSynthesizerRequest(
+          _version == 0 ? ShortTts : LongTts);
+  bool prepared = false;
+  if (request) {
+    request->setOnTaskFailed(onSegmentEvent, segment);
+    request->setOnSynthesisCompleted(onSegmentEvent, segment);
+    request->setOnChannelClosed(onSegmentEvent, segment);
+    request->setOnBinaryDataReceived(onSegmentEvent, segment);
+    request->setOnMetaInfo(onSegmentEvent, segment);
+    prepared = applySettings(request) == 0 &&
+               request->setText(segment->text.c_str()) == 0;
+  }
+
+  lock();
+  segment->request = request;
+  bool cancelled = _cancelled || _releasing;
+  unlock();
+
+  int ret = -1;
+  if (prepared && !cancelled) {
+    ret = request->start();
+  }
+
+  lock();
+  if (ret == 0) {
+    // cancel()可能早于start()执行, 启动后补发取消
+    cancelled = _cancelled || _releasing;
+    LOG_DEBUG("long text segment %d started, chars offset:%zu, bytes:%zu.",
+        segment->index, segment->charOffset, segment->text.size());
+  } else {
+    segment->closed = true;
+    _inFlight--;
+    if (reportFailure && !cancelled) {
+      LOG_ERROR("start long text segment %d failed.", segment->index);
+      char msg[128] = {0};
+      snprintf(msg, sizeof(msg) - 1,
+               "{\"TaskFailed\":\"start segment %d failed.\"}",
+               segment->index);
+      std::string taskId;
+      NlsEvent event(msg, -1, NlsEvent::TaskFailed, taskId);
+      handleFailure(&event);
+
+      if (_inFlight == 0 && _running) {
+        _running = false;
+        postOwned(new NlsEvent(CLOSE_JSON_STRING, CLOSE_CODE,
+                               NlsEvent::Close, taskId));
+      }
+    }
+  }
+  unlock();
+
+  if (ret == 0 && cancelled) {
+    request->cancel();
+  }
+
+  lock();
+  _launching--;
+  if (_launching == 0) {
+#if defined(_MSC_VER)
+    SetEvent(_launchEvent);
+#else
+    pthread_cond_broadcast(&_cvLaunch);
+#endif
+  }
+  unlock();
+  return ret;
+}
+
+void SpeechSynthesizerLongText::launchSegments(
+    const std::vector<LongTextSegment*>& segments) {
+  for (size_t i = 0; i < segments.size(); i++) {
+    launchSegment(segments[i], true);
+  }
+}
+
+/* 持锁调用, 按并行上限预留待启动的段, 由launchSegments在锁外启动 */
+void SpeechSynthesizerLongText::reserveLaunches(
+    std::vector<LongTextSegment*>& segments) {
+  while (!_failed && !_cancelled && _next < _segments.size() &&
+         _inFlight < _param.maxInFlight) {
+    segments.push_back(_segments[_next++]);
+    _inFlight++;
+    _launching++;
+  }
+}
+
+int SpeechSynthesizerLongText::start() {
+  std::vector<LongTextSegment*> segments;
+
+  lock();
+  // 上一次合成已结束或已取消时, 等待其锁外的启动完成后移出各段
+  waitLaunches();
+  if (_running) {
+    unlock();
+    LOG_ERROR("long text synthesis is running.");
+    return -1;
+  }
+  detachSegments(segments);
+  _running = true;
+  _cancelled = false;
+  unlock();
+
+  // 上一次合成的请求在锁外取消并释放
+  releaseSegments(segments);
+
+  splitText(_text, _param.firstSegmentChars, _param.maxSegmentChars,
+            segments);
+  for (size_t i = 0; i < segments.size(); i++) {
+    segments[i]->owner = this;
+  }
+
+  std::vector<LongTextSegment*> launches;
+  lock();
+  _segments.swap(segments);
+  _head = 0;
+  _next = 0;
+  _inFlight = 0;
+  _timeOffset = 0;
+  _failed = false;
+  _completed = false;
+  size_t count = _segments.size();
+  if (!_cancelled) {
+    reserveLaunches(launches);
+  }
+  unlock();
+
+  int ret = -1;
+  if (!launches.empty()) {
+    // 首段启动失败直接返回, 其余段失败经OnTaskFailed上报
+    ret = launchSegment(launches[0], false);
+  } else if (count == 0) {
+    LOG_ERROR("long text is empty.");
+  }
+
+  LOG_INFO("long text synthesis start:%d, chars:%zu, segments:%zu.",
+      ret, _text.size(), count);
+
+  if (ret < 0) {
+    lock();
+    _running = false;
+    detachSegments(segments);
+    unlock();
+    releaseSegments(segments);
+    return -1;
+  }
+
+  launches.erase(launches.begin());
+  launchSegments(launches);
+
+  lock();
+  if (!_draining) {
+    drainOutbox();
+  }
+  unlock();
+  return 0;
+}
+
+int SpeechSynthesizerLongText::cancel() {
+  std::vector<SpeechSynthesizerRequest*> running;
+
+  lock();
+  if (!_running) {
+    unlock();
+    return -1;
+  }
+  _cancelled = true;
+  _running = false;
+  discardOutbox();
+  for (size_t i = 0; i < _segments.size(); i++) {
+    if (_segments[i]->request && !_segments[i]->closed) {
+      running.push_back(_segments[i]->request);
+    }
+  }
+  unlock();
+
+  for (size_t i = 0; i < running.size(); i++) {
+    running[i]->cancel();
+  }
+  return 0;
+}
+
+void SpeechSynthesizerLongText::deliverEvent(NlsEvent* event,
+                                             LongTextSegment* segment) {
+  std::vector<LongTextSegment*> launches;
+
+  lock();
+  // 无线程上报时由本线程上报, 入参事件在本函数返回前上报, 可不复制
+  bool drainer = !_draining;
+  _draining = true;
+  _borrowable = drainer ? event : NULL;
+
+  // 取消后不再上报任何回调
+  if (!_releasing && !_cancelled && !segment->detached) {
+    switch (event->getMsgType()) {
+      case NlsEvent::Binary:
+        handleBinary(event, segment);
+        break;
+      case NlsEvent::MetaInfo:
+        handleMeta(event, segment);
+        break;
+      case NlsEvent::SynthesisCompleted:
+        segment->completed = true;
+        if (!_failed) {
+          advanceHead(event);
+        }
+        break;
+      case NlsEvent::TaskFailed:
+        handleFailure(event);
+        break;
+      case NlsEvent::Close:
+        handleClose(event, segment, launches);
+        break;
+      default:
+        break;
+    }
+  }
+  _borrowable = NULL;
+  unlock();
+
+  // 后续段在锁外启动, 启动失败经_outbox上报
+  launchSegments(launches);
+
+  lock();
+  if (drainer || !_draining) {
+    drainOutbox();
+  }
+  unlock();
+}
+
+/*
+ * 解析wav头部, 返回本次数据中属于头部的字节数.
+ * 不是RIFF/WAVE或头部过长时按无头部处理.
+ */
+size_t SpeechSynthesizerLongText::stripWavHeader(
+    LongTextSegment* segment, const unsigned char* data, size_t size,
+    size_t* headerBytes) {
+  *headerBytes = 0;
+  if (segment->headerDone || _format != "wav") {
+    return size;
+  }
+
+  size_t seen = segment->header.size();
+  size_t take = LONG_TEXT_WAV_HEADER_MAX - seen;
+  if (take > size) take = size;
+  segment->header.insert(segment->header.end(), data, data + take);
+
+  const std::vector<unsigned char>& h = segment->header;
+  if (h.size() < 12) {
+    *headerBytes = size;
+    return 0;
+  }
+  if (memcmp(&h[0], "RIFF", 4) != 0 || memcmp(&h[8], "WAVE", 4) != 0) {
+    segment->headerDone = true;
+    return size;
+  }
+
+  size_t pos = 12;
+  while (pos + 8 <= h.size()) {
+    uint32_t chunkSize = readLe32(&h[pos + 4]);
+    if (memcmp(&h[pos], "fmt ", 4) == 0 && pos + 20 <= h.size()) {
+      segment->byteRate = (int)readLe32(&h[pos + 16]);
+    }
+    if (memcmp(&h[pos], "data", 4) == 0) {
+      segment->headerDone = true;
+      segment->header.clear();
+      *headerBytes = pos + 8 - seen;
+      return size - *headerBytes;
+    }
+    if (chunkSize > LONG_TEXT_WAV_HEADER_MAX) {
+      break;
+    }
+    pos += 8 + chunkSize + (chunkSize & 1);
+  }
+
+  if (h.size() >= LONG_TEXT_WAV_HEADER_MAX) {
+    LOG_WARN("long text segment %d wav header not found.", segment->index);
+    segment->headerDone = true;
+    return size;
+  }
+  *headerBytes = size;
+  return 0;
+}
+
+int64_t SpeechSynthesizerLongText::segmentDurationMs(
+    LongTextSegment* segment) {
+  if (_format == "pcm" && _sampleRate > 0) {
+    return (int64_t)(segment->audioBytes * 1000 / (_sampleRate * 2));
+  }
+  if (_format == "wav" && segment->byteRate > 0) {
+    return (int64_t)(segment->audioBytes * 1000 / segment->byteRate);
+  }
+  // mp3等压缩格式无法由字节数得到时长, 以字幕的最大结束时间代替
+  return segment->lastEndTime;
+}
+
+void SpeechSynthesizerLongText::handleBinary(NlsEvent* event,
+                                             LongTextSegment* segment) {
+  if (_failed) {
+    return;
+  }
+
+  int size = 0;
+  const unsigned char* data = event->getBinaryDataBuffer(&size);
+  if (data == NULL || size <= 0) {
+    return;
+  }
+
+  size_t headerBytes = 0;
+  size_t payload = stripWavHeader(segment, data, (size_t)size, &headerBytes);
+  segment->audioBytes += payload;
+
+  // 第一段保留wav头部, 其余段只上报音频数据
+  if (segment->index > 0) {
+    data += headerBytes;
+    size = (int)payload;
+  }
+  if (size <= 0) {
+    return;
+  }
+
+  if ((size_t)segment->index == _head) {
+    emitBinary(segment, data, (size_t)size,
+               (segment->index > 0 && headerBytes > 0) ? NULL : event);
+    return;
+  }
+
+  std::vector<LongTextPendingItem>& pending = segment->pending;
+  if (pending.empty() || pending.back().type != NlsEvent::Binary) {
+    LongTextPendingItem item;
+    item.type = NlsEvent::Binary;
+    pending.push_back(item);
+  }
+  pending.back().data.insert(pending.back().data.end(), data, data + size);
+}
+
+void SpeechSynthesizerLongText::handleMeta(NlsEvent* event,
+                                           LongTextSegment* segment) {
+  if (_failed) {
+    return;
+  }
+
+  std::string msg = event->getAllResponse();
+  if (_param.remapSubtitle) {
+    // 记录本段字幕的最大结束时间, 压缩格式以此作为本段时长
+    Json::Reader reader;
+    Json::Value root;
+    if (reader.parse(msg, root) && root["payload"].isObject() &&
+        root["payload"]["subtitles"].isArray()) {
+      const Json::Value& subtitles = root["payload"]["subtitles"];
+      for (Json::Value::ArrayIndex i = 0; i < subtitles.size(); i++) {
+        const Json::Value& endTime = subtitles[i]["end_time"];
+        if (endTime.isNumeric() &&
+            (int64_t)endTime.asInt() > segment->lastEndTime) {
+          segment->lastEndTime = endTime.asInt();
+        }
+      }
+    }
+  }
+
+  if ((size_t)segment->index == _head) {
+    emitMeta(segment, msg, event);
+    return;
+  }
+
+  LongTextPendingItem item;
+  item.type = NlsEvent::MetaInfo;
+  item.msg = msg;
+  segment->pending.push_back(item);
+}
+
+void SpeechSynthesizerLongText::emitBinary(
+    LongTextSegment* segment, const unsigned char* data, size_t size,
+    NlsEvent* source) {
+  if (source) {
+    post(source);
+    return;
+  }
+
+  std::string taskId;
+  if (segment->request) {
+    taskId = segment->request->getRequestParam()->_task_id;
+  }
+  std::vector<unsigned char> buffer(data, data + size);
+  postOwned(new NlsEvent(buffer, 0, NlsEvent::Binary, taskId));
+}
+
+void SpeechSynthesizerLongText::emitMeta(
+    LongTextSegment* segment, const std::string& msg, NlsEvent* source) {
+  if (!_param.remapSubtitle) {
+    if (source) {
+      post(source);
+    } else {
+      std::string copy = msg;
+      NlsEvent* event = new NlsEvent(copy);
+      event->parseJsonMsg();
+      postOwned(event);
+    }
+    return;
+  }
+
+  Json::Reader reader;
+  Json::Value root;
+  if (!reader.parse(msg, root) || !root["payload"].isObject() ||
+      !root["payload"]["subtitles"].isArray()) {
+    std::string copy = msg;
+    NlsEvent* event = new NlsEvent(copy);
+    event->parseJsonMsg();
+    postOwned(event);
+    return;
+  }
+
+  // 字幕位置换算为完整文本中的字符及字节偏移, 时间加上之前各段的时长
+  Json::Value& subtitles = root["payload"]["subtitles"];
+  for (Json::Value::ArrayIndex i = 0; i < subtitles.size(); i++) {
+    Json::Value& item = subtitles[i];
+    if (item["begin_index"].isNumeric()) {
+      int index = item["begin_index"].asInt();
+      item["begin_index"] = (int)(segment->charOffset + index);
+      item["begin_byte"] = (int)(segment->byteOffset +
+          utf8ByteOffset(segment->text, index < 0 ? 0 : index));
+    }
+    if (item["end_index"].isNumeric()) {
+      int index = item["end_index"].asInt();
+      item["end_index"] = (int)(segment->charOffset + index);
+      item["end_byte"] = (int)(segment->byteOffset +
+          utf8ByteOffset(segment->text, index < 0 ? 0 : index));
+    }
+    if (item["begin_time"].isNumeric()) {
+      item["begin_time"] =
+          (int)(_timeOffset + item["begin_time"].asInt());
+    }
+    if (item["end_time"].isNumeric()) {
+      item["end_time"] = (int)(_timeOffset + item["end_time"].asInt());
+    }
+    Json::Value& phonemes = item["phoneme_list"];
+    if (phonemes.isArray()) {
+      for (Json::Value::ArrayIndex j = 0; j < phonemes.size(); j++) {
+        if (phonemes[j]["begin_time"].isNumeric()) {
+          phonemes[j]["begin_time"] =
+              (int)(_timeOffset + phonemes[j]["begin_time"].asInt());
+        }
+        if (phonemes[j]["end_time"].isNumeric()) {
+          phonemes[j]["end_time"] =
+              (int)(_timeOffset + phonemes[j]["end_time"].asInt());
+        }
+      }
+    }
+  }
+
+  Json::FastWriter writer;
+  std::string remapped = writer.write(root);
+  NlsEvent* event = new NlsEvent(remapped);
+  event->parseJsonMsg();
+  postOwned(event);
+}
+
+/* 当前段合成完成后依次上报后续已缓存的段, 全部完成时上报一次完成事件 */
+void SpeechSynthesizerLongText::advanceHead(NlsEvent* completed) {
+  while (_head < _segments.size() && _segments[_head]->completed) {
+    _timeOffset += segmentDurationMs(_segments[_head]);
+    _head++;
+    if (_head >= _segments.size()) {
+      break;
+    }
+
+    LongTextSegment* segment = _segments[_head];
+    for (size_t i = 0; i < segment->pending.size(); i++) {
+      LongTextPendingItem& item = segment->pending[i];
+      if (item.type == NlsEvent::Binary) {
+        emitBinary(segment, &item.data[0], item.data.size(), NULL);
+      } else {
+        emitMeta(segment, item.msg, NULL);
+      }
+    }
+    std::vector<LongTextPendingItem>().swap(segment->pending);
+  }
+
+  if (_head >= _segments.size() && !_completed) {
+    _completed = true;
+    LOG_INFO("long text synthesis completed, segments:%zu, duration:%lld.",
+        _segments.size(), (long long)_timeOffset);
+    post(completed);
+  }
+}
+
+void SpeechSynthesizerLongText::handleFailure(NlsEvent* event) {
+  if (_failed || _completed) {
+    return;
+  }
+  _failed = true;
+  LOG_ERROR("long text synthesis failed at segment %zu.", _head);
+
+  for (size_t i = 0; i < _segments.size(); i++) {
+    std::vector<LongTextPendingItem>().swap(_segments[i]->pending);
+  }
+  post(event);
+}
+
+void SpeechSynthesizerLongText::handleClose(
+    NlsEvent* event, LongTextSegment* segment,
+    std::vector<LongTextSegment*>& launches) {
+  if (segment->closed) {
+    return;
+  }
+  segment->closed = true;
+  _inFlight--;
+
+  if (!segment->completed && !_failed) {
+    char msg[128] = {0};
+    snprintf(msg, sizeof(msg) - 1,
+             "{\"TaskFailed\":\"segment %d closed before completion.\"}",
+             segment->index);
+    std::string taskId = event->getTaskId();
+    NlsEvent failed(msg, -1, NlsEvent::TaskFailed, taskId);
+    handleFailure(&failed);
+  }
+
+  reserveLaunches(launches);
+
+  if (_inFlight == 0 && _running) {
+    _running = false;
+    post(event);
+  }
+}
+
+void SpeechSynthesizerLongText::setOnTaskFailed(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnTaskFailed(_event, para);
+}
+
+void SpeechSynthesizerLongText::setOnSynthesisCompleted(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnSynthesisCompleted(_event, para);
+}
+
+void SpeechSynthesizerLongText::setOnChannelClosed(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnChannelClosed(_event, para);
+}
+
+void SpeechSynthesizerLongText::setOnBinaryDataReceived(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnBinaryDataReceived(_event, para);
+}
+
+void SpeechSynthesizerLongText::setOnMetaInfo(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnMetaInfo(_event, para);
+}
+
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_SPEECH_SYNTHESIZER_LONG_TEXT_H
+#define NLS_SDK_SPEECH_SYNTHESIZER_LONG_TEXT_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "nlsGlobal.h"
+#include "nlsEvent.h"
+#include "speechSynthesizerRequest.h"
+
+namespace AlibabaNls {
+
+class SpeechSynthesizerListener;
+class SpeechSynthesizerLongText;
+
+/* 按调用顺序保存的参数设置, 在每段请求启动前依次应用 */
+struct LongTextSetting {
+  int id;
+  std::string value;
+  std::string extra;
+  int number;
+};
+
+/* 尚未轮到上报的音频或字幕 */
+struct LongTextPendingItem {
+  NlsEvent::EventType type;
+  std::vector<unsigned char> data;
+  std::string msg;
+};
+
+/* 待上报的回调事件, 在锁外按序上报 */
+struct LongTextOutgoing {
+  NlsEvent* event;
+  bool owned;  // 否则为上报线程所在deliverEvent的入参, 在其返回前上报
+};
+
+struct LongTextSegment {
+  SpeechSynthesizerLongText* owner;
+  int index;
+  std::string text;
+  size_t charOffset;  // 在完整文本中的字符偏移
+  size_t byteOffset;  // 在完整文本中的字节偏移
+
+  SpeechSynthesizerRequest* request;
+  bool completed;
+  bool closed;
+  bool detached;  // 已从本次合成中移出, 之后到达的事件均被忽略
+  std::vector<LongTextPendingItem> pending;
+
+  /* wav头部解析, 第一段之后的头部不上报 */
+  std::vector<unsigned char> header;
+  bool headerDone;
+  int byteRate;
+  /* 不含wav头部的音频字节数及字幕最大结束时间, 用于计算后续段的时间偏移 */
+  uint64_t audioBytes;
+  int64_t lastEndTime;
+};
+
+/*
+ * 长文本语音合成. 文本在句末标点处切分为多段, 以至多maxInFlight个并行的
+ * SpeechSynthesizerRequest合成, 各段音频及字幕按文本顺序经同一组回调上报,
+ * 首段合成完成即开始上报, 无需等待全部文本合成.
+ * 各段请求经NlsClient创建, 开启请求池时复用池中的连接缓冲与参数对象.
+ * 回调串行上报, 事件的getTaskId()为所属段的task id.
+ */
+class NLS_SDK_CLIENT_EXPORT SpeechSynthesizerLongText {
+ public:
+  explicit SpeechSynthesizerLongText(int version = 0);
+  ~SpeechSynthesizerLongText();
+
+  /*
+   * @brief 以下参数对每段合成请求生效, 含义同SpeechSynthesizerRequest
+   * @note 在start前调用, 下一次start时仍然有效
+   * @return 成功则返回0，否则返回-1
+   */
+  int setUrl(const char* value);
+  int setAppKey(const char* value);
+  int setToken(const char* value);
+  int setFormat(const char* value);
+  int setSampleRate(int value);
+  int setVoice(const char* value);
+  int setVolume(int value);
+  int setSpeechRate(int value);
+  int setPitchRate(int value);
+  int setMethod(int value);
+  int setEnableSubtitle(bool value);
+  int setPayloadParam(const char* value);
+  int setContextParam(const char* value);
+  int setTimeout(int value);
+  int setOutputFormat(const char* value);
+  int AppendHttpHeaderParam(const char* key, const char* value);
+
+  /*
+   * @brief 设置待合成的完整文本, 长度不受单次合成限制
+   * @param value UTF-8编码的文本
+   * @return 成功则返回0，否则返回-1
+   */
+  int setText(const char* value);
+
+  /*
+   * @brief 设置切分及并行参数, 见NlsLongTextTtsParam
+   * @return 成功则返回0，参数越界返回-1
+   */
+  int setLongTextParam(const NlsLongTextTtsParam& param);
+
+  /*
+   * @brief 切分文本并启动合成
+   * @note 上一次合成未结束时返回失败. 音频格式为wav时仅上报第一段的wav头部,
+   *       其中的长度字段不代表完整音频.
+   * @return 成功则返回0，否则返回-1
+   */
+  int start();
+
+  /*
+   * @brief 取消合成, 进行中的段被直接关闭, 其余段不再启动,
+   *        尚未上报的回调被丢弃, 之后不再开始新的回调
+   * @return 成功则返回0，未在合成返回-1
+   */
+  int cancel();
+
+  /* @brief 最近一次start切分出的段数 */
+  int getSegmentCount();
+
+  /*
+   * @brief 设置回调函数
+   * @note OnBinaryDataReceived及OnMetaInfo按文本顺序上报各段数据;
+   *       全部段合成完成后上报一次OnSynthesisCompleted;
+   *       任一段失败时上报一次OnTaskFailed, 之后不再上报数据;
+   *       所有段的连接关闭后上报一次OnChannelClosed.
+   *       回调在锁外上报, 同一时刻至多一个回调在执行.
+   *       不可在回调中调用本对象的接口或释放本对象.
+   * @param _event 回调方法
+   * @param para 用户传入参数, 默认为NULL
+   */
+  void setOnTaskFailed(NlsCallbackMethod _event, void* para = NULL);
+  void setOnSynthesisCompleted(NlsCallbackMethod _event, void* para = NULL);
+  void setOnChannelClosed(NlsCallbackMethod _event, void* para = NULL);
+  void setOnBinaryDataReceived(NlsCallbackMethod _event, void* para = NULL);
+  void setOnMetaInfo(NlsCallbackMethod _event, void* para = NULL);
+
+  /* 各段请求的回调入口 */
+  void deliverEvent(NlsEvent* event, LongTextSegment* segment);
+
+  /*
+   * @brief 在句末标点处切分文本, 单句超长时在逗号等次级标点或空白处切分,
+   *        仍超长则按字符数截断. 仅含空白的段被丢弃.
+   * @return 切分出的段数
+   */
+  static int splitText(const std::string& text, int firstSegmentChars,
+                       int maxSegmentChars, std::vector<LongTextSegment*>& out);
+
+ private:
+  void lock();
+  void unlock();
+  void addSetting(int id, const char* value, const char* extra, int number);
+  int applySettings(SpeechSynthesizerRequest* request);
+  int launchSegment(LongTextSegment* segment, bool reportFailure);
+  void launchSegments(const std::vector<LongTextSegment*>& segments);
+  void reserveLaunches(std::vector<LongTextSegment*>& segments);
+  void waitLaunches();
+  void detachSegments(std::vector<LongTextSegment*>& segments);
+  static void releaseSegments(std::vector<LongTextSegment*>& segments);
+
+  void post(NlsEvent* event);
+  void postOwned(NlsEvent* event);
+  void discardOutbox();
+  void drainOutbox();
+
+  void handleBinary(NlsEvent* event, LongTextSegment* segment);
+  void handleMeta(NlsEvent* event, LongTextSegment* segment);
+  void handleClose(NlsEvent* event, LongTextSegment* segment,
+                   std::vector<LongTextSegment*>& launches);
+  void handleFailure(NlsEvent* event);
+  void advanceHead(NlsEvent* completed);
+  void emitBinary(LongTextSegment* segment, const unsigned char* data,
+                  size_t size, NlsEvent* source);
+  void emitMeta(LongTextSegment* segment, const std::string& msg,
+                NlsEvent* source);
+  size_t stripWavHeader(LongTextSegment* segment, const unsigned char* data,
+                        size_t size, size_t* headerBytes);
+  int64_t segmentDurationMs(LongTextSegment* segment);
+
+  int _version;
+  std::string _text;
+  std::string _format;
+  int _sampleRate;
+  NlsLongTextTtsParam _param;
+  std::vector<LongTextSetting> _settings;
+
+  std::vector<LongTextSegment*> _segments;
+  size_t _head;        // 当前上报的段
+  size_t _next;        // 下一个待启动的段
+  int _inFlight;       // 已启动或预留启动, 尚未关闭的段数
+  int _launching;      // 正在锁外启动的段数
+  int64_t _timeOffset; // 当前上报段在完整音频中的起始时间(ms)
+  bool _running;
+  bool _failed;
+  bool _cancelled;
+  bool _completed;
+  bool _releasing;
+
+  std::deque<LongTextOutgoing> _outbox;
+  bool _draining;          // 已有线程在上报_outbox
+  NlsEvent* _borrowable;   // 可不复制直接入队的事件
+
+  SpeechSynthesizerCallback* _callback;
+  SpeechSynthesizerListener* _listener;
+
+#if defined(_MSC_VER)
+  HANDLE _mtxDeliver;
+  HANDLE _launchEvent;      // 手动复位, _launching归零时置位
+#else
+  pthread_mutex_t _mtxDeliver;
+  pthread_cond_t _cvLaunch; // _launching归零时广播
+#endif
+};
+
+}
+
+#endif //NLS_SDK_SPEECH_SYNTHESIZER_LONG_TEXT_H
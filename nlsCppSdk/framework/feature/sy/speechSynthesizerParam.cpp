@@ -27,6 +27,8 @@ namespace AlibabaNls {
 
 SpeechSynthesizerParam::SpeechSynthesizerParam(int version) :
     INlsRequestParam(TypeTts) {
+  _version = version;
+
   if (version == 0) {
     _header[D_NAMESPACE] = D_NAMESPACE_SYNTHESIZER;
   } else {
@@ -21,6 +21,7 @@
 #include "connectNode.h"
 #include "nlog.h"
 #include "utility.h"
+#include "nlsRequestParamInfo.h"
 
 namespace AlibabaNls {
 
@@ -30,6 +31,9 @@ SpeechSynthesizerCallback::SpeechSynthesizerCallback() {
   this->_onSynthesisCompleted = NULL;
   this->_onChannelClosed = NULL;
   this->_onBinaryDataReceived = NULL;
+  this->_onMetaInfo = NULL;
+  this->_onPcmFrameReceived = NULL;
+  this->_pcmFramePara = NULL;
 }
 
 SpeechSynthesizerCallback::~SpeechSynthesizerCallback() {
@@ -38,6 +42,7 @@ SpeechSynthesizerCallback::~SpeechSynthesizerCallback() {
   this->_onSynthesisCompleted = NULL;
   this->_onChannelClosed = NULL;
   this->_onBinaryDataReceived = NULL;
+  this->_onPcmFrameReceived = NULL;
 
   std::map<NlsEvent::EventType, void*>::iterator iter;
   for (iter = _paramap.begin(); iter != _paramap.end();) {
@@ -117,6 +122,12 @@ void SpeechSynthesizerCallback::setOnMetaInfo(
   }
 }
 
+void SpeechSynthesizerCallback::setOnPcmFrameReceived(
+    NlsCallbackMethod _event, void* para) {
+  this->_onPcmFrameReceived = _event;
+  this->_pcmFramePara = para;
+}
+
 SpeechSynthesizerRequest::SpeechSynthesizerRequest(int version) {
   _callback = new SpeechSynthesizerCallback();
 
@@ -137,6 +148,9 @@ SpeechSynthesizerRequest::~SpeechSynthesizerRequest() {
 //  delete _synthesizerParam;
 //  _synthesizerParam = NULL;
 
+  // 回调可能仍在异步回调线程中排队, 需在释放listener前等待其完成
+  _node->drainCallbacks();
+
   delete _listener;
   _listener = NULL;
 
@@ -154,6 +168,10 @@ SpeechSynthesizerRequest::~SpeechSynthesizerRequest() {
 
 int SpeechSynthesizerRequest::start() {
   _synthesizerParam->setNlsRequestType(SpeechSynthesizer);
+  static_cast<SpeechSynthesizerListener*>(_listener)->preparePcmOutput(
+      _synthesizerParam->_ttsPcmParam,
+      _synthesizerParam->_payload[D_FORMAT].asString(),
+      _synthesizerParam->_sampleRate);
   return INlsRequest::start(this);
 }
 
@@ -167,6 +185,14 @@ int SpeechSynthesizerRequest::cancel() {
   //    return INlsRequest::cancel(this);
 }
 
+int SpeechSynthesizerRequest::reset() {
+  return INlsRequest::reset(this);
+}
+
+void SpeechSynthesizerRequest::resetCallback() {
+  *_callback = SpeechSynthesizerCallback();
+}
+
 int SpeechSynthesizerRequest::setPayloadParam(const char* value) {
   INPUT_PARAM_STRING_CHECK(value);
   return _synthesizerParam->setPayloadParam(value);
@@ -271,6 +297,39 @@ void SpeechSynthesizerRequest::setOnMetaInfo(
   _callback->setOnMetaInfo(_event, para);
 }
 
+void SpeechSynthesizerRequest::setOnPcmFrameReceived(
+    NlsCallbackMethod _event, void* para) {
+  _callback->setOnPcmFrameReceived(_event, para);
+}
+
+int SpeechSynthesizerRequest::setPcmOutputParam(const NlsTtsPcmParam& param) {
+  return _synthesizerParam->setTtsPcmParam(param);
+}
+
+int SpeechSynthesizerRequest::getPcmStats(NlsTtsPcmStats* stats) {
+  if (stats == NULL) {
+    return -1;
+  }
+  static_cast<SpeechSynthesizerListener*>(_listener)->getPcmStats(stats);
+  return 0;
+}
+
+int SpeechSynthesizerRequest::getLatencyTrace(NlsLatencyTrace* trace) {
+  if (_node == NULL || trace == NULL) {
+    return -1;
+  }
+  _node->getLatencyTrace(trace);
+  return 0;
+}
+
+int SpeechSynthesizerRequest::getMemoryUsage(NlsRequestMemoryUsage* usage) {
+  if (_node == NULL || usage == NULL) {
+    return -1;
+  }
+  _node->getMemoryUsage(usage);
+  return 0;
+}
+
 int SpeechSynthesizerRequest::AppendHttpHeaderParam(
     const char* key, const char* value) {
   return _synthesizerParam->AppendHttpHeader(key, value);
@@ -41,6 +41,7 @@ class NLS_SDK_CLIENT_EXPORT SpeechSynthesizerCallback {
   void setOnChannelClosed(NlsCallbackMethod _event, void* para = NULL);
   void setOnBinaryDataReceived(NlsCallbackMethod _event, void* para = NULL);
   void setOnMetaInfo(NlsCallbackMethod _event, void* para = NULL);
+  void setOnPcmFrameReceived(NlsCallbackMethod _event, void* para = NULL);
 
   NlsCallbackMethod _onTaskFailed;
   NlsCallbackMethod _onSynthesisStarted;
@@ -48,6 +49,9 @@ class NLS_SDK_CLIENT_EXPORT SpeechSynthesizerCallback {
   NlsCallbackMethod _onChannelClosed;
   NlsCallbackMethod _onBinaryDataReceived;
   NlsCallbackMethod _onMetaInfo;
+  /* PCM帧与原始二进制数据同为Binary事件, 参数单独保存 */
+  NlsCallbackMethod _onPcmFrameReceived;
+  void* _pcmFramePara;
   std::map<NlsEvent::EventType, void*> _paramap;
 };
 
@@ -192,6 +196,39 @@ class NLS_SDK_CLIENT_EXPORT SpeechSynthesizerRequest : public INlsRequest {
    */
   int AppendHttpHeaderParam(const char* key, const char* value);
 
+  /**
+   * @brief 设置PCM输出参数, 开启后SDK将合成音频解码为16bit单声道PCM,
+   *        经抖动缓冲后按固定帧长通过OnPcmFrameReceived回调输出
+   * @note 可选参数, 在start前调用. 支持pcm/wav/opus格式, opus需以ENABLE_OGGOPUS编译,
+   *       输出采样率为setSampleRate设置的采样率(wav为其头部采样率).
+   *       解码在回调线程中进行, 未开启回调执行器时在事件线程中进行.
+   * @param param 参数, 见NlsTtsPcmParam
+   * @return 成功则返回0，否则返回-1
+   */
+  int setPcmOutputParam(const NlsTtsPcmParam& param);
+
+  /**
+   * @brief 获取PCM输出统计, 包括首包音频及首个PCM帧的时延
+   * @param stats 统计信息, 本次start以来的累计值
+   * @return 成功则返回0，否则返回-1
+   */
+  int getPcmStats(NlsTtsPcmStats* stats);
+
+  /**
+   * @brief 获取本次请求各阶段的时间点, 可在回调中或stop后调用,
+   *        请求进行中调用时尚未到达的阶段为0, 见NlsLatencyTrace
+   * @param trace 时延信息输出
+   * @return 成功则返回0，否则返回-1
+   */
+  int getLatencyTrace(NlsLatencyTrace* trace);
+
+  /**
+   * @brief 获取本次请求持有的缓冲内存, 可在回调中或stop后调用
+   * @param usage 内存统计输出, 见NlsRequestMemoryUsage
+   * @return 成功则返回0，否则返回-1
+   */
+  int getMemoryUsage(NlsRequestMemoryUsage* usage);
+
   /**
    * @brief 启动SpeechSynthesizerRequest
    * @note 异步操作。成功返回BinaryRecv事件。失败返回TaskFailed事件。
@@ -213,6 +250,14 @@ class NLS_SDK_CLIENT_EXPORT SpeechSynthesizerRequest : public INlsRequest {
    */
   int cancel();
 
+  /**
+   * @brief 重置请求, 以便在同一个request上发起下一次请求
+   * @note 需在收到ChannelClosed回调后调用, 保留已设置的参数与回调,
+   *       复用连接缓冲区与编码器. 若事件线程尚未完成清理则返回-1, 可稍后重试.
+   * @return 成功则返回0，否则返回-1
+   */
+  int reset();
+
   /**
    * @brief 设置错误回调函数
    * @note 在语音合成过程中出现错误时，sdk内部线程该回调上报.
@@ -259,6 +304,18 @@ class NLS_SDK_CLIENT_EXPORT SpeechSynthesizerRequest : public INlsRequest {
    */
   void setOnMetaInfo(NlsCallbackMethod _event, void* para = NULL);
 
+  /**
+   * @brief 设置PCM帧接收回调函数
+   * @note 开启setPcmOutputParam后, 每输出一帧PCM时sdk内部线程上报该回调函数.
+   *       事件类型为Binary, 通过getBinaryDataBuffer取得帧数据, 无需拷贝.
+   *       合成结束时先输出剩余数据, 再上报SynthesisCompleted.
+   * @param _event	回调方法
+   * @param para	用户传入参数, 默认为NULL
+   * @return void
+   * @notice 切不可在回调中进行阻塞操作
+   */
+  void setOnPcmFrameReceived(NlsCallbackMethod _event, void* para = NULL);
+
   ///**
   //    * @brief 获取request错误信息
   //    * @return 错误信息字符串
@@ -271,6 +328,9 @@ class NLS_SDK_CLIENT_EXPORT SpeechSynthesizerRequest : public INlsRequest {
   //    */
   //    int getRequestErrorStatus();
 
+ protected:
+  virtual void resetCallback();
+
  private:
   SpeechSynthesizerParam* _synthesizerParam;
   SpeechSynthesizerCallback* _callback;
@@ -82,6 +82,24 @@ int INlsRequest::sendAudio(INlsRequest *request, const uint8_t* data,
   return ret;
 }
 
+int INlsRequest::reset(INlsRequest *request, bool clearSettings) {
+  if (request == NULL) {
+    LOG_ERROR("Input request is empty.");
+    return -1;
+  }
+
+  if (request->getConnectNode()->resetConnectNode() < 0) {
+    return -1;
+  }
+
+  if (clearSettings) {
+    request->getRequestParam()->resetParam();
+    request->resetCallback();
+  }
+
+  return 0;
+}
+
 ConnectNode* INlsRequest::getConnectNode() {
   return _node;
 }
@@ -45,11 +45,15 @@ class NLS_SDK_CLIENT_EXPORT INlsRequest {
   int stControl(INlsRequest*, const char*);
   int sendAudio(INlsRequest*, const uint8_t *, size_t,
                 ENCODER_TYPE type = ENCODER_NONE);
+  int reset(INlsRequest*, bool clearSettings = false);
 
   ConnectNode* getConnectNode();
   INlsRequestParam* getRequestParam();
 
  protected:
+  /* 清空用户设置的回调, 由请求池回收时调用 */
+  virtual void resetCallback() {};
+
   ConnectNode* _node;
   INlsRequestListener* _listener;
   INlsRequestParam* _requestParam;
@@ -29,7 +29,7 @@ class INlsRequestListener : public HandleBaseOneParamWithReturnVoid<NlsEvent> {
   INlsRequestListener();
   ~INlsRequestListener();
 
-  virtual void handlerFrame(NlsEvent) = 0;
+  virtual void handlerFrame(NlsEvent&) = 0;
   virtual void handlerFrame(std::string errorInfo, int errorCode,
                             NlsEvent::EventType type, std::string taskId);
 };
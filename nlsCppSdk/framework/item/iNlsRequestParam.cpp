@@ -23,6 +23,7 @@
 #include "nlog.h"
 #include "Config.h"
 #include "connectNode.h"
+#include "nlsEncoder.h"
 #include "nlsRequestParamInfo.h"
 #include "iNlsRequestParam.h"
 
@@ -51,11 +52,18 @@ const char g_sdk_version[] = NLS_SDK_VERSION_STR;
 
 INlsRequestParam::INlsRequestParam(NlsType mode) : _mode(mode),
                                                    _payload(Json::objectValue) {
+  _version = 0;
+  _context[D_SDK_CLIENT] = getSdkInfo();
+
+  setDefaultParam();
+}
+
+INlsRequestParam::~INlsRequestParam() {}
+
+void INlsRequestParam::setDefaultParam() {
   _url = "wss://nls-gateway.cn-shanghai.aliyuncs.com/ws/v1";
   _token = "";
 
-  _context[D_SDK_CLIENT] = getSdkInfo();
-
 #if defined(_WIN32)
   _outputFormat = D_DEFAULT_VALUE_ENCODE_GBK;
 #else
@@ -67,11 +75,37 @@ INlsRequestParam::INlsRequestParam(NlsType mode) : _mode(mode),
 
   _requestType = SpeechNormal;
   _timeout = STOP_RECV_TIMEOUT;
+  _coalesceIntervalMs = 0;
+  _coalesceTextDelta = 0;
 
   _enableWakeWord = false;
+  _sampleRate = D_DEFAULT_VALUE_SAMPLE_RATE;
+  _encoderProfile = NlsEncoderProfile();
+  _vadParam = NlsVadParam();
+  _inputFormat = NlsAudioInputFormat();
+  _ttsPcmParam = NlsTtsPcmParam();
 }
 
-INlsRequestParam::~INlsRequestParam() {}
+void INlsRequestParam::resetParam() {
+  Json::Value nameSpace = _header[D_NAMESPACE];
+  Json::Value sdkInfo = _context[D_SDK_CLIENT];
+
+  _header = Json::Value();
+  _header[D_NAMESPACE] = nameSpace;
+  _payload = Json::Value(Json::objectValue);
+  _context = Json::Value();
+  _context[D_SDK_CLIENT] = sdkInfo;
+  _httpHeader = Json::Value();
+  _httpHeaderString.clear();
+
+  _format.clear();
+  _task_id.clear();
+  _startCommand.clear();
+  _controlCommand.clear();
+  _stopCommand.clear();
+
+  setDefaultParam();
+}
 
 std::string INlsRequestParam::getRandomUuid() {
   char uuidBuff[48] = {0};
@@ -243,6 +277,71 @@ int INlsRequestParam::setPayloadParam(const char* value) {
   return 0;
 }
 
+int INlsRequestParam::setEncoderProfile(const NlsEncoderProfile& profile) {
+  if (profile.bitrate < 6000 || profile.bitrate > 510000 ||
+      profile.complexity < 0 || profile.complexity > 10 ||
+      (profile.frameMs != 20 && profile.frameMs != 40 &&
+       profile.frameMs != 60)) {
+    LOG_ERROR("invalid encoder profile: bitrate %d, complexity %d, frame %dms.",
+        profile.bitrate, profile.complexity, profile.frameMs);
+    return -1;
+  }
+
+  _encoderProfile = profile;
+  return 0;
+}
+
+int INlsRequestParam::setEncoderPreset(ENCODER_PRESET preset) {
+  NlsEncoderProfile profile;
+  if (NlsEncoder::getPresetProfile(preset, &profile) < 0) {
+    LOG_ERROR("invalid encoder preset: %d.", preset);
+    return -1;
+  }
+
+  return setEncoderProfile(profile);
+}
+
+int INlsRequestParam::setVadParam(const NlsVadParam& param) {
+  if (param.mode < VAD_MODE_NONE || param.mode > VAD_MODE_DROP ||
+      param.energyThresholdDb < -90 || param.energyThresholdDb > 0 ||
+      param.zcrThreshold < 0 || param.zcrThreshold > 1000 ||
+      param.hangoverMs < 0 || param.keepAliveMs < 0) {
+    LOG_ERROR("invalid vad param: mode %d, threshold %ddB, zcr %d.",
+        param.mode, param.energyThresholdDb, param.zcrThreshold);
+    return -1;
+  }
+
+  _vadParam = param;
+  return 0;
+}
+
+int INlsRequestParam::setInputAudioFormat(const NlsAudioInputFormat& format) {
+  if (format.sampleFormat < SAMPLE_FORMAT_S16 ||
+      format.sampleFormat > SAMPLE_FORMAT_F32 ||
+      format.channels < 1 || format.channels > 8 ||
+      (format.sampleRate != 0 &&
+       (format.sampleRate < 8000 || format.sampleRate > 192000))) {
+    LOG_ERROR("invalid input audio format: format %d, rate %d, channels %d.",
+        format.sampleFormat, format.sampleRate, format.channels);
+    return -1;
+  }
+
+  _inputFormat = format;
+  return 0;
+}
+
+int INlsRequestParam::setTtsPcmParam(const NlsTtsPcmParam& param) {
+  if (param.frameMs < 10 || param.frameMs > 200 ||
+      param.jitterMs < 0 || param.jitterMs > 2000) {
+    LOG_ERROR("invalid tts pcm param: frame %dms, jitter %dms.",
+        param.frameMs, param.jitterMs);
+    return -1;
+  }
+
+  _ttsPcmParam = param;
+  return 0;
+}
+
 int INlsRequestParam::setContextParam(const char* value) {
   Json::Value root;
   Json::Reader reader;
@@ -19,6 +19,7 @@
 
 #include <string>
 #include "json/json.h"
+#include "nlsGlobal.h"
 
 namespace AlibabaNls {
 
@@ -46,6 +47,9 @@ class INlsRequestParam {
   INlsRequestParam(NlsType mode);
   virtual ~INlsRequestParam() = 0;
 
+  /* 恢复为构造时的默认参数, 保留namespace, 供请求池复用 */
+  virtual void resetParam();
+
   std::string getRandomUuid();
   Json::Value getSdkInfo();
 
@@ -69,6 +73,15 @@ class INlsRequestParam {
   void setFormat(const char* format);
   void setSampleRate(int sampleRate);
 
+  inline void setEncoderFrameDuration(int frameMs) {
+    _encoderProfile.frameMs = frameMs;
+  };
+  int setEncoderProfile(const NlsEncoderProfile& profile);
+  int setEncoderPreset(ENCODER_PRESET preset);
+  int setVadParam(const NlsVadParam& param);
+  int setInputAudioFormat(const NlsAudioInputFormat& format);
+  int setTtsPcmParam(const NlsTtsPcmParam& param);
+
   inline void setTimeout(int timeout) {
     _timeout = timeout;
   };
@@ -78,6 +91,10 @@ class INlsRequestParam {
   };
 
   void setIntermediateResult(bool value);
+  inline void setIntermediateResultCoalescing(int intervalMs, int textDelta) {
+    _coalesceIntervalMs = intervalMs;
+    _coalesceTextDelta = textDelta;
+  };
   void setPunctuationPrediction(bool value);
   void setTextNormalization(bool value);
   void setSentenceDetection(bool value);
@@ -104,6 +121,12 @@ class INlsRequestParam {
 
   int _timeout;
   int _sampleRate;
+  NlsEncoderProfile _encoderProfile;  // OPU/OPUS编码参数
+  NlsVadParam _vadParam;              // 客户端静音检测参数
+  NlsAudioInputFormat _inputFormat;   // sendAudio输入PCM格式
+  NlsTtsPcmParam _ttsPcmParam;        // 语音合成PCM输出参数
+  int _coalesceIntervalMs;  // 中间结果最小回调间隔(ms), 0不按时间合并
+  int _coalesceTextDelta;   // 中间结果最小文本变化字符数, 0不按文本合并
   NlsRequestType _requestType;
 
   std::string _url;
@@ -114,6 +137,7 @@ class INlsRequestParam {
   std::string _task_id;
 
   NlsType _mode;
+  int _version;  // TtsVersion或DaVersion
 
   std::string _startCommand;
   std::string _controlCommand;
@@ -125,6 +149,9 @@ class INlsRequestParam {
 
   Json::Value _httpHeader;
   std::string _httpHeaderString;
+
+ private:
+  void setDefaultParam();
 };
 
 }  // namespace AlibabaNls
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 二进制日志解码工具, 将setAsyncLog(..., LogRecordBinary)生成的.nlog文件
+ * 转为与文本日志相同格式的文本, 输出到标准输出.
+ *
+ * 用法: nlsLogDecode [-l 最高级别] <xxx.nlog> [xxx.nlog.1 ...]
+ *   -l 只输出不高于该级别的日志, 1:ERROR 2:WARN 3:INFO 4:DEBUG, 默认全部
+ *   多个文件按参数顺序输出, 滚动备份需按从旧到新的顺序给出.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "nlsLogSink.h"
+
+using namespace AlibabaNls::utility;
+
+static int decodeFile(const char* path, int maxLevel) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "%s: cannot open.\n", path);
+    return -1;
+  }
+
+  std::vector<uint8_t> data;
+  uint8_t chunk[64 * 1024];
+  size_t read = 0;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + read);
+  }
+  fclose(file);
+
+  if (data.size() < LOG_SINK_FILE_HEADER_SIZE ||
+      memcmp(&data[0], LOG_SINK_FILE_MAGIC,
+             strlen(LOG_SINK_FILE_MAGIC) + 1) != 0) {
+    fprintf(stderr, "%s: not a binary nls log.\n", path);
+    return -1;
+  }
+  uint32_t version = (uint32_t)data[8] | ((uint32_t)data[9] << 8) |
+                     ((uint32_t)data[10] << 16) | ((uint32_t)data[11] << 24);
+  if (version != LOG_SINK_FILE_VERSION) {
+    fprintf(stderr, "%s: unsupported version %u.\n", path, version);
+    return -1;
+  }
+  int utcOffset = (int)((uint32_t)data[12] | ((uint32_t)data[13] << 8) |
+                        ((uint32_t)data[14] << 16) |
+                        ((uint32_t)data[15] << 24));
+
+  size_t offset = LOG_SINK_FILE_HEADER_SIZE;
+  std::string line;
+  while (offset < data.size()) {
+    NlsLogRecord record;
+    size_t size = NlsLogSink::decodeRecord(&data[offset],
+                                           data.size() - offset, &record);
+    if (size == 0) {
+      // 进程异常退出时最后一次写出可能不完整
+      fprintf(stderr, "%s: truncated record at offset %lu, %lu bytes left.\n",
+              path, (unsigned long)offset,
+              (unsigned long)(data.size() - offset));
+      return -1;
+    }
+    offset += size;
+
+    if (maxLevel > 0 && record.level > maxLevel) {
+      continue;
+    }
+    line.clear();
+    NlsLogSink::formatRecord(record, utcOffset, line);
+    fwrite(line.data(), 1, line.size(), stdout);
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  int maxLevel = 0;
+  int ret = 0;
+  int files = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      maxLevel = atoi(argv[++i]);
+      continue;
+    }
+    if (decodeFile(argv[i], maxLevel) < 0) {
+      ret = 1;
+    }
+    files++;
+  }
+
+  if (files == 0) {
+    fprintf(stderr,
+            "usage: nlsLogDecode [-l max level] <file.nlog> [file.nlog ...]\n");
+    return 1;
+  }
+  return ret;
+}
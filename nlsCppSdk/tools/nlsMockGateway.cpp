@@ -0,0 +1,1383 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 本地模拟NLS网关, 用于离线压测及回归测试, 不访问任何外部网络.
+ * 完成WebSocket升级, 按start/stop指令模拟一句话识别、实时转写、
+ * 语音合成及对话助手的应答, 可注入时延和故障, 可选TLS(自签名证书).
+ *
+ * 用法: nlsMockGateway [选项]
+ *   -a <地址>               监听地址, 默认127.0.0.1
+ *   -p <端口>               监听端口, 默认8101, SDK中url设为 ws://127.0.0.1:8101/ws/v1
+ *   --tls                   启用TLS, 启动时生成自签名证书, url改为wss://
+ *   --cert <文件> --key <文件>  使用指定的PEM证书和私钥, 隐含--tls
+ *   --result-interval <ms>  识别结果节拍, 有新音频时每拍下发一个结果, 默认100
+ *   --sentence-results <n>  实时转写每句的结果数(含SentenceEnd), 默认5
+ *   --idle-timeout <ms>     开始后无音频超时, 返回IDLE_TIMEOUT, 默认10000, 0为不超时
+ *   --tts-ms-per-char <ms>  合成音频时长(每字), 默认200
+ *   --tts-chunk <字节>      合成音频每帧字节数, 默认3200
+ *   --tts-interval <ms>     合成音频帧间隔, 默认20
+ *   --upgrade-delay <ms>    WebSocket升级应答的附加时延
+ *   --latency <ms>          每条下行消息的附加时延
+ *   --jitter <ms>           附加时延的随机上限, 消息顺序保持不变
+ *   --reject-rate <0~1>     以403拒绝升级的比例
+ *   --fail-rate <0~1>       以TaskFailed代替Started应答的比例
+ *   --drop-rate <0~1>       开始后在--fault-delay内直接断开TCP的比例
+ *   --stall-rate <0~1>      开始后不再应答的比例, 用于验证客户端超时
+ *   --fault-delay <ms>      断开的最晚时间, 默认1000
+ *   --seed <n>              随机种子, 默认取当前时间
+ *   --stats <s>             每隔s秒输出统计, 默认只在退出时输出
+ *   -v                      输出每个连接的收发日志
+ *
+ * 单线程运行, 收到SIGINT/SIGTERM退出.
+ * 合成音频为16bit单声道正弦波, format为wav时先发送wav头, 其余格式同样下发PCM.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <deque>
+#include <string>
+
+#include "event2/event.h"
+#include "event2/buffer.h"
+#include "event2/listener.h"
+#include "event2/util.h"
+#include "openssl/ssl.h"
+#include "openssl/err.h"
+#include "openssl/evp.h"
+#include "openssl/sha.h"
+#include "openssl/x509.h"
+#include "json/json.h"
+#include "utility.h"
+
+using AlibabaNls::utility::getMonotonicUs;
+
+#define MOCK_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define MOCK_HTTP_HEADER_MAX (16 * 1024)
+#define MOCK_FRAME_MAX (16 * 1024 * 1024)
+#define MOCK_TLS_CHUNK (16 * 1024)
+#define MOCK_STATUS_SUCCESS 20000000
+#define MOCK_STATUS_IDLE_TIMEOUT 40000004
+#define MOCK_STATUS_BAD_REQUEST 40000001
+#define MOCK_STATUS_INJECTED 50000000
+
+struct MockConfig {
+  const char* address;
+  int port;
+  bool tls;
+  const char* certFile;
+  const char* keyFile;
+  int resultIntervalMs;
+  int sentenceResults;
+  int idleTimeoutMs;
+  int ttsMsPerChar;
+  int ttsChunk;
+  int ttsIntervalMs;
+  int upgradeDelayMs;
+  int latencyMs;
+  int jitterMs;
+  double rejectRate;
+  double failRate;
+  double dropRate;
+  double stallRate;
+  int faultDelayMs;
+  int statsSeconds;
+  bool verbose;
+};
+
+struct MockStats {
+  uint64_t connections;
+  uint64_t active;
+  uint64_t requests;
+  uint64_t completed;
+  uint64_t rejected;
+  uint64_t failed;
+  uint64_t dropped;
+  uint64_t stalled;
+  uint64_t idleTimeouts;
+  uint64_t bytesIn;
+  uint64_t bytesOut;
+};
+
+enum SessionState {
+  StateTlsHandshake = 0,
+  StateHttp,
+  StateWebSocket
+};
+
+enum TaskKind {
+  KindNone = 0,
+  KindRecognizer,
+  KindTranscriber,
+  KindSynthesizer,
+  KindDialog
+};
+
+enum FaultType {
+  FaultNone = 0,
+  FaultFail,
+  FaultDrop,
+  FaultStall
+};
+
+struct PendingData {
+  uint64_t dueUs;
+  std::string data;
+};
+
+struct Session {
+  uint64_t id;
+  evutil_socket_t fd;
+  SSL* ssl;
+  struct event* readEvent;
+  struct event* writeEvent;
+  struct event* tickEvent;
+  struct event* delayEvent;
+  struct evbuffer* input;
+  struct evbuffer* output;
+  SessionState state;
+  std::deque<PendingData> pending;
+  uint64_t lastDueUs;
+  // 待发送数据写完后关闭
+  bool closeAfterFlush;
+
+  TaskKind kind;
+  std::string nameSpace;
+  std::string taskId;
+  bool started;
+  bool stopped;
+  FaultType fault;
+  uint64_t faultAtUs;
+  uint64_t startedUs;
+
+  int sampleRate;
+  bool pcmAudio;
+  bool intermediateResult;
+  bool wakeWord;
+  bool wakeWordSent;
+  uint64_t audioBytes;
+  uint64_t audioBytesAtTick;
+  uint64_t lastAudioUs;
+  int resultCount;
+  int sentenceIndex;
+  bool sentenceOpen;
+  int sentenceBeginMs;
+
+  uint64_t ttsTotal;
+  uint64_t ttsSent;
+  uint64_t ttsSample;
+};
+
+static MockConfig config;
+static MockStats stats;
+static struct event_base* eventBase = NULL;
+static SSL_CTX* sslContext = NULL;
+static uint64_t randomState = 0;
+static uint64_t sessionCounter = 0;
+
+static void readCallback(evutil_socket_t fd, short what, void* arg);
+static void writeCallback(evutil_socket_t fd, short what, void* arg);
+static void tickCallback(evutil_socket_t fd, short what, void* arg);
+static void delayCallback(evutil_socket_t fd, short what, void* arg);
+
+static uint64_t nextRandom() {
+  // xorshift64*
+  randomState ^= randomState >> 12;
+  randomState ^= randomState << 25;
+  randomState ^= randomState >> 27;
+  return randomState * 2685821657736338717ULL;
+}
+
+static double randomUnit() {
+  return (double)(nextRandom() >> 11) / (double)(1ULL << 53);
+}
+
+static std::string randomHex(int length) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(length, '0');
+  for (int i = 0; i < length; i++) {
+    hex[i] = digits[nextRandom() >> 60];
+  }
+  return hex;
+}
+
+static void verboseLog(Session* session, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void verboseLog(Session* session, const char* format, ...) {
+  if (!config.verbose) {
+    return;
+  }
+  char message[1024];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(message, sizeof(message), format, args);
+  va_end(args);
+  fprintf(stderr, "[%llu] %s\n", (unsigned long long)session->id, message);
+}
+
+/*
+ * 连接管理
+ */
+static void freeSession(Session* session) {
+  if (session->readEvent) event_free(session->readEvent);
+  if (session->writeEvent) event_free(session->writeEvent);
+  if (session->tickEvent) event_free(session->tickEvent);
+  if (session->delayEvent) event_free(session->delayEvent);
+  if (session->ssl) {
+    SSL_free(session->ssl);
+  }
+  evutil_closesocket(session->fd);
+  evbuffer_free(session->input);
+  evbuffer_free(session->output);
+
+  verboseLog(session, "closed, audio %llu bytes",
+             (unsigned long long)session->audioBytes);
+  stats.active--;
+  delete session;
+}
+
+/* 直接断开, 以RST结束, 模拟网关或链路故障 */
+static void abortSession(Session* session) {
+  struct linger option;
+  option.l_onoff = 1;
+  option.l_linger = 0;
+  setsockopt(session->fd, SOL_SOCKET, SO_LINGER,
+             (const char*)&option, sizeof(option));
+  freeSession(session);
+}
+
+static bool retriable(int error) {
+  return error == EAGAIN || error == EWOULDBLOCK || error == EINTR;
+}
+
+static bool sessionFinished(Session* session) {
+  return session->closeAfterFlush && session->pending.empty() &&
+         evbuffer_get_length(session->output) == 0;
+}
+
+/*
+ * @brief 尽量写出output中的数据, 写不完时等待可写
+ * @return 连接出错返回-1
+ */
+static int flushOutput(Session* session) {
+  while (evbuffer_get_length(session->output) > 0) {
+    int written = 0;
+    if (session->ssl) {
+      size_t length = evbuffer_get_length(session->output);
+      if (length > MOCK_TLS_CHUNK) {
+        length = MOCK_TLS_CHUNK;
+      }
+      unsigned char* data = evbuffer_pullup(session->output, length);
+      written = SSL_write(session->ssl, data, (int)length);
+      if (written <= 0) {
+        int error = SSL_get_error(session->ssl, written);
+        if (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+          break;
+        }
+        return -1;
+      }
+      evbuffer_drain(session->output, written);
+    } else {
+      written = evbuffer_write(session->output, session->fd);
+      if (written < 0) {
+        if (retriable(errno)) {
+          break;
+        }
+        return -1;
+      }
+    }
+    stats.bytesOut += written;
+  }
+
+  if (evbuffer_get_length(session->output) > 0) {
+    event_add(session->writeEvent, NULL);
+  }
+  return 0;
+}
+
+/*
+ * @brief 按注入的时延发送数据, 时延内到期的数据保持原有顺序
+ * @param extraDelayMs 在--latency/--jitter之外的附加时延
+ */
+static void queueData(Session* session, const std::string& data,
+                      int extraDelayMs) {
+  uint64_t delayUs = (uint64_t)(config.latencyMs + extraDelayMs) * 1000;
+  if (config.jitterMs > 0) {
+    delayUs += nextRandom() % ((uint64_t)config.jitterMs * 1000);
+  }
+
+  if (delayUs == 0 && session->pending.empty()) {
+    evbuffer_add(session->output, data.data(), data.size());
+    return;
+  }
+
+  PendingData item;
+  item.dueUs = getMonotonicUs() + delayUs;
+  if (item.dueUs < session->lastDueUs) {
+    item.dueUs = session->lastDueUs;
+  }
+  item.data = data;
+  session->lastDueUs = item.dueUs;
+  session->pending.push_back(item);
+
+  if (session->pending.size() == 1) {
+    struct timeval tv;
+    tv.tv_sec = delayUs / 1000000;
+    tv.tv_usec = delayUs % 1000000;
+    evtimer_add(session->delayEvent, &tv);
+  }
+}
+
+static void queueFrame(Session* session, int opcode, const std::string& payload) {
+  std::string frame;
+  unsigned char header[10];
+  size_t headerSize = 2;
+  size_t length = payload.size();
+  header[0] = (unsigned char)(0x80 | opcode);
+  if (length < 126) {
+    header[1] = (unsigned char)length;
+  } else if (length < 65536) {
+    header[1] = 126;
+    header[2] = (unsigned char)(length >> 8);
+    header[3] = (unsigned char)length;
+    headerSize = 4;
+  } else {
+    header[1] = 127;
+    for (int i = 0; i < 8; i++) {
+      header[2 + i] = (unsigned char)((uint64_t)length >> (56 - 8 * i));
+    }
+    headerSize = 10;
+  }
+  frame.reserve(headerSize + length);
+  frame.append((const char*)header, headerSize);
+  frame.append(payload);
+  queueData(session, frame, 0);
+}
+
+static void sendMessage(Session* session, const char* name, int status,
+                        const char* statusText, const Json::Value& payload) {
+  Json::Value header(Json::objectValue);
+  header["namespace"] = session->nameSpace;
+  header["name"] = name;
+  header["status"] = status;
+  header["status_text"] = statusText;
+  header["message_id"] = randomHex(32);
+  header["task_id"] = session->taskId;
+
+  Json::Value root(Json::objectValue);
+  root["header"] = header;
+  root["payload"] = payload;
+
+  Json::FastWriter writer;
+  std::string text = writer.write(root);
+  if (!text.empty() && text[text.size() - 1] == '\n') {
+    text.erase(text.size() - 1);
+  }
+  queueFrame(session, 1, text);
+  verboseLog(session, "send %s", name);
+}
+
+static void sendSuccess(Session* session, const char* name,
+                        const Json::Value& payload) {
+  sendMessage(session, name, MOCK_STATUS_SUCCESS,
+              "Gateway:SUCCESS:Success.", payload);
+}
+
+static void sendFailed(Session* session, int status, const char* statusText) {
+  sendMessage(session, "TaskFailed", status, statusText,
+              Json::Value(Json::objectValue));
+  session->stopped = true;
+  session->closeAfterFlush = true;
+}
+
+/*
+ * 识别结果
+ */
+static int audioMs(Session* session) {
+  if (session->pcmAudio && session->sampleRate > 0) {
+    return (int)(session->audioBytes * 1000 /
+                 ((uint64_t)session->sampleRate * 2));
+  }
+  return (int)((getMonotonicUs() - session->startedUs) / 1000);
+}
+
+static std::string resultText(int words) {
+  std::string text;
+  char word[32];
+  for (int i = 0; i < words; i++) {
+    snprintf(word, sizeof(word), i == 0 ? "mock%d" : " mock%d", i + 1);
+    text += word;
+  }
+  return text;
+}
+
+static void sendSentenceEnd(Session* session) {
+  int now = audioMs(session);
+  int words = session->resultCount > 0 ? session->resultCount : 1;
+  Json::Value payload(Json::objectValue);
+  payload["index"] = session->sentenceIndex;
+  payload["time"] = now;
+  payload["begin_time"] = session->sentenceBeginMs;
+  payload["result"] = resultText(words);
+  payload["confidence"] = 0.9;
+  payload["status"] = 0;
+
+  Json::Value wordList(Json::arrayValue);
+  int span = (now - session->sentenceBeginMs) / words;
+  for (int i = 0; i < words; i++) {
+    Json::Value word(Json::objectValue);
+    char text[32];
+    snprintf(text, sizeof(text), "mock%d", i + 1);
+    word["text"] = text;
+    word["startTime"] = session->sentenceBeginMs + span * i;
+    word["endTime"] = session->sentenceBeginMs + span * (i + 1);
+    wordList.append(word);
+  }
+  payload["words"] = wordList;
+
+  sendSuccess(session, "SentenceEnd", payload);
+  session->sentenceOpen = false;
+  session->sentenceIndex++;
+  session->resultCount = 0;
+}
+
+static void transcriberTick(Session* session) {
+  int now = audioMs(session);
+  Json::Value payload(Json::objectValue);
+  payload["index"] = session->sentenceIndex;
+  payload["time"] = now;
+
+  if (!session->sentenceOpen) {
+    session->sentenceOpen = true;
+    session->sentenceBeginMs = now;
+    session->resultCount = 0;
+    sendSuccess(session, "SentenceBegin", payload);
+    return;
+  }
+
+  session->resultCount++;
+  if (session->resultCount >= config.sentenceResults) {
+    sendSentenceEnd(session);
+  } else {
+    payload["result"] = resultText(session->resultCount);
+    sendSuccess(session, "TranscriptionResultChanged", payload);
+  }
+}
+
+static void recognizerTick(Session* session) {
+  if (session->wakeWord && !session->wakeWordSent) {
+    Json::Value payload(Json::objectValue);
+    payload["accepted"] = true;
+    payload["known"] = true;
+    payload["user_id"] = "";
+    payload["gender"] = 0;
+    sendSuccess(session, "WakeWordVerificationCompleted", payload);
+    session->wakeWordSent = true;
+    return;
+  }
+
+  session->resultCount++;
+  if (session->intermediateResult) {
+    Json::Value payload(Json::objectValue);
+    payload["result"] = resultText(session->resultCount);
+    sendSuccess(session, "RecognitionResultChanged", payload);
+  }
+}
+
+static void sendDialogResult(Session* session, const std::string& query) {
+  Json::Value payload(Json::objectValue);
+  payload["session_id"] = session->taskId;
+  payload["action"] = "Speak";
+  payload["display_text"] = "mock answer: " + query;
+  payload["spoken_text"] = "mock answer: " + query;
+  sendSuccess(session, "DialogResultGenerated", payload);
+}
+
+/*
+ * 合成音频
+ */
+static void appendLittleEndian(std::string& data, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    data.push_back((char)((value >> (8 * i)) & 0xff));
+  }
+}
+
+static void sendWavHeader(Session* session) {
+  uint32_t dataSize = (uint32_t)session->ttsTotal;
+  std::string header("RIFF");
+  appendLittleEndian(header, 36 + dataSize, 4);
+  header.append("WAVEfmt ");
+  appendLittleEndian(header, 16, 4);
+  appendLittleEndian(header, 1, 2);
+  appendLittleEndian(header, 1, 2);
+  appendLittleEndian(header, session->sampleRate, 4);
+  appendLittleEndian(header, session->sampleRate * 2, 4);
+  appendLittleEndian(header, 2, 2);
+  appendLittleEndian(header, 16, 2);
+  header.append("data");
+  appendLittleEndian(header, dataSize, 4);
+  queueFrame(session, 2, header);
+}
+
+static void synthesizerTick(Session* session) {
+  uint64_t remaining = session->ttsTotal - session->ttsSent;
+  size_t length = (size_t)config.ttsChunk;
+  if (remaining < length) {
+    length = (size_t)remaining;
+  }
+  length &= ~(size_t)1;
+
+  std::string chunk(length, '\0');
+  for (size_t i = 0; i + 1 < length; i += 2) {
+    double t = (double)session->ttsSample++ / session->sampleRate;
+    int16_t sample = (int16_t)(3000.0 * sin(2.0 * M_PI * 440.0 * t));
+    chunk[i] = (char)(sample & 0xff);
+    chunk[i + 1] = (char)((sample >> 8) & 0xff);
+  }
+  if (length > 0) {
+    queueFrame(session, 2, chunk);
+  }
+  session->ttsSent += length;
+
+  if (session->ttsSent >= session->ttsTotal) {
+    sendSuccess(session, "SynthesisCompleted", Json::Value(Json::objectValue));
+    session->stopped = true;
+    stats.completed++;
+  }
+}
+
+static size_t utf8Length(const std::string& text) {
+  size_t count = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (((unsigned char)text[i] & 0xc0) != 0x80) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void startTick(Session* session, int intervalMs) {
+  struct timeval tv;
+  tv.tv_sec = intervalMs / 1000;
+  tv.tv_usec = (intervalMs % 1000) * 1000;
+  evtimer_add(session->tickEvent, &tv);
+}
+
+/*
+ * 指令处理
+ */
+static int intField(const Json::Value& object, const char* key, int value) {
+  if (object.isObject() && object[key].isInt()) {
+    return object[key].asInt();
+  }
+  return value;
+}
+
+static bool boolField(const Json::Value& object, const char* key) {
+  return object.isObject() && object[key].isBool() && object[key].asBool();
+}
+
+static std::string stringField(const Json::Value& object, const char* key,
+                               const char* value) {
+  if (object.isObject() && object[key].isString()) {
+    return object[key].asString();
+  }
+  return value;
+}
+
+static TaskKind kindOfNamespace(const std::string& nameSpace) {
+  if (nameSpace == "SpeechRecognizer") {
+    return KindRecognizer;
+  } else if (nameSpace == "SpeechTranscriber") {
+    return KindTranscriber;
+  } else if (nameSpace == "SpeechSynthesizer" ||
+             nameSpace == "SpeechLongSynthesizer") {
+    return KindSynthesizer;
+  } else if (nameSpace.compare(0, 15, "DialogAssistant") == 0) {
+    return KindDialog;
+  }
+  return KindNone;
+}
+
+static void handleStart(Session* session, const std::string& name,
+                        const Json::Value& payload) {
+  stats.requests++;
+  session->kind = kindOfNamespace(session->nameSpace);
+  if (session->kind == KindNone) {
+    sendFailed(session, MOCK_STATUS_BAD_REQUEST,
+               "Gateway:NAMESPACE_NOT_SUPPORTED:Unsupported namespace.");
+    return;
+  }
+
+  session->sampleRate = intField(payload, "sample_rate", 16000);
+  if (session->sampleRate <= 0) {
+    session->sampleRate = 16000;
+  }
+  std::string format = stringField(payload, "format", "pcm");
+  session->pcmAudio = (format == "pcm" || format == "wav");
+  session->intermediateResult =
+      boolField(payload, "enable_intermediate_result");
+  session->wakeWord =
+      boolField(payload, "enable_wake_word_verification");
+
+  double dice = randomUnit();
+  if (dice < config.failRate) {
+    session->fault = FaultFail;
+  } else if (dice < config.failRate + config.dropRate) {
+    session->fault = FaultDrop;
+    session->faultAtUs = getMonotonicUs() +
+        nextRandom() % ((uint64_t)config.faultDelayMs * 1000 + 1);
+  } else if (dice < config.failRate + config.dropRate + config.stallRate) {
+    session->fault = FaultStall;
+    stats.stalled++;
+    verboseLog(session, "stall injected");
+    return;
+  }
+
+  if (session->fault == FaultFail) {
+    stats.failed++;
+    sendFailed(session, MOCK_STATUS_INJECTED,
+               "Gateway:SERVER_ERROR:Failure injected by mock gateway.");
+    return;
+  }
+
+  session->started = true;
+  session->startedUs = getMonotonicUs();
+  session->lastAudioUs = session->startedUs;
+
+  if (name == "ExecuteDialog") {
+    sendDialogResult(session, stringField(payload, "query", ""));
+    session->stopped = true;
+    stats.completed++;
+    return;
+  }
+
+  if (session->kind == KindSynthesizer) {
+    std::string text = stringField(payload, "text", "");
+    session->ttsTotal = (uint64_t)utf8Length(text) * config.ttsMsPerChar *
+                        session->sampleRate / 1000 * 2;
+    if (format == "wav") {
+      sendWavHeader(session);
+    }
+    startTick(session, config.ttsIntervalMs);
+    return;
+  }
+
+  sendSuccess(session, session->kind == KindTranscriber ?
+                  "TranscriptionStarted" : "RecognitionStarted",
+              Json::Value(Json::objectValue));
+  startTick(session, config.resultIntervalMs);
+}
+
+static void handleStop(Session* session) {
+  if (!session->started || session->stopped) {
+    return;
+  }
+  session->stopped = true;
+  event_del(session->tickEvent);
+
+  if (session->kind == KindTranscriber) {
+    if (session->sentenceOpen) {
+      sendSentenceEnd(session);
+    }
+    sendSuccess(session, "TranscriptionCompleted",
+                Json::Value(Json::objectValue));
+  } else {
+    Json::Value payload(Json::objectValue);
+    payload["result"] = resultText(session->resultCount > 0 ?
+                                   session->resultCount : 1);
+    sendSuccess(session, "RecognitionCompleted", payload);
+    if (session->kind == KindDialog) {
+      sendDialogResult(session, payload["result"].asString());
+    }
+  }
+  stats.completed++;
+}
+
+static void handleText(Session* session, const std::string& text) {
+  Json::Reader reader;
+  Json::Value root;
+  if (!reader.parse(text, root) || !root.isObject() ||
+      !root["header"].isObject()) {
+    verboseLog(session, "invalid message: %s", text.c_str());
+    return;
+  }
+
+  const Json::Value& header = root["header"];
+  std::string name = stringField(header, "name", "");
+  verboseLog(session, "recv %s", name.c_str());
+  if (session->fault == FaultStall) {
+    return;
+  }
+
+  if (name.compare(0, 5, "Start") == 0 || name == "ExecuteDialog") {
+    if (session->started || session->kind != KindNone) {
+      return;
+    }
+    session->nameSpace = stringField(header, "namespace", "");
+    session->taskId = stringField(header, "task_id", "");
+    handleStart(session, name, root["payload"]);
+  } else if (name == "StopTranscription" || name == "StopRecognition") {
+    handleStop(session);
+  }
+}
+
+/*
+ * 协议解析
+ */
+static void handleUpgrade(Session* session) {
+  struct evbuffer_ptr end =
+      evbuffer_search(session->input, "\r\n\r\n", 4, NULL);
+  if (end.pos < 0) {
+    if (evbuffer_get_length(session->input) > MOCK_HTTP_HEADER_MAX) {
+      session->closeAfterFlush = true;
+    }
+    return;
+  }
+
+  std::string request((size_t)end.pos + 4, '\0');
+  evbuffer_remove(session->input, &request[0], request.size());
+
+  std::string key;
+  const char* field = strcasestr(request.c_str(), "\nSec-WebSocket-Key:");
+  if (field) {
+    field += strlen("\nSec-WebSocket-Key:");
+    while (*field == ' ') field++;
+    key.assign(field, strcspn(field, "\r\n"));
+  }
+
+  if (request.compare(0, 4, "GET ") != 0 || key.empty() ||
+      randomUnit() < config.rejectRate) {
+    static const char body[] =
+        "Meta:ACCESS_DENIED:The token is rejected by mock gateway!";
+    char response[256];
+    snprintf(response, sizeof(response),
+             "HTTP/1.1 403 Forbidden\r\n"
+             "Content-Length: %d\r\n"
+             "Connection: close\r\n\r\n%s",
+             (int)strlen(body), body);
+    queueData(session, response, config.upgradeDelayMs);
+    session->closeAfterFlush = true;
+    stats.rejected++;
+    verboseLog(session, "upgrade rejected");
+    return;
+  }
+
+  unsigned char digest[SHA_DIGEST_LENGTH];
+  std::string source = key + MOCK_WS_GUID;
+  SHA1((const unsigned char*)source.data(), source.size(), digest);
+  unsigned char accept[64];
+  EVP_EncodeBlock(accept, digest, SHA_DIGEST_LENGTH);
+
+  char response[256];
+  snprintf(response, sizeof(response),
+           "HTTP/1.1 101 Switching Protocols\r\n"
+           "Connection: upgrade\r\n"
+           "upgrade: websocket\r\n"
+           "sec-websocket-accept: %s\r\n\r\n",
+           accept);
+  queueData(session, response, config.upgradeDelayMs);
+  session->state = StateWebSocket;
+  verboseLog(session, "upgraded");
+}
+
+static void handleFrames(Session* session) {
+  while (!session->closeAfterFlush) {
+    size_t available = evbuffer_get_length(session->input);
+    if (available < 2) {
+      return;
+    }
+
+    unsigned char header[14];
+    evbuffer_copyout(session->input, header,
+                     available < sizeof(header) ? available : sizeof(header));
+    int opcode = header[0] & 0x0f;
+    bool masked = (header[1] & 0x80) != 0;
+    uint64_t length = header[1] & 0x7f;
+    size_t headerSize = 2;
+    if (length == 126) {
+      if (available < 4) return;
+      length = ((uint64_t)header[2] << 8) | header[3];
+      headerSize = 4;
+    } else if (length == 127) {
+      if (available < 10) return;
+      length = 0;
+      for (int i = 0; i < 8; i++) {
+        length = (length << 8) | header[2 + i];
+      }
+      headerSize = 10;
+    }
+    const unsigned char* mask = header + headerSize;
+    if (masked) {
+      headerSize += 4;
+    }
+    if (length > MOCK_FRAME_MAX) {
+      session->closeAfterFlush = true;
+      return;
+    }
+    if (available < headerSize + length) {
+      return;
+    }
+
+    unsigned char maskKey[4] = {0, 0, 0, 0};
+    if (masked) {
+      memcpy(maskKey, mask, 4);
+    }
+    evbuffer_drain(session->input, headerSize);
+    std::string payload((size_t)length, '\0');
+    if (length > 0) {
+      evbuffer_remove(session->input, &payload[0], (size_t)length);
+    }
+    for (size_t i = 0; i < payload.size(); i++) {
+      payload[i] ^= maskKey[i & 3];
+    }
+
+    switch (opcode) {
+      case 1:
+        handleText(session, payload);
+        break;
+      case 2:
+        session->audioBytes += payload.size();
+        session->lastAudioUs = getMonotonicUs();
+        break;
+      case 8:
+        queueFrame(session, 8, payload.substr(0, 2));
+        session->closeAfterFlush = true;
+        break;
+      case 9:
+        queueFrame(session, 10, payload);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/*
+ * 事件回调
+ */
+static void processSession(Session* session) {
+  if (session->state == StateHttp) {
+    handleUpgrade(session);
+  }
+  if (session->state == StateWebSocket) {
+    handleFrames(session);
+  }
+  if (flushOutput(session) < 0 || sessionFinished(session)) {
+    freeSession(session);
+  }
+}
+
+static int tlsHandshake(Session* session) {
+  int ret = SSL_accept(session->ssl);
+  if (ret == 1) {
+    session->state = StateHttp;
+    return 0;
+  }
+  int error = SSL_get_error(session->ssl, ret);
+  if (error == SSL_ERROR_WANT_READ) {
+    return 0;
+  } else if (error == SSL_ERROR_WANT_WRITE) {
+    event_add(session->writeEvent, NULL);
+    return 0;
+  }
+  verboseLog(session, "tls handshake failed");
+  return -1;
+}
+
+static void readCallback(evutil_socket_t fd, short what, void* arg) {
+  Session* session = (Session*)arg;
+
+  if (session->state == StateTlsHandshake) {
+    if (tlsHandshake(session) < 0) {
+      freeSession(session);
+      return;
+    }
+    if (session->state == StateTlsHandshake) {
+      return;
+    }
+  }
+
+  bool closed = false;
+  if (session->ssl) {
+    char buffer[MOCK_TLS_CHUNK];
+    for (;;) {
+      int received = SSL_read(session->ssl, buffer, sizeof(buffer));
+      if (received > 0) {
+        evbuffer_add(session->input, buffer, received);
+        stats.bytesIn += received;
+        continue;
+      }
+      int error = SSL_get_error(session->ssl, received);
+      if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) {
+        closed = true;
+      }
+      break;
+    }
+  } else {
+    for (;;) {
+      int received = evbuffer_read(session->input, fd, 64 * 1024);
+      if (received > 0) {
+        stats.bytesIn += received;
+        continue;
+      }
+      if (received == 0 ||
+          !retriable(errno)) {
+        closed = true;
+      }
+      break;
+    }
+  }
+
+  if (closed) {
+    // 对端已关闭或连接出错
+    freeSession(session);
+    return;
+  }
+  processSession(session);
+}
+
+static void writeCallback(evutil_socket_t fd, short what, void* arg) {
+  Session* session = (Session*)arg;
+
+  if (session->state == StateTlsHandshake) {
+    if (tlsHandshake(session) < 0) {
+      freeSession(session);
+    }
+    return;
+  }
+
+  if (flushOutput(session) < 0 || sessionFinished(session)) {
+    freeSession(session);
+  }
+}
+
+static void delayCallback(evutil_socket_t fd, short what, void* arg) {
+  Session* session = (Session*)arg;
+  uint64_t now = getMonotonicUs();
+
+  while (!session->pending.empty() && session->pending.front().dueUs <= now) {
+    const std::string& data = session->pending.front().data;
+    evbuffer_add(session->output, data.data(), data.size());
+    session->pending.pop_front();
+  }
+  if (!session->pending.empty()) {
+    uint64_t delayUs = session->pending.front().dueUs - now;
+    struct timeval tv;
+    tv.tv_sec = delayUs / 1000000;
+    tv.tv_usec = delayUs % 1000000;
+    evtimer_add(session->delayEvent, &tv);
+  }
+
+  if (flushOutput(session) < 0 || sessionFinished(session)) {
+    freeSession(session);
+  }
+}
+
+static void tickCallback(evutil_socket_t fd, short what, void* arg) {
+  Session* session = (Session*)arg;
+  uint64_t now = getMonotonicUs();
+
+  if (session->fault == FaultDrop && now >= session->faultAtUs) {
+    stats.dropped++;
+    verboseLog(session, "drop injected");
+    abortSession(session);
+    return;
+  }
+
+  if (session->stopped) {
+    event_del(session->tickEvent);
+  } else if (session->kind == KindSynthesizer) {
+    synthesizerTick(session);
+  } else if (session->audioBytes != session->audioBytesAtTick) {
+    session->audioBytesAtTick = session->audioBytes;
+    if (session->kind == KindTranscriber) {
+      transcriberTick(session);
+    } else {
+      recognizerTick(session);
+    }
+  } else if (config.idleTimeoutMs > 0 &&
+             now - session->lastAudioUs >= (uint64_t)config.idleTimeoutMs * 1000) {
+    stats.idleTimeouts++;
+    sendFailed(session, MOCK_STATUS_IDLE_TIMEOUT,
+               "Gateway:IDLE_TIMEOUT:Websocket session is idle for too long time!");
+    event_del(session->tickEvent);
+  }
+
+  if (flushOutput(session) < 0 || sessionFinished(session)) {
+    freeSession(session);
+  }
+}
+
+static void acceptCallback(struct evconnlistener* listener,
+                           evutil_socket_t fd, struct sockaddr* address,
+                           int length, void* arg) {
+  int noDelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+             (const char*)&noDelay, sizeof(noDelay));
+
+  Session* session = new Session();
+  session->id = ++sessionCounter;
+  session->fd = fd;
+  session->ssl = NULL;
+  session->input = evbuffer_new();
+  session->output = evbuffer_new();
+  session->state = StateHttp;
+  session->lastDueUs = 0;
+  session->closeAfterFlush = false;
+  session->kind = KindNone;
+  session->started = false;
+  session->stopped = false;
+  session->fault = FaultNone;
+  session->faultAtUs = 0;
+  session->startedUs = 0;
+  session->sampleRate = 16000;
+  session->pcmAudio = true;
+  session->intermediateResult = false;
+  session->wakeWord = false;
+  session->wakeWordSent = false;
+  session->audioBytes = 0;
+  session->audioBytesAtTick = 0;
+  session->lastAudioUs = 0;
+  session->resultCount = 0;
+  session->sentenceIndex = 1;
+  session->sentenceOpen = false;
+  session->sentenceBeginMs = 0;
+  session->ttsTotal = 0;
+  session->ttsSent = 0;
+  session->ttsSample = 0;
+
+  session->readEvent = event_new(eventBase, fd, EV_READ | EV_PERSIST,
+                                 readCallback, session);
+  session->writeEvent = event_new(eventBase, fd, EV_WRITE,
+                                  writeCallback, session);
+  session->tickEvent = event_new(eventBase, -1, EV_PERSIST,
+                                 tickCallback, session);
+  session->delayEvent = evtimer_new(eventBase, delayCallback, session);
+
+  stats.connections++;
+  stats.active++;
+
+  if (sslContext) {
+    session->ssl = SSL_new(sslContext);
+    SSL_set_fd(session->ssl, fd);
+    SSL_set_mode(session->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                               SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    session->state = StateTlsHandshake;
+  }
+
+  event_add(session->readEvent, NULL);
+  verboseLog(session, "accepted");
+}
+
+/*
+ * TLS
+ */
+static int useSelfSignedCertificate(SSL_CTX* context) {
+  int ret = -1;
+  EVP_PKEY* key = NULL;
+  X509* certificate = NULL;
+  EVP_PKEY_CTX* keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+
+  if (keyContext == NULL || EVP_PKEY_keygen_init(keyContext) <= 0 ||
+      EVP_PKEY_CTX_set_rsa_keygen_bits(keyContext, 2048) <= 0 ||
+      EVP_PKEY_keygen(keyContext, &key) <= 0) {
+    goto done;
+  }
+
+  certificate = X509_new();
+  if (certificate == NULL) {
+    goto done;
+  }
+  X509_set_version(certificate, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+  X509_gmtime_adj(X509_get_notBefore(certificate), 0);
+  X509_gmtime_adj(X509_get_notAfter(certificate), 365L * 24 * 3600);
+  X509_set_pubkey(certificate, key);
+  {
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               (const unsigned char*)"localhost", -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+  }
+  if (X509_sign(certificate, key, EVP_sha256()) <= 0 ||
+      SSL_CTX_use_certificate(context, certificate) != 1 ||
+      SSL_CTX_use_PrivateKey(context, key) != 1) {
+    goto done;
+  }
+  ret = 0;
+
+done:
+  if (certificate) X509_free(certificate);
+  if (key) EVP_PKEY_free(key);
+  if (keyContext) EVP_PKEY_CTX_free(keyContext);
+  return ret;
+}
+
+static SSL_CTX* createSslContext() {
+  SSL_library_init();
+  SSL_load_error_strings();
+
+  SSL_CTX* context = SSL_CTX_new(SSLv23_server_method());
+  if (context == NULL) {
+    return NULL;
+  }
+
+  int ret = 0;
+  if (config.certFile) {
+    if (SSL_CTX_use_certificate_chain_file(context, config.certFile) != 1 ||
+        SSL_CTX_use_PrivateKey_file(context, config.keyFile,
+                                    SSL_FILETYPE_PEM) != 1) {
+      ret = -1;
+    }
+  } else {
+    ret = useSelfSignedCertificate(context);
+  }
+
+  if (ret < 0) {
+    ERR_print_errors_fp(stderr);
+    SSL_CTX_free(context);
+    return NULL;
+  }
+  return context;
+}
+
+/*
+ * 统计
+ */
+static void printStats() {
+  fprintf(stdout,
+          "connections:%llu active:%llu requests:%llu completed:%llu "
+          "rejected:%llu failed:%llu dropped:%llu stalled:%llu "
+          "idle_timeouts:%llu bytes_in:%llu bytes_out:%llu\n",
+          (unsigned long long)stats.connections,
+          (unsigned long long)stats.active,
+          (unsigned long long)stats.requests,
+          (unsigned long long)stats.completed,
+          (unsigned long long)stats.rejected,
+          (unsigned long long)stats.failed,
+          (unsigned long long)stats.dropped,
+          (unsigned long long)stats.stalled,
+          (unsigned long long)stats.idleTimeouts,
+          (unsigned long long)stats.bytesIn,
+          (unsigned long long)stats.bytesOut);
+  fflush(stdout);
+}
+
+static void statsCallback(evutil_socket_t fd, short what, void* arg) {
+  printStats();
+}
+
+static void signalCallback(evutil_socket_t fd, short what, void* arg) {
+  event_base_loopexit(eventBase, NULL);
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [-a address] [-p port] [--tls] [--cert file --key file]\n"
+          "  [--result-interval ms] [--sentence-results n] [--idle-timeout ms]\n"
+          "  [--tts-ms-per-char ms] [--tts-chunk bytes] [--tts-interval ms]\n"
+          "  [--upgrade-delay ms] [--latency ms] [--jitter ms]\n"
+          "  [--reject-rate r] [--fail-rate r] [--drop-rate r] [--stall-rate r]\n"
+          "  [--fault-delay ms] [--seed n] [--stats s] [-v]\n",
+          program);
+}
+
+enum {
+  OptionTls = 256,
+  OptionCert,
+  OptionKey,
+  OptionResultInterval,
+  OptionSentenceResults,
+  OptionIdleTimeout,
+  OptionTtsMsPerChar,
+  OptionTtsChunk,
+  OptionTtsInterval,
+  OptionUpgradeDelay,
+  OptionLatency,
+  OptionJitter,
+  OptionRejectRate,
+  OptionFailRate,
+  OptionDropRate,
+  OptionStallRate,
+  OptionFaultDelay,
+  OptionSeed,
+  OptionStats
+};
+
+int main(int argc, char* argv[]) {
+  static const struct option options[] = {
+    {"tls", no_argument, NULL, OptionTls},
+    {"cert", required_argument, NULL, OptionCert},
+    {"key", required_argument, NULL, OptionKey},
+    {"result-interval", required_argument, NULL, OptionResultInterval},
+    {"sentence-results", required_argument, NULL, OptionSentenceResults},
+    {"idle-timeout", required_argument, NULL, OptionIdleTimeout},
+    {"tts-ms-per-char", required_argument, NULL, OptionTtsMsPerChar},
+    {"tts-chunk", required_argument, NULL, OptionTtsChunk},
+    {"tts-interval", required_argument, NULL, OptionTtsInterval},
+    {"upgrade-delay", required_argument, NULL, OptionUpgradeDelay},
+    {"latency", required_argument, NULL, OptionLatency},
+    {"jitter", required_argument, NULL, OptionJitter},
+    {"reject-rate", required_argument, NULL, OptionRejectRate},
+    {"fail-rate", required_argument, NULL, OptionFailRate},
+    {"drop-rate", required_argument, NULL, OptionDropRate},
+    {"stall-rate", required_argument, NULL, OptionStallRate},
+    {"fault-delay", required_argument, NULL, OptionFaultDelay},
+    {"seed", required_argument, NULL, OptionSeed},
+    {"stats", required_argument, NULL, OptionStats},
+    {NULL, 0, NULL, 0}
+  };
+
+  memset(&config, 0, sizeof(config));
+  memset(&stats, 0, sizeof(stats));
+  config.address = "127.0.0.1";
+  config.port = 8101;
+  config.resultIntervalMs = 100;
+  config.sentenceResults = 5;
+  config.idleTimeoutMs = 10000;
+  config.ttsMsPerChar = 200;
+  config.ttsChunk = 3200;
+  config.ttsIntervalMs = 20;
+  config.faultDelayMs = 1000;
+  randomState = (uint64_t)time(NULL) ^ ((uint64_t)getMonotonicUs() << 16);
+
+  int option = 0;
+  while ((option = getopt_long(argc, argv, "a:p:vh", options, NULL)) != -1) {
+    switch (option) {
+      case 'a': config.address = optarg; break;
+      case 'p': config.port = atoi(optarg); break;
+      case 'v': config.verbose = true; break;
+      case OptionTls: config.tls = true; break;
+      case OptionCert: config.certFile = optarg; config.tls = true; break;
+      case OptionKey: config.keyFile = optarg; break;
+      case OptionResultInterval: config.resultIntervalMs = atoi(optarg); break;
+      case OptionSentenceResults: config.sentenceResults = atoi(optarg); break;
+      case OptionIdleTimeout: config.idleTimeoutMs = atoi(optarg); break;
+      case OptionTtsMsPerChar: config.ttsMsPerChar = atoi(optarg); break;
+      case OptionTtsChunk: config.ttsChunk = atoi(optarg); break;
+      case OptionTtsInterval: config.ttsIntervalMs = atoi(optarg); break;
+      case OptionUpgradeDelay: config.upgradeDelayMs = atoi(optarg); break;
+      case OptionLatency: config.latencyMs = atoi(optarg); break;
+      case OptionJitter: config.jitterMs = atoi(optarg); break;
+      case OptionRejectRate: config.rejectRate = atof(optarg); break;
+      case OptionFailRate: config.failRate = atof(optarg); break;
+      case OptionDropRate: config.dropRate = atof(optarg); break;
+      case OptionStallRate: config.stallRate = atof(optarg); break;
+      case OptionFaultDelay: config.faultDelayMs = atoi(optarg); break;
+      case OptionSeed: randomState = strtoull(optarg, NULL, 10); break;
+      case OptionStats: config.statsSeconds = atoi(optarg); break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (config.port <= 0 || config.port > 65535 ||
+      config.resultIntervalMs <= 0 || config.sentenceResults <= 0 ||
+      config.ttsChunk < 2 || config.ttsIntervalMs <= 0 ||
+      config.faultDelayMs < 0 || (config.certFile && !config.keyFile)) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (randomState == 0) {
+    randomState = 1;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+  if (config.tls) {
+    sslContext = createSslContext();
+    if (sslContext == NULL) {
+      fprintf(stderr, "TLS setup failed.\n");
+      return 1;
+    }
+  }
+
+  eventBase = event_base_new();
+  if (eventBase == NULL) {
+    fprintf(stderr, "event_base_new failed.\n");
+    return 1;
+  }
+
+  char endpoint[128];
+  snprintf(endpoint, sizeof(endpoint), "%s:%d", config.address, config.port);
+  struct sockaddr_storage address;
+  int addressLength = sizeof(address);
+  memset(&address, 0, sizeof(address));
+  if (evutil_parse_sockaddr_port(endpoint, (struct sockaddr*)&address,
+                                 &addressLength) != 0) {
+    fprintf(stderr, "Invalid address %s.\n", endpoint);
+    return 1;
+  }
+
+  struct evconnlistener* listener = evconnlistener_new_bind(
+      eventBase, acceptCallback, NULL,
+      LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, 1024,
+      (struct sockaddr*)&address, addressLength);
+  if (listener == NULL) {
+    fprintf(stderr, "Listen on %s failed.\n", endpoint);
+    return 1;
+  }
+
+  struct event* interruptEvent =
+      evsignal_new(eventBase, SIGINT, signalCallback, NULL);
+  struct event* terminateEvent =
+      evsignal_new(eventBase, SIGTERM, signalCallback, NULL);
+  event_add(interruptEvent, NULL);
+  event_add(terminateEvent, NULL);
+
+  struct event* statsEvent = NULL;
+  if (config.statsSeconds > 0) {
+    struct timeval tv;
+    tv.tv_sec = config.statsSeconds;
+    tv.tv_usec = 0;
+    statsEvent = event_new(eventBase, -1, EV_PERSIST, statsCallback, NULL);
+    evtimer_add(statsEvent, &tv);
+  }
+
+  fprintf(stdout, "mock gateway listening on %s://%s/ws/v1\n",
+          config.tls ? "wss" : "ws", endpoint);
+  fflush(stdout);
+
+  event_base_dispatch(eventBase);
+
+  printStats();
+
+  // 退出时不逐个释放连接, 由进程退出回收
+  if (statsEvent) event_free(statsEvent);
+  event_free(interruptEvent);
+  event_free(terminateEvent);
+  evconnlistener_free(listener);
+  event_base_free(eventBase);
+  if (sslContext) {
+    SSL_CTX_free(sslContext);
+  }
+  return 0;
+}
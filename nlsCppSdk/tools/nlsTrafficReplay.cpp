@@ -0,0 +1,313 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * 回放NlsClient::setTrafficCapture录制的.nlsrec文件, 不访问网络.
+ * 录制的下行数据经ConnectNode::gatewayResponse/webSocketResponse送入
+ * 与线上相同的解析及回调分发路径, 用于复现问题及性能分析
+ * (如 perf record -- nlsTrafficReplay --speed 0 --repeat 1000 x.nlsrec).
+ *
+ * 用法: nlsTrafficReplay [选项] <文件.nlsrec>...
+ *   --speed <x>    回放倍速, 1为录制时的节奏(默认), 0为尽快
+ *   --repeat <n>   每个文件的回放次数, 默认1
+ *   --log <文件>   SDK日志输出, 默认不输出
+ *   -v             输出每个回调事件
+ *
+ * 每个文件输出录制信息、回调事件数, 以及扣除等待后的解析分发耗时.
+ * 有文件无法读取或回放中未收到任何事件时返回1.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "nlsClient.h"
+#include "nlsEvent.h"
+#include "connectNode.h"
+#include "trafficCapture.h"
+#include "utility.h"
+#include "iNlsRequestParam.h"
+#include "speechTranscriberRequest.h"
+#include "speechRecognizerRequest.h"
+#include "speechSynthesizerRequest.h"
+#include "dialogAssistantRequest.h"
+
+using namespace AlibabaNls;
+using AlibabaNls::utility::getMonotonicUs;
+
+struct ReplayState {
+  bool verbose;
+  uint64_t beginUs;
+  size_t events;
+  size_t closed;
+  std::map<int, size_t> eventTypes;
+};
+
+static const char* modeName(int mode) {
+  switch (mode) {
+    case TypeAsr: return "recognizer";
+    case TypeRealTime: return "transcriber";
+    case TypeTts: return "synthesizer";
+    case TypeDialog: return "dialog";
+    default: return "unknown";
+  }
+}
+
+static void onEvent(NlsEvent* ev, void* arg) {
+  ReplayState* state = (ReplayState*)arg;
+  state->events++;
+  state->eventTypes[ev->getMsgType()]++;
+  if (ev->getMsgType() == NlsEvent::Close) {
+    state->closed++;
+  }
+
+  if (state->verbose) {
+    std::string text;
+    if (ev->getMsgType() == NlsEvent::Binary) {
+      int size = 0;
+      ev->getBinaryDataBuffer(&size);
+      char tmp[32];
+      snprintf(tmp, sizeof(tmp), "<%d bytes>", size);
+      text = tmp;
+    } else {
+      const char* response = ev->getAllResponse();
+      text = response ? response : "";
+      if (text.size() > 120) {
+        text = text.substr(0, 117) + "...";
+      }
+    }
+    printf("  %9.3fms  type:%-2d %s\n",
+           (getMonotonicUs() - state->beginUs) / 1000.0,
+           (int)ev->getMsgType(), text.c_str());
+  }
+}
+
+static INlsRequest* createRequest(int mode, ReplayState* state) {
+  switch (mode) {
+    case TypeAsr: {
+      SpeechRecognizerRequest* request = new SpeechRecognizerRequest();
+      request->setOnTaskFailed(onEvent, state);
+      request->setOnRecognitionStarted(onEvent, state);
+      request->setOnRecognitionResultChanged(onEvent, state);
+      request->setOnRecognitionCompleted(onEvent, state);
+      request->setOnChannelClosed(onEvent, state);
+      return request;
+    }
+    case TypeRealTime: {
+      SpeechTranscriberRequest* request = new SpeechTranscriberRequest();
+      request->setOnTaskFailed(onEvent, state);
+      request->setOnTranscriptionStarted(onEvent, state);
+      request->setOnSentenceBegin(onEvent, state);
+      request->setOnTranscriptionResultChanged(onEvent, state);
+      request->setOnSentenceEnd(onEvent, state);
+      request->setOnTranscriptionCompleted(onEvent, state);
+      request->setOnSentenceSemantics(onEvent, state);
+      request->setOnChannelClosed(onEvent, state);
+      return request;
+    }
+    case TypeTts: {
+      SpeechSynthesizerRequest* request = new SpeechSynthesizerRequest(0);
+      request->setOnTaskFailed(onEvent, state);
+      request->setOnSynthesisCompleted(onEvent, state);
+      request->setOnBinaryDataReceived(onEvent, state);
+      request->setOnMetaInfo(onEvent, state);
+      request->setOnChannelClosed(onEvent, state);
+      return request;
+    }
+    case TypeDialog: {
+      DialogAssistantRequest* request = new DialogAssistantRequest(0);
+      request->setOnTaskFailed(onEvent, state);
+      request->setOnRecognitionStarted(onEvent, state);
+      request->setOnRecognitionResultChanged(onEvent, state);
+      request->setOnRecognitionCompleted(onEvent, state);
+      request->setOnDialogResultGenerated(onEvent, state);
+      request->setOnWakeWordVerificationCompleted(onEvent, state);
+      request->setOnChannelClosed(onEvent, state);
+      return request;
+    }
+    default:
+      return NULL;
+  }
+}
+
+/*
+ * 回放一遍, 返回扣除等待后的耗时(us), 失败返回-1.
+ * 升级应答经gatewayResponse, 之后的数据经webSocketResponse.
+ */
+static int64_t replayOnce(TrafficReplayer* replayer, ReplayState* state) {
+  INlsRequest* request = createRequest(replayer->getMode(), state);
+  if (request == NULL) {
+    fprintf(stderr, "unsupported request mode %d\n", replayer->getMode());
+    return -1;
+  }
+  request->getRequestParam()->setNlsRequestType(
+      (NlsRequestType)replayer->getRequestType());
+
+  ConnectNode* node = request->getConnectNode();
+  replayer->rewind();
+  node->setReplaySource(replayer);
+
+  state->beginUs = getMonotonicUs();
+  int ret = 1;
+  while (ret > 0 && !replayer->finished()) {
+    ret = node->gatewayResponse();
+  }
+  if (ret != 0) {
+    fprintf(stderr, "upgrade response replay failed: %s\n",
+            node->getErrorMsg());
+  } else {
+    while (!replayer->finished() && node->webSocketResponse() == 0) {
+    }
+  }
+  int64_t busyUs =
+      (int64_t)(getMonotonicUs() - state->beginUs - replayer->getWaitUs());
+
+  // 无连接, 析构前直接置为结束状态
+  node->setReplaySource(NULL);
+  node->setConnectNodeStatus(NodeInvalid);
+  node->setExitStatus(ExitStopped);
+  delete request;
+
+  return ret == 0 ? busyUs : -1;
+}
+
+static int replayFile(const char* path, double speed, int repeat,
+                      bool verbose) {
+  TrafficReplayer replayer;
+  if (replayer.load(path) != 0) {
+    fprintf(stderr, "%s: load failed\n", path);
+    return -1;
+  }
+  replayer.setSpeed(speed);
+
+  time_t start = (time_t)replayer.getStartTime();
+  char stamp[32] = {0};
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&start));
+  printf("%s\n  %s request recorded at %s, %.1fms, "
+         "received %zu chunks/%zu bytes, sent %zu chunks/%zu bytes\n",
+         path, modeName(replayer.getMode()), stamp,
+         replayer.getDurationUs() / 1000.0,
+         replayer.getReceivedChunks(), replayer.getReceivedBytes(),
+         replayer.getSentChunks(), replayer.getSentBytes());
+
+  ReplayState state;
+  state.verbose = verbose;
+  state.events = 0;
+  state.closed = 0;
+
+  std::vector<int64_t> busy;
+  for (int i = 0; i < repeat; i++) {
+    state.verbose = verbose && i == 0;
+    int64_t busyUs = replayOnce(&replayer, &state);
+    if (busyUs < 0) {
+      return -1;
+    }
+    busy.push_back(busyUs);
+  }
+
+  std::sort(busy.begin(), busy.end());
+  double totalUs = 0;
+  for (size_t i = 0; i < busy.size(); i++) {
+    totalUs += busy[i];
+  }
+  double meanUs = totalUs / busy.size();
+  printf("  %d pass(es), %zu events/pass, closed %zu/%d\n",
+         repeat, state.events / repeat, state.closed, repeat);
+  for (std::map<int, size_t>::iterator it = state.eventTypes.begin();
+       it != state.eventTypes.end(); ++it) {
+    printf("    type %-2d x%zu\n", it->first, it->second / repeat);
+  }
+  printf("  parse+dispatch per pass: mean %.1fus, min %lldus, "
+         "p50 %lldus, max %lldus, %.2fus/chunk\n",
+         meanUs, (long long)busy.front(),
+         (long long)busy[busy.size() / 2], (long long)busy.back(),
+         replayer.getReceivedChunks() ?
+             meanUs / replayer.getReceivedChunks() : 0.0);
+
+  return state.events > 0 ? 0 : -1;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr,
+      "Usage: %s [options] <file.nlsrec>...\n"
+      "  --speed <x>    replay speed, 1 = recorded pacing (default), "
+      "0 = as fast as possible\n"
+      "  --repeat <n>   passes per file, default 1\n"
+      "  --log <file>   SDK log output\n"
+      "  -v             print every callback event (first pass)\n",
+      program);
+}
+
+int main(int argc, char* argv[]) {
+  double speed = 1.0;
+  int repeat = 1;
+  const char* logFile = NULL;
+  bool verbose = false;
+
+  static struct option options[] = {
+    {"speed", required_argument, NULL, 's'},
+    {"repeat", required_argument, NULL, 'r'},
+    {"log", required_argument, NULL, 'l'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "vh", options, NULL)) != -1) {
+    switch (option) {
+      case 's':
+        speed = atof(optarg);
+        break;
+      case 'r':
+        repeat = atoi(optarg);
+        break;
+      case 'l':
+        logFile = optarg;
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind >= argc || repeat < 1 || speed < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  NlsClient* client = NlsClient::getInstance();
+  if (logFile) {
+    client->setLogConfig(logFile, LogInfo);
+  }
+
+  int failed = 0;
+  for (int i = optind; i < argc; i++) {
+    if (replayFile(argv[i], speed, repeat, verbose) != 0) {
+      failed++;
+    }
+  }
+
+  NlsClient::releaseInstance();
+  return failed ? 1 : 0;
+}
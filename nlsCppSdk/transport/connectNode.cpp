@@ -43,7 +43,13 @@
 #include "iNlsRequestParam.h"
 #include "nlog.h"
 #include "utility.h"
+#include "nlsAtomic.h"
 #include "workThread.h"
+#include "callbackExecutor.h"
+#include "encoderExecutor.h"
+#include "latencyTracer.h"
+#include "loopWatchdog.h"
+#include "nlsMetrics.h"
 #include "connectNode.h"
 
 namespace AlibabaNls {
@@ -81,18 +87,34 @@ ConnectNode::ConnectNode(INlsRequest* request,
   evbuffer_enable_locking(_cmdEvBuffer, NULL);
   evbuffer_enable_locking(_wwvEvBuffer, NULL);
 
+  _memAccount.watch(_binaryEvBuffer);
+  _memAccount.watch(_readEvBuffer);
+  _memAccount.watch(_cmdEvBuffer);
+  _memAccount.watch(_wwvEvBuffer);
+
   //int errorCode = 0;
   _nlsEncoder = NULL; //createNlsEncoder
   _encoder_type = ENCODER_NONE;
+  _pcmFrameFill = 0;
+  _asyncEncode = false;
+  _encoderWorker = -1;
+  _pendingEncodes = 0;
+  _recycleOnEncoded = false;
+  _encodeScheduled = false;
+  _encodeFlush = false;
 
   _eventThread = NULL;
+  _callbackWorker = -1;
+  _pendingCallbacks = 0;
+  _affinityNode = NULL;
 
-  _isDestroy = false;
-  _isWakeStop = false;
   _isStop = false;
+  _nodeState = NODE_STATE_INITIAL;
 
-  _workStatus = NodeInitial;
-  _exitStatus = ExitInvalid;
+  _lastIntermediateUs = 0;
+  _droppedIntermediateCount = 0;
+  memset(&_trace, 0, sizeof(_trace));
+  _replaySource = NULL;
 
   _sslHandle = new SSLconnect();
   if (_sslHandle == NULL) {
@@ -105,9 +127,17 @@ ConnectNode::ConnectNode(INlsRequest* request,
 #if defined(_MSC_VER)
   _mtxNode = CreateMutex(NULL, FALSE, NULL);
   _mtxCloseNode = CreateMutex(NULL, FALSE, NULL);
+  _mtxEncode = CreateMutex(NULL, FALSE, NULL);
+  _mtxTrace = CreateMutex(NULL, FALSE, NULL);
+  _mtxDrain = CreateMutex(NULL, FALSE, NULL);
+  _drainEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
 #else
   pthread_mutex_init(&_mtxNode, NULL);
   pthread_mutex_init(&_mtxCloseNode, NULL);
+  pthread_mutex_init(&_mtxEncode, NULL);
+  pthread_mutex_init(&_mtxTrace, NULL);
+  pthread_mutex_init(&_mtxDrain, NULL);
+  pthread_cond_init(&_cvDrain, NULL);
 #endif
 
   LOG_DEBUG("Create ConnectNode done.");
@@ -116,6 +146,7 @@ ConnectNode::ConnectNode(INlsRequest* request,
 ConnectNode::~ConnectNode() {
   LOG_DEBUG("Destroy ConnectNode begin.");
 
+  drainEncodes();
   closeConnectNode();
 
   if (_sslHandle) {
@@ -123,6 +154,8 @@ ConnectNode::~ConnectNode() {
     _sslHandle = NULL;
   }
 
+  // evbuffer_free不触发长度回调, 余量在此扣除
+  _memAccount.release();
   evbuffer_free(_cmdEvBuffer);
   evbuffer_free(_readEvBuffer);
   evbuffer_free(_binaryEvBuffer);
@@ -137,134 +170,238 @@ ConnectNode::~ConnectNode() {
 #if defined(_MSC_VER)
   CloseHandle(_mtxNode);
   CloseHandle(_mtxCloseNode);
+  CloseHandle(_mtxEncode);
+  CloseHandle(_mtxTrace);
+  CloseHandle(_mtxDrain);
+  CloseHandle(_drainEvent);
 #else
   pthread_mutex_destroy(&_mtxNode);
   pthread_mutex_destroy(&_mtxCloseNode);
+  pthread_mutex_destroy(&_mtxEncode);
+  pthread_mutex_destroy(&_mtxTrace);
+  pthread_mutex_destroy(&_mtxDrain);
+  pthread_cond_destroy(&_cvDrain);
 #endif
   LOG_DEBUG("Destroy ConnectNode done.");
 }
 
-ConnectStatus ConnectNode::getConnectNodeStatus() {
-  ConnectStatus status;
+/*
+ * 状态名称表, 下标与ConnectStatus/ExitStatus取值一一对应, 仅用于日志.
+ */
+static const char* const kConnectStatusNames[] = {
+  "NodeInitial",
+  "NodeConnecting",
+  "NodeConnected",
+  "NodeHandshaking",
+  "NodeHandshaked",
+  "NodeStarting",
+  "NodeStarted",
+  "NodeWakeWording",
+  "NodeInvalid"
+};
+
+static const char* const kExitStatusNames[] = {
+  "ExitInvalid",
+  "ExitStopping",
+  "ExitStopped",
+  "ExitCancel"
+};
+
+static inline ConnectStatus nodeStateWork(long state) {
+  return (ConnectStatus)(state & NODE_STATE_WORK_MASK);
+}
 
-#if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
-#else
-  pthread_mutex_lock(&_mtxNode);
-#endif
+static inline ExitStatus nodeStateExit(long state) {
+  return (ExitStatus)((state & NODE_STATE_EXIT_MASK) >> NODE_STATE_EXIT_SHIFT);
+}
 
-  status = _workStatus;
+/*
+ * 状态迁移规则, 非法迁移被拒绝. 连接状态只允许向前推进,
+ * 例外: 重连时回到NodeConnecting, 任意状态可进入NodeInvalid,
+ * 唤醒词校验结束后由NodeWakeWording回到NodeStarted,
+ * 启动通知失败时由NodeConnecting回退到NodeInitial.
+ * NodeInvalid为终态, 只能经resetConnectNode重置.
+ */
+static bool isValidConnectTransition(ConnectStatus from, ConnectStatus to) {
+  if (to == from || to == NodeInvalid) {
+    return true;
+  }
+  if (from == NodeInvalid) {
+    return false;
+  }
+  if (to == NodeConnecting) {
+    return true;
+  }
+  if (to == NodeInitial) {
+    return from == NodeConnecting;
+  }
+  if (from == NodeWakeWording && to == NodeStarted) {
+    return true;
+  }
+  return to > from;
+}
 
-#if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
-#else
-  pthread_mutex_unlock(&_mtxNode);
-#endif
-  return status;
+/* 退出状态只允许向前推进 */
+static bool isValidExitTransition(ExitStatus from, ExitStatus to) {
+  return to >= from;
 }
 
-std::string ConnectNode::getConnectNodeStatusString() {
-#if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
-#else
-  pthread_mutex_lock(&_mtxNode);
-#endif
+const char* ConnectNode::getConnectStatusName(ConnectStatus status) {
+  if (status < NodeInitial || status > NodeInvalid) {
+    return "Unknown";
+  }
+  return kConnectStatusNames[status];
+}
 
-  std::string ret_str("Unknown");
-  switch (_workStatus) {
-    case NodeInitial:
-      ret_str.assign("NodeInitial");
-      break;
-    case NodeConnecting:
-      ret_str.assign("NodeConnecting");
-      break;
-    case NodeConnected:
-      ret_str.assign("NodeConnected");
-      break;
-    case NodeHandshaking:
-      ret_str.assign("NodeHandshaking");
-      break;
-    case NodeHandshaked:
-      ret_str.assign("NodeHandshaked");
-      break;
-    case NodeStarting:
-      ret_str.assign("NodeStarting");
-      break;
-    case NodeStarted:
-      ret_str.assign("NodeStarted");
-      break;
-    case NodeWakeWording:
-      ret_str.assign("NodeWakeWording");
-      break;
-    case NodeInvalid:
-      ret_str.assign("NodeInvalid");
-      break;
+const char* ConnectNode::getExitStatusName(ExitStatus status) {
+  if (status < ExitInvalid || status > ExitCancel) {
+    return "Unknown";
   }
-#if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
-#else
-  pthread_mutex_unlock(&_mtxNode);
-#endif
-  return ret_str;
+  return kExitStatusNames[status];
 }
 
-void ConnectNode::setConnectNodeStatus(ConnectStatus status) {
-#if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
-#else
-  pthread_mutex_lock(&_mtxNode);
-#endif
+ConnectStatus ConnectNode::getConnectNodeStatus() {
+  return nodeStateWork(utility::atomicLoadAcquire(&_nodeState));
+}
 
-  _workStatus = status;
+const char* ConnectNode::getConnectNodeStatusString() {
+  return getConnectStatusName(getConnectNodeStatus());
+}
 
-#if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
-#else
-  pthread_mutex_unlock(&_mtxNode);
-#endif
+bool ConnectNode::setConnectNodeStatus(ConnectStatus status) {
+  long current = 0;
+  do {
+    current = utility::atomicLoadAcquire(&_nodeState);
+    if (!isValidConnectTransition(nodeStateWork(current), status)) {
+      LOG_WARN("Node:%p reject transition %s -> %s.", this,
+          getConnectStatusName(nodeStateWork(current)),
+          getConnectStatusName(status));
+      return false;
+    }
+  } while (!utility::atomicCompareSwap(
+      &_nodeState, current,
+      (current & ~NODE_STATE_WORK_MASK) | (long)status));
+  return true;
+}
+
+bool ConnectNode::compareAndSetStatus(ConnectStatus from, ConnectStatus to) {
+  if (!isValidConnectTransition(from, to)) {
+    LOG_WARN("Node:%p reject transition %s -> %s.", this,
+        getConnectStatusName(from), getConnectStatusName(to));
+    return false;
+  }
+
+  long current = 0;
+  do {
+    current = utility::atomicLoadAcquire(&_nodeState);
+    if (nodeStateWork(current) != from) {
+      return false;
+    }
+  } while (!utility::atomicCompareSwap(
+      &_nodeState, current,
+      (current & ~NODE_STATE_WORK_MASK) | (long)to));
+  return true;
 }
 
 ExitStatus ConnectNode::getExitStatus() {
-  ExitStatus ret = ExitInvalid;
+  return nodeStateExit(utility::atomicLoadAcquire(&_nodeState));
+}
 
-#if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
-#else
-  pthread_mutex_lock(&_mtxNode);
-#endif
+const char* ConnectNode::getExitStatusString() {
+  return getExitStatusName(getExitStatus());
+}
 
-  ret = _exitStatus;
+bool ConnectNode::setExitStatus(ExitStatus status) {
+  long current = 0;
+  do {
+    current = utility::atomicLoadAcquire(&_nodeState);
+    ExitStatus from = nodeStateExit(current);
+    // ExitCancel为终态, 不再被覆盖
+    if (from == ExitCancel) {
+      return status == ExitCancel;
+    }
+    if (!isValidExitTransition(from, status)) {
+      LOG_WARN("Node:%p reject transition %s -> %s.", this,
+          getExitStatusName(from), getExitStatusName(status));
+      return false;
+    }
+  } while (!utility::atomicCompareSwap(
+      &_nodeState, current,
+      (current & ~NODE_STATE_EXIT_MASK) |
+      ((long)status << NODE_STATE_EXIT_SHIFT)));
+  return true;
+}
 
-#if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
-#else
-  pthread_mutex_unlock(&_mtxNode);
-#endif
+bool ConnectNode::updateDestroyStatus() {
+  long current = 0;
+  do {
+    current = utility::atomicLoadAcquire(&_nodeState);
+    if (current & NODE_STATE_DESTROY) {
+      return true;
+    }
+  } while (!utility::atomicCompareSwap(
+      &_nodeState, current, current | NODE_STATE_DESTROY));
 
-  return ret;
+  return false;
 }
 
-std::string ConnectNode::getExitStatusString() {
-  std::string ret_str = "Unknown";
+int ConnectNode::resetConnectNode() {
+  /*
+   * 仅允许复用空闲节点: 从未启动, 或事件线程已完成destroyConnectNode.
+   * 其余状态下事件线程仍可能访问该节点.
+   */
+  long state = utility::atomicLoad(&_nodeState);
+  if (nodeStateWork(state) != NodeInitial && !(state & NODE_STATE_DESTROY)) {
+    LOG_WARN("Node:%p is busy(%s), cannot be reset.",
+        this, getConnectStatusName(nodeStateWork(state)));
+    return -1;
+  }
+
+  drainCallbacks();
+  drainEncodes();
+  closeConnectNode();
+
+  evbuffer_drain(_readEvBuffer, evbuffer_get_length(_readEvBuffer));
+  evbuffer_drain(_binaryEvBuffer, evbuffer_get_length(_binaryEvBuffer));
+  evbuffer_drain(_cmdEvBuffer, evbuffer_get_length(_cmdEvBuffer));
+  evbuffer_drain(_wwvEvBuffer, evbuffer_get_length(_wwvEvBuffer));
+  memset(&_wsType, 0, sizeof(_wsType));
+
 #if defined(_MSC_VER)
   WaitForSingleObject(_mtxNode, INFINITE);
 #else
   pthread_mutex_lock(&_mtxNode);
 #endif
 
-  switch (_exitStatus) {
-    case ExitInvalid:
-      ret_str.assign("ExitInvalid");
-      break;
-    case ExitStopping:
-      ret_str.assign("ExitStopping");
-      break;
-    case ExitStopped:
-      ret_str.assign("ExitStopped");
-      break;
-    case ExitCancel:
-      ret_str.assign("ExitCancel");
-      break;
+  _connectErrCode = 0;
+  _retryConnectCount = 0;
+  _nodeErrMsg.clear();
+
+  _eventThread = NULL;
+  _callbackWorker = -1;
+  _affinityNode = NULL;
+  // 在自身回调线程中reset时剩余回调已被丢弃, 计数不会再递减
+  _pendingCallbacks = 0;
+  _recycleOnEncoded = false;
+
+  _isStop = false;
+  utility::atomicStore(&_nodeState, NODE_STATE_INITIAL);
+
+  _lastIntermediateUs = 0;
+  _lastIntermediateText.clear();
+  _droppedIntermediateCount = 0;
+
+  _pcmFrameFill = 0;
+  discardPendingAudio();
+  _asyncEncode = false;
+  _encoderWorker = -1;
+  if (_nlsEncoder) {
+    if (_nlsEncoder->resetNlsEncoder() < 0) {
+      _nlsEncoder->destroyNlsEncoder();
+      delete _nlsEncoder;
+      _nlsEncoder = NULL;
+      _encoder_type = ENCODER_NONE;
+    }
   }
 
 #if defined(_MSC_VER)
@@ -273,108 +410,196 @@ std::string ConnectNode::getExitStatusString() {
   pthread_mutex_unlock(&_mtxNode);
 #endif
 
-  return ret_str;
-}
-
-void ConnectNode::setExitStatus(ExitStatus status) {
 #if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
+  WaitForSingleObject(_mtxTrace, INFINITE);
+  memset(&_trace, 0, sizeof(_trace));
+  ReleaseMutex(_mtxTrace);
 #else
-  pthread_mutex_lock(&_mtxNode);
+  pthread_mutex_lock(&_mtxTrace);
+  memset(&_trace, 0, sizeof(_trace));
+  pthread_mutex_unlock(&_mtxTrace);
 #endif
 
-  if (_exitStatus != ExitCancel) {
-    _exitStatus = status;
-  }
+  LOG_DEBUG("Node:%p reset done.", this);
+  return 0;
+}
+
+void ConnectNode::setWakeStatus(bool status) {
+  long current = 0;
+  do {
+    current = utility::atomicLoad(&_nodeState);
+  } while (!utility::atomicCompareSwap(
+      &_nodeState, current,
+      status ? (current | NODE_STATE_WAKE_STOP) :
+               (current & ~NODE_STATE_WAKE_STOP)));
+}
+
+bool ConnectNode::getWakeStatus() {
+  return (utility::atomicLoad(&_nodeState) & NODE_STATE_WAKE_STOP) != 0;
+}
+
+void ConnectNode::markTrace(TracePoint point) {
+  uint64_t now = utility::getMonotonicUs();
 
 #if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
+  WaitForSingleObject(_mtxTrace, INFINITE);
 #else
-  pthread_mutex_unlock(&_mtxNode);
+  pthread_mutex_lock(&_mtxTrace);
 #endif
-}
 
-bool ConnectNode::updateDestroyStatus() {
-  bool ret = true;
+  uint64_t* field = NULL;
+  switch (point) {
+    case TraceStart:         field = &_trace.startUs; break;
+    case TraceDnsStart:
+      // 重连时丢弃上一次尝试的时间点
+      _trace.connectAttempts++;
+      _trace.dnsStartUs = 0;
+      _trace.dnsEndUs = 0;
+      _trace.tcpConnectedUs = 0;
+      _trace.tlsHandshakedUs = 0;
+      field = &_trace.dnsStartUs;
+      break;
+    case TraceDnsEnd:        field = &_trace.dnsEndUs; break;
+    case TraceTcpConnected:  field = &_trace.tcpConnectedUs; break;
+    case TraceTlsHandshaked: field = &_trace.tlsHandshakedUs; break;
+    case TraceUpgraded:      field = &_trace.upgradedUs; break;
+    case TraceStartSent:     field = &_trace.startSentUs; break;
+    case TraceStarted:       field = &_trace.startedUs; break;
+    case TraceFirstResult:   field = &_trace.firstResultUs; break;
+    case TraceStopSent:      field = &_trace.stopSentUs; break;
+    case TraceCompleted:     field = &_trace.completedUs; break;
+    default: break;
+  }
+  bool marked = false;
+  if (field && *field == 0 && _trace.closedUs == 0) {
+    *field = now;
+    marked = true;
+  }
+  int attempts = _trace.connectAttempts;
+  uint64_t dnsStartUs = _trace.dnsStartUs;
+  uint64_t tcpConnectedUs = _trace.tcpConnectedUs;
+
 #if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
+  ReleaseMutex(_mtxTrace);
 #else
-  pthread_mutex_lock(&_mtxNode);
+  pthread_mutex_unlock(&_mtxTrace);
 #endif
 
-  if (!_isDestroy) {
-    _isDestroy = true;
-    ret = false;
+  if (!marked) {
+    return;
   }
+  switch (point) {
+    case TraceStart:
+      utility::NlsMetrics::requestsStarted.add();
+      break;
+    case TraceDnsStart:
+      if (attempts > 1) {
+        utility::NlsMetrics::reconnects.add();
+      }
+      break;
+    case TraceTlsHandshaked:
+      if (tcpConnectedUs != 0) {
+        utility::NlsMetrics::tlsHandshakeUs.observe(now - tcpConnectedUs);
+      }
+      break;
+    case TraceUpgraded:
+      if (dnsStartUs != 0) {
+        utility::NlsMetrics::connectUs.observe(now - dnsStartUs);
+      }
+      break;
+    default:
+      break;
+  }
+}
 
+void ConnectNode::getLatencyTrace(NlsLatencyTrace* trace) {
 #if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
+  WaitForSingleObject(_mtxTrace, INFINITE);
+  *trace = _trace;
+  ReleaseMutex(_mtxTrace);
 #else
-  pthread_mutex_unlock(&_mtxNode);
+  pthread_mutex_lock(&_mtxTrace);
+  *trace = _trace;
+  pthread_mutex_unlock(&_mtxTrace);
 #endif
-
-  return ret;
 }
 
-void ConnectNode::setWakeStatus(bool status) {
+void ConnectNode::getMemoryUsage(NlsRequestMemoryUsage* usage) {
+  usage->sendBufferBytes = evbuffer_get_length(_binaryEvBuffer) +
+                           evbuffer_get_length(_cmdEvBuffer) +
+                           evbuffer_get_length(_wwvEvBuffer);
+  usage->receiveBufferBytes = evbuffer_get_length(_readEvBuffer);
 #if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
+  WaitForSingleObject(_mtxEncode, INFINITE);
 #else
-  pthread_mutex_lock(&_mtxNode);
+  pthread_mutex_lock(&_mtxEncode);
 #endif
-
-  _isWakeStop = status;
-
+  usage->pendingAudioBytes = _pcmPending.size();
 #if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
+  ReleaseMutex(_mtxEncode);
 #else
-  pthread_mutex_unlock(&_mtxNode);
+  pthread_mutex_unlock(&_mtxEncode);
 #endif
+  usage->peakBytes = (uint64_t)_memAccount.getPeak();
 }
 
-bool ConnectNode::getWakeStatus() {
-  bool ret = false;
+void ConnectNode::finishTrace() {
+  NlsLatencyTrace trace;
+
 #if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
+  WaitForSingleObject(_mtxTrace, INFINITE);
 #else
-  pthread_mutex_lock(&_mtxNode);
+  pthread_mutex_lock(&_mtxTrace);
 #endif
 
-  ret = _isWakeStop;
+  bool first = (_trace.closedUs == 0);
+  if (first) {
+    _trace.closedUs = utility::getMonotonicUs();
+    if (_trace.completedUs != 0) {
+      _trace.status = TRACE_STATUS_COMPLETED;
+    } else if (getExitStatus() == ExitCancel) {
+      _trace.status = TRACE_STATUS_CANCELLED;
+    } else {
+      _trace.status = TRACE_STATUS_FAILED;
+    }
+    const std::string& taskId = _request->getRequestParam()->_task_id;
+    size_t length = taskId.size();
+    if (length >= sizeof(_trace.taskId)) {
+      length = sizeof(_trace.taskId) - 1;
+    }
+    memcpy(_trace.taskId, taskId.c_str(), length);
+    _trace.taskId[length] = '\0';
+    trace = _trace;
+  }
 
 #if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
+  ReleaseMutex(_mtxTrace);
 #else
-  pthread_mutex_unlock(&_mtxNode);
+  pthread_mutex_unlock(&_mtxTrace);
 #endif
 
-  return ret;
+  if (first && trace.startUs != 0) {
+    if (trace.status == TRACE_STATUS_COMPLETED) {
+      utility::NlsMetrics::requestsCompleted.add();
+    } else if (trace.status == TRACE_STATUS_CANCELLED) {
+      utility::NlsMetrics::requestsCancelled.add();
+    } else {
+      utility::NlsMetrics::requestsFailed.add();
+    }
+    LatencyTracer::report(trace, _request->getRequestParam()->_mode);
+  }
 }
 
+/* 仅在事件线程中调用 */
 bool ConnectNode::checkConnectCount() {
-  bool result = false;
-
-#if defined(_MSC_VER)
-  WaitForSingleObject(_mtxNode, INFINITE);
-#else
-  pthread_mutex_lock(&_mtxNode);
-#endif
-
   if (_retryConnectCount < RETRY_CONNECT_COUNT) {
     _retryConnectCount ++;
-    result = true;
-  } else {
-    _retryConnectCount = 0;
-    // return false : restart connect failed
+    return true;
   }
 
-#if defined(_MSC_VER)
-  ReleaseMutex(_mtxNode);
-#else
-  pthread_mutex_unlock(&_mtxNode);
-#endif
-
-  return result;
+  // return false : restart connect failed
+  _retryConnectCount = 0;
+  return false;
 }
 
 bool ConnectNode::parseUrlInformation() {
@@ -476,9 +701,16 @@ void ConnectNode::closeConnectNode() {
     event_del(&_writeEvent);
     event_del(&_connectEvent);
 
+    if (_droppedIntermediateCount > 0) {
+      LOG_INFO("Node:%p dropped %zu superseded intermediate results.",
+          this, _droppedIntermediateCount);
+    }
+
     LOG_INFO("Node:%p closeConnectNode done.", this);
   }
 
+  _recorder.end();
+
 #if defined(_MSC_VER)
   ReleaseMutex(_mtxCloseNode);
 #else
@@ -535,6 +767,9 @@ int ConnectNode::gatewayRequest() {
     return -1;
   };
 
+  _recorder.begin(_request->getRequestParam()->_mode,
+                  _request->getRequestParam()->_requestType, _url._token);
+
   evbuffer_add(_cmdEvBuffer, (void *)tmp, tmpLen);
 
   return 0;
@@ -554,8 +789,10 @@ int ConnectNode::gatewayResponse() {
     free(frame);
     return -1;
   } else if (read_len == 0) {
+    // 未读到数据(如TLS1.3握手后的session ticket), 继续等待应答,
+    // 返回0会被当作升级完成
     free(frame);
-    return 0;
+    return 1;
   }
 
   int frameSize = evbuffer_get_length(_readEvBuffer);
@@ -589,64 +826,94 @@ int ConnectNode::gatewayResponse() {
 }
 
 int ConnectNode::addAudioDataBuffer(const uint8_t * frame, size_t frameSize) {
+  if (_converter.isEnabled()) {
+    // 转换为请求采样率的16bit单声道PCM
+    _convertOutput.clear();
+    if (_converter.process(frame, frameSize, _convertOutput) == 0) {
+      return 0;
+    }
+    frame = &_convertOutput[0];
+    frameSize = _convertOutput.size();
+  }
+
+  if (!_vad.isEnabled()) {
+    return pushAudioData(frame, frameSize);
+  }
+
+  // 静音检测在编码前进行, 只有需要上传的PCM进入编码及发送流程
+  _vadOutput.clear();
+  if (_vad.process(frame, frameSize, _vadOutput) == 0) {
+    return 0;
+  }
+  return pushAudioData(&_vadOutput[0], _vadOutput.size());
+}
+
+int ConnectNode::pushAudioData(const uint8_t * frame, size_t frameSize) {
   int ret = 0;
-  uint8_t *tmp = NULL;
-  size_t tmpSize = 0;
+  const uint8_t *payload = frame;
+  size_t payloadSize = frameSize;
   size_t length = 0;
   struct evbuffer* buff = NULL;
 
+  if (_asyncEncode) {
+    // 交给编码线程池, 编码后由事件线程发送
+    if (EncoderExecutor::submit(this, frame, frameSize) < 0) {
+      LOG_WARN("Node:%p submit audio to encoder failed.", this);
+      return -1;
+    }
+    return 0;
+  }
+
   if (_nlsEncoder && _encoder_type != ENCODER_NONE) {
 //    LOG_DEBUG("should encording...");
-    int nSize = 0;
-    uint8_t *outputBuffer = new uint8_t[frameSize];
-    if (outputBuffer == NULL) {
-      LOG_ERROR("Node:%p new outputBuffer failed", this);
+    int nSize = encodeAudioFrames(frame, frameSize);
+    if (nSize < 0) {
       return -1;
-    } else {
-      memset(outputBuffer, 0, frameSize);
-      nSize = _nlsEncoder->nlsEncoding(
-          frame, (int)frameSize,
-          outputBuffer, (int)frameSize);
-      if (nSize < 0) {
-        LOG_ERROR("Node:%p Opus encoder failed %d.", this, nSize);
-        delete [] outputBuffer;
-        return -1;
-      }
-      _webSocket.binaryFrame(outputBuffer, nSize, &tmp, &tmpSize);
-      delete [] outputBuffer;
+    } else if (nSize == 0) {
+      // 不足一帧, 等待后续数据
+      return 0;
     }
-  } else {
-    // pack frame data
-    _webSocket.binaryFrame(frame, frameSize, &tmp, &tmpSize);
+    payload = &_encodedBuffer[0];
+    payloadSize = (size_t)nSize;
   }
 
-  if (_request->getRequestParam()->_enableWakeWord == true &&
-      !getWakeStatus()) {
-    //LOG_DEBUG("Node:%p It's _wwvEvBuffer.", this);
-    buff = _wwvEvBuffer;
-  } else {
-    //LOG_DEBUG("Node:%p It's _binaryEvBuffer.", this);
-    buff = _binaryEvBuffer;
-  }
+  // 帧直接封装在发送缓冲区中, 不经临时内存
+  size_t tmpSize = WebSocketTcp::frameSize(payloadSize);
+  buff = getAudioEvBuffer();
 
   evbuffer_lock(buff);
   length = evbuffer_get_length(buff);
   if (length >= _limitSize) {
     LOG_WARN("too many audio data in evbuffer");
     evbuffer_unlock(buff);
+    utility::NlsMetrics::audioRejected.add();
+    return -1;
+  }
+  if (utility::NlsMemory::exceedsLimit(tmpSize)) {
+    LOG_WARN("Node:%p SDK memory limit reached, reject audio.", this);
+    evbuffer_unlock(buff);
+    utility::NlsMetrics::memoryRejectedAudio.add();
     return -1;
   }
 
-  evbuffer_add(buff, (void *)tmp, tmpSize);
-
-  if (tmp) free(tmp);
-  tmp = NULL;
+  if (_webSocket.frameToBuffer(WebSocketHeaderType::BINARY_FRAME,
+                               payload, payloadSize, buff) < 0) {
+    evbuffer_unlock(buff);
+    return -1;
+  }
+  utility::NlsMetrics::framesSent.add();
+  utility::NlsMetrics::sendBufferBytes.observe(length + tmpSize);
 
   evbuffer_unlock(buff);
   //LOG_DEBUG("Node:%p AudioBuffer add buff:%zu %zu", 
   //    this, length, length + tmpSize);
 
-  if (length == 0 && getConnectNodeStatus() == NodeStarted) {
+  ConnectStatus workStatus = NodeInitial;
+  if (length == 0) {
+    workStatus = getConnectNodeStatus();
+  }
+
+  if (workStatus == NodeStarted || workStatus == NodeWakeWording) {
     #if defined(_MSC_VER)
     WaitForSingleObject(_mtxNode, INFINITE);
     #else
@@ -662,14 +929,275 @@ int ConnectNode::addAudioDataBuffer(const uint8_t * frame, size_t frameSize) {
     #endif
   }
 
-  if (length == 0 && getConnectNodeStatus() == NodeWakeWording) {
+  if (ret == 0) {
+    ret = sendControlDirective();
+  }
+
+  if (ret == -1) {
+    handlerTaskFailedEvent(getErrorMsg());
+    disconnectProcess();
+  }
+
+  return ret;
+}
+
+/*
+ * 将PCM拼接为完整帧后逐帧编码, 编码结果连续写入_encodedBuffer,
+ * 不足一帧的数据保留在_pcmFrame中, 与下次传入的数据拼接.
+ * 返回编码后数据长度, 失败返回-1.
+ */
+int ConnectNode::encodeAudioFrames(const uint8_t * data, size_t dataSize) {
+  size_t frameBytes = (size_t)_nlsEncoder->getFrameBytes();
+  if (frameBytes == 0) {
+    LOG_ERROR("Node:%p invalid encoder frame size.", this);
+    return -1;
+  }
+  if (_pcmFrame.size() != frameBytes) {
+    _pcmFrame.resize(frameBytes);
+    _pcmFrameFill = 0;
+  }
+
+  size_t frames = (_pcmFrameFill + dataSize) / frameBytes;
+  if (frames == 0) {
+    memcpy(&_pcmFrame[_pcmFrameFill], data, dataSize);
+    _pcmFrameFill += dataSize;
+    return 0;
+  }
+
+  /* 编码后每帧不会超过原始PCM长度, 另外为ogg头页预留空间 */
+  size_t capacity = frames * frameBytes + 1024;
+  if (_encodedBuffer.size() < capacity) {
+    _encodedBuffer.resize(capacity);
+  }
+
+  size_t encoded = 0;
+  while (dataSize > 0) {
+    const uint8_t *pcm = NULL;
+    if (_pcmFrameFill == 0 && dataSize >= frameBytes) {
+      // 完整帧直接编码, 无需拷贝
+      pcm = data;
+      data += frameBytes;
+      dataSize -= frameBytes;
+    } else {
+      size_t copySize = frameBytes - _pcmFrameFill;
+      if (copySize > dataSize) {
+        copySize = dataSize;
+      }
+      memcpy(&_pcmFrame[_pcmFrameFill], data, copySize);
+      _pcmFrameFill += copySize;
+      data += copySize;
+      dataSize -= copySize;
+      if (_pcmFrameFill < frameBytes) {
+        break;
+      }
+      pcm = &_pcmFrame[0];
+      _pcmFrameFill = 0;
+    }
+
+    int nSize = _nlsEncoder->nlsEncoding(
+        pcm, (int)frameBytes,
+        &_encodedBuffer[encoded], (int)(capacity - encoded));
+    if (nSize < 0) {
+      LOG_ERROR("Node:%p Opus encoder failed %d.", this, nSize);
+      return -1;
+    }
+    encoded += nSize;
+  }
+
+  return (int)encoded;
+}
+
+int ConnectNode::flushAudioFrames() {
+  // 重采样滤波器中剩余的样本先经静音检测, 再随编码器一同清空
+  _convertOutput.clear();
+  if (_converter.isEnabled() && _converter.flush(_convertOutput) > 0) {
+    if (!_vad.isEnabled()) {
+      if (pushAudioData(&_convertOutput[0], _convertOutput.size()) < 0) {
+        return -1;
+      }
+    } else {
+      _vadOutput.clear();
+      if (_vad.process(&_convertOutput[0], _convertOutput.size(),
+                       _vadOutput) > 0 &&
+          pushAudioData(&_vadOutput[0], _vadOutput.size()) < 0) {
+        return -1;
+      }
+    }
+  }
+
+  if (_vad.isEnabled()) {
+    _vadOutput.clear();
+    if (_vad.flush(_vadOutput) > 0 &&
+        pushAudioData(&_vadOutput[0], _vadOutput.size()) < 0) {
+      return -1;
+    }
+  }
+
+  if (_asyncEncode) {
+    // 等待编码线程池处理完已提交的音频, 保证stop指令在音频之后
+    EncoderExecutor::flush(this);
+    EncoderExecutor::drainNode(this);
+    return 0;
+  }
+
+  if (_nlsEncoder == NULL || _encoder_type == ENCODER_NONE ||
+      _pcmFrameFill == 0) {
+    return 0;
+  }
+
+  std::vector<uint8_t> padding(_pcmFrame.size() - _pcmFrameFill, 0);
+  return pushAudioData(&padding[0], padding.size());
+}
+
+struct evbuffer *ConnectNode::getAudioEvBuffer() {
+  if (_request->getRequestParam()->_enableWakeWord == true &&
+      !getWakeStatus()) {
+    //LOG_DEBUG("Node:%p It's _wwvEvBuffer.", this);
+    return _wwvEvBuffer;
+  } else {
+    //LOG_DEBUG("Node:%p It's _binaryEvBuffer.", this);
+    return _binaryEvBuffer;
+  }
+}
+
+/*
+ * sendAudio线程调用, 暂存PCM等待编码线程处理.
+ * 返回1表示需要调度到编码线程, 0表示已在编码队列中, -1表示缓冲区已满.
+ */
+int ConnectNode::appendPendingAudio(const uint8_t * data, size_t dataSize,
+                                    bool flush) {
+  int ret = 0;
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxEncode, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxEncode);
+#endif
+
+  if (dataSize > 0 &&
+      evbuffer_get_length(getAudioEvBuffer()) + _pcmPending.size() >=
+      _limitSize) {
+    LOG_WARN("too many audio data in evbuffer");
+    utility::NlsMetrics::audioRejected.add();
+    ret = -1;
+  } else if (dataSize > 0 && utility::NlsMemory::exceedsLimit(dataSize)) {
+    LOG_WARN("Node:%p SDK memory limit reached, reject audio.", this);
+    utility::NlsMetrics::memoryRejectedAudio.add();
+    ret = -1;
+  } else {
+    if (dataSize > 0) {
+      _pcmPending.insert(_pcmPending.end(), data, data + dataSize);
+      _memAccount.add((int64_t)dataSize);
+    }
+    if (flush) {
+      _encodeFlush = true;
+    }
+    if (!_encodeScheduled) {
+      _encodeScheduled = true;
+      utility::atomicAdd(&_pendingEncodes, 1);
+      ret = 1;
+    }
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxEncode);
+#else
+  pthread_mutex_unlock(&_mtxEncode);
+#endif
+  return ret;
+}
+
+void ConnectNode::discardPendingAudio() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxEncode, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxEncode);
+#endif
+  _memAccount.add(-(int64_t)_pcmPending.size());
+  _pcmPending.clear();
+  _encodeScheduled = false;
+  _encodeFlush = false;
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxEncode);
+#else
+  pthread_mutex_unlock(&_mtxEncode);
+#endif
+}
+
+/*
+ * 编码线程调用, 编码已暂存的PCM并加入发送缓冲, 返回加入的字节数.
+ */
+int ConnectNode::encodePendingAudio() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxEncode, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxEncode);
+#endif
+  _pcmWorking.swap(_pcmPending);
+  _memAccount.add(-(int64_t)_pcmWorking.size());
+  bool flush = _encodeFlush;
+  _encodeFlush = false;
+  _encodeScheduled = false;
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxEncode);
+#else
+  pthread_mutex_unlock(&_mtxEncode);
+#endif
+
+  if (utility::atomicLoad(&_nodeState) & NODE_STATE_DESTROY ||
+      _nlsEncoder == NULL) {
+    _pcmWorking.clear();
+    return 0;
+  }
+
+  if (flush) {
+    size_t frameBytes = (size_t)_nlsEncoder->getFrameBytes();
+    size_t remain = (_pcmFrameFill + _pcmWorking.size()) % frameBytes;
+    if (remain > 0) {
+      _pcmWorking.resize(_pcmWorking.size() + frameBytes - remain, 0);
+    }
+  }
+
+  int nSize = 0;
+  if (!_pcmWorking.empty()) {
+    nSize = encodeAudioFrames(&_pcmWorking[0], _pcmWorking.size());
+  }
+  _pcmWorking.clear();
+  if (nSize <= 0) {
+    return 0;
+  }
+
+  int tmpSize = _webSocket.frameToBuffer(WebSocketHeaderType::BINARY_FRAME,
+                                         &_encodedBuffer[0], (size_t)nSize,
+                                         getAudioEvBuffer());
+  if (tmpSize < 0) {
+    return -1;
+  }
+  utility::NlsMetrics::framesSent.add();
+  utility::NlsMetrics::sendBufferBytes.observe(
+      evbuffer_get_length(getAudioEvBuffer()));
+
+  return tmpSize;
+}
+
+/*
+ * 事件线程调用, 发送编码线程已加入缓冲区的音频.
+ */
+void ConnectNode::sendEncodedAudio() {
+  long state = utility::atomicLoad(&_nodeState);
+  if (state & NODE_STATE_DESTROY) {
+    return;
+  }
+
+  int ret = 0;
+  ConnectStatus workStatus = nodeStateWork(state);
+  if (workStatus == NodeStarted || workStatus == NodeWakeWording) {
     #if defined(_MSC_VER)
     WaitForSingleObject(_mtxNode, INFINITE);
     #else
     pthread_mutex_lock(&_mtxNode);
     #endif
     if (!_isStop) {
-      ret = nlsSendFrame(buff);
+      ret = nlsSendFrame(getAudioEvBuffer());
     }
     #if defined(_MSC_VER)
     ReleaseMutex(_mtxNode);
@@ -686,8 +1214,10 @@ int ConnectNode::addAudioDataBuffer(const uint8_t * frame, size_t frameSize) {
     handlerTaskFailedEvent(getErrorMsg());
     disconnectProcess();
   }
+}
 
-  return ret;
+void ConnectNode::drainEncodes() {
+  EncoderExecutor::drainNode(this);
 }
 
 int ConnectNode::sendControlDirective() {
@@ -699,18 +1229,23 @@ int ConnectNode::sendControlDirective() {
   pthread_mutex_lock(&_mtxNode);
 #endif
 
-  if (_workStatus == NodeStarted && _exitStatus == ExitInvalid) {
+  long state = utility::atomicLoad(&_nodeState);
+  if (nodeStateWork(state) == NodeStarted &&
+      nodeStateExit(state) == ExitInvalid) {
     size_t length = evbuffer_get_length(getCmdEvBuffer());
     if (length != 0) {
       LOG_DEBUG("Node:%p Cmd buffer is't empty.", this);
       ret = nlsSendFrame(getCmdEvBuffer());
     }
   } else {
-    if (_exitStatus == ExitStopping && _isStop == false) {
+    if (nodeStateExit(state) == ExitStopping && _isStop == false) {
       LOG_DEBUG("Node:%p Audio is send done. And invoke stop command.", this);
       addCmdDataBuffer(CmdStop);
       ret = nlsSendFrame(getCmdEvBuffer());
       _isStop = true;
+      if (ret >= 0) {
+        markTrace(TraceStopSent);
+      }
     }
   }
 
@@ -755,16 +1290,15 @@ void ConnectNode::addCmdDataBuffer(CmdType type, const char* message) {
   if (cmd) {
     LOG_INFO("Node:%p Get Cmd:%s", this, cmd);
 
-    uint8_t *frame = NULL;
-    size_t frameSize = 0;
-    _webSocket.textFrame((uint8_t *) cmd, strlen(cmd), &frame, &frameSize);
+    int frameSize = _webSocket.frameToBuffer(
+        WebSocketHeaderType::TEXT_FRAME, (const uint8_t *)cmd, strlen(cmd),
+        _cmdEvBuffer);
 
-    LOG_DEBUG("Node:%p WebSocket Size:%zu", this, frameSize);
+    LOG_DEBUG("Node:%p WebSocket Size:%d", this, frameSize);
 
-    evbuffer_add(_cmdEvBuffer, (void *) frame, frameSize);
-
-    if (frame) free(frame);
-    frame = NULL;
+    if (frameSize > 0) {
+      utility::NlsMetrics::framesSent.add();
+    }
   }
 }
 
@@ -819,6 +1353,10 @@ int ConnectNode::nlsSend(const uint8_t * frame, size_t length) {
     return 0;
   }
 
+  if (_replaySource) {
+    return length;
+  }
+
   if (_url._isSsl) {
     //LOG_DEBUG("SSL Send data.");
     sLen = _sslHandle->sslWrite(frame, length);
@@ -828,6 +1366,11 @@ int ConnectNode::nlsSend(const uint8_t * frame, size_t length) {
   }
 
   //LOG_DEBUG("Send data: %d.", sLen);
+  if (sLen > 0) {
+    utility::NlsMetrics::bytesSent.add(sLen);
+    utility::NlsMetrics::socketWrites.add();
+    _recorder.record(TrafficSent, frame, sLen);
+  }
 
   if (sLen < 0) {
     if (_url._isSsl) {
@@ -888,7 +1431,13 @@ int ConnectNode::nlsSendFrame(struct evbuffer * eventBuffer) {
 int ConnectNode::nlsReceive(uint8_t *buffer, int max_size) {
   int rLen = 0;
   int read_buffer_size = max_size;
-  if (_url._isSsl) {
+  if (_replaySource) {
+    rLen = _replaySource->read(buffer, read_buffer_size);
+    if (rLen < 0) {
+      _nodeErrMsg = "replay finished";
+      return -1;
+    }
+  } else if (_url._isSsl) {
     rLen = _sslHandle->sslRead((uint8_t *)buffer, read_buffer_size);
   } else {
     rLen = socketRead((uint8_t *)buffer, read_buffer_size);
@@ -906,6 +1455,11 @@ int ConnectNode::nlsReceive(uint8_t *buffer, int max_size) {
   }
 
   evbuffer_add(_readEvBuffer, (void *)buffer, rLen);
+  if (rLen > 0) {
+    utility::NlsMetrics::bytesReceived.add(rLen);
+    utility::NlsMetrics::socketReads.add();
+    _recorder.record(TrafficReceived, buffer, rLen);
+  }
 
   return rLen;
 }
@@ -1118,6 +1672,9 @@ NlsEvent* ConnectNode::convertResult(WebSocketFrame * wsFrame) {
         handlerEvent(TASKFAILED_PARSE_JSON_STRING,
                      TASK_FAILED_CODE,
                      NlsEvent::TaskFailed);
+      } else {
+        // 服务端时间不含VAD_MODE_DROP丢弃的静音, 上报前换算回原始音频时间
+        wsEvent->rebaseTime(&_vad);
       }
     }
   } else {
@@ -1129,9 +1686,126 @@ NlsEvent* ConnectNode::convertResult(WebSocketFrame * wsFrame) {
   return wsEvent;
 }
 
+/*
+ * 在原始json文本中查找"key":"value"形式的字符串字段, 不做完整解析.
+ * value指向原始(可能含转义)文本, 不包含引号.
+ */
+static bool scanJsonString(const char* data, size_t len, const char* key,
+                           const char** value, size_t* valueLen) {
+  size_t keyLen = strlen(key);
+  const char* end = data + len;
+  const char* p = data;
+
+  while (p + keyLen + 2 < end) {
+    if (*p == '"' && memcmp(p + 1, key, keyLen) == 0 && p[keyLen + 1] == '"') {
+      const char* q = p + keyLen + 2;
+      while (q < end && (*q == ' ' || *q == '\t')) q++;
+      if (q < end && *q == ':') {
+        q++;
+        while (q < end && (*q == ' ' || *q == '\t')) q++;
+        if (q < end && *q == '"') {
+          const char* begin = ++q;
+          while (q < end && *q != '"') {
+            if (*q == '\\') q++;
+            q++;
+          }
+          if (q < end) {
+            *value = begin;
+            *valueLen = q - begin;
+            return true;
+          }
+        }
+        return false;
+      }
+    }
+    p++;
+  }
+  return false;
+}
+
+static size_t utf8CharCount(const char* data, size_t len) {
+  size_t count = 0;
+  for (size_t i = 0; i < len; i++) {
+    if ((data[i] & 0xC0) != 0x80) count++;
+  }
+  return count;
+}
+
+/*
+ * 开启中间结果合并时, 判断该帧是否为可丢弃的中间结果.
+ * 仅扫描header.name与payload.result, 被丢弃的帧不会进入parseJsonMsg.
+ */
+bool ConnectNode::isSupersededIntermediate(WebSocketFrame *wsFrame) {
+  INlsRequestParam* param = _request->getRequestParam();
+  if (param->_coalesceIntervalMs <= 0 && param->_coalesceTextDelta <= 0) {
+    return false;
+  }
+
+  const char* data = (const char*)wsFrame->data;
+  size_t len = wsFrame->length;
+  const char* name = NULL;
+  size_t nameLen = 0;
+  if (!scanJsonString(data, len, "name", &name, &nameLen)) {
+    return false;
+  }
+
+  std::string msgName(name, nameLen);
+  if (msgName != "TranscriptionResultChanged" &&
+      msgName != "RecognitionResultChanged") {
+    // 句子边界等事件之后的第一个中间结果总是回调
+    _lastIntermediateUs = 0;
+    _lastIntermediateText.clear();
+    return false;
+  }
+
+  const char* text = "";
+  size_t textLen = 0;
+  scanJsonString(data, len, "result", &text, &textLen);
+
+  uint64_t now = utility::getMonotonicUs();
+  bool deliver = (_lastIntermediateUs == 0);
+
+  if (!deliver && param->_coalesceIntervalMs > 0 &&
+      now - _lastIntermediateUs >= (uint64_t)param->_coalesceIntervalMs * 1000) {
+    deliver = true;
+  }
+
+  if (!deliver && param->_coalesceTextDelta > 0) {
+    size_t lastLen = _lastIntermediateText.size();
+    const char* last = _lastIntermediateText.c_str();
+    size_t prefix = 0;
+    while (prefix < lastLen && prefix < textLen && last[prefix] == text[prefix]) {
+      prefix++;
+    }
+    // 回退到utf8字符边界
+    while (prefix > 0 && (text[prefix] & 0xC0) == 0x80) {
+      prefix--;
+    }
+    size_t newDelta = utf8CharCount(text + prefix, textLen - prefix);
+    size_t oldDelta = utf8CharCount(last + prefix, lastLen - prefix);
+    size_t delta = newDelta > oldDelta ? newDelta : oldDelta;
+    if (delta >= (size_t)param->_coalesceTextDelta) {
+      deliver = true;
+    }
+  }
+
+  if (deliver) {
+    _lastIntermediateUs = now;
+    _lastIntermediateText.assign(text, textLen);
+    return false;
+  }
+
+  _droppedIntermediateCount++;
+  LOG_DEBUG("Node:%p drop superseded intermediate result, total:%zu.",
+      this, _droppedIntermediateCount);
+  return true;
+}
+
 int ConnectNode::parseFrame(WebSocketFrame * wsFrame) {
   NlsEvent* frameEvent = NULL;
 
+  utility::NlsMetrics::framesReceived.add();
+
   if (wsFrame->type == WebSocketHeaderType::CLOSE) {
     if (wsFrame->closeCode == -1) {
       std::string msg((char *)wsFrame->data);
@@ -1146,6 +1820,10 @@ int ConnectNode::parseFrame(WebSocketFrame * wsFrame) {
           NlsEvent::TaskFailed, _request->getRequestParam()->_task_id);
     }
   } else {
+    if (wsFrame->type == WebSocketHeaderType::TEXT_FRAME &&
+        isSupersededIntermediate(wsFrame)) {
+      return 0;
+    }
     frameEvent = convertResult(wsFrame);
   }
 
@@ -1162,15 +1840,40 @@ int ConnectNode::parseFrame(WebSocketFrame * wsFrame) {
   //invoke cancel()
   if (getExitStatus() == ExitCancel || getExitStatus() == ExitStopped) {
     LOG_DEBUG("Node:%p is stopped, %d.", this, getExitStatus());
+    delete frameEvent;
     return -1;
   }
 
+  NlsEvent::EventType msgType = frameEvent->getMsgType();
+  switch (msgType) {
+    case NlsEvent::RecognitionStarted:
+    case NlsEvent::TranscriptionStarted:
+    case NlsEvent::SynthesisStarted:
+      markTrace(TraceStarted);
+      break;
+    case NlsEvent::SentenceBegin:
+    case NlsEvent::TaskFailed:
+    case NlsEvent::Close:
+      break;
+    case NlsEvent::RecognitionCompleted:
+    case NlsEvent::TranscriptionCompleted:
+    case NlsEvent::SynthesisCompleted:
+    case NlsEvent::DialogResultGenerated:
+      markTrace(TraceFirstResult);
+      markTrace(TraceCompleted);
+      break;
+    default:
+      markTrace(TraceFirstResult);
+      break;
+  }
+
   LOG_DEBUG("Node:%p Begin HandlerFrame:%d.", this, getExitStatus());
-  _handler->handlerFrame(*frameEvent);
+  dispatchEvent(frameEvent);
+  frameEvent = NULL;
   LOG_DEBUG("Node:%p End HandlerFrame.", this);
 
   bool closeFlag = false;
-  switch(frameEvent->getMsgType()) {
+  switch(msgType) {
     case NlsEvent::RecognitionStarted:
     case NlsEvent::TranscriptionStarted:
       if (_request->getRequestParam()->_requestType != SpeechWakeWordDialog) {
@@ -1201,9 +1904,6 @@ int ConnectNode::parseFrame(WebSocketFrame * wsFrame) {
       break;
   }
 
-  if (frameEvent) delete frameEvent;
-  frameEvent = NULL;
-
   if (closeFlag) {
     handlerEvent(CLOSE_JSON_STRING, CLOSE_CODE, NlsEvent::Close);
     closeConnectNode();
@@ -1231,11 +1931,71 @@ void ConnectNode::handlerEvent(const char* error,
   }
 
   LOG_INFO("Node:%p Begin HandlerFrame.", this);
-  _handler->handlerFrame(*useEvent);
+  dispatchEvent(useEvent);
+  useEvent = NULL;
   LOG_INFO("Node:%p End HandlerFrame.", this);
+}
 
-  delete useEvent;
-  useEvent = NULL;
+/*
+ * 开启异步回调执行器时投递到回调线程执行, 否则在当前线程同步执行.
+ * event的所有权在此转移.
+ */
+void ConnectNode::dispatchEvent(NlsEvent* event) {
+  if (CallbackExecutor::dispatch(this, event) == 0) {
+    return;
+  }
+
+  {
+    LoopCallbackTimer timer(_eventThread, LoopEventHandler, this,
+                            (int)event->getMsgType());
+    _handler->handlerFrame(*event);
+  }
+  delete event;
+}
+
+void ConnectNode::drainCallbacks() {
+  CallbackExecutor::drainNode(this);
+}
+
+/*
+ * 计数在_mtxDrain内递减, 等待方在锁内看到0时通知方已结束,
+ * 随后即可安全释放node.
+ */
+void ConnectNode::finishCallback() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxDrain, INFINITE);
+  if (utility::atomicAdd(&_pendingCallbacks, -1) <= 0) {
+    SetEvent(_drainEvent);
+  }
+  ReleaseMutex(_mtxDrain);
+#else
+  pthread_mutex_lock(&_mtxDrain);
+  if (utility::atomicAdd(&_pendingCallbacks, -1) <= 0) {
+    pthread_cond_broadcast(&_cvDrain);
+  }
+  pthread_mutex_unlock(&_mtxDrain);
+#endif
+}
+
+void ConnectNode::waitCallbacks() {
+#if defined(_MSC_VER)
+  while (true) {
+    WaitForSingleObject(_mtxDrain, INFINITE);
+    if (utility::atomicLoad(&_pendingCallbacks) <= 0) {
+      ReleaseMutex(_mtxDrain);
+      break;
+    }
+    ResetEvent(_drainEvent);
+    ReleaseMutex(_mtxDrain);
+    WaitForSingleObject(_drainEvent, INFINITE);
+  }
+#else
+  pthread_mutex_lock(&_mtxDrain);
+  while (utility::atomicLoad(&_pendingCallbacks) > 0) {
+    pthread_cond_wait(&_cvDrain, &_mtxDrain);
+  }
+  pthread_mutex_unlock(&_mtxDrain);
+#endif
 }
 
 void ConnectNode::handlerTaskFailedEvent(std::string failedInfo) {
@@ -1269,6 +2029,7 @@ int ConnectNode::dnsProcess() {
   }
 
   setConnectNodeStatus(NodeConnecting);
+  markTrace(TraceDnsStart);
 
   parseUrlInformation();
 
@@ -1456,6 +2217,7 @@ int ConnectNode::socketConnect() {
   } else {
     LOG_INFO("Node:%p connected directly1.", this);
     setConnectNodeStatus(NodeConnected);
+    markTrace(TraceTcpConnected);
   }
   return 0;
 }
@@ -1482,6 +2244,7 @@ int ConnectNode::sslProcess() {
     } else {
       //LOG_INFO("Node:%p sslHandshake done.", this);
       setConnectNodeStatus(NodeHandshaking);
+      markTrace(TraceTlsHandshaked);
       return 0;
     }
   } else {
@@ -1509,37 +2272,81 @@ void ConnectNode::initNlsEncoder() {
   pthread_mutex_lock(&_mtxNode);
 #endif
 
-  if (_nlsEncoder == NULL) {
-    if (_request->getRequestParam()->_format == "opu") {
-      _encoder_type = ENCODER_OPU;
-    } else if (_request->getRequestParam()->_format == "opus") {
-      _encoder_type = ENCODER_OPUS;
-    }
+  ENCODER_TYPE type = ENCODER_NONE;
+  int sampleRate = _request->getRequestParam()->_sampleRate;
+  if (_request->getRequestParam()->_format == "opu") {
+    type = ENCODER_OPU;
+  } else if (_request->getRequestParam()->_format == "opus") {
+    type = ENCODER_OPUS;
+  }
 
-    if (_encoder_type != ENCODER_NONE) {
-      int errorCode = 0;
-      _nlsEncoder = new NlsEncoder();
-      if (_nlsEncoder == NULL) {
-        LOG_ERROR("new _nlsEncoder failed");
-        #if defined(_MSC_VER)
-        ReleaseMutex(_mtxNode);
-        #else
-        pthread_mutex_unlock(&_mtxNode);
-        #endif
-        return;
-      }
-      int ret = _nlsEncoder->createNlsEncoder(
-          _encoder_type, 1,
-          _request->getRequestParam()->_sampleRate,
-          &errorCode);
-      if (ret < 0) {
-        LOG_ERROR("createNlsEncoder failed, errcode:%d", errorCode);
-        delete _nlsEncoder;
-        _nlsEncoder = NULL;
-      }
+  const NlsEncoderProfile& profile =
+      _request->getRequestParam()->_encoderProfile;
+  int frameMs = profile.frameMs;
+  _pcmFrameFill = 0;
+
+  /* 复用的请求可能修改了编码格式、采样率或帧长, 此时重建编码器 */
+  if (_nlsEncoder != NULL &&
+      (_nlsEncoder->getEncoderType() != type ||
+       _nlsEncoder->getSampleRate() != sampleRate ||
+       _nlsEncoder->getFrameDuration() != frameMs)) {
+    _nlsEncoder->destroyNlsEncoder();
+    delete _nlsEncoder;
+    _nlsEncoder = NULL;
+  }
+  _encoder_type = type;
+
+  if (_nlsEncoder == NULL && _encoder_type != ENCODER_NONE) {
+    int errorCode = 0;
+    _nlsEncoder = new NlsEncoder();
+    if (_nlsEncoder == NULL) {
+      LOG_ERROR("new _nlsEncoder failed");
+      #if defined(_MSC_VER)
+      ReleaseMutex(_mtxNode);
+      #else
+      pthread_mutex_unlock(&_mtxNode);
+      #endif
+      return;
+    }
+    int ret = _nlsEncoder->createNlsEncoder(
+        _encoder_type, 1, sampleRate, &errorCode, frameMs);
+    if (ret < 0) {
+      LOG_ERROR("createNlsEncoder failed, errcode:%d", errorCode);
+      delete _nlsEncoder;
+      _nlsEncoder = NULL;
     }
   }
 
+  /* 码率等参数无需重建编码器, 每轮请求开始前重新设置 */
+  if (_nlsEncoder != NULL && _nlsEncoder->setEncoderProfile(profile) < 0) {
+    LOG_WARN("Node:%p set encoder profile failed.", this);
+  }
+
+  // 编码线程池开启时, 本轮请求的编码交给编码线程
+  _asyncEncode = (_nlsEncoder != NULL && EncoderExecutor::isEnabled());
+
+  /* 格式转换及静音检测只处理PCM输入, 其他格式原样上传 */
+  const std::string& format = _request->getRequestParam()->_format;
+  bool pcmInput = (format == "pcm" || _encoder_type != ENCODER_NONE);
+
+  NlsAudioInputFormat inputFormat = _request->getRequestParam()->_inputFormat;
+  if (!pcmInput) {
+    inputFormat = NlsAudioInputFormat();
+  }
+  if (_converter.init(inputFormat, sampleRate) < 0) {
+    LOG_WARN("Node:%p init audio converter failed.", this);
+  }
+
+  NlsVadParam vadParam = _request->getRequestParam()->_vadParam;
+  if (vadParam.mode != VAD_MODE_NONE && !pcmInput) {
+    LOG_WARN("Node:%p vad is not supported for format %s.",
+             this, format.c_str());
+    vadParam.mode = VAD_MODE_NONE;
+  }
+  if (_vad.init(sampleRate, vadParam) < 0) {
+    LOG_WARN("Node:%p init vad failed, vad disabled.", this);
+  }
+
 #if defined(_MSC_VER)
   ReleaseMutex(_mtxNode);
 #else
@@ -28,13 +28,18 @@
 
 #include <queue>
 #include <string>
+#include <vector>
 #include <stdint.h>
 //#include "nlsEvent.h"
 #include "nlsEncoder.h"
+#include "nlsVad.h"
+#include "nlsAudioConverter.h"
 #include "error.h"
 #include "webSocketTcp.h"
 #include "webSocketFrameHandleBase.h"
 #include "SSLconnect.h"
+#include "trafficCapture.h"
+#include "nlsMemory.h"
 
 #include "event2/util.h"
 #include "event2/dns.h"
@@ -123,6 +128,32 @@ enum ConnectStatus {
   NodeInvalid
 };
 
+/*
+ * _nodeState按位打包连接状态与退出状态, 整体以CAS方式更新:
+ * bit0-7 ConnectStatus, bit8-15 ExitStatus, bit16 唤醒词结束, bit17 已销毁
+ */
+#define NODE_STATE_WORK_MASK 0x000000FFL
+#define NODE_STATE_EXIT_SHIFT 8
+#define NODE_STATE_EXIT_MASK 0x0000FF00L
+#define NODE_STATE_WAKE_STOP 0x00010000L
+#define NODE_STATE_DESTROY 0x00020000L
+#define NODE_STATE_INITIAL ((long)NodeInitial | ((long)ExitInvalid << NODE_STATE_EXIT_SHIFT))
+
+/* 时延追踪的时间点, 与NlsLatencyTrace的字段一一对应 */
+enum TracePoint {
+  TraceStart = 0,
+  TraceDnsStart,
+  TraceDnsEnd,
+  TraceTcpConnected,
+  TraceTlsHandshaked,
+  TraceUpgraded,
+  TraceStartSent,
+  TraceStarted,
+  TraceFirstResult,
+  TraceStopSent,
+  TraceCompleted
+};
+
 //class ConnectNode : public utility::BaseError {
 class ConnectNode {
 
@@ -136,6 +167,8 @@ class ConnectNode {
 
   void addCmdDataBuffer(CmdType type, const char* message = NULL);
   int addAudioDataBuffer(const uint8_t * frame, size_t length);
+  /* 将未凑满一帧的PCM数据补零编码后发出, stop前调用 */
+  int flushAudioFrames();
   int cmdNotify(CmdType type, const char* message);
 
   int nlsSend(const uint8_t * frame, size_t length);
@@ -158,32 +191,62 @@ class ConnectNode {
   void handlerEvent(const char* error, int errorCode,
                     NlsEvent::EventType eventType);
   void handlerTaskFailedEvent(std::string failedInfo);
+  void dispatchEvent(NlsEvent* event);
+  void drainCallbacks();
+  /* 回调执行完(或被丢弃)后调用, 最后一个回调唤醒drainCallbacks */
+  void finishCallback();
+  void waitCallbacks();
+
+  /* 编码线程池, 见EncoderExecutor */
+  int appendPendingAudio(const uint8_t * data, size_t dataSize, bool flush);
+  void discardPendingAudio();
+  int encodePendingAudio();
+  void sendEncodedAudio();
+  void drainEncodes();
 
   WorkThread* _eventThread;
+  volatile long _callbackWorker;    // 异步回调执行器中绑定的回调线程
+  volatile long _pendingCallbacks;  // 已投递尚未执行完的回调数
+  bool _asyncEncode;                // 本轮请求由编码线程池编码
+  volatile long _encoderWorker;     // 编码线程池中绑定的编码线程
+  volatile long _pendingEncodes;    // 已提交尚未发送完的编码任务数
+  bool _recycleOnEncoded;           // 编码结果发送完后回收, 仅事件线程访问
+  /* 与该node共用事件线程、回调线程及编码线程, 多声道转写时使用 */
+  ConnectNode* _affinityNode;
   evutil_socket_t _socketFd;
   urlAddress _url;
   INlsRequest *_request;
   HandleBaseOneParamWithReturnVoid<NlsEvent>* _handler;
 
   SSLconnect *_sslHandle;
-  ConnectStatus _workStatus;
   ConnectStatus getConnectNodeStatus();
-  std::string getConnectNodeStatusString();
-  void setConnectNodeStatus(ConnectStatus status);
+  const char* getConnectNodeStatusString();
+  /* 非法迁移(见isValidConnectTransition)被拒绝, 不写入并返回false */
+  bool setConnectNodeStatus(ConnectStatus status);
+  /* 仅当连接状态仍为from时迁移到to, 用于与其他线程竞争的迁移 */
+  bool compareAndSetStatus(ConnectStatus from, ConnectStatus to);
 
   ExitStatus getExitStatus();
-  std::string getExitStatusString();
-  void setExitStatus(ExitStatus status);
+  const char* getExitStatusString();
+  /* 退出状态只进不退, ExitCancel为终态 */
+  bool setExitStatus(ExitStatus status);
+
+  static const char* getConnectStatusName(ConnectStatus status);
+  static const char* getExitStatusName(ExitStatus status);
+
+  /* 结果文本由UTF-8转为GBK, 与node状态无关 */
+  static std::string utf8ToGbk(const std::string &strUTF8);
 
   void resetBufferLimit();
 
-  bool _isWakeStop;
   bool getWakeStatus();
   void setWakeStatus(bool status);
 
-  bool _isDestroy;
   bool updateDestroyStatus();
 
+  /* 请求结束后恢复为初始状态, 保留缓冲区与编码器以便复用 */
+  int resetConnectNode();
+
   int socketConnect();
     
   void initNlsEncoder();
@@ -194,9 +257,30 @@ class ConnectNode {
   inline struct evbuffer *getBinaryEvBuffer() {return _binaryEvBuffer;};
   inline struct evbuffer *getCmdEvBuffer() {return _cmdEvBuffer;};
   inline struct evbuffer *getWwvEvBuffer() {return _wwvEvBuffer;};
+  inline void getVadStats(NlsVadStats* stats) {_vad.getStats(stats);};
+
+  /*
+   * 记录时间点, 同一请求内只记录第一次;
+   * TraceDnsStart每次重连都记录, 并清除上一次尝试的连接时间点
+   */
+  void markTrace(TracePoint point);
+  void getLatencyTrace(NlsLatencyTrace* trace);
+  /* 收发缓冲及待编码PCM的当前字节数, 以及本次请求的峰值 */
+  void getMemoryUsage(NlsRequestMemoryUsage* usage);
+  inline void resetMemoryPeak() {_memAccount.resetPeak();};
+  /* 请求结束时在事件线程中调用, 确定结束状态并上报, 仅第一次调用生效 */
+  void finishTrace();
 
   int sendControlDirective();
 
+  /*
+   * 离线回放: 以录制文件代替socket, nlsReceive从replayer读取,
+   * nlsSend直接丢弃. NULL为恢复正常读写
+   */
+  inline void setReplaySource(TrafficReplayer* replayer) {
+    _replaySource = replayer;
+  };
+
  private:
   int _connectErrCode;
   int _aiFamily;
@@ -220,38 +304,82 @@ class ConnectNode {
   WebSocketTcp _webSocket;
   WebSocketHeaderType _wsType;
 
-  ExitStatus _exitStatus;
+  volatile long _nodeState;
   size_t _retryConnectCount;
 
   NlsEncoder * _nlsEncoder;
   ENCODER_TYPE _encoder_type;
 
+  /* 按编码帧长拼接sendAudio传入的PCM, 不足一帧部分留待下次 */
+  int encodeAudioFrames(const uint8_t * data, size_t dataSize);
+  std::vector<uint8_t> _pcmFrame;
+  size_t _pcmFrameFill;
+  std::vector<uint8_t> _encodedBuffer;
+
+  /* 编码及发送已通过静音检测的PCM */
+  int pushAudioData(const uint8_t * data, size_t dataSize);
+  NlsVad _vad;
+  std::vector<uint8_t> _vadOutput;
+
+  /* 输入PCM格式转换, 位于静音检测之前 */
+  NlsAudioConverter _converter;
+  std::vector<uint8_t> _convertOutput;
+
+  struct evbuffer *getAudioEvBuffer();
+
+  /* 以下受_mtxEncode保护, _pcmWorking仅编码线程访问 */
+  bool _encodeScheduled;
+  bool _encodeFlush;
+  std::vector<uint8_t> _pcmPending;
+  std::vector<uint8_t> _pcmWorking;
+
 #if defined(_MSC_VER)
   HANDLE _mtxNode;
   HANDLE _mtxCloseNode;
+  HANDLE _mtxEncode;
+  HANDLE _mtxTrace;
+  HANDLE _mtxDrain;
+  HANDLE _drainEvent;
 #else
   pthread_mutex_t  _mtxNode;
   pthread_mutex_t  _mtxCloseNode;
+  pthread_mutex_t  _mtxEncode;
+  pthread_mutex_t  _mtxTrace;
+  pthread_mutex_t  _mtxDrain;
+  pthread_cond_t   _cvDrain;
 #endif
 
 #if defined(__ANDROID__) || defined(__linux__)
-  int codeConvert(char *from_charset,
-                  char *to_charset,
-                  char *inbuf,
-                  size_t inlen,
-                  char *outbuf,
-                  size_t outlen);
+  static int codeConvert(char *from_charset,
+                         char *to_charset,
+                         char *inbuf,
+                         size_t inlen,
+                         char *outbuf,
+                         size_t outlen);
 #endif
 
-  std::string utf8ToGbk(const std::string &strUTF8);
   NlsEvent* convertResult(WebSocketFrame * frame);
 
   int parseFrame(WebSocketFrame *wsFrame);
+  bool isSupersededIntermediate(WebSocketFrame *wsFrame);
+
+  uint64_t _lastIntermediateUs;
+  std::string _lastIntermediateText;
+  size_t _droppedIntermediateCount;
 
   int socketWrite(const uint8_t * buffer, size_t len);
   int socketRead(uint8_t * buffer, size_t len);
 
   bool _isStop;
+
+  /* 时延追踪, 受_mtxTrace保护 */
+  NlsLatencyTrace _trace;
+
+  TrafficRecorder _recorder;
+  TrafficReplayer* _replaySource;
+
+  /* 各evbuffer的长度变化及_pcmPending的增删均计入 */
+  utility::NlsMemoryAccount _memAccount;
 };
 
 }
@@ -28,13 +28,14 @@
 #include "iNlsRequest.h"
 #include "nlog.h"
 #include "utility.h"
+#include "nlsMemory.h"
+#include "nlsMetrics.h"
 #include "connectNode.h"
 #include "workThread.h"
 #include "nlsEventNetWork.h"
 
 namespace AlibabaNls {
 
-#define DEFAULT_OPUS_FRAME_SIZE 640
 
 #ifdef _MSC_VER
 #pragma comment(lib, "ws2_32")
@@ -66,6 +67,9 @@ void NlsEventNetWork::initEventNetWork(int count) {
   pthread_mutex_lock(&_mtxThread);
 #endif
 
+  // 此后libevent已有分配, 不能再安装内存钩子
+  utility::NlsMemory::markLibeventInUse();
+
 #if defined(_MSC_VER)
 #ifdef EVTHREAD_USE_WINDOWS_THREADS_IMPLEMENTED
   LOG_DEBUG("evthread_use_windows_thread.");
@@ -101,6 +105,10 @@ void NlsEventNetWork::initEventNetWork(int count) {
   LOG_INFO("Work threads number: %d", _workThreadsNumber);
 
   _workThreadArray = new WorkThread[_workThreadsNumber];
+  for (size_t i = 0; i < _workThreadsNumber; i++) {
+    _workThreadArray[i]._threadIndex = i;
+    _workThreadArray[i]._activeNodes = utility::NlsMetrics::activeNodes(i);
+  }
 
   evdns_set_log_fn(DnsLogCb);
 
@@ -114,6 +122,10 @@ void NlsEventNetWork::initEventNetWork(int count) {
   return;
 }
 
+size_t NlsEventNetWork::getWorkThreadsNumber() {
+  return _workThreadsNumber;
+}
+
 void NlsEventNetWork::destroyEventNetWork() {
   LOG_INFO("destroy NlsEventNetWork begin.");
 #if defined(_MSC_VER)
@@ -171,9 +183,29 @@ int NlsEventNetWork::start(INlsRequest *request) {
 
   ConnectNode *node = request->getConnectNode();
 
+  if (node && utility::NlsMemory::rejectStart()) {
+    LOG_ERROR("Node:%p SDK memory limit reached, buffered %lld bytes, "
+              "reject start.", node,
+              (long long)utility::NlsMemory::getBufferedBytes());
+    utility::NlsMetrics::memoryRejectedStarts.add();
+#if defined(_MSC_VER)
+    ReleaseMutex(_mtxThread);
+#else
+    pthread_mutex_unlock(&_mtxThread);
+#endif
+    return -1;
+  }
+
   if (node && (node->getConnectNodeStatus() == NodeInitial) &&
       (node->getExitStatus() == ExitInvalid)) {
-    int num = selectThreadNumber();
+    int num = -1;
+    ConnectNode *affinity = node->_affinityNode;
+    if (affinity && affinity->_eventThread) {
+      // 与关联node使用同一事件线程
+      num = (int)(affinity->_eventThread - _workThreadArray);
+    } else {
+      num = selectThreadNumber();
+    }
     if (num == -1) {
     #if defined(_MSC_VER)
       ReleaseMutex(_mtxThread);
@@ -185,15 +217,30 @@ int NlsEventNetWork::start(INlsRequest *request) {
 
     LOG_DEBUG("Node:%p Select NO.%d thread.", node, num);
 
+    // 事件线程收到通知后即开始连接, 状态与编码器须在通知前就绪
+    if (!node->compareAndSetStatus(NodeInitial, NodeConnecting)) {
+      LOG_ERROR("Node:%p status changed to %s before start.",
+          node, node->getConnectNodeStatusString());
+    #if defined(_MSC_VER)
+      ReleaseMutex(_mtxThread);
+    #else
+      pthread_mutex_unlock(&_mtxThread);
+    #endif
+      return -1;
+    }
     node->_eventThread = &_workThreadArray[num];
-    WorkThread::insertQueueNode(node->_eventThread, request);
     node->resetBufferLimit();
+    node->initNlsEncoder();
+    node->markTrace(TraceStart);
+    node->resetMemoryPeak();
+    WorkThread::insertQueueNode(node->_eventThread, request);
 
     char cmd = 'c';
     int ret = send(node->_eventThread->_notifySendFd,
                    (char *)&cmd, sizeof(char), 0);
     if (ret < 1) {
       LOG_ERROR("Node:%p Start command is failed.", node);
+      node->compareAndSetStatus(NodeConnecting, NodeInitial);
       #if defined(_MSC_VER)
       ReleaseMutex(_mtxThread);
       #else
@@ -201,14 +248,13 @@ int NlsEventNetWork::start(INlsRequest *request) {
       #endif
       return -1;
     }
-    node->setConnectNodeStatus(NodeConnecting);
   } else {
     LOG_ERROR("Node:%p Invoke start failed:%d(%s), %d(%s).",
         node,
         node->getConnectNodeStatus(),
-        node->getConnectNodeStatusString().c_str(),
+        node->getConnectNodeStatusString(),
         node->getExitStatus(),
-        node->getExitStatusString().c_str());
+        node->getExitStatusString());
     #if defined(_MSC_VER)
     ReleaseMutex(_mtxThread);
     #else
@@ -217,8 +263,6 @@ int NlsEventNetWork::start(INlsRequest *request) {
     return -1;
   }
 
-  node->initNlsEncoder();
-
 #if defined(_MSC_VER)
   ReleaseMutex(_mtxThread);
 #else
@@ -248,14 +292,6 @@ int NlsEventNetWork::sendAudio(INlsRequest *request, const uint8_t * data,
 //      node->getConnectNodeStatusString(node->getConnectNodeStatus()).c_str(),
 //      node->getExitStatusString(node->getExitStatus()).c_str());
 
-  if (type == ENCODER_OPU) {
-    if (dataSize != DEFAULT_OPUS_FRAME_SIZE) {
-//      pthread_mutex_unlock(&_mtxThread);
-      LOG_ERROR("Node:%p The Opus data size is n't 640.", node);
-      return -1;
-    }
-  }
-
   ret = node->addAudioDataBuffer(data, dataSize);
 
 //  pthread_mutex_unlock(&_mtxThread);
@@ -263,20 +299,30 @@ int NlsEventNetWork::sendAudio(INlsRequest *request, const uint8_t * data,
 }
 
 int NlsEventNetWork::stop(INlsRequest *request, int type) {
+  ConnectNode * node = request->getConnectNode();
+
+  /*
+   * 编码模式下尚未凑满一帧的音频补零后先行发出.
+   * 异步编码时需等待编码线程及事件线程处理完已提交的音频,
+   * 在进程级的_mtxThread之外进行, 不阻塞其他请求的start/stop/cancel.
+   */
+  if (type == 0 && node->getConnectNodeStatus() != NodeInitial &&
+      node->getExitStatus() == ExitInvalid) {
+    node->flushAudioFrames();
+  }
+
 #if defined(_MSC_VER)
   WaitForSingleObject(_mtxThread, INFINITE);
 #else
   pthread_mutex_lock(&_mtxThread);
 #endif
 
-  ConnectNode * node = request->getConnectNode();
-
   if ((node->getConnectNodeStatus() == NodeInitial) ||
       (node->getExitStatus() != ExitInvalid)) {
     LOG_ERROR("Node:%p Invoke command failed. Status:%s and %s",
         node,
-        node->getConnectNodeStatusString().c_str(),
-        node->getExitStatusString().c_str());
+        node->getConnectNodeStatusString(),
+        node->getExitStatusString());
 #if defined(_MSC_VER)
     ReleaseMutex(_mtxThread);
 #else
@@ -40,6 +40,7 @@ class NlsEventNetWork {
   static void DnsLogCb(int w, const char *m);
   static void initEventNetWork(int count);
   static void destroyEventNetWork();
+  static size_t getWorkThreadsNumber();
 
   int start(INlsRequest *request);
   int sendAudio(INlsRequest *request, const uint8_t * data,
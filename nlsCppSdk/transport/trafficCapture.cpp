@@ -0,0 +1,382 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "nlog.h"
+#include "utility.h"
+#include "trafficCapture.h"
+
+namespace AlibabaNls {
+
+volatile long TrafficRecorder::_enabled = 0;
+volatile long TrafficRecorder::_sequence = 0;
+
+/* 抓包配置, 受s_mtxConfig保护 */
+static std::string s_captureDir;
+static bool s_captureSent = false;
+#if defined(_MSC_VER)
+static HANDLE s_mtxConfig = CreateMutex(NULL, FALSE, NULL);
+#else
+static pthread_mutex_t s_mtxConfig = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void lockConfig() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(s_mtxConfig, INFINITE);
+#else
+  pthread_mutex_lock(&s_mtxConfig);
+#endif
+}
+
+static void unlockConfig() {
+#if defined(_MSC_VER)
+  ReleaseMutex(s_mtxConfig);
+#else
+  pthread_mutex_unlock(&s_mtxConfig);
+#endif
+}
+
+static size_t putVarint(uint8_t* out, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+static bool getVarint(const std::vector<uint8_t>& data, size_t* pos,
+                      uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *pos < data.size(); shift += 7) {
+    uint8_t byte = data[(*pos)++];
+    result |= (uint64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+int TrafficRecorder::setCaptureDir(const char* dir, bool captureSent) {
+  if (dir == NULL || dir[0] == '\0') {
+    utility::atomicStore(&_enabled, 0);
+    LOG_INFO("Traffic capture disabled.");
+    return 0;
+  }
+
+  std::string probe = std::string(dir) + "/.nlsrec_probe";
+  FILE* file = fopen(probe.c_str(), "wb");
+  if (file == NULL) {
+    LOG_ERROR("Traffic capture dir %s is not writable.", dir);
+    return -1;
+  }
+  fclose(file);
+  remove(probe.c_str());
+
+  lockConfig();
+  s_captureDir = dir;
+  s_captureSent = captureSent;
+  unlockConfig();
+  utility::atomicStore(&_enabled, 1);
+
+  LOG_INFO("Traffic capture to %s, sent payload:%d.", dir, captureSent);
+  return 0;
+}
+
+TrafficRecorder::TrafficRecorder()
+    : _file(NULL), _captureSent(false), _lastUs(0) {
+#if defined(_MSC_VER)
+  _mtxFile = CreateMutex(NULL, FALSE, NULL);
+#else
+  pthread_mutex_init(&_mtxFile, NULL);
+#endif
+}
+
+TrafficRecorder::~TrafficRecorder() {
+  end();
+#if defined(_MSC_VER)
+  CloseHandle(_mtxFile);
+#else
+  pthread_mutex_destroy(&_mtxFile);
+#endif
+}
+
+void TrafficRecorder::lock() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxFile, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxFile);
+#endif
+}
+
+void TrafficRecorder::unlock() {
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxFile);
+#else
+  pthread_mutex_unlock(&_mtxFile);
+#endif
+}
+
+void TrafficRecorder::begin(int mode, int requestType, const char* token) {
+  if (!enabled()) {
+    return;
+  }
+
+  lock();
+  if (_file) {
+    unlock();
+    return;
+  }
+
+  lockConfig();
+  std::string dir = s_captureDir;
+  _captureSent = s_captureSent;
+  unlockConfig();
+
+  time_t now = time(NULL);
+  char name[128] = {0};
+  struct tm tmNow;
+#if defined(_MSC_VER)
+  localtime_s(&tmNow, &now);
+  long pid = (long)GetCurrentProcessId();
+#else
+  localtime_r(&now, &tmNow);
+  long pid = (long)getpid();
+#endif
+  char stamp[32] = {0};
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tmNow);
+  _ssnprintf(name, sizeof(name), "/nls_%s_%ld_%ld.nlsrec",
+             stamp, pid, utility::atomicAdd(&_sequence, 1));
+  std::string path = dir + name;
+
+  _file = fopen(path.c_str(), "wb");
+  if (_file == NULL) {
+    unlock();
+    LOG_WARN("Traffic capture open %s failed.", path.c_str());
+    return;
+  }
+
+  uint8_t header[TRAFFIC_FILE_HEADER_SIZE] = {0};
+  memcpy(header, TRAFFIC_FILE_MAGIC, 6);
+  header[6] = TRAFFIC_FILE_VERSION;
+  header[7] = _captureSent ? TRAFFIC_FLAG_SENT_PAYLOAD : 0;
+  header[8] = (uint8_t)mode;
+  header[9] = (uint8_t)requestType;
+  for (int i = 0; i < 4; i++) {
+    header[12 + i] = (uint8_t)(((uint64_t)now >> (8 * i)) & 0xFF);
+  }
+  fwrite(header, 1, sizeof(header), _file);
+
+  _token = token ? token : "";
+  _lastUs = utility::getMonotonicUs();
+  unlock();
+
+  LOG_INFO("Traffic capture to %s.", path.c_str());
+}
+
+void TrafficRecorder::record(TrafficDirection direction,
+                             const uint8_t* data, size_t length) {
+  if (!enabled() || length == 0) {
+    return;
+  }
+
+  lock();
+  if (_file == NULL) {
+    unlock();
+    return;
+  }
+
+  if (direction == TrafficSent && !_captureSent) {
+    direction = TrafficSentSize;
+  }
+
+  const uint8_t* payload = data;
+  if (direction == TrafficSent && !_token.empty()) {
+    // 升级请求中的token不写入文件
+    _masked.assign(data, data + length);
+    std::vector<uint8_t>::iterator it = _masked.begin();
+    while ((it = std::search(it, _masked.end(),
+                             _token.begin(), _token.end())) != _masked.end()) {
+      std::fill(it, it + _token.size(), '*');
+      it += _token.size();
+    }
+    payload = &_masked[0];
+  }
+
+  uint64_t now = utility::getMonotonicUs();
+  uint8_t header[24];
+  size_t headerSize = 0;
+  header[headerSize++] = (uint8_t)direction;
+  headerSize += putVarint(header + headerSize, now - _lastUs);
+  headerSize += putVarint(header + headerSize, length);
+  _lastUs = now;
+
+  fwrite(header, 1, headerSize, _file);
+  if (direction != TrafficSentSize) {
+    fwrite(payload, 1, length, _file);
+  }
+  unlock();
+}
+
+void TrafficRecorder::end() {
+  lock();
+  if (_file) {
+    fclose(_file);
+    _file = NULL;
+  }
+  _token.clear();
+  unlock();
+}
+
+TrafficReplayer::TrafficReplayer()
+    : _next(0), _nextPos(0), _speed(1.0), _beginUs(0), _waitUs(0),
+      _mode(0), _requestType(0), _startTime(0), _durationUs(0),
+      _receivedBytes(0), _sentChunks(0), _sentBytes(0) {}
+
+int TrafficReplayer::load(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    LOG_ERROR("Replay open %s failed.", path);
+    return -1;
+  }
+
+  _data.clear();
+  uint8_t buffer[16 * 1024];
+  size_t n = 0;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    _data.insert(_data.end(), buffer, buffer + n);
+  }
+  fclose(file);
+
+  if (_data.size() < TRAFFIC_FILE_HEADER_SIZE ||
+      memcmp(&_data[0], TRAFFIC_FILE_MAGIC, 6) != 0 ||
+      _data[6] != TRAFFIC_FILE_VERSION) {
+    LOG_ERROR("Replay %s is not a traffic capture file.", path);
+    return -1;
+  }
+
+  _mode = _data[8];
+  _requestType = _data[9];
+  _startTime = 0;
+  for (int i = 0; i < 4; i++) {
+    _startTime |= (uint64_t)_data[12 + i] << (8 * i);
+  }
+
+  _chunks.clear();
+  _receivedBytes = 0;
+  _sentChunks = 0;
+  _sentBytes = 0;
+  uint64_t offsetUs = 0;
+  size_t pos = TRAFFIC_FILE_HEADER_SIZE;
+  while (pos < _data.size()) {
+    uint8_t direction = _data[pos++];
+    uint64_t deltaUs = 0;
+    uint64_t length = 0;
+    if (!getVarint(_data, &pos, &deltaUs) ||
+        !getVarint(_data, &pos, &length)) {
+      LOG_WARN("Replay %s truncated record header.", path);
+      break;
+    }
+    offsetUs += deltaUs;
+
+    if (direction == TrafficSentSize) {
+      _sentChunks++;
+      _sentBytes += length;
+      continue;
+    }
+    if (length > _data.size() - pos) {
+      // 进程退出时未关闭文件, 丢弃残缺的最后一条
+      LOG_WARN("Replay %s truncated record.", path);
+      break;
+    }
+    if (direction == TrafficReceived) {
+      Chunk chunk;
+      chunk.offsetUs = offsetUs;
+      chunk.pos = pos;
+      chunk.length = length;
+      _chunks.push_back(chunk);
+      _receivedBytes += length;
+    } else if (direction == TrafficSent) {
+      _sentChunks++;
+      _sentBytes += length;
+    } else {
+      LOG_ERROR("Replay %s unknown direction %d.", path, direction);
+      return -1;
+    }
+    pos += length;
+  }
+  _durationUs = offsetUs;
+
+  rewind();
+  return 0;
+}
+
+void TrafficReplayer::rewind() {
+  _next = 0;
+  _nextPos = 0;
+  _beginUs = 0;
+  _waitUs = 0;
+}
+
+int TrafficReplayer::read(uint8_t* buffer, size_t maxSize) {
+  if (finished()) {
+    return -1;
+  }
+
+  uint64_t now = utility::getMonotonicUs();
+  if (_beginUs == 0) {
+    _beginUs = now;
+  }
+
+  const Chunk& chunk = _chunks[_next];
+  if (_speed > 0 && _nextPos == 0) {
+    uint64_t dueUs = _beginUs + (uint64_t)(chunk.offsetUs / _speed);
+    if (dueUs > now) {
+      uint64_t waitUs = dueUs - now;
+#if defined(_MSC_VER)
+      Sleep((DWORD)(waitUs / 1000));
+#else
+      usleep((useconds_t)waitUs);
+#endif
+      _waitUs += waitUs;
+    }
+  }
+
+  size_t length = chunk.length - _nextPos;
+  if (length > maxSize) {
+    length = maxSize;
+  }
+  memcpy(buffer, &_data[chunk.pos + _nextPos], length);
+  _nextPos += length;
+  if (_nextPos >= chunk.length) {
+    _next++;
+    _nextPos = 0;
+  }
+  return (int)length;
+}
+
+}  // namespace AlibabaNls
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_TRAFFIC_CAPTURE_H
+#define NLS_SDK_TRAFFIC_CAPTURE_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "nlsAtomic.h"
+
+namespace AlibabaNls {
+
+/*
+ * 抓包文件格式, 多字节整数均为小端:
+ *   文件头16字节: "NLSREC" 版本(1) 标志(1) 语音类型NlsType(1)
+ *                 请求类型NlsRequestType(1) 保留(2) 开始时间(4, 秒)
+ *   记录: 方向(1) 距上一条记录的时间(varint, us) 长度(varint) 数据
+ * 记录位于nlsSend/nlsReceive处, 即TLS之下的明文.
+ * 发送方向默认只记录长度(TrafficSentSize), 避免写出音频.
+ */
+#define TRAFFIC_FILE_MAGIC "NLSREC"
+#define TRAFFIC_FILE_VERSION 1
+#define TRAFFIC_FILE_HEADER_SIZE 16
+#define TRAFFIC_FLAG_SENT_PAYLOAD 0x01
+
+enum TrafficDirection {
+  TrafficSent = 1,      /* 发送, 含数据(token已替换为'*') */
+  TrafficSentSize = 2,  /* 发送, 仅长度 */
+  TrafficReceived = 3   /* 接收 */
+};
+
+/*
+ * 每个ConnectNode一个, 一次请求写一个文件:
+ * <目录>/nls_<开始时间>_<进程号>_<序号>.nlsrec
+ * 未开启抓包时record只多一次标志读取.
+ */
+class TrafficRecorder {
+ public:
+  TrafficRecorder();
+  ~TrafficRecorder();
+
+  /*
+   * @param dir         输出目录, NULL或空串为关闭
+   * @param captureSent 是否记录发送数据
+   * @return 成功返回0, 目录不可写返回-1
+   */
+  static int setCaptureDir(const char* dir, bool captureSent);
+
+  static inline bool enabled() {
+    return utility::atomicLoad(&_enabled) != 0;
+  }
+
+  /* 连接建立后发送升级请求前调用, 已打开时忽略 */
+  void begin(int mode, int requestType, const char* token);
+  void record(TrafficDirection direction, const uint8_t* data, size_t length);
+  /* 请求结束时调用, 关闭文件 */
+  void end();
+
+ private:
+  void lock();
+  void unlock();
+
+  FILE* _file;
+  bool _captureSent;
+  uint64_t _lastUs;
+  std::string _token;
+  std::vector<uint8_t> _masked;
+
+#if defined(_MSC_VER)
+  HANDLE _mtxFile;
+#else
+  pthread_mutex_t _mtxFile;
+#endif
+
+  static volatile long _enabled;
+  static volatile long _sequence;
+};
+
+/*
+ * 读取抓包文件, 按录制时的节奏或尽快返回接收数据,
+ * 由ConnectNode::nlsReceive代替socket读取, 用于离线回放解析及分发.
+ */
+class TrafficReplayer {
+ public:
+  TrafficReplayer();
+
+  /* @return 成功返回0, 文件不存在或格式错误返回-1 */
+  int load(const char* path);
+
+  /* @param speed 回放倍速, 1为原始节奏, 0为尽快 */
+  inline void setSpeed(double speed) { _speed = speed < 0 ? 0 : speed; };
+
+  /* 回到开头, 可重复回放 */
+  void rewind();
+
+  /*
+   * 等到下一段接收数据的时间点后复制到buffer
+   * @return 复制的字节数, 已全部回放返回-1
+   */
+  int read(uint8_t* buffer, size_t maxSize);
+
+  inline bool finished() const { return _next >= _chunks.size(); };
+
+  inline int getMode() const { return _mode; };
+  inline int getRequestType() const { return _requestType; };
+  inline uint64_t getStartTime() const { return _startTime; };
+  inline size_t getReceivedChunks() const { return _chunks.size(); };
+  inline size_t getReceivedBytes() const { return _receivedBytes; };
+  inline size_t getSentChunks() const { return _sentChunks; };
+  inline size_t getSentBytes() const { return _sentBytes; };
+  /* 录制时长(us), 即最后一条记录的时间 */
+  inline uint64_t getDurationUs() const { return _durationUs; };
+  /* 本轮回放中等待时间点的累计时长(us) */
+  inline uint64_t getWaitUs() const { return _waitUs; };
+
+ private:
+  struct Chunk {
+    uint64_t offsetUs;
+    size_t pos;
+    size_t length;
+  };
+
+  std::vector<uint8_t> _data;
+  std::vector<Chunk> _chunks;
+  size_t _next;
+  size_t _nextPos;  // _chunks[_next]中已读取的字节数
+
+  double _speed;
+  uint64_t _beginUs;
+  uint64_t _waitUs;
+
+  int _mode;
+  int _requestType;
+  uint64_t _startTime;
+  uint64_t _durationUs;
+  size_t _receivedBytes;
+  size_t _sentChunks;
+  size_t _sentBytes;
+};
+
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_TRAFFIC_CAPTURE_H
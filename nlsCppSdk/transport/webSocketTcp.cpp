@@ -25,6 +25,7 @@
 #include <fstream>
 #include <sstream>
 #include <stdlib.h>
+#include "event2/buffer.h"
 #include "webSocketTcp.h"
 #include "utility.h"
 #include "nlog.h"
@@ -366,39 +367,31 @@ int WebSocketTcp::textFrame(const uint8_t * buffer,
                       buffer, length, frame, frameSize);
 }
 
-int WebSocketTcp::framePackage(WebSocketHeaderType::OpCodeType codeType,
-                               const uint8_t * buffer,
-                               size_t length,
-                               uint8_t ** frame,
-                               size_t * frameSize) {
-  bool useMask = true;
-  const uint8_t masKingKey[4] = { 0x12, 0x34, 0x56, 0x78 };
-  const int headlen = 2 + (length >= 126 ? 2 : 0) + (length >= 65536 ? 6 : 0) + (useMask ? 4 : 0);
+static const uint8_t kMaskingKey[4] = { 0x12, 0x34, 0x56, 0x78 };
+
+size_t WebSocketTcp::frameSize(size_t length) {
+  return 2 + (length >= 126 ? 2 : 0) + (length >= 65536 ? 6 : 0) + 4 +
+         length;
+}
 
-  uint8_t* header = (uint8_t*)calloc(headlen, sizeof(uint8_t));//new uint8_t[headlen];
-  //memset(header, 0, sizeof(uint8_t)*headlen);
+/* 向frame写入头部及掩码后的负载, frame长度须为frameSize(length) */
+static void fillFrame(WebSocketHeaderType::OpCodeType codeType,
+                      const uint8_t * buffer, size_t length,
+                      uint8_t * frame) {
+  uint8_t* header = frame;
+  size_t headlen = 0;
   header[0] = 0x80 | codeType;
 
   if (length < 126) {
-    header[1] = (length & 0xff) | (useMask ? 0x80 : 0);
-    if (useMask) {
-      header[2] = masKingKey[0];
-      header[3] = masKingKey[1];
-      header[4] = masKingKey[2];
-      header[5] = masKingKey[3];
-    }
+    header[1] = (length & 0xff) | 0x80;
+    headlen = 2;
   } else if (length < 65536) {
-    header[1] = 126 | (useMask ? 0x80 : 0);
+    header[1] = 126 | 0x80;
     header[2] = (length >> 8) & 0xff;
     header[3] = (length >> 0) & 0xff;
-    if (useMask) {
-      header[4] = masKingKey[0];
-      header[5] = masKingKey[1];
-      header[6] = masKingKey[2];
-      header[7] = masKingKey[3];
-    }
+    headlen = 4;
   } else { // TODO: run coverage testing here
-    header[1] = 127 | (useMask ? 0x80 : 0);
+    header[1] = 127 | 0x80;
     header[2] = ((uint64_t)length >> 56) & 0xff;
     header[3] = ((uint64_t)length >> 48) & 0xff;
     header[4] = ((uint64_t)length >> 40) & 0xff;
@@ -407,26 +400,16 @@ int WebSocketTcp::framePackage(WebSocketHeaderType::OpCodeType codeType,
     header[7] = ((uint64_t)length >> 16) & 0xff;
     header[8] = ((uint64_t)length >> 8) & 0xff;
     header[9] = ((uint64_t)length >> 0) & 0xff;
-    if (useMask) {
-      header[10] = masKingKey[0];
-      header[11] = masKingKey[1];
-      header[12] = masKingKey[2];
-      header[13] = masKingKey[3];
-    }
+    headlen = 10;
+  }
+  memcpy(header + headlen, kMaskingKey, 4);
+  headlen += 4;
+
+  uint8_t* payload = frame + headlen;
+  for (size_t i = 0; i != length; ++i) {
+    payload[i] = buffer[i] ^ kMaskingKey[i & 0x3];
   }
 
-  // N.B. - tmpBuffer will keep growing until it can be transmitted over the socket:
-  // uint8_t * tmpBuffer = new uint8_t[headlen + length];
-  // memset(tmpBuffer, 0, sizeof(uint8_t) * (headlen + length));
-  // memcpy(tmpBuffer, header, headlen);
-  // memcpy(tmpBuffer + headlen, (uint8_t*)buffer, length);
-
-  *frameSize = (headlen + length);
-  *frame = (uint8_t *)calloc(*frameSize, sizeof(uint8_t));
-  memset(*frame, 0, *frameSize);
-  memcpy(*frame, header, headlen);
-  memcpy(*frame + headlen, (uint8_t*)buffer, length);
- 
 #ifdef OPU_DEBUG
   std::ofstream ofs;
   ofs.open("./out.opus", std::ios::out | std::ios::app | std::ios::binary);
@@ -436,19 +419,42 @@ int WebSocketTcp::framePackage(WebSocketHeaderType::OpCodeType codeType,
     ofs.close();
   }
 #endif
+}
 
-  //LOG_DEBUG("framePackage Receive Data: %d ", *frameSize);
-
-  if (useMask) {
-    for (size_t i = 0; i != length; ++i) {
-      *(*frame + headlen + length - length + i) ^= masKingKey[i & 0x3];
-    }
+int WebSocketTcp::framePackage(WebSocketHeaderType::OpCodeType codeType,
+                               const uint8_t * buffer,
+                               size_t length,
+                               uint8_t ** frame,
+                               size_t * frameSize) {
+  *frameSize = WebSocketTcp::frameSize(length);
+  *frame = (uint8_t *)malloc(*frameSize);
+  if (*frame == NULL) {
+    *frameSize = 0;
+    return -1;
   }
-
-  free(header);
-  header = NULL;
-
+  fillFrame(codeType, buffer, length, *frame);
   return 0;
 }
 
+int WebSocketTcp::frameToBuffer(WebSocketHeaderType::OpCodeType codeType,
+                                const uint8_t * buffer,
+                                size_t length,
+                                struct evbuffer * output) {
+  size_t size = frameSize(length);
+  struct evbuffer_iovec vec;
+  // 只取一段, 保证预留空间连续
+  if (evbuffer_reserve_space(output, size, &vec, 1) != 1 ||
+      vec.iov_len < size) {
+    LOG_ERROR("reserve %zu bytes for websocket frame failed.", size);
+    return -1;
+  }
+  fillFrame(codeType, buffer, length, (uint8_t *)vec.iov_base);
+  vec.iov_len = size;
+  if (evbuffer_commit_space(output, &vec, 1) != 0) {
+    LOG_ERROR("commit websocket frame failed.");
+    return -1;
+  }
+  return (int)size;
+}
+
 }
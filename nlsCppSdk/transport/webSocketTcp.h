@@ -21,6 +21,8 @@
 #include <string>
 #include <stdint.h>
 
+struct evbuffer;
+
 namespace AlibabaNls {
 
 #define BUFFER_SIZE 2048  //1024
@@ -90,6 +92,16 @@ class WebSocketTcp {
   int textFrame(const uint8_t * buffer, size_t length,
                 uint8_t** frame, size_t * frameSize);
 
+  /* 负载为length字节时的帧长度(含头部及掩码) */
+  static size_t frameSize(size_t length);
+  /*
+   * @brief 在output尾部预留连续空间并直接封装帧, 不另行分配帧内存
+   * @return 成功返回帧长度, 失败返回-1
+   */
+  int frameToBuffer(WebSocketHeaderType::OpCodeType type,
+                    const uint8_t * buffer, size_t length,
+                    struct evbuffer * output);
+
   int receiveFullWebSocketFrame(uint8_t * frame, size_t frameSize,
                                 WebSocketHeaderType* ws, WebSocketFrame* rData);
   int decodeHeaderSizeWebSocketFrame(uint8_t * buffer, size_t length,
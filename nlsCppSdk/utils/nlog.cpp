@@ -15,8 +15,14 @@
  */
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <ctime>
+#if !defined(_MSC_VER)
+#include <sys/time.h>
+#include <unistd.h>
+#endif
 
 #if defined(__ANDRIOD__)
 #include <android/log.h>
@@ -30,6 +36,7 @@
 #endif
 
 #include "nlog.h"
+#include "nlsLogSink.h"
 #include "utility.h"
 
 namespace AlibabaNls {
@@ -39,34 +46,12 @@ using std::string;
 using std::cout;
 using std::endl;
 
-#define LOG_BUFFER_SIZE      2048
 #define LOG_BUFFER_PLUS_SIZE 2560
 #define LOG_FILES_NUMBER     20
 #define LOG_FILE_BASE_SIZE   1024*1024
 #define LOG_TAG              "AliSpeechLib"
-
-#define LOG_FORMAT_STRING(a, l, f, b)  \
-          char tmpBuffer[LOG_BUFFER_SIZE] = {0}; \
-          va_list arg; \
-          va_start(arg, f); \
-          vsnprintf(tmpBuffer, LOG_BUFFER_SIZE - 1, f, arg); \
-          va_end(arg); \
-          _ssnprintf(b, LOG_BUFFER_SIZE, "[ID:%lu][%s:%d]%s", pthreadSelfId(), a, l, tmpBuffer);
-
-#define LOG_PRINT_COMMON(level, message) { \
-          time_t tt = time(NULL); \
-          struct tm* ptm = localtime(&tt); \
-          fprintf(stdout, "%4d-%02d-%02d %02d:%02d:%02d %s(%s): %s\n",\
-          (int)ptm->tm_year + 1900, \
-          (int)ptm->tm_mon + 1, \
-          (int)ptm->tm_mday, \
-          (int)ptm->tm_hour, \
-          (int)ptm->tm_min, \
-          (int)ptm->tm_sec, \
-          LOG_TAG, \
-          level, \
-          message); \
-        }
+/* logException的输出级别, 不参与级别过滤 */
+#define LOG_LEVEL_EXCEPTION  0
 
 #if defined(_MSC_VER)
 HANDLE NlsLog::_mtxLog = CreateMutex(NULL, FALSE, NULL);
@@ -74,15 +59,34 @@ HANDLE NlsLog::_mtxLog = CreateMutex(NULL, FALSE, NULL);
 pthread_mutex_t NlsLog::_mtxLog = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
+volatile long NlsLog::_activeLevel = 0;
+volatile long NlsLog::_sinkActive = 0;
+
 NlsLog* NlsLog::_logInstance = new NlsLog();
 
 NlsLog::NlsLog() {
-  _logLevel = 1;
   _isStdout = true;
   _isConfig = false;
+  _stamp[0] = '\0';
+  _stampExpireUs = 0;
+  _sink = NULL;
+  _asyncEnabled = false;
+  _asyncRingSize = 0;
+  _asyncFlushIntervalMs = 0;
+  _asyncFsyncIntervalMs = 0;
+  _asyncBinary = false;
 }
 
 NlsLog::~NlsLog() {
+  if (_sink) {
+    // 仍在append中的线程可能正使用各自的环形缓冲, 须等其退出后再释放
+    atomicStore(&_sinkActive, 0);
+    NlsLogSink::waitThreads();
+    _sink->stop();
+    delete _sink;
+    _sink = NULL;
+  }
+
 #if (!defined(__ANDRIOD__)) && (!defined(__APPLE__))
 #if defined(_MSC_VER) || defined(__linux__)
   if (!_isStdout && _isConfig) {
@@ -113,6 +117,7 @@ NlsLog* NlsLog::getInstance() {
 }
 
 void NlsLog::destroyLogInstance() {
+  atomicStore(&_activeLevel, 0);
   if (_logInstance) {
     delete _logInstance;
     _logInstance = NULL;
@@ -156,7 +161,21 @@ void NlsLog::logConfig(const char* name, int level,
 
   if (!_isConfig) {
 #if (!defined(__ANDRIOD__)) && (!defined(__APPLE__))
-    if (name && (fileSize > 0)) {
+    if (name && (fileSize > 0) && _asyncEnabled) {
+      _sink = new NlsLogSink();
+      if (_sink->start(name, fileSize, fileNum, _asyncRingSize,
+                       _asyncFlushIntervalMs, _asyncFsyncIntervalMs,
+                       _asyncBinary) < 0) {
+        cout << "Async log start failed, use synchronous log." << endl;
+        delete _sink;
+        _sink = NULL;
+      }
+    }
+
+    if (_sink) {
+      _isStdout = false;
+      atomicStore(&_sinkActive, 1);
+    } else if (name && (fileSize > 0)) {
       log4cpp::PatternLayout* layout;
       layout = new log4cpp::PatternLayout();
       layout->setConversionPattern("%d: %p %c%x: %m%n");
@@ -195,8 +214,8 @@ void NlsLog::logConfig(const char* name, int level,
       _isStdout = true;
     }
 #endif
-    _logLevel = level;
     _isConfig = true;
+    atomicStore(&_activeLevel, level);
   }
 
 #ifdef _MSC_VER
@@ -209,140 +228,217 @@ void NlsLog::logConfig(const char* name, int level,
   return;
 }
 
-void NlsLog::logVerbose(const char* function, int line, const char *format, ...) {
-  if (!format || !_isConfig) {
-    return;
-  }
-
-  char message[LOG_BUFFER_PLUS_SIZE] = {0};
-  LOG_FORMAT_STRING(function, line, format, message);
+int NlsLog::asyncConfig(size_t ringSize, int flushIntervalMs,
+                        int fsyncIntervalMs, bool binary) {
+  int ret = 0;
+#ifdef _MSC_VER
+  WaitForSingleObject(_mtxLog, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxLog);
+#endif
 
-#if defined (__ANDRIOD__)
-  __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, "%s", message);
-#elif defined(_MSC_VER) || defined(__linux__)
-  if (!_isStdout) {
-    getCategory().debug(message);
+  if (_isConfig) {
+    ret = -1;
   } else {
-    LOG_PRINT_COMMON("VERBOSE", message);
+    _asyncEnabled = true;
+    _asyncRingSize = ringSize;
+    _asyncFlushIntervalMs = flushIntervalMs;
+    _asyncFsyncIntervalMs = fsyncIntervalMs;
+    _asyncBinary = binary;
   }
+
+#ifdef _MSC_VER
+  ReleaseMutex(_mtxLog);
 #else
-  LOG_PRINT_COMMON("VERBOSE", message);
+  pthread_mutex_unlock(&_mtxLog);
 #endif
+  return ret;
 }
 
-void NlsLog::logDebug(const char* function, int line, const char *format, ...) {
-  if (!format || !_isConfig) {
-    return;
+int NlsLog::getAsyncStats(NlsAsyncLogStats* stats) {
+  if (stats == NULL) {
+    return -1;
   }
-
-  char message[LOG_BUFFER_PLUS_SIZE] = {0};
-  LOG_FORMAT_STRING(function, line, format, message);
-
-  if (_logLevel >= 4) {
-  #if defined (__ANDRIOD__)
-    __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, "%s", message);
-  #elif defined(_MSC_VER) || defined(__linux__)
-    if (!_isStdout) {
-      getCategory().debug(message);
-    } else {
-      LOG_PRINT_COMMON("DEBUG", message);
-    }
-  #else
-    LOG_PRINT_COMMON("DEBUG", message);
-  #endif
+  NlsLogThreadRing* threadRing = NULL;
+  NlsLogSink* sink = acquireSink(&threadRing);
+  if (sink == NULL) {
+    return -1;
   }
+  sink->getStats(stats);
+  releaseSink(threadRing);
+  return 0;
 }
 
-void NlsLog::logInfo(const char* function, int line, const char * format, ...) {
-  if (!format || !_isConfig) {
-    return;
+/*
+ * 先置位本线程的inUse再检查发布标志, 与析构中先清除标志再等待inUse相对,
+ * 两者均为全屏障, 析构看到所有inUse清零后不会再有写入者使用_sink.
+ * inUse只在本线程的登记项上读写, 各线程互不争用.
+ */
+NlsLogSink* NlsLog::acquireSink(NlsLogThreadRing** threadRing) {
+  if (!atomicLoadRelaxed(&_sinkActive)) {
+    return NULL;
   }
-
-  char message[LOG_BUFFER_PLUS_SIZE] = {0};
-  LOG_FORMAT_STRING(function, line, format, message);
-
-  if (_logLevel >= 3) {
-  #if defined (__ANDRIOD__)
-    __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, "%s", message);
-  #elif defined(_MSC_VER) || defined(__linux__)
-    if (!_isStdout) {
-      getCategory().info(message);
-    } else {
-      LOG_PRINT_COMMON("INFO", message);
-    }
-  #else
-    LOG_PRINT_COMMON("INFO", message);
-  #endif
+  NlsLogThreadRing* ring = NlsLogSink::enterThread(pthreadSelfId());
+  if (ring == NULL) {
+    return NULL;
   }
-}
-
-void NlsLog::logWarn(const char* function, int line, const char * format, ...) {
-  if (!format || !_isConfig) {
-    return;
+  if (atomicLoadAcquire(&_sinkActive)) {
+    *threadRing = ring;
+    return _sink;
   }
+  NlsLogSink::leaveThread(ring);
+  return NULL;
+}
 
-  char message[LOG_BUFFER_PLUS_SIZE] = {0};
-  LOG_FORMAT_STRING(function, line, format, message);
+void NlsLog::releaseSink(NlsLogThreadRing* threadRing) {
+  NlsLogSink::leaveThread(threadRing);
+}
 
-  if (NlsLog::_logLevel >= 2) {
-  #if defined (__ANDRIOD__)
-    __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, "%s", message);
-  #elif defined(_MSC_VER) || defined(__linux__)
-    if (!_isStdout) {
-      getCategory().warn(message);
-    } else {
-      LOG_PRINT_COMMON("WARN", message);
-    }
-  #else
-    LOG_PRINT_COMMON("WARN", message);
-  #endif
+static const char* levelTag(int level) {
+  switch (level) {
+    case NLS_LOG_LEVEL_DEBUG:
+      return "DEBUG";
+    case NLS_LOG_LEVEL_INFO:
+      return "INFO";
+    case NLS_LOG_LEVEL_WARN:
+      return "WARN";
+    case LOG_LEVEL_EXCEPTION:
+      return "EXCEPTION";
+    default:
+      return "ERROR";
   }
 }
 
-void NlsLog::logError(const char* function, int line, const char * format, ...) {
-  if (!format || !_isConfig) {
-    return;
-  }
+/*
+ * 刷新时间前缀, 返回距离下一整秒的微秒数
+ */
+static uint64_t formatTimestamp(char* stamp, size_t size) {
+#if defined(_MSC_VER)
+  SYSTEMTIME st;
+  GetLocalTime(&st);
+  _ssnprintf(stamp, size, "%4d-%02d-%02d %02d:%02d:%02d",
+             (int)st.wYear, (int)st.wMonth, (int)st.wDay,
+             (int)st.wHour, (int)st.wMinute, (int)st.wSecond);
+  return (uint64_t)(1000 - st.wMilliseconds) * 1000;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  time_t tt = tv.tv_sec;
+  struct tm tmv;
+  localtime_r(&tt, &tmv);
+  _ssnprintf(stamp, size, "%4d-%02d-%02d %02d:%02d:%02d",
+             (int)tmv.tm_year + 1900, (int)tmv.tm_mon + 1, (int)tmv.tm_mday,
+             (int)tmv.tm_hour, (int)tmv.tm_min, (int)tmv.tm_sec);
+  return (uint64_t)(1000000 - tv.tv_usec);
+#endif
+}
 
-  char message[LOG_BUFFER_PLUS_SIZE] = {0};
-  LOG_FORMAT_STRING(function, line, format, message);
+void NlsLog::printStdout(int level, const char* message) {
+  char stamp[sizeof(_stamp)];
+  uint64_t now = getMonotonicUs();
 
-  if (NlsLog::_logLevel >= 1) {
-  #if defined (__ANDRIOD__)
-    __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, "%s", message);
-  #elif defined(_MSC_VER) || defined(__linux__)
-    if (!_isStdout) {
-      getCategory().error(message);
-    } else {
-      LOG_PRINT_COMMON("ERROR", message);
-    }
-  #else
-    LOG_PRINT_COMMON("ERROR", message);
-  #endif
+#ifdef _MSC_VER
+  WaitForSingleObject(_mtxLog, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxLog);
+#endif
+  // 同一秒内复用已格式化的时间, 不再调用time/localtime
+  if (now >= _stampExpireUs) {
+    _stampExpireUs = now + formatTimestamp(_stamp, sizeof(_stamp));
   }
+  memcpy(stamp, _stamp, sizeof(stamp));
+#ifdef _MSC_VER
+  ReleaseMutex(_mtxLog);
+#else
+  pthread_mutex_unlock(&_mtxLog);
+#endif
+
+  fprintf(stdout, "%s %s(%s): %s\n", stamp, LOG_TAG, levelTag(level), message);
 }
 
-//FATAL
-void NlsLog::logException(const char* function, int line, const char *format, ...) {
-  if (!format || !_isConfig) {
+/*
+ * 级别已由调用方判断, 此处只做一次格式化: 前缀与正文写入同一缓冲
+ */
+void NlsLog::logOutput(int level, const char* function, int line,
+                       const char* format, va_list args) {
+  char message[LOG_BUFFER_PLUS_SIZE];
+
+  // 异步日志只格式化正文, 时间及前缀字段原样写入缓冲, 由日志线程格式化
+  NlsLogThreadRing* threadRing = NULL;
+  NlsLogSink* sink = acquireSink(&threadRing);
+  if (sink) {
+    int length = vsnprintf(message, LOG_BUFFER_PLUS_SIZE, format, args);
+    if (length < 0) {
+      length = 0;
+    } else if (length >= LOG_BUFFER_PLUS_SIZE) {
+      length = LOG_BUFFER_PLUS_SIZE - 1;
+    }
+    sink->append(threadRing, level, function, (unsigned int)line,
+                 message, (size_t)length);
+    releaseSink(threadRing);
     return;
   }
 
-  char message[LOG_BUFFER_PLUS_SIZE] = {0};
-  LOG_FORMAT_STRING(function, line, format, message);
+  int prefix = _ssnprintf(message, LOG_BUFFER_PLUS_SIZE, "[ID:%lu][%s:%d]",
+                          pthreadSelfId(), function, line);
+  if (prefix < 0 || prefix >= LOG_BUFFER_PLUS_SIZE) {
+    prefix = 0;
+  }
+  int length = vsnprintf(message + prefix, LOG_BUFFER_PLUS_SIZE - prefix,
+                         format, args);
+  if (length < 0) {
+    message[prefix] = '\0';
+  }
+  message[LOG_BUFFER_PLUS_SIZE - 1] = '\0';
 
 #if defined (__ANDRIOD__)
   __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, "%s", message);
 #elif defined(_MSC_VER) || defined(__linux__)
   if (!_isStdout) {
-    getCategory().fatal(message);
+    switch (level) {
+      case NLS_LOG_LEVEL_DEBUG:
+        getCategory().debug(message);
+        break;
+      case NLS_LOG_LEVEL_INFO:
+        getCategory().info(message);
+        break;
+      case NLS_LOG_LEVEL_WARN:
+        getCategory().warn(message);
+        break;
+      case LOG_LEVEL_EXCEPTION:
+        getCategory().fatal(message);
+        break;
+      default:
+        getCategory().error(message);
+        break;
+    }
   } else {
-    LOG_PRINT_COMMON("EXCEPTION", message);
+    printStdout(level, message);
   }
 #else
-  LOG_PRINT_COMMON("EXCEPTION", message);
+  printStdout(level, message);
 #endif
 }
 
+#define NLS_LOG_METHOD(name, level, outputLevel) \
+void NlsLog::name(const char* function, int line, const char* format, ...) { \
+  if (!format || atomicLoadRelaxed(&_activeLevel) < level) { \
+    return; \
+  } \
+  va_list args; \
+  va_start(args, format); \
+  logOutput(outputLevel, function, line, format, args); \
+  va_end(args); \
+}
+
+NLS_LOG_METHOD(logDebug, NLS_LOG_LEVEL_DEBUG, NLS_LOG_LEVEL_DEBUG)
+NLS_LOG_METHOD(logInfo, NLS_LOG_LEVEL_INFO, NLS_LOG_LEVEL_INFO)
+NLS_LOG_METHOD(logWarn, NLS_LOG_LEVEL_WARN, NLS_LOG_LEVEL_WARN)
+NLS_LOG_METHOD(logError, NLS_LOG_LEVEL_ERROR, NLS_LOG_LEVEL_ERROR)
+//FATAL
+NLS_LOG_METHOD(logException, NLS_LOG_LEVEL_ERROR, LOG_LEVEL_EXCEPTION)
+
+#undef NLS_LOG_METHOD
+
 }  // utility
 }  // AlibabaNls
@@ -23,9 +23,36 @@
 #include <pthread.h>
 #endif
 
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "nlsAtomic.h"
+
+/*
+ * 日志级别, 取值与LogLevel一致.
+ */
+#define NLS_LOG_LEVEL_ERROR   1
+#define NLS_LOG_LEVEL_WARN    2
+#define NLS_LOG_LEVEL_INFO    3
+#define NLS_LOG_LEVEL_DEBUG   4
+
+/*
+ * 编译期最低日志级别, 高于该级别的LOG_XXX展开为空语句, 参数不再求值.
+ * 如-DNLS_LOG_COMPILE_LEVEL=3将去除LOG_DEBUG.
+ */
+#ifndef NLS_LOG_COMPILE_LEVEL
+#define NLS_LOG_COMPILE_LEVEL NLS_LOG_LEVEL_DEBUG
+#endif
+
 namespace AlibabaNls {
+
+struct NlsAsyncLogStats;
+
 namespace utility {
 
+class NlsLogSink;
+struct NlsLogThreadRing;
+
 class NlsLog {
 
 public:
@@ -34,7 +61,22 @@ public:
   static void destroyLogInstance();
   void logConfig(const char* name, int level, size_t fileSize, size_t fileNum);
 
-  void logVerbose(const char* function, int line, const char * format, ...);
+  /*
+   * @brief 设置异步日志参数, 在logConfig前调用, 之后写文件的日志经NlsLogSink输出
+   * @return 成功返回0, 日志已配置返回-1
+   */
+  int asyncConfig(size_t ringSize, int flushIntervalMs, int fsyncIntervalMs,
+                  bool binary);
+  int getAsyncStats(NlsAsyncLogStats* stats);
+
+  /*
+   * @brief 该级别的日志是否输出, 未调用logConfig时均不输出
+   * @note 仅一次无屏障读取, LOG_XXX在格式化参数之前先行判断
+   */
+  static inline bool isEnabled(int level) {
+    return _logInstance != NULL && atomicLoadRelaxed(&_activeLevel) >= level;
+  }
+
   void logDebug(const char* function, int line, const char * format, ...);
   void logInfo(const char* function, int line, const char * format, ...);
   void logWarn(const char* function, int line, const char * format, ...);
@@ -46,6 +88,12 @@ private:
   ~NlsLog();
 
   unsigned long pthreadSelfId();
+  void logOutput(int level, const char* function, int line,
+                 const char* format, va_list args);
+  void printStdout(int level, const char* message);
+  /* 取得已发布的异步日志及本线程的登记项, 非NULL时须调用releaseSink */
+  NlsLogSink* acquireSink(NlsLogThreadRing** threadRing);
+  void releaseSink(NlsLogThreadRing* threadRing);
 
 #if defined(_MSC_VER)
   static HANDLE _mtxLog;
@@ -53,42 +101,65 @@ private:
   static pthread_mutex_t _mtxLog;
 #endif
 
-  int _logLevel;
+  /* 已配置的日志级别, 未配置时为0 */
+  static volatile long _activeLevel;
+
   bool _isStdout;
   bool _isConfig;
+
+  /*
+   * 异步日志, 未开启时为NULL.
+   * _sinkActive置位后写入者才可使用, 使用期间置位本线程登记项的inUse,
+   * 释放前先清除_sinkActive并等待所有线程的inUse清零.
+   * _sinkActive为静态成员, 写入者在实例释放后检查也不会访问已释放的内存.
+   */
+  NlsLogSink* _sink;
+  static volatile long _sinkActive;
+  bool _asyncEnabled;
+  size_t _asyncRingSize;
+  int _asyncFlushIntervalMs;
+  int _asyncFsyncIntervalMs;
+  bool _asyncBinary;
+
+  /*
+   * 标准输出的时间前缀按秒缓存, 由_mtxLog保护.
+   * 按6个int字段的最大宽度分配, 格式化时不会截断
+   */
+  char _stamp[72];
+  uint64_t _stampExpireUs;
 };
 
 }  // namespace utility
 
-#define LOG_VERBOSE(...)   do { \
-  if (utility::NlsLog::_logInstance) { \
-    utility::NlsLog::_logInstance->logVerbose(__FUNCTION__, __LINE__, __VA_ARGS__); \
+#define NLS_LOG_CALL(level, method, ...) do { \
+  if (utility::NlsLog::isEnabled(level)) { \
+    utility::NlsLog::_logInstance->method(__FUNCTION__, __LINE__, __VA_ARGS__); \
   } } while(0);
 
-#define LOG_DEBUG(...)     do { \
-  if (utility::NlsLog::_logInstance) { \
-    utility::NlsLog::_logInstance->logDebug(__FUNCTION__, __LINE__, __VA_ARGS__); \
-  } } while(0);
+#define NLS_LOG_NONE() do {} while(0);
 
-#define LOG_INFO(...)      do { \
-  if (utility::NlsLog::_logInstance) { \
-    utility::NlsLog::_logInstance->logInfo(__FUNCTION__, __LINE__, __VA_ARGS__); \
-  } } while(0);
+#if NLS_LOG_COMPILE_LEVEL >= NLS_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...)     NLS_LOG_CALL(NLS_LOG_LEVEL_DEBUG, logDebug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)     NLS_LOG_NONE()
+#endif
 
-#define LOG_WARN(...)      do { \
-  if (utility::NlsLog::_logInstance) { \
-    utility::NlsLog::_logInstance->logWarn(__FUNCTION__, __LINE__, __VA_ARGS__); \
-  } } while(0);
+#if NLS_LOG_COMPILE_LEVEL >= NLS_LOG_LEVEL_INFO
+#define LOG_INFO(...)      NLS_LOG_CALL(NLS_LOG_LEVEL_INFO, logInfo, __VA_ARGS__)
+#else
+#define LOG_INFO(...)      NLS_LOG_NONE()
+#endif
 
-#define LOG_ERROR(...)     do { \
-  if (utility::NlsLog::_logInstance) { \
-    utility::NlsLog::_logInstance->logError(__FUNCTION__, __LINE__, __VA_ARGS__); \
-  } } while(0);
+#if NLS_LOG_COMPILE_LEVEL >= NLS_LOG_LEVEL_WARN
+#define LOG_WARN(...)      NLS_LOG_CALL(NLS_LOG_LEVEL_WARN, logWarn, __VA_ARGS__)
+#else
+#define LOG_WARN(...)      NLS_LOG_NONE()
+#endif
 
-#define LOG_EXCEPTION(...) do { \
-  if (utility::NlsLog::_logInstance) { \
-    utility::NlsLog::_logInstance->logException(__FUNCTION__, __LINE__, __VA_ARGS__); \
-  } } while(0);
+/* 错误及异常日志不受编译期级别影响 */
+#define LOG_ERROR(...)     NLS_LOG_CALL(NLS_LOG_LEVEL_ERROR, logError, __VA_ARGS__)
+
+#define LOG_EXCEPTION(...) NLS_LOG_CALL(NLS_LOG_LEVEL_ERROR, logException, __VA_ARGS__)
 
 }  // namespace AlibabaNls
 
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_ATOMIC_H
+#define NLS_SDK_ATOMIC_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#include <intrin.h>
+#endif
+#include <stdint.h>
+
+namespace AlibabaNls {
+namespace utility {
+
+/*
+ * 轻量原子操作封装, gcc使用__sync内建函数, msvc使用Interlocked系列接口.
+ * 除atomicLoadRelaxed及获取/释放语义的读写外, 所有操作均带完整内存屏障.
+ */
+
+#if defined(__GNUC__) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define NLS_ATOMIC_BUILTINS 1
+#endif
+
+inline long atomicAdd(volatile long* value, long delta) {
+#if defined(_MSC_VER)
+  return InterlockedExchangeAdd(value, delta) + delta;
+#else
+  return __sync_add_and_fetch(value, delta);
+#endif
+}
+
+inline long atomicLoad(volatile long* value) {
+#if defined(_MSC_VER)
+  return InterlockedCompareExchange(value, 0, 0);
+#else
+  return __sync_add_and_fetch(value, 0);
+#endif
+}
+
+/*
+ * 不带内存屏障的读取, 仅保证读取本身完整, 用于高频读取的开关及级别,
+ * 读到旧值无害的场景.
+ */
+inline long atomicLoadRelaxed(volatile long* value) {
+#if defined(NLS_ATOMIC_BUILTINS)
+  return __atomic_load_n(value, __ATOMIC_RELAXED);
+#else
+  return *value;
+#endif
+}
+
+/*
+ * 获取语义的读取, 与atomicStoreRelease配对: 读到对端发布的值后,
+ * 对端在发布前写入的数据均可见. 用于单写者发布位置或状态, 不做读改写.
+ * msvc在x86/x64上volatile读即有获取语义, 只需阻止编译器重排.
+ */
+inline long atomicLoadAcquire(volatile long* value) {
+#if defined(NLS_ATOMIC_BUILTINS)
+  return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#elif defined(_MSC_VER)
+  long result = *value;
+#if defined(_M_IX86) || defined(_M_X64)
+  _ReadWriteBarrier();
+#else
+  MemoryBarrier();
+#endif
+  return result;
+#else
+  long result = *value;
+  __sync_synchronize();
+  return result;
+#endif
+}
+
+/* 释放语义的写入, 之前的读写不会重排到其后 */
+inline void atomicStoreRelease(volatile long* value, long newValue) {
+#if defined(NLS_ATOMIC_BUILTINS)
+  __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#elif defined(_MSC_VER)
+#if defined(_M_IX86) || defined(_M_X64)
+  _ReadWriteBarrier();
+#else
+  MemoryBarrier();
+#endif
+  *value = newValue;
+#else
+  __sync_synchronize();
+  *value = newValue;
+#endif
+}
+
+inline void atomicStore(volatile long* value, long newValue) {
+#if defined(_MSC_VER)
+  InterlockedExchange(value, newValue);
+#else
+  __sync_lock_test_and_set(value, newValue);
+  __sync_synchronize();
+#endif
+}
+
+/* 写入新值并返回旧值, 读取与写入之间不会丢失其他线程的更新 */
+inline long atomicExchange(volatile long* value, long newValue) {
+#if defined(_MSC_VER)
+  return InterlockedExchange(value, newValue);
+#else
+  long oldValue = __sync_lock_test_and_set(value, newValue);
+  __sync_synchronize();
+  return oldValue;
+#endif
+}
+
+inline bool atomicCompareSwap(volatile long* value,
+                              long expected, long desired) {
+#if defined(_MSC_VER)
+  return InterlockedCompareExchange(value, desired, expected) == expected;
+#else
+  return __sync_bool_compare_and_swap(value, expected, desired);
+#endif
+}
+
+inline int64_t atomicAdd64(volatile int64_t* value, int64_t delta) {
+#if defined(_MSC_VER)
+  return InterlockedExchangeAdd64((volatile LONGLONG*)value, delta) + delta;
+#else
+  return __sync_add_and_fetch(value, delta);
+#endif
+}
+
+inline int64_t atomicLoad64(volatile int64_t* value) {
+#if defined(_MSC_VER)
+  return InterlockedCompareExchange64((volatile LONGLONG*)value, 0, 0);
+#else
+  return __sync_add_and_fetch(value, 0);
+#endif
+}
+
+inline void atomicStore64(volatile int64_t* value, int64_t newValue) {
+#if defined(_MSC_VER)
+  InterlockedExchange64((volatile LONGLONG*)value, newValue);
+#else
+  __sync_lock_test_and_set(value, newValue);
+  __sync_synchronize();
+#endif
+}
+
+/* 仅当newValue更大时更新, 用于记录峰值 */
+inline void atomicMax64(volatile int64_t* value, int64_t newValue) {
+  int64_t current = atomicLoad64(value);
+  while (newValue > current) {
+#if defined(_MSC_VER)
+    int64_t prev = InterlockedCompareExchange64(
+        (volatile LONGLONG*)value, newValue, current);
+#else
+    int64_t prev = __sync_val_compare_and_swap(value, current, newValue);
+#endif
+    if (prev == current) {
+      break;
+    }
+    current = prev;
+  }
+}
+
+/* 减去delta, 结果不低于0, 返回更新后的值 */
+inline int64_t atomicSubFloor64(volatile int64_t* value, int64_t delta) {
+  int64_t current = atomicLoad64(value);
+  while (true) {
+    int64_t next = current > delta ? current - delta : 0;
+#if defined(_MSC_VER)
+    int64_t prev = InterlockedCompareExchange64(
+        (volatile LONGLONG*)value, next, current);
+#else
+    int64_t prev = __sync_val_compare_and_swap(value, current, next);
+#endif
+    if (prev == current) {
+      return next;
+    }
+    current = prev;
+  }
+}
+
+inline void memoryBarrier() {
+#if defined(_MSC_VER)
+  MemoryBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+}  // namespace utility
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_ATOMIC_H
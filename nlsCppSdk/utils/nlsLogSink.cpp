@@ -0,0 +1,841 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(_MSC_VER)
+#include <io.h>
+#include <process.h>
+#include <sys/stat.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "nlsLogSink.h"
+#include "nlsAtomic.h"
+#include "thread_data.h"
+#include "utility.h"
+
+namespace AlibabaNls {
+namespace utility {
+
+#if defined(_MSC_VER)
+#define LOG_SINK_OPEN(name) \
+  _open(name, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, \
+        _S_IREAD | _S_IWRITE)
+#define LOG_SINK_WRITE(fd, data, size) _write(fd, data, (unsigned int)(size))
+#define LOG_SINK_SIZE(fd)  _lseeki64(fd, 0, SEEK_END)
+#define LOG_SINK_SYNC(fd)  _commit(fd)
+#define LOG_SINK_CLOSE(fd) _close(fd)
+#else
+#define LOG_SINK_OPEN(name) open(name, O_WRONLY | O_CREAT | O_APPEND, 0644)
+#define LOG_SINK_WRITE(fd, data, size) write(fd, data, size)
+#define LOG_SINK_SIZE(fd)  lseek(fd, 0, SEEK_END)
+#define LOG_SINK_SYNC(fd)  fsync(fd)
+#define LOG_SINK_CLOSE(fd) close(fd)
+#endif
+
+#define LOG_SINK_FILE_BASE_SIZE  (1024 * 1024)
+/* 拼接到该大小即写出一次, 避免日志线程占用过多内存 */
+#define LOG_SINK_BATCH_SIZE      (256 * 1024)
+#define LOG_SINK_FUNCTION_MAX    255
+/* 记录上限, 超出时截断正文; 生产者在栈上组装记录 */
+#define LOG_SINK_RECORD_MAX_SIZE 4096
+#define LOG_SINK_CATEGORY        "alibabaNlsLog"
+
+static inline void putU16(uint8_t* p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void putU32(uint8_t* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (uint8_t)(v >> (i * 8));
+  }
+}
+
+static inline void putU64(uint8_t* p, uint64_t v) {
+  for (int i = 0; i < 8; i++) {
+    p[i] = (uint8_t)(v >> (i * 8));
+  }
+}
+
+static inline uint32_t getU32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t getU64(const uint8_t* p) {
+  return (uint64_t)getU32(p) | ((uint64_t)getU32(p + 4) << 32);
+}
+
+/* 与log4cpp的Priority名称一致 */
+static const char* priorityName(int level) {
+  switch (level) {
+    case 0:
+      return "FATAL";
+    case 1:
+      return "ERROR";
+    case 2:
+      return "WARN";
+    case 3:
+      return "INFO";
+    default:
+      return "DEBUG";
+  }
+}
+
+/*
+ * 各线程的登记项, 进程内唯一, 跨日志后台的启停保留, 不随进程退出释放.
+ * 线程退出时由TLS析构(Windows为FLS回调)释放未持有缓冲的登记项,
+ * 持有缓冲的由日志线程读空后释放.
+ */
+#if defined(_MSC_VER)
+static HANDLE _mtxRings = CreateMutex(NULL, FALSE, NULL);
+#else
+static pthread_mutex_t _mtxRings = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static std::vector<NlsLogThreadRing*>& threadRings() {
+  static std::vector<NlsLogThreadRing*>* rings =
+      new std::vector<NlsLogThreadRing*>();
+  return *rings;
+}
+
+static inline void lockRings() {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxRings, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxRings);
+#endif
+}
+
+static inline void unlockRings() {
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxRings);
+#else
+  pthread_mutex_unlock(&_mtxRings);
+#endif
+}
+
+/* 持_mtxRings调用 */
+static void eraseThreadRing(NlsLogThreadRing* threadRing) {
+  std::vector<NlsLogThreadRing*>& rings = threadRings();
+  for (size_t i = 0; i < rings.size(); i++) {
+    if (rings[i] == threadRing) {
+      rings.erase(rings.begin() + i);
+      break;
+    }
+  }
+}
+
+static void releaseThreadRing(NlsLogThreadRing* threadRing) {
+  if (threadRing == NULL) {
+    return;
+  }
+  lockRings();
+  if (threadRing->ring == NULL) {
+    eraseThreadRing(threadRing);
+    delete threadRing;
+  } else {
+    atomicStore(&threadRing->detached, 1);
+  }
+  unlockRings();
+}
+
+#if defined(_MSC_VER)
+static VOID WINAPI onThreadExit(PVOID arg) {
+  releaseThreadRing((NlsLogThreadRing*)arg);
+}
+
+/* FLS回调在线程退出时执行, TLS无析构回调 */
+static DWORD _flsIndex = FlsAlloc(onThreadExit);
+#else
+static void onThreadExit(void* arg) {
+  releaseThreadRing((NlsLogThreadRing*)arg);
+}
+
+static pthread_key_t _tlsKey;
+static pthread_once_t _tlsOnce = PTHREAD_ONCE_INIT;
+static bool _tlsReady = false;
+
+static void createTlsKey() {
+  _tlsReady = pthread_key_create(&_tlsKey, onThreadExit) == 0;
+}
+#endif
+
+NlsLogSink::NlsLogSink() : _fileSize(0), _fileNum(0), _ringSize(0),
+    _flushIntervalMs(0), _fsyncIntervalMs(0), _binary(false), _utcOffset(0),
+    _fd(-1), _writtenSize(0), _lastSyncUs(0), _dirty(false),
+    _running(0), _wakePending(0), _threads(0), _records(0),
+    _droppedReleased(0), _bytes(0), _writes(0), _fsyncs(0), _writeErrors(0) {
+#if defined(_MSC_VER)
+  _mtxStats = CreateMutex(NULL, FALSE, NULL);
+  _wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  _writerHandle = NULL;
+  _writerId = 0;
+#else
+  pthread_mutex_init(&_mtxStats, NULL);
+  pthread_mutex_init(&_mtxWake, NULL);
+  pthread_cond_init(&_cvWake, NULL);
+#endif
+}
+
+NlsLogSink::~NlsLogSink() {
+  stop();
+
+#if defined(_MSC_VER)
+  CloseHandle(_mtxStats);
+  CloseHandle(_wakeEvent);
+#else
+  pthread_mutex_destroy(&_mtxStats);
+  pthread_mutex_destroy(&_mtxWake);
+  pthread_cond_destroy(&_cvWake);
+#endif
+}
+
+int NlsLogSink::start(const char* name, size_t fileSize, size_t fileNum,
+                      size_t ringSize, int flushIntervalMs,
+                      int fsyncIntervalMs, bool binary) {
+  if (name == NULL || fileSize == 0 || atomicLoad(&_running)) {
+    return -1;
+  }
+
+  _binary = binary;
+  _fileName = name;
+  _fileName += _binary ? ".nlog" : ".log";
+  _fileSize = fileSize * LOG_SINK_FILE_BASE_SIZE;
+  _fileNum = fileNum;
+  _ringSize = ringSize;
+  _flushIntervalMs = flushIntervalMs;
+  _fsyncIntervalMs = fsyncIntervalMs;
+  _utcOffset = localUtcOffset();
+  _lastSyncUs = getMonotonicUs();
+
+  if (openFile() < 0) {
+    return -1;
+  }
+
+atomicStore(&_running, 1);
+#if defined(_MSC_VER)
+  _writerHandle = (HANDLE)_beginthreadex(
+      NULL, 0, loopWriter, (LPVOID)this, 0, &_writerId);
+  if (_writerHandle == NULL) {
+    atomicStore(&_running, 0);
+    closeFile();
+    return -1;
+  }
+#else
+  if (pthread_create(&_writerId, NULL, loopWriter, (void*)this) != 0) {
+    atomicStore(&_running, 0);
+    closeFile();
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+void NlsLogSink::stop() {
+  if (!atomicCompareSwap(&_running, 1, 0)) {
+    return;
+  }
+
+  // 日志线程退出前会写出所有缓冲中的记录
+#if defined(_MSC_VER)
+  SetEvent(_wakeEvent);
+  WaitForSingleObject(_writerHandle, INFINITE);
+  CloseHandle(_writerHandle);
+  _writerHandle = NULL;
+#else
+  pthread_mutex_lock(&_mtxWake);
+  pthread_cond_signal(&_cvWake);
+  pthread_mutex_unlock(&_mtxWake);
+  pthread_join(_writerId, NULL);
+#endif
+
+  closeFile();
+
+  // 调用者已等待所有线程离开写入, 释放本后台分配的缓冲, 登记项留待线程退出
+  lockRings();
+  std::vector<NlsLogThreadRing*>& rings = threadRings();
+  for (size_t i = 0; i < rings.size();) {
+    NlsLogThreadRing* threadRing = rings[i];
+    if (threadRing->ring) {
+      _droppedReleased += (uint64_t)atomicLoad(&threadRing->dropped);
+      delete threadRing->ring;
+      threadRing->ring = NULL;
+      atomicStore(&threadRing->dropped, 0);
+      threadRing->reported = 0;
+    }
+    if (atomicLoad(&threadRing->detached)) {
+      rings.erase(rings.begin() + i);
+      delete threadRing;
+    } else {
+      i++;
+    }
+  }
+  unlockRings();
+}
+
+size_t NlsLogSink::encodeRecord(uint8_t* buffer, int level,
+                                unsigned long threadId, uint64_t timeUs,
+                                const char* function, unsigned int line,
+                                const char* message, size_t messageSize) {
+  size_t functionSize = function ? strlen(function) : 0;
+  if (functionSize > LOG_SINK_FUNCTION_MAX) {
+    functionSize = LOG_SINK_FUNCTION_MAX;
+  }
+  size_t limit = LOG_SINK_RECORD_MAX_SIZE - LOG_SINK_RECORD_HEADER_SIZE -
+                 functionSize;
+  if (messageSize > limit) {
+    messageSize = limit;
+  }
+  size_t size = LOG_SINK_RECORD_HEADER_SIZE + functionSize + messageSize;
+
+  putU16(buffer, (uint16_t)size);
+  buffer[2] = (uint8_t)level;
+  buffer[3] = (uint8_t)functionSize;
+  putU32(buffer + 4, (uint32_t)line);
+  putU64(buffer + 8, timeUs);
+  putU64(buffer + 16, (uint64_t)threadId);
+  if (functionSize > 0) {
+    memcpy(buffer + LOG_SINK_RECORD_HEADER_SIZE, function, functionSize);
+  }
+  if (messageSize > 0) {
+    memcpy(buffer + LOG_SINK_RECORD_HEADER_SIZE + functionSize,
+           message, messageSize);
+  }
+  return size;
+}
+
+size_t NlsLogSink::decodeRecord(const uint8_t* buffer, size_t size,
+                                NlsLogRecord* record) {
+  if (size < LOG_SINK_RECORD_HEADER_SIZE) {
+    return 0;
+  }
+  size_t recordSize = (size_t)buffer[0] | ((size_t)buffer[1] << 8);
+  size_t functionSize = buffer[3];
+  if (recordSize < LOG_SINK_RECORD_HEADER_SIZE + functionSize ||
+      recordSize > size) {
+    return 0;
+  }
+
+  record->level = buffer[2];
+  record->line = getU32(buffer + 4);
+  record->timeUs = getU64(buffer + 8);
+  record->threadId = getU64(buffer + 16);
+  record->function = (const char*)buffer + LOG_SINK_RECORD_HEADER_SIZE;
+  record->functionSize = functionSize;
+  record->message = record->function + functionSize;
+  record->messageSize =
+      recordSize - LOG_SINK_RECORD_HEADER_SIZE - functionSize;
+  return recordSize;
+}
+
+void NlsLogSink::formatRecord(const NlsLogRecord& record, int utcOffset,
+                              std::string& output) {
+  int64_t seconds = (int64_t)(record.timeUs / 1000000) + utcOffset;
+  int millis = (int)((record.timeUs / 1000) % 1000);
+  int64_t days = seconds / 86400;
+  int secondOfDay = (int)(seconds % 86400);
+  if (secondOfDay < 0) {
+    secondOfDay += 86400;
+    days--;
+  }
+
+  // 由1970-01-01起的天数换算公历日期, 不依赖gmtime及时区设置
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int dayOfEra = (int)(days - era * 146097);
+  int yearOfEra =
+      (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  int mp = (5 * dayOfYear + 2) / 153;
+  int day = dayOfYear - (153 * mp + 2) / 5 + 1;
+  int month = mp < 10 ? mp + 3 : mp - 9;
+  int year = (int)(yearOfEra + era * 400) + (month <= 2 ? 1 : 0);
+
+  char prefix[128];
+  int length = _ssnprintf(prefix, sizeof(prefix),
+      "%04d-%02d-%02d %02d:%02d:%02d,%03d: %s %s: [ID:%lu][",
+      year, month, day, secondOfDay / 3600, (secondOfDay / 60) % 60,
+      secondOfDay % 60, millis, priorityName(record.level),
+      LOG_SINK_CATEGORY, (unsigned long)record.threadId);
+  if (length < 0 || length >= (int)sizeof(prefix)) {
+    length = (int)sizeof(prefix) - 1;
+  }
+  output.append(prefix, length);
+  output.append(record.function, record.functionSize);
+  length = _ssnprintf(prefix, sizeof(prefix), ":%u]", record.line);
+  output.append(prefix, length);
+  output.append(record.message, record.messageSize);
+  output.append(1, '\n');
+}
+
+int NlsLogSink::localUtcOffset() {
+  time_t now = time(NULL);
+  struct tm localTm;
+  struct tm utcTm;
+#if defined(_MSC_VER)
+  localtime_s(&localTm, &now);
+  gmtime_s(&utcTm, &now);
+#else
+  localtime_r(&now, &localTm);
+  gmtime_r(&now, &utcTm);
+#endif
+  int dayDiff = localTm.tm_yday - utcTm.tm_yday;
+  if (localTm.tm_year != utcTm.tm_year) {
+    dayDiff = localTm.tm_year > utcTm.tm_year ? 1 : -1;
+  }
+  return dayDiff * 86400 + (localTm.tm_hour - utcTm.tm_hour) * 3600 +
+         (localTm.tm_min - utcTm.tm_min) * 60 +
+         (localTm.tm_sec - utcTm.tm_sec);
+}
+
+uint64_t NlsLogSink::wallClockUs() {
+#if defined(_MSC_VER)
+  FILETIME ft;
+  GetSystemTimeAsFileTime(&ft);
+  uint64_t ticks = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+  return (ticks - 116444736000000000ULL) / 10;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+#endif
+}
+
+NlsLogThreadRing* NlsLogSink::enterThread(unsigned long threadId) {
+#if defined(_MSC_VER)
+  if (_flsIndex == FLS_OUT_OF_INDEXES) {
+    return NULL;
+  }
+  NlsLogThreadRing* threadRing = (NlsLogThreadRing*)FlsGetValue(_flsIndex);
+#else
+  pthread_once(&_tlsOnce, createTlsKey);
+  if (!_tlsReady) {
+    return NULL;
+  }
+  NlsLogThreadRing* threadRing =
+      (NlsLogThreadRing*)pthread_getspecific(_tlsKey);
+#endif
+
+  if (threadRing == NULL) {
+    // 线程首次写异步日志, 创建并登记, 缓冲在首次append时分配
+    threadRing = new NlsLogThreadRing();
+    threadRing->ring = NULL;
+    threadRing->threadId = threadId;
+    threadRing->inUse = 0;
+    threadRing->dropped = 0;
+    threadRing->reported = 0;
+    threadRing->detached = 0;
+
+    lockRings();
+    threadRings().push_back(threadRing);
+    unlockRings();
+#if defined(_MSC_VER)
+    FlsSetValue(_flsIndex, threadRing);
+#else
+    pthread_setspecific(_tlsKey, threadRing);
+#endif
+  }
+
+  // 全屏障, 与NlsLog清除发布标志后的waitThreads相对
+  atomicStore(&threadRing->inUse, 1);
+  return threadRing;
+}
+
+void NlsLogSink::leaveThread(NlsLogThreadRing* threadRing) {
+  atomicStoreRelease(&threadRing->inUse, 0);
+}
+
+void NlsLogSink::waitThreads() {
+  // 写入中的线程不取_mtxRings, 持锁等待期间登记项不会被释放
+  lockRings();
+  std::vector<NlsLogThreadRing*>& rings = threadRings();
+  for (size_t i = 0; i < rings.size(); i++) {
+    while (atomicLoad(&rings[i]->inUse)) {
+      sleepOneMs();
+    }
+  }
+  unlockRings();
+}
+
+int NlsLogSink::append(NlsLogThreadRing* threadRing, int level,
+                       const char* function, unsigned int line,
+                       const char* message, size_t messageSize) {
+  if (!atomicLoadRelaxed(&_running)) {
+    return -1;
+  }
+
+  ByteRing* ring = threadRing->ring;
+  if (ring == NULL) {
+    // 本线程在当前后台首次写入, 仅本线程分配, 发布前先写完成员
+    ring = new ByteRing(_ringSize);
+    if (ring->Capacity() == 0) {
+      delete ring;
+      return -1;
+    }
+    memoryBarrier();
+    threadRing->ring = ring;
+    atomicAdd(&_threads, 1);
+  }
+
+  uint8_t record[LOG_SINK_RECORD_MAX_SIZE];
+  size_t size = encodeRecord(record, level, threadRing->threadId,
+                             wallClockUs(), function, line,
+                             message, messageSize);
+  if (!ring->WriteAll(record, size)) {
+    atomicAdd(&threadRing->dropped, 1);
+    wakeup();
+    return -1;
+  }
+
+  // ERROR及以上立即写出, 缓冲过半时提前唤醒日志线程
+  if (level <= 1 || ring->Size() > ring->Capacity() / 2) {
+    wakeup();
+  }
+  return 0;
+}
+
+void NlsLogSink::getStats(NlsAsyncLogStats* stats) {
+  if (stats == NULL) {
+    return;
+  }
+
+  uint64_t dropped = 0;
+  lockRings();
+  std::vector<NlsLogThreadRing*>& rings = threadRings();
+  for (size_t i = 0; i < rings.size(); i++) {
+    if (rings[i]->ring) {
+      dropped += (uint64_t)atomicLoad(&rings[i]->dropped);
+    }
+  }
+  unlockRings();
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxStats, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxStats);
+#endif
+  stats->records = _records;
+  stats->dropped = dropped + _droppedReleased;
+  stats->bytes = _bytes;
+  stats->writes = _writes;
+  stats->fsyncs = _fsyncs;
+  stats->writeErrors = _writeErrors;
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxStats);
+#else
+  pthread_mutex_unlock(&_mtxStats);
+#endif
+  stats->threads = (uint64_t)atomicLoad(&_threads);
+}
+
+void NlsLogSink::wakeup() {
+  // 只在日志线程未被唤醒时通知一次, 不取锁, 偶发丢失仅推迟到下一周期
+  if (!atomicCompareSwap(&_wakePending, 0, 1)) {
+    return;
+  }
+#if defined(_MSC_VER)
+  SetEvent(_wakeEvent);
+#else
+  pthread_cond_signal(&_cvWake);
+#endif
+}
+
+void NlsLogSink::waitFlush() {
+#if defined(_MSC_VER)
+  if (atomicLoad(&_running) && !atomicLoad(&_wakePending)) {
+    WaitForSingleObject(_wakeEvent, _flushIntervalMs);
+  }
+#else
+  pthread_mutex_lock(&_mtxWake);
+  if (atomicLoad(&_running) && !atomicLoad(&_wakePending)) {
+    struct timeval now;
+    struct timespec deadline;
+    gettimeofday(&now, NULL);
+    uint64_t nsec = (uint64_t)now.tv_usec * 1000 +
+                    (uint64_t)_flushIntervalMs * 1000000;
+    deadline.tv_sec = now.tv_sec + (time_t)(nsec / 1000000000);
+    deadline.tv_nsec = (long)(nsec % 1000000000);
+    pthread_cond_timedwait(&_cvWake, &_mtxWake, &deadline);
+  }
+  pthread_mutex_unlock(&_mtxWake);
+#endif
+  atomicStore(&_wakePending, 0);
+}
+
+#if defined(_MSC_VER)
+unsigned __stdcall NlsLogSink::loopWriter(LPVOID arg) {
+#else
+void* NlsLogSink::loopWriter(void* arg) {
+#endif
+  NlsLogSink* sink = (NlsLogSink*)arg;
+  while (atomicLoad(&sink->_running)) {
+    sink->waitFlush();
+    sink->flushBatch(false);
+  }
+  sink->flushBatch(true);
+
+#if defined(_MSC_VER)
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+void NlsLogSink::appendRecord(const uint8_t* data, size_t size) {
+  if (_binary) {
+    _batch.append((const char*)data, size);
+  } else {
+    NlsLogRecord record;
+    if (decodeRecord(data, size, &record) > 0) {
+      formatRecord(record, _utcOffset, _batch);
+    }
+  }
+  if (_batch.size() >= LOG_SINK_BATCH_SIZE) {
+    writeBatch();
+  }
+}
+
+void NlsLogSink::drain(NlsLogThreadRing* threadRing,
+                       std::vector<uint8_t>& scratch) {
+  ByteRing* ring = threadRing->ring;
+  uint8_t header[LOG_SINK_RECORD_HEADER_SIZE];
+  uint64_t records = 0;
+
+  // 生产者以WriteAll整条提交, 读到头部即可读到整条记录
+  while (ring->Peek(header, sizeof(header), 0) == sizeof(header)) {
+    size_t size = (size_t)header[0] | ((size_t)header[1] << 8);
+    if (size < LOG_SINK_RECORD_HEADER_SIZE) {
+      ring->Skip(ring->Size());
+      break;
+    }
+    if (scratch.size() < size) {
+      scratch.resize(size);
+    }
+    if (ring->Peek(&scratch[0], size, 0) != size) {
+      break;
+    }
+    appendRecord(&scratch[0], size);
+    ring->Skip(size);
+    records++;
+  }
+
+  long dropped = atomicLoad(&threadRing->dropped);
+  if (dropped != threadRing->reported) {
+    char message[128];
+    int length = _ssnprintf(message, sizeof(message),
+        "%ld log records dropped, thread log buffer is full.",
+        dropped - threadRing->reported);
+    uint8_t record[LOG_SINK_RECORD_HEADER_SIZE + 160];
+    size_t size = encodeRecord(record, 2, threadRing->threadId, wallClockUs(),
+                               "NlsLogSink", 0,
+                               message, length > 0 ? (size_t)length : 0);
+    appendRecord(record, size);
+    threadRing->reported = dropped;
+  }
+
+  if (records > 0) {
+#if defined(_MSC_VER)
+    WaitForSingleObject(_mtxStats, INFINITE);
+#else
+    pthread_mutex_lock(&_mtxStats);
+#endif
+    _records += records;
+#if defined(_MSC_VER)
+    ReleaseMutex(_mtxStats);
+#else
+    pthread_mutex_unlock(&_mtxStats);
+#endif
+  }
+}
+
+void NlsLogSink::flushBatch(bool force) {
+  // 只取已分配缓冲的登记项, 其在日志线程释放前不会被线程退出释放
+  std::vector<NlsLogThreadRing*> rings;
+  lockRings();
+  std::vector<NlsLogThreadRing*>& registered = threadRings();
+  for (size_t i = 0; i < registered.size(); i++) {
+    if (registered[i]->ring) {
+      rings.push_back(registered[i]);
+    }
+  }
+  unlockRings();
+  memoryBarrier();
+
+  std::vector<NlsLogThreadRing*> released;
+  for (size_t i = 0; i < rings.size(); i++) {
+    // 先读标记再读空, 标记之后线程不会再写入
+    bool detached = atomicLoad(&rings[i]->detached) != 0;
+    drain(rings[i], _scratch);
+    if (detached) {
+      released.push_back(rings[i]);
+    }
+  }
+  writeBatch();
+
+  uint64_t now = getMonotonicUs();
+  if (_dirty && _fd >= 0 && (force || (_fsyncIntervalMs > 0 &&
+      now - _lastSyncUs >= (uint64_t)_fsyncIntervalMs * 1000))) {
+    LOG_SINK_SYNC(_fd);
+    _dirty = false;
+    _lastSyncUs = now;
+#if defined(_MSC_VER)
+    WaitForSingleObject(_mtxStats, INFINITE);
+#else
+    pthread_mutex_lock(&_mtxStats);
+#endif
+    _fsyncs++;
+#if defined(_MSC_VER)
+    ReleaseMutex(_mtxStats);
+#else
+    pthread_mutex_unlock(&_mtxStats);
+#endif
+  }
+
+  if (released.empty()) {
+    return;
+  }
+
+  lockRings();
+  for (size_t i = 0; i < released.size(); i++) {
+    eraseThreadRing(released[i]);
+    _droppedReleased += (uint64_t)atomicLoad(&released[i]->dropped);
+    delete released[i]->ring;
+    delete released[i];
+  }
+  unlockRings();
+}
+
+void NlsLogSink::writeBatch() {
+  if (_batch.empty()) {
+    return;
+  }
+
+  uint64_t writes = 0;
+  uint64_t bytes = 0;
+  uint64_t errors = 0;
+  const char* data = _batch.data();
+  size_t remaining = _batch.size();
+  while (remaining > 0 && _fd >= 0) {
+    long written = (long)LOG_SINK_WRITE(_fd, data, remaining);
+    writes++;
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // 磁盘满等错误时丢弃本批, 不阻塞日志线程
+      errors++;
+      break;
+    }
+    data += written;
+    remaining -= (size_t)written;
+    bytes += (uint64_t)written;
+  }
+  _batch.clear();
+
+  if (bytes > 0) {
+    _dirty = true;
+    _writtenSize += bytes;
+  }
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxStats, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxStats);
+#endif
+  _writes += writes;
+  _bytes += bytes;
+  _writeErrors += errors;
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxStats);
+#else
+  pthread_mutex_unlock(&_mtxStats);
+#endif
+
+  if (_writtenSize >= _fileSize) {
+    rollFile();
+  }
+}
+
+int NlsLogSink::openFile() {
+  _fd = LOG_SINK_OPEN(_fileName.c_str());
+  if (_fd < 0) {
+    return -1;
+  }
+
+  long long size = (long long)LOG_SINK_SIZE(_fd);
+  _writtenSize = size > 0 ? (uint64_t)size : 0;
+
+  if (_binary && _writtenSize == 0) {
+    uint8_t header[LOG_SINK_FILE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, LOG_SINK_FILE_MAGIC, strlen(LOG_SINK_FILE_MAGIC));
+    putU32(header + 8, LOG_SINK_FILE_VERSION);
+    putU32(header + 12, (uint32_t)_utcOffset);
+    if (LOG_SINK_WRITE(_fd, header, sizeof(header)) ==
+        (long)sizeof(header)) {
+      _writtenSize = sizeof(header);
+    }
+  }
+  return 0;
+}
+
+void NlsLogSink::rollFile() {
+  if (_dirty && _fd >= 0) {
+    LOG_SINK_SYNC(_fd);
+    _dirty = false;
+  }
+  closeFile();
+
+  // 同RollingFileAppender: name.(n-1) -> name.n, ..., name -> name.1
+  char source[1024];
+  char target[1024];
+  _ssnprintf(target, sizeof(target), "%s.%d",
+             _fileName.c_str(), (int)_fileNum);
+  remove(target);
+  for (int i = (int)_fileNum - 1; i >= 1; i--) {
+    _ssnprintf(source, sizeof(source), "%s.%d", _fileName.c_str(), i);
+    rename(source, target);
+    memcpy(target, source, sizeof(target));
+  }
+  if (_fileNum > 0) {
+    rename(_fileName.c_str(), target);
+  } else {
+    remove(_fileName.c_str());
+  }
+
+  openFile();
+}
+
+void NlsLogSink::closeFile() {
+  if (_fd >= 0) {
+    if (_dirty) {
+      LOG_SINK_SYNC(_fd);
+      _dirty = false;
+    }
+    LOG_SINK_CLOSE(_fd);
+    _fd = -1;
+  }
+}
+
+}  // namespace utility
+}  // namespace AlibabaNls
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_LOG_SINK_H
+#define NLS_SDK_LOG_SINK_H
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "nlsClient.h"
+
+namespace AlibabaNls {
+
+class ByteRing;
+
+namespace utility {
+
+/*
+ * 日志记录, 环形缓冲与二进制日志文件中的格式相同, 各字段均为小端:
+ *   0  uint16 记录总字节数, 含头部
+ *   2  uint8  日志级别, 0为EXCEPTION, 1~5同NLS_LOG_LEVEL_XXX
+ *   3  uint8  函数名字节数
+ *   4  uint32 行号
+ *   8  uint64 时间, 1970年起的微秒数(UTC)
+ *   16 uint64 线程ID
+ *   24 函数名, 不含结尾'\0'
+ *   .. 日志正文, 不含结尾'\0'
+ * 二进制日志文件以LOG_SINK_FILE_HEADER_SIZE字节的文件头开始:
+ *   0  char[8] 魔数"NLSBLOG\0"
+ *   8  uint32  格式版本, 当前为1
+ *   12 int32   写入时本地时区相对UTC的秒数, 解码时按此输出本地时间
+ */
+#define LOG_SINK_RECORD_HEADER_SIZE 24
+#define LOG_SINK_FILE_HEADER_SIZE   16
+#define LOG_SINK_FILE_MAGIC         "NLSBLOG"
+#define LOG_SINK_FILE_VERSION       1
+
+struct NlsLogRecord {
+  int level;
+  unsigned int line;
+  uint64_t timeUs;
+  uint64_t threadId;
+  const char* function;
+  size_t functionSize;
+  const char* message;
+  size_t messageSize;
+};
+
+/*
+ * 每个写日志线程独占, 首次写异步日志时创建并登记, 线程退出时释放.
+ * ring为当前日志后台分配的环形缓冲, 日志后台停止时释放并置NULL.
+ */
+struct NlsLogThreadRing {
+  ByteRing* volatile ring;
+  unsigned long threadId;
+  volatile long inUse;     // 本线程正在写入, 停止日志后台前等待其清零
+  volatile long dropped;   // 生产者累加, 缓冲满丢弃的条数
+  long reported;           // 日志线程已写出丢弃提示的条数
+  volatile long detached;  // 线程已退出, 读空后由日志线程释放
+};
+
+/*
+ * 异步日志后台. 调用LOG_XXX的线程将格式化好的记录写入自身的环形缓冲,
+ * 不加锁也不做IO; 日志线程按flushIntervalMs周期(或缓冲过半时被唤醒)
+ * 读出所有缓冲, 拼接后一次write, 并按fsyncIntervalMs间隔fsync.
+ * 文件按fileSize(MB)滚动, 保留fileNum个备份, 命名同log4cpp的
+ * RollingFileAppender: name.log, name.log.1, ...
+ * 缓冲满时整条记录丢弃, 日志线程随后写出一条丢弃数量的提示.
+ */
+class NlsLogSink {
+ public:
+  NlsLogSink();
+  ~NlsLogSink();
+
+  /*
+   * @brief 打开日志文件并启动日志线程
+   * @param name 日志文件名, 不含扩展名; 文本格式为.log, 二进制格式为.nlog
+   * @return 成功返回0, 失败返回-1
+   */
+  int start(const char* name, size_t fileSize, size_t fileNum,
+            size_t ringSize, int flushIntervalMs, int fsyncIntervalMs,
+            bool binary);
+
+  /* @brief 写出所有缓冲中的记录, 停止日志线程并关闭文件 */
+  void stop();
+
+  /*
+   * @brief 写日志的线程进入/离开写入, 期间置位本线程的inUse.
+   *        只写本线程的缓存行, 不争用全局计数.
+   * @return 本线程的登记项, 创建失败返回NULL
+   */
+  static NlsLogThreadRing* enterThread(unsigned long threadId);
+  static void leaveThread(NlsLogThreadRing* threadRing);
+
+  /* @brief 等待所有线程离开写入, 调用前须已阻止新的写入 */
+  static void waitThreads();
+
+  /*
+   * @brief 写入一条记录, 由写日志的线程在enterThread后调用,
+   *        仅一次拷贝进入本线程的缓冲
+   * @param message 日志正文, 不含[ID][函数:行号]前缀
+   * @return 成功返回0, 缓冲满被丢弃返回-1
+   */
+  int append(NlsLogThreadRing* threadRing, int level,
+             const char* function, unsigned int line,
+             const char* message, size_t messageSize);
+
+  void getStats(NlsAsyncLogStats* stats);
+
+  /*
+   * @brief 解析buffer开头的一条记录, 字符串字段指向buffer内部
+   * @return 记录字节数, 数据不足或格式错误返回0
+   */
+  static size_t decodeRecord(const uint8_t* buffer, size_t size,
+                             NlsLogRecord* record);
+
+  /*
+   * @brief 将记录格式化为一行文本追加到output, 格式同log4cpp文件日志:
+   *        "2021-01-01 12:00:00,000: INFO alibabaNlsLog: [ID:tid][func:line]msg"
+   * @param utcOffset 本地时区相对UTC的秒数
+   */
+  static void formatRecord(const NlsLogRecord& record, int utcOffset,
+                           std::string& output);
+
+  /* @brief 当前本地时区相对UTC的秒数 */
+  static int localUtcOffset();
+
+  /* @brief 1970年起的微秒数(UTC) */
+  static uint64_t wallClockUs();
+
+ private:
+  static size_t encodeRecord(uint8_t* buffer, int level,
+                             unsigned long threadId, uint64_t timeUs,
+                             const char* function, unsigned int line,
+                             const char* message, size_t messageSize);
+
+  void wakeup();
+  void waitFlush();
+  void drain(NlsLogThreadRing* ring, std::vector<uint8_t>& scratch);
+  void appendRecord(const uint8_t* data, size_t size);
+  void flushBatch(bool force);
+  void writeBatch();
+  int openFile();
+  void rollFile();
+  void closeFile();
+
+#if defined(_MSC_VER)
+  static unsigned __stdcall loopWriter(LPVOID arg);
+#else
+  static void* loopWriter(void* arg);
+#endif
+
+  std::string _fileName;
+  size_t _fileSize;
+  size_t _fileNum;
+  size_t _ringSize;
+  int _flushIntervalMs;
+  int _fsyncIntervalMs;
+  bool _binary;
+  int _utcOffset;
+
+  int _fd;
+  uint64_t _writtenSize;     // 当前文件已写入的字节数
+  uint64_t _lastSyncUs;
+  bool _dirty;               // 上次fsync后有新写入
+  std::string _batch;
+  std::vector<uint8_t> _scratch;
+
+  volatile long _running;
+  volatile long _wakePending;
+
+  /* 统计, 除dropped外仅由日志线程更新 */
+  volatile long _threads;
+  uint64_t _records;
+  uint64_t _droppedReleased;  // 已释放的缓冲中累计的丢弃数
+  uint64_t _bytes;
+  uint64_t _writes;
+  uint64_t _fsyncs;
+  uint64_t _writeErrors;
+
+#if defined(_MSC_VER)
+  HANDLE _mtxStats;
+  HANDLE _wakeEvent;
+  HANDLE _writerHandle;
+  unsigned _writerId;
+#else
+  pthread_mutex_t _mtxStats;
+  pthread_mutex_t _mtxWake;
+  pthread_cond_t _cvWake;
+  pthread_t _writerId;
+#endif
+};
+
+}  // namespace utility
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_LOG_SINK_H
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#define NLS_MALLOC_SIZE(p) _msize(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define NLS_MALLOC_SIZE(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define NLS_MALLOC_SIZE(p) malloc_usable_size(p)
+#endif
+
+#include "event2/event.h"
+#include "event2/buffer.h"
+#include "nlog.h"
+#include "nlsMetrics.h"
+#include "nlsMemory.h"
+
+namespace AlibabaNls {
+namespace utility {
+
+volatile int64_t NlsMemory::_limit = 0;
+volatile int64_t NlsMemory::_peak = 0;
+volatile long NlsMemory::_hookState = 0;
+
+#if !defined(EVENT__DISABLE_MM_REPLACEMENT)
+static void* hookMalloc(size_t size) {
+  void* ptr = malloc(size);
+  if (ptr) {
+    NlsMetrics::memoryLibeventBytes.add((int64_t)NLS_MALLOC_SIZE(ptr));
+  }
+  return ptr;
+}
+
+/*
+ * 钩子安装前分配的内存在此释放或缩小时无从区分, 分片可能偏小,
+ * 汇总时不低于0.
+ */
+static void* hookRealloc(void* ptr, size_t size) {
+  int64_t oldSize = ptr ? (int64_t)NLS_MALLOC_SIZE(ptr) : 0;
+  void* newPtr = realloc(ptr, size);
+  int64_t delta = 0;
+  if (newPtr) {
+    delta = (int64_t)NLS_MALLOC_SIZE(newPtr) - oldSize;
+  } else if (size == 0) {
+    delta = -oldSize;
+  }
+  if (delta != 0) {
+    NlsMetrics::memoryLibeventBytes.add(delta);
+  }
+  return newPtr;
+}
+
+static void hookFree(void* ptr) {
+  if (ptr) {
+    NlsMetrics::memoryLibeventBytes.add(-(int64_t)NLS_MALLOC_SIZE(ptr));
+    free(ptr);
+  }
+}
+#endif
+
+int NlsMemory::installAllocatorHook() {
+#if !defined(EVENT__DISABLE_MM_REPLACEMENT)
+  if (atomicCompareSwap(&_hookState, 0, 1)) {
+    event_set_mem_functions(hookMalloc, hookRealloc, hookFree);
+  }
+  return atomicLoad(&_hookState) == 1 ? 0 : -1;
+#else
+  return -1;
+#endif
+}
+
+void NlsMemory::markLibeventInUse() {
+  atomicCompareSwap(&_hookState, 0, 2);
+}
+
+void NlsMemory::setLimit(int64_t limitBytes) {
+  atomicStore64(&_limit, limitBytes > 0 ? limitBytes : 0);
+  LOG_INFO("SDK memory limit:%lld bytes, buffered:%lld bytes.",
+           (long long)limitBytes, (long long)getBufferedBytes());
+}
+
+bool NlsMemory::exceedsLimit(size_t incoming) {
+  int64_t limit = atomicLoad64(&_limit);
+  return limit > 0 && getBufferedBytes() + (int64_t)incoming >= limit;
+}
+
+bool NlsMemory::rejectStart() {
+  int64_t limit = atomicLoad64(&_limit);
+  return limit > 0 && getBufferedBytes() >= limit - limit / 10;
+}
+
+int64_t NlsMemory::getBufferedBytes() {
+  int64_t total = NlsMetrics::memoryBufferedBytes.value();
+  atomicMax64(&_peak, total);
+  return total;
+}
+
+int64_t NlsMemory::getPeakBufferedBytes() {
+  getBufferedBytes();
+  return atomicLoad64(&_peak);
+}
+
+int64_t NlsMemory::getLibeventBytes() {
+  return NlsMetrics::memoryLibeventBytes.value();
+}
+
+void NlsMemory::addBuffered(int64_t delta) {
+  NlsMetrics::memoryBufferedBytes.add(delta);
+}
+
+NlsMemoryAccount::NlsMemoryAccount() : _bytes(0), _peak(0) {}
+
+NlsMemoryAccount::~NlsMemoryAccount() {
+  release();
+}
+
+void NlsMemoryAccount::add(int64_t delta) {
+  if (delta == 0) {
+    return;
+  }
+  int64_t bytes = atomicAdd64(&_bytes, delta);
+  if (delta > 0) {
+    atomicMax64(&_peak, bytes);
+  }
+  NlsMemory::addBuffered(delta);
+}
+
+void NlsMemoryAccount::watch(struct evbuffer* buffer) {
+  if (buffer) {
+    evbuffer_add_cb(buffer, evbufferCallback, this);
+  }
+}
+
+void NlsMemoryAccount::release() {
+  int64_t bytes = atomicLoad64(&_bytes);
+  add(-bytes);
+}
+
+void NlsMemoryAccount::resetPeak() {
+  atomicStore64(&_peak, atomicLoad64(&_bytes));
+  /* 请求开始时顺带采样进程总量的峰值 */
+  NlsMemory::getBufferedBytes();
+}
+
+/* evbuffer持锁调用, 只做原子计数 */
+void NlsMemoryAccount::evbufferCallback(struct evbuffer* buffer,
+                                        const struct evbuffer_cb_info* info,
+                                        void* arg) {
+  NlsMemoryAccount* account = (NlsMemoryAccount*)arg;
+  account->add((int64_t)info->n_added - (int64_t)info->n_deleted);
+}
+
+}  // namespace utility
+}  // namespace AlibabaNls
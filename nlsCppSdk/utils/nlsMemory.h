@@ -0,0 +1,120 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_MEMORY_H
+#define NLS_SDK_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "nlsAtomic.h"
+
+struct evbuffer;
+struct evbuffer_cb_info;
+
+namespace AlibabaNls {
+namespace utility {
+
+/*
+ * SDK内存统计.
+ * 各请求的收发evbuffer注册长度变化回调, 待编码PCM在增删时记账,
+ * 汇总为进程级缓冲字节数(nls_memory_buffered_bytes);
+ * 启用内存钩子后libevent的分配计入nls_memory_libevent_bytes.
+ * 两者均按线程分片累加, 收发路径不争用同一缓存行, 读取时汇总.
+ * 设置上限后, 缓冲总量接近上限时拒绝新的start, 达到上限时sendAudio返回-1,
+ * 网络抖动时各请求的发送缓冲同时堆积也不会无限增长.
+ */
+class NlsMemory {
+ public:
+  /*
+   * 安装libevent内存分配钩子, 默认不安装. 须在创建任何libevent对象之前调用,
+   * 只生效一次. 统计值只含钩子安装后的分配, 释放时按malloc_usable_size扣减.
+   * 钩子安装前分配的内存(如进程内其他模块先使用了libevent)经钩子释放时
+   * 无从区分, 读取时不低于0, 此时统计值偏小.
+   * @return 已安装返回0, SDK已使用libevent或libevent禁用内存替换时返回-1
+   */
+  static int installAllocatorHook();
+  /* 事件线程初始化时调用, 此后不能再安装钩子 */
+  static void markLibeventInUse();
+
+  /* @param limitBytes 缓冲总量上限, 0为不限制 */
+  static void setLimit(int64_t limitBytes);
+  static inline int64_t getLimit() { return atomicLoad64(&_limit); }
+
+  /* 再加入incoming字节后是否达到上限, 未设置上限时恒为false */
+  static bool exceedsLimit(size_t incoming);
+  /*
+   * 是否拒绝新的start: 缓冲总量达到上限的90%.
+   * 留出的余量供已开始的请求使用, 避免新请求与之争抢
+   */
+  static bool rejectStart();
+
+  /* 汇总各分片, 同时更新峰值 */
+  static int64_t getBufferedBytes();
+  /*
+   * 峰值不在每次增减时更新, 而在读取统计、上限检查及请求开始时采样,
+   * 两次采样之间的短暂峰值可能遗漏
+   */
+  static int64_t getPeakBufferedBytes();
+  static int64_t getLibeventBytes();
+
+ private:
+  friend class NlsMemoryAccount;
+
+  static void addBuffered(int64_t delta);
+
+  static volatile int64_t _limit;
+  static volatile int64_t _peak;
+  /* 0未决定, 1已安装钩子, 2已使用libevent而未安装 */
+  static volatile long _hookState;
+};
+
+/*
+ * 单个请求的内存记账, 每次变化同时计入进程总量中本线程的分片.
+ */
+class NlsMemoryAccount {
+ public:
+  NlsMemoryAccount();
+  ~NlsMemoryAccount();
+
+  void add(int64_t delta);
+
+  /* 跟踪evbuffer的长度变化, evbuffer释放前须调用release */
+  void watch(struct evbuffer* buffer);
+
+  /* 将余量从进程总量中扣除, 析构前evbuffer释放时调用 */
+  void release();
+
+  inline int64_t getBytes() { return atomicLoad64(&_bytes); }
+  inline int64_t getPeak() { return atomicLoad64(&_peak); }
+  /* 请求开始时调用, 峰值从当前值重新统计 */
+  void resetPeak();
+
+ private:
+  NlsMemoryAccount(const NlsMemoryAccount&);
+  NlsMemoryAccount& operator=(const NlsMemoryAccount&);
+
+  static void evbufferCallback(struct evbuffer* buffer,
+                               const struct evbuffer_cb_info* info,
+                               void* arg);
+
+  volatile int64_t _bytes;
+  volatile int64_t _peak;
+};
+
+}  // namespace utility
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_MEMORY_H
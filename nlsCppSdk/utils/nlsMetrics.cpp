@@ -0,0 +1,416 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "utility.h"
+#include "nlsMetrics.h"
+
+namespace AlibabaNls {
+namespace utility {
+
+/* 登记表须先于下方的内置指标初始化 */
+#if defined(_MSC_VER)
+static HANDLE _mtxRegistry = CreateMutex(NULL, FALSE, NULL);
+#else
+static pthread_mutex_t _mtxRegistry = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static std::vector<NlsMetric*>& registeredMetrics() {
+  static std::vector<NlsMetric*> metrics;
+  return metrics;
+}
+
+/* 时长类直方图的le边界(us), 输出单位为秒 */
+static const uint64_t kLatencyBounds[] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+  100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 0
+};
+
+/* 事件回调时长的le边界(us), 输出单位为秒 */
+static const uint64_t kCallbackBounds[] = {
+  10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+  100000, 250000, 500000, 1000000, 0
+};
+
+/* 发送缓冲深度的le边界(字节) */
+static const uint64_t kBufferBounds[] = {
+  1024, 4096, 16384, 65536, 262144, 1048576, 4194304, 0
+};
+
+NlsCounter NlsMetrics::bytesSent(
+    "nls_bytes_sent_total", "Bytes written to gateway connections.");
+NlsCounter NlsMetrics::bytesReceived(
+    "nls_bytes_received_total", "Bytes read from gateway connections.");
+NlsCounter NlsMetrics::socketWrites(
+    "nls_socket_writes_total",
+    "Write calls that sent data on gateway connections.");
+NlsCounter NlsMetrics::socketReads(
+    "nls_socket_reads_total",
+    "Read calls that returned data from gateway connections.");
+NlsCounter NlsMetrics::framesSent(
+    "nls_frames_sent_total", "WebSocket frames queued for sending.");
+NlsCounter NlsMetrics::framesReceived(
+    "nls_frames_received_total", "WebSocket frames received.");
+NlsCounter NlsMetrics::audioRejected(
+    "nls_send_audio_rejected_total",
+    "sendAudio calls rejected because the send buffer was full.");
+NlsCounter NlsMetrics::reconnects(
+    "nls_reconnects_total", "Connection attempts after the first one.");
+NlsCounter NlsMetrics::requestsStarted(
+    "nls_requests_started_total", "Requests started.");
+NlsCounter NlsMetrics::requestsCompleted(
+    "nls_requests_finished_total", "Requests finished, by final status.",
+    "status=\"completed\"");
+NlsCounter NlsMetrics::requestsFailed(
+    "nls_requests_finished_total", "Requests finished, by final status.",
+    "status=\"failed\"");
+NlsCounter NlsMetrics::requestsCancelled(
+    "nls_requests_finished_total", "Requests finished, by final status.",
+    "status=\"cancelled\"");
+NlsHistogram NlsMetrics::sendBufferBytes(
+    "nls_send_buffer_bytes",
+    "Audio send buffer depth after each frame is queued.",
+    kBufferBounds, 1.0);
+NlsHistogram NlsMetrics::tlsHandshakeUs(
+    "nls_tls_handshake_seconds", "TLS handshake duration.",
+    kLatencyBounds, 0.000001);
+NlsHistogram NlsMetrics::connectUs(
+    "nls_connect_seconds",
+    "Time from DNS start to WebSocket upgrade of the last attempt.",
+    kLatencyBounds, 0.000001);
+NlsHistogram NlsMetrics::connectCallbackUs(
+    "nls_event_callback_seconds", "Event thread callback duration, by type.",
+    kCallbackBounds, 0.000001, "event=\"connect\"");
+NlsHistogram NlsMetrics::readCallbackUs(
+    "nls_event_callback_seconds", "Event thread callback duration, by type.",
+    kCallbackBounds, 0.000001, "event=\"read\"");
+NlsHistogram NlsMetrics::writeCallbackUs(
+    "nls_event_callback_seconds", "Event thread callback duration, by type.",
+    kCallbackBounds, 0.000001, "event=\"write\"");
+NlsHistogram NlsMetrics::dnsCallbackUs(
+    "nls_event_callback_seconds", "Event thread callback duration, by type.",
+    kCallbackBounds, 0.000001, "event=\"dns\"");
+NlsHistogram NlsMetrics::notifyCallbackUs(
+    "nls_event_callback_seconds", "Event thread callback duration, by type.",
+    kCallbackBounds, 0.000001, "event=\"notify\"");
+NlsHistogram NlsMetrics::handlerCallbackUs(
+    "nls_event_callback_seconds", "Event thread callback duration, by type.",
+    kCallbackBounds, 0.000001, "event=\"handler\"");
+NlsHistogram NlsMetrics::loopLagUs(
+    "nls_event_loop_lag_seconds",
+    "Delay of the event loop watchdog timer beyond its scheduled time.",
+    kLatencyBounds, 0.000001);
+NlsCounter NlsMetrics::slowCallbacks(
+    "nls_event_slow_callbacks_total",
+    "Event thread callbacks exceeding the watchdog threshold.");
+NlsShardedGauge NlsMetrics::memoryBufferedBytes(
+    "nls_memory_buffered_bytes",
+    "Bytes held in request send/receive buffers and pending PCM.");
+NlsShardedGauge NlsMetrics::memoryLibeventBytes(
+    "nls_memory_libevent_bytes",
+    "Bytes allocated through libevent after the SDK allocator hook was "
+    "installed, including buffer chunk overhead.");
+NlsCounter NlsMetrics::memoryRejectedStarts(
+    "nls_memory_rejected_total",
+    "Requests rejected because the SDK memory limit was reached.",
+    "call=\"start\"");
+NlsCounter NlsMetrics::memoryRejectedAudio(
+    "nls_memory_rejected_total",
+    "Requests rejected because the SDK memory limit was reached.",
+    "call=\"sendAudio\"");
+
+NlsGauge* NlsMetrics::activeNodes(size_t threadIndex) {
+  char labels[32];
+  _ssnprintf(labels, sizeof(labels), "thread=\"%d\"", (int)threadIndex);
+  return NlsMetricRegistry::labeledGauge(
+      "nls_active_nodes", "Requests attached to each event thread.", labels);
+}
+
+NlsMetric::NlsMetric(NlsMetricType type, const char* name, const char* help,
+                     const char* labels, bool autoRegister)
+    : _type(type), _name(name), _help(help), _labels(labels ? labels : "") {
+  if (autoRegister) {
+    NlsMetricRegistry::add(this);
+  }
+}
+
+size_t NlsMetric::shardIndex() {
+#if defined(_MSC_VER)
+  uint64_t id = (uint64_t)GetCurrentThreadId();
+#else
+  uint64_t id = (uint64_t)(size_t)pthread_self();
+#endif
+  // 线程ID多为对齐的地址或连续整数, 混合后取高位
+  return (size_t)((id * 0x9E3779B97F4A7C15ULL) >> 60) &
+         (NLS_METRIC_SHARDS - 1);
+}
+
+static void appendSample(std::string& output, const std::string& name,
+                         const char* suffix, const std::string& labels,
+                         const char* extraLabel, const char* value) {
+  output.append(name);
+  output.append(suffix);
+  if (!labels.empty() || extraLabel) {
+    output.push_back('{');
+    output.append(labels);
+    if (extraLabel) {
+      if (!labels.empty()) {
+        output.push_back(',');
+      }
+      output.append(extraLabel);
+    }
+    output.push_back('}');
+  }
+  output.push_back(' ');
+  output.append(value);
+  output.push_back('\n');
+}
+
+NlsCounter::NlsCounter(const char* name, const char* help, const char* labels)
+    : NlsMetric(MetricCounter, name, help, labels) {
+  memset(_shards, 0, sizeof(_shards));
+}
+
+int64_t NlsCounter::value() {
+  int64_t total = 0;
+  for (size_t i = 0; i < NLS_METRIC_SHARDS; i++) {
+    total += atomicLoad64(&_shards[i].value);
+  }
+  return total;
+}
+
+void NlsCounter::expose(std::string& output) {
+  char buffer[32];
+  _ssnprintf(buffer, sizeof(buffer), "%lld", (long long)value());
+  appendSample(output, _name, "", _labels, NULL, buffer);
+}
+
+NlsGauge::NlsGauge(const char* name, const char* help, const char* labels,
+                   bool autoRegister)
+    : NlsMetric(MetricGauge, name, help, labels, autoRegister), _value(0) {}
+
+int64_t NlsGauge::add(int64_t delta) {
+  return atomicAdd64(&_value, delta);
+}
+
+int64_t NlsGauge::subtract(int64_t delta) {
+  return atomicSubFloor64(&_value, delta);
+}
+
+int64_t NlsGauge::value() {
+  return atomicLoad64(&_value);
+}
+
+void NlsGauge::expose(std::string& output) {
+  char buffer[32];
+  _ssnprintf(buffer, sizeof(buffer), "%lld", (long long)value());
+  appendSample(output, _name, "", _labels, NULL, buffer);
+}
+
+NlsShardedGauge::NlsShardedGauge(const char* name, const char* help,
+                                 const char* labels)
+    : NlsMetric(MetricGauge, name, help, labels) {
+  memset(_shards, 0, sizeof(_shards));
+}
+
+int64_t NlsShardedGauge::value() {
+  int64_t total = 0;
+  for (size_t i = 0; i < NLS_METRIC_SHARDS; i++) {
+    total += atomicLoad64(&_shards[i].value);
+  }
+  return total > 0 ? total : 0;
+}
+
+void NlsShardedGauge::expose(std::string& output) {
+  char buffer[32];
+  _ssnprintf(buffer, sizeof(buffer), "%lld", (long long)value());
+  appendSample(output, _name, "", _labels, NULL, buffer);
+}
+
+NlsHistogram::NlsHistogram(const char* name, const char* help,
+                           const uint64_t* bounds, double scale,
+                           const char* labels)
+    : NlsMetric(MetricHistogram, name, help, labels),
+      _bounds(bounds), _scale(scale) {
+  memset(_shards, 0, sizeof(_shards));
+}
+
+size_t NlsHistogram::bucketIndex(uint64_t value) {
+  if (value < 16) {
+    return (size_t)value;
+  }
+  int exponent = 4;
+  while (exponent < 39 && (value >> (exponent + 1)) != 0) {
+    exponent++;
+  }
+  if ((value >> (exponent + 1)) != 0) {
+    return NLS_HISTOGRAM_BUCKETS - 1;
+  }
+  size_t sub = (size_t)((value >> (exponent - 3)) & 7);
+  return 16 + (size_t)(exponent - 4) * 8 + sub;
+}
+
+uint64_t NlsHistogram::bucketMax(size_t index) {
+  if (index < 16) {
+    return index;
+  }
+  int exponent = (int)((index - 16) / 8) + 4;
+  uint64_t sub = (index - 16) % 8;
+  uint64_t width = (uint64_t)1 << (exponent - 3);
+  return ((8 + sub) << (exponent - 3)) + width - 1;
+}
+
+void NlsHistogram::observe(uint64_t value) {
+  Shard& shard = _shards[shardIndex() & (NLS_HISTOGRAM_SHARDS - 1)];
+  // 先增加count, 读取时先读桶后读count, 保证+Inf不小于任一le
+  atomicAdd64(&shard.count, 1);
+  atomicAdd64(&shard.sum, (int64_t)value);
+  atomicAdd64(&shard.buckets[bucketIndex(value)], 1);
+}
+
+void NlsHistogram::expose(std::string& output) {
+  int64_t buckets[NLS_HISTOGRAM_BUCKETS];
+  int64_t count = 0;
+  int64_t sum = 0;
+  memset(buckets, 0, sizeof(buckets));
+  for (size_t s = 0; s < NLS_HISTOGRAM_SHARDS; s++) {
+    for (size_t i = 0; i < NLS_HISTOGRAM_BUCKETS; i++) {
+      buckets[i] += atomicLoad64(&_shards[s].buckets[i]);
+    }
+    count += atomicLoad64(&_shards[s].count);
+    sum += atomicLoad64(&_shards[s].sum);
+  }
+
+  char value[48];
+  char label[48];
+  int64_t cumulative = 0;
+  size_t index = 0;
+  for (const uint64_t* bound = _bounds; *bound != 0; bound++) {
+    while (index < NLS_HISTOGRAM_BUCKETS && bucketMax(index) <= *bound) {
+      cumulative += buckets[index];
+      index++;
+    }
+    _ssnprintf(label, sizeof(label), "le=\"%g\"", (double)*bound * _scale);
+    _ssnprintf(value, sizeof(value), "%lld", (long long)cumulative);
+    appendSample(output, _name, "_bucket", _labels, label, value);
+  }
+  _ssnprintf(value, sizeof(value), "%lld", (long long)count);
+  appendSample(output, _name, "_bucket", _labels, "le=\"+Inf\"", value);
+  _ssnprintf(value, sizeof(value), "%.9g", (double)sum * _scale);
+  appendSample(output, _name, "_sum", _labels, NULL, value);
+  _ssnprintf(value, sizeof(value), "%lld", (long long)count);
+  appendSample(output, _name, "_count", _labels, NULL, value);
+}
+
+void NlsMetricRegistry::add(NlsMetric* metric) {
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxRegistry, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxRegistry);
+#endif
+
+  registeredMetrics().push_back(metric);
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxRegistry);
+#else
+  pthread_mutex_unlock(&_mtxRegistry);
+#endif
+}
+
+NlsGauge* NlsMetricRegistry::labeledGauge(const char* name, const char* help,
+                                          const char* labels) {
+  NlsGauge* gauge = NULL;
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxRegistry, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxRegistry);
+#endif
+
+  std::vector<NlsMetric*>& metrics = registeredMetrics();
+  for (size_t i = 0; i < metrics.size(); i++) {
+    if (metrics[i]->_type == MetricGauge && metrics[i]->_name == name &&
+        metrics[i]->_labels == labels) {
+      gauge = static_cast<NlsGauge*>(metrics[i]);
+      break;
+    }
+  }
+
+  // 查找与创建在同一锁内, 并发调用不会重复创建同名同标签的指标
+  if (gauge == NULL) {
+    gauge = new NlsGauge(name, help, labels, false);
+    metrics.push_back(gauge);
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxRegistry);
+#else
+  pthread_mutex_unlock(&_mtxRegistry);
+#endif
+  return gauge;
+}
+
+void NlsMetricRegistry::dump(std::string& output) {
+  static const char* const kTypeNames[] = {"counter", "gauge", "histogram"};
+
+#if defined(_MSC_VER)
+  WaitForSingleObject(_mtxRegistry, INFINITE);
+#else
+  pthread_mutex_lock(&_mtxRegistry);
+#endif
+
+  std::vector<NlsMetric*>& metrics = registeredMetrics();
+  std::vector<bool> done(metrics.size(), false);
+  for (size_t i = 0; i < metrics.size(); i++) {
+    if (done[i]) {
+      continue;
+    }
+    // 同名指标须连续输出, HELP及TYPE只输出一次
+    output.append("# HELP ");
+    output.append(metrics[i]->_name);
+    output.push_back(' ');
+    output.append(metrics[i]->_help);
+    output.append("\n# TYPE ");
+    output.append(metrics[i]->_name);
+    output.push_back(' ');
+    output.append(kTypeNames[metrics[i]->_type]);
+    output.push_back('\n');
+    for (size_t j = i; j < metrics.size(); j++) {
+      if (!done[j] && metrics[j]->_name == metrics[i]->_name) {
+        metrics[j]->expose(output);
+        done[j] = true;
+      }
+    }
+  }
+
+#if defined(_MSC_VER)
+  ReleaseMutex(_mtxRegistry);
+#else
+  pthread_mutex_unlock(&_mtxRegistry);
+#endif
+}
+
+}  // namespace utility
+}  // namespace AlibabaNls
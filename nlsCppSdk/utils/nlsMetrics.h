@@ -0,0 +1,228 @@
+/*
+ * Copyright 2021 Alibaba Group Holding Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLS_SDK_METRICS_H
+#define NLS_SDK_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "nlsAtomic.h"
+
+namespace AlibabaNls {
+namespace utility {
+
+/*
+ * 进程级指标. 更新均为无锁原子操作, 计数器及直方图按线程分片,
+ * 分片各占一个缓存行, 多个事件线程并发更新时互不争用;
+ * 读取时累加所有分片. 指标在静态初始化时登记, 进程退出前不释放.
+ */
+#define NLS_METRIC_SHARDS 16
+#define NLS_METRIC_CACHE_LINE 64
+
+/*
+ * 分片按缓存行对齐, 否则紧随虚表及名称之后的分片会跨行, 相邻分片仍共用缓存行.
+ * C++98的new不保证该对齐, 带分片的指标只定义为静态对象.
+ */
+#if defined(_MSC_VER)
+#define NLS_METRIC_ALIGNED __declspec(align(64))
+#else
+#define NLS_METRIC_ALIGNED __attribute__((aligned(NLS_METRIC_CACHE_LINE)))
+#endif
+
+enum NlsMetricType {
+  MetricCounter = 0,
+  MetricGauge,
+  MetricHistogram
+};
+
+struct NLS_METRIC_ALIGNED NlsMetricShard {
+  volatile int64_t value;
+  char padding[NLS_METRIC_CACHE_LINE - sizeof(int64_t)];
+};
+
+class NlsMetric {
+ public:
+  /*
+   * @param name   指标名, 同名指标以labels区分, 输出时归为一组
+   * @param labels Prometheus标签, 如 thread="0", 无标签为NULL
+   * @param autoRegister 构造时登记, 否则由调用者持登记表锁登记
+   */
+  NlsMetric(NlsMetricType type, const char* name, const char* help,
+            const char* labels, bool autoRegister = true);
+  virtual ~NlsMetric() {}
+
+  /* 按Prometheus文本格式追加本指标的样本行, 不含HELP/TYPE */
+  virtual void expose(std::string& output) = 0;
+
+  NlsMetricType _type;
+  std::string _name;
+  std::string _help;
+  std::string _labels;
+
+ protected:
+  static size_t shardIndex();
+};
+
+class NlsCounter : public NlsMetric {
+ public:
+  NlsCounter(const char* name, const char* help, const char* labels = NULL);
+
+  inline void add(int64_t delta = 1);
+  int64_t value();
+  void expose(std::string& output);
+
+ private:
+  NlsMetricShard _shards[NLS_METRIC_SHARDS];
+};
+
+class NlsGauge : public NlsMetric {
+ public:
+  NlsGauge(const char* name, const char* help, const char* labels = NULL,
+           bool autoRegister = true);
+
+  /* @return 更新后的值 */
+  int64_t add(int64_t delta);
+  /* 减少delta, 结果不低于0. @return 更新后的值 */
+  int64_t subtract(int64_t delta);
+  int64_t value();
+  void expose(std::string& output);
+
+ private:
+  volatile int64_t _value;
+};
+
+/*
+ * 按线程分片的计量值, 用于各线程高频增减的总量, 如内存统计.
+ * 增减只写本线程的分片; 一个线程增加、另一个线程减少时分片可为负,
+ * 读取时累加所有分片, 结果不低于0.
+ */
+class NlsShardedGauge : public NlsMetric {
+ public:
+  NlsShardedGauge(const char* name, const char* help,
+                  const char* labels = NULL);
+
+  inline void add(int64_t delta);
+  int64_t value();
+  void expose(std::string& output);
+
+ private:
+  NlsMetricShard _shards[NLS_METRIC_SHARDS];
+};
+
+/*
+ * HDR风格直方图: 0~15为线性桶, 之后每个2的幂区间分为8个桶,
+ * 相对误差不超过1/8, 可记录至2^40.
+ * 输出时按固定的le边界累加, 值落在桶内的部分按桶上界计入.
+ */
+#define NLS_HISTOGRAM_BUCKETS 304
+#define NLS_HISTOGRAM_SHARDS 8
+
+class NlsHistogram : public NlsMetric {
+ public:
+  /*
+   * @param bounds 输出的le边界, 以记录值的单位表示, 升序, 以0结尾
+   * @param scale  输出时乘以的系数, 如微秒记录、秒输出为0.000001
+   */
+  NlsHistogram(const char* name, const char* help,
+               const uint64_t* bounds, double scale,
+               const char* labels = NULL);
+
+  void observe(uint64_t value);
+  void expose(std::string& output);
+
+  static size_t bucketIndex(uint64_t value);
+  /* 桶内的最大值 */
+  static uint64_t bucketMax(size_t index);
+
+ private:
+  struct NLS_METRIC_ALIGNED Shard {
+    volatile int64_t buckets[NLS_HISTOGRAM_BUCKETS];
+    volatile int64_t count;
+    volatile int64_t sum;
+  };
+
+  Shard _shards[NLS_HISTOGRAM_SHARDS];
+  const uint64_t* _bounds;
+  double _scale;
+};
+
+/*
+ * 指标登记表
+ */
+class NlsMetricRegistry {
+ public:
+  static void add(NlsMetric* metric);
+
+  /* 查找或创建带标签的计量值, 用于数量在运行时确定的指标 */
+  static NlsGauge* labeledGauge(const char* name, const char* help,
+                                const char* labels);
+
+  /* 以Prometheus文本格式(0.0.4)输出所有指标 */
+  static void dump(std::string& output);
+};
+
+/*
+ * SDK内置指标
+ */
+class NlsMetrics {
+ public:
+  static NlsCounter bytesSent;
+  static NlsCounter bytesReceived;
+  static NlsCounter socketWrites;
+  static NlsCounter socketReads;
+  static NlsCounter framesSent;
+  static NlsCounter framesReceived;
+  static NlsCounter audioRejected;
+  static NlsCounter reconnects;
+  static NlsCounter requestsStarted;
+  static NlsCounter requestsCompleted;
+  static NlsCounter requestsFailed;
+  static NlsCounter requestsCancelled;
+  static NlsHistogram sendBufferBytes;
+  static NlsHistogram tlsHandshakeUs;
+  static NlsHistogram connectUs;
+  /* 事件线程各类回调的执行时长及循环延迟, 开启LoopWatchdog时记录 */
+  static NlsHistogram connectCallbackUs;
+  static NlsHistogram readCallbackUs;
+  static NlsHistogram writeCallbackUs;
+  static NlsHistogram dnsCallbackUs;
+  static NlsHistogram notifyCallbackUs;
+  static NlsHistogram handlerCallbackUs;
+  static NlsHistogram loopLagUs;
+  static NlsCounter slowCallbacks;
+  /* SDK持有的内存, 见NlsMemory */
+  static NlsShardedGauge memoryBufferedBytes;
+  static NlsShardedGauge memoryLibeventBytes;
+  static NlsCounter memoryRejectedStarts;
+  static NlsCounter memoryRejectedAudio;
+
+  /* 事件线程的活跃请求数, 按线程下标区分 */
+  static NlsGauge* activeNodes(size_t threadIndex);
+};
+
+inline void NlsCounter::add(int64_t delta) {
+  atomicAdd64(&_shards[shardIndex()].value, delta);
+}
+
+inline void NlsShardedGauge::add(int64_t delta) {
+  atomicAdd64(&_shards[shardIndex()].value, delta);
+}
+
+}  // namespace utility
+}  // namespace AlibabaNls
+
+#endif //NLS_SDK_METRICS_H
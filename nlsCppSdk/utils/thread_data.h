@@ -20,12 +20,220 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <vector>
-#include <utility>
-#include <pthread.h>
+#include <stdint.h>
+#include "nlsAtomic.h"
 
 namespace AlibabaNls {
 
+/*
+ * 单生产者单消费者的定长字节环形缓冲, 无锁.
+ * 容量向上取整为2的幂, 读写位置为单调递增计数, 取模后定位.
+ * 生产者只修改write_pos_, 消费者只修改read_pos_, 读写两端可在不同线程,
+ * 同一端不可并发调用. Clear仅在两端均空闲时调用.
+ * 两端各自缓存对端位置, 仅在缓存的空间或数据不足时重新读取.
+ * 位置以释放语义写入、获取语义读取, 不使用带锁的读改写指令,
+ * 一次读或写通常只有提交时的一次普通写入.
+ *
+ * 除整段拷贝的Write/Read外, 提供连续读写区间, 便于直接在缓冲上编码或发送:
+ *   uint8_t* p; size_t n = ring.WriteSpan(&p); ...写入p[0, m)...; ring.CommitWrite(m);
+ *   const uint8_t* q; n = ring.ReadSpan(&q); ...使用q[0, m)...; ring.CommitRead(m);
+ * 区间在回绕处截断, 两次调用即可取得全部数据.
+ */
+class ByteRing {
+ public:
+  explicit ByteRing(size_t capacity) : buffer_(NULL), capacity_(0), mask_(0),
+      read_pos_(0), cached_write_pos_(0), write_pos_(0), cached_read_pos_(0) {
+    size_t size = 1;
+    while (size < capacity && size < kMaxCapacity) {
+      size <<= 1;
+    }
+    buffer_ = static_cast<uint8_t *>(malloc(size));
+    if (buffer_) {
+      capacity_ = size;
+      mask_ = size - 1;
+    }
+  }
+  ~ByteRing() {
+    if (buffer_) {
+      free(buffer_);
+      buffer_ = NULL;
+    }
+  }
+
+  size_t Capacity() const {
+    return capacity_;
+  }
+
+  /* 可读字节数, 任意线程可调用, 结果仅为快照 */
+  size_t Size() {
+    unsigned long write_pos = utility::atomicLoadAcquire(&write_pos_);
+    unsigned long read_pos = utility::atomicLoadAcquire(&read_pos_);
+    return (size_t)(write_pos - read_pos);
+  }
+
+  /* 生产者: 可写字节数 */
+  size_t Space() {
+    return WritableSpace(capacity_);
+  }
+
+  /* 生产者: 写入至多size字节, 返回实际写入字节数 */
+  size_t Write(const void *data, size_t size) {
+    size_t space = WritableSpace(size);
+    if (size > space) {
+      size = space;
+    }
+    CopyIn(data, size);
+    return size;
+  }
+
+  /* 生产者: 空间足够时写入全部size字节并返回true, 否则不写入 */
+  bool WriteAll(const void *data, size_t size) {
+    if (WritableSpace(size) < size) {
+      return false;
+    }
+    CopyIn(data, size);
+    return true;
+  }
+
+  /* 生产者: 返回从写位置起到回绕点或已读位置为止的连续可写区间 */
+  size_t WriteSpan(uint8_t **span) {
+    size_t offset = (size_t)(unsigned long)write_pos_ & mask_;
+    size_t contiguous = capacity_ - offset;
+    size_t space = WritableSpace(contiguous);
+    *span = buffer_ + offset;
+    return space < contiguous ? space : contiguous;
+  }
+
+  /* 生产者: 提交已写入的size字节, 对消费者可见 */
+  void CommitWrite(size_t size) {
+    // 只有生产者修改write_pos_, 数据写入后以释放语义发布
+    utility::atomicStoreRelease(&write_pos_,
+        (long)((unsigned long)write_pos_ + size));
+  }
+
+  /* 消费者: 读出至多size字节并移除, 返回实际读出字节数 */
+  size_t Read(void *data, size_t size) {
+    size_t read = Peek(data, size, 0);
+    CommitRead(read);
+    return read;
+  }
+
+  /* 消费者: 从已读位置后offset字节处拷贝至多size字节, 不移除 */
+  size_t Peek(void *data, size_t size, size_t offset) {
+    size_t available = ReadableSize(offset + size);
+    if (offset >= available) {
+      return 0;
+    }
+    available -= offset;
+    if (size > available) {
+      size = available;
+    }
+    uint8_t *dst = static_cast<uint8_t *>(data);
+    size_t start = ((size_t)(unsigned long)read_pos_ + offset) & mask_;
+    size_t first = capacity_ - start;
+    if (first > size) {
+      first = size;
+    }
+    memcpy(dst, buffer_ + start, first);
+    if (size > first) {
+      memcpy(dst + first, buffer_, size - first);
+    }
+    return size;
+  }
+
+  /* 消费者: 移除至多size字节, 返回实际移除字节数 */
+  size_t Skip(size_t size) {
+    size_t available = ReadableSize(size);
+    if (size > available) {
+      size = available;
+    }
+    CommitRead(size);
+    return size;
+  }
+
+  /* 消费者: 返回从已读位置起到回绕点或写位置为止的连续可读区间 */
+  size_t ReadSpan(const uint8_t **span) {
+    size_t offset = (size_t)(unsigned long)read_pos_ & mask_;
+    size_t contiguous = capacity_ - offset;
+    size_t available = ReadableSize(contiguous);
+    *span = buffer_ + offset;
+    return available < contiguous ? available : contiguous;
+  }
+
+  /* 消费者: 提交已使用的size字节, 腾出的空间对生产者可见 */
+  void CommitRead(size_t size) {
+    if (size > 0) {
+      utility::atomicStoreRelease(&read_pos_,
+          (long)((unsigned long)read_pos_ + size));
+    }
+  }
+
+  void Clear() {
+    utility::atomicStoreRelease(&read_pos_, 0);
+    utility::atomicStoreRelease(&write_pos_, 0);
+    cached_read_pos_ = 0;
+    cached_write_pos_ = 0;
+  }
+
+ private:
+  ByteRing(const ByteRing &);
+  ByteRing &operator=(const ByteRing &);
+
+  /* 生产者侧可写空间, 缓存不足needed时重新读取read_pos_ */
+  size_t WritableSpace(size_t needed) {
+    unsigned long write_pos = (unsigned long)write_pos_;
+    size_t space = capacity_ - (size_t)(write_pos - cached_read_pos_);
+    if (space < needed) {
+      cached_read_pos_ = utility::atomicLoadAcquire(&read_pos_);
+      space = capacity_ - (size_t)(write_pos - cached_read_pos_);
+    }
+    return space;
+  }
+
+  /* 消费者侧可读字节数, 缓存不足needed时重新读取write_pos_ */
+  size_t ReadableSize(size_t needed) {
+    unsigned long read_pos = (unsigned long)read_pos_;
+    size_t available = (size_t)(cached_write_pos_ - read_pos);
+    if (available < needed) {
+      cached_write_pos_ = utility::atomicLoadAcquire(&write_pos_);
+      available = (size_t)(cached_write_pos_ - read_pos);
+    }
+    return available;
+  }
+
+  void CopyIn(const void *data, size_t size) {
+    if (size == 0) {
+      return;
+    }
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+    size_t start = (size_t)(unsigned long)write_pos_ & mask_;
+    size_t first = capacity_ - start;
+    if (first > size) {
+      first = size;
+    }
+    memcpy(buffer_ + start, src, first);
+    if (size > first) {
+      memcpy(buffer_, src + first, size - first);
+    }
+    CommitWrite(size);
+  }
+
+  static const size_t kMaxCapacity = (size_t)1 << 30;
+
+  uint8_t *buffer_;
+  size_t capacity_;
+  size_t mask_;
+  /* 消费者侧, 与生产者侧分处不同cache line, 避免两端互相失效 */
+  char pad0_[64];
+  volatile long read_pos_;
+  unsigned long cached_write_pos_;
+  char pad1_[64];
+  /* 生产者侧 */
+  volatile long write_pos_;
+  unsigned long cached_read_pos_;
+  char pad2_[64];
+};
+
 class DataItf {
  protected:
   virtual ~DataItf() {}
@@ -35,24 +243,25 @@ class DataItf {
   virtual size_t ElementSize() = 0;
 };
 
+/*
+ * 基于ByteRing的定长元素队列, 接口与原分块链表实现一致, 一个生产者线程
+ * Pushback, 一个消费者线程Get/TryGet/Flush, 无锁且Pushback/Get不再分配内存.
+ * 与原实现的差异:
+ *   容量固定, 剩余空间不足时Pushback整段失败返回-1;
+ *   数据视为单一连续数组, start_array_idx恒为0, start_element_idx为
+ *   相对队首的读取游标, 以is_delete_after_get读取后游标之前的数据一并移除.
+ */
 template <typename T>
 class DataBase : public DataItf {
  public:
-  DataBase() {
-    pthread_mutex_init(&data_mutex_, NULL);
-  }
-  virtual ~DataBase() {
-    Clear();
-    pthread_mutex_destroy(&data_mutex_);
-  }
+  static const size_t kDefaultCapacity = 64 * 1024;
+
+  explicit DataBase(size_t capacity = kDefaultCapacity) : ring_(capacity) {}
+  virtual ~DataBase() {}
+
   virtual int Pushback(const T *data, int element_num) {
     if ((NULL != data) && (element_num > 0)) {
-      T *data_for_insert = new T[element_num];
-      memcpy(data_for_insert, data, sizeof(T) * element_num);
-      pthread_mutex_lock(&data_mutex_);
-      data_.push_back(std::make_pair(data_for_insert, element_num));
-      pthread_mutex_unlock(&data_mutex_);
-      return 0;
+      return ring_.WriteAll(data, sizeof(T) * element_num) ? 0 : -1;
     } else {
       return -1;
     }
@@ -61,109 +270,69 @@ class DataBase : public DataItf {
                   int *start_element_idx, bool is_delete_after_get = false) {
     int num_shift = 0;
     if ((NULL != data) && (element_num > 0) && (*start_array_idx >= 0)) {
-      pthread_mutex_lock(&data_mutex_);
-      for (; (*start_array_idx < data_.size()) && (num_shift < element_num);) {
-        if (*start_element_idx + element_num - num_shift >=
-            data_[*start_array_idx].second) {
-          // get data partly from cur array
-          int cur_copy_num =
-            data_[*start_array_idx].second - *start_element_idx;
-          memcpy(data + num_shift,
-                 data_[*start_array_idx].first + *start_element_idx,
-                 sizeof(T) * cur_copy_num);
-          num_shift += cur_copy_num;
-          *start_element_idx = 0;
-          if (is_delete_after_get) {
-            delete [](data_[*start_array_idx].first);
-            data_.erase(data_.begin() + *start_array_idx);
-          } else {
-            (*start_array_idx)++;
-          }
-          continue;
-        } else {
-          // get data entirely from cur array
-          int cur_copy_num = element_num - num_shift;
-          memcpy(data + num_shift,
-                 data_[*start_array_idx].first + *start_element_idx,
-                 sizeof(T) * cur_copy_num);
-          num_shift += cur_copy_num;
-          *start_element_idx += cur_copy_num;
-          break;
-        }
-      }
-      pthread_mutex_unlock(&data_mutex_);
+      num_shift = Fetch(data, element_num, start_array_idx, start_element_idx,
+                        is_delete_after_get, false);
     }
     return num_shift;
   }
 
   virtual int TryGet(T *data, int element_num, int *start_array_idx,
                   int *start_element_idx, bool is_delete_after_get = false) {
-    int tmp_start_array_idx = *start_array_idx;
-    int tmp_start_element_idx = *start_element_idx;
-    if (element_num != Get(data, element_num, start_array_idx,
-                           start_element_idx)) {
-      *start_array_idx = tmp_start_array_idx;
-      *start_element_idx = tmp_start_element_idx;
-      if (is_delete_after_get) {
-        Flush(start_array_idx);
-      }
-      return 0;
-    } else {
-      if (is_delete_after_get) {
-        Flush(start_array_idx);
-      }
-      return element_num;
+    int num_shift = 0;
+    if ((NULL != data) && (element_num > 0) && (*start_array_idx >= 0)) {
+      num_shift = Fetch(data, element_num, start_array_idx, start_element_idx,
+                        is_delete_after_get, true);
+    }
+    if (num_shift != element_num && is_delete_after_get) {
+      Flush(start_array_idx);
     }
+    return num_shift;
   }
 
+  /* 数据读取后即按游标移除, 无整块待释放 */
   virtual void Flush(int *start_array_idx) {
-    pthread_mutex_lock(&data_mutex_);
-    for (; *start_array_idx > 0 && *start_array_idx < data_.size();) {
-      if ((*data_.begin()).first) {
-       delete[](*data_.begin()).first;
-      }
-      data_.erase(data_.begin());
-      (*start_array_idx)--;
-    }
-    pthread_mutex_unlock(&data_mutex_);
+    *start_array_idx = 0;
   }
 
   virtual void Clear() {
-    pthread_mutex_lock(&data_mutex_);
-    for (size_t i = 0; i < data_.size(); ++i) {
-      if (data_[i].first) {
-        delete [](data_[i].first);
-      }
-    }
-    data_.clear();
-    pthread_mutex_unlock(&data_mutex_);
+    ring_.Clear();
   }
   virtual size_t ArrayNum() {
-    size_t array_num = 0;
-    pthread_mutex_lock(&data_mutex_);
-    array_num = data_.size();
-    pthread_mutex_unlock(&data_mutex_);
-    return array_num;
+    return ring_.Size() > 0 ? 1 : 0;
   }
   virtual size_t ElementNum() {
-    size_t element_num = 0;
-    pthread_mutex_lock(&data_mutex_);
-    for (size_t i = 0; i < data_.size(); ++i) {
-      element_num += data_[i].second;
-    }
-    pthread_mutex_unlock(&data_mutex_);
-    return element_num;
+    return ring_.Size() / sizeof(T);
   }
   virtual size_t ElementSize() {
     return sizeof(T);
   }
+  size_t Capacity() const {
+    return ring_.Capacity() / sizeof(T);
+  }
 
  protected:
-  std::vector< std::pair<T *, int> > data_;
-  pthread_mutex_t data_mutex_;
+  /* 从游标处读取, all为true时数据不足element_num则不读取并返回0 */
+  int Fetch(T *data, int element_num, int *start_array_idx,
+            int *start_element_idx, bool is_delete_after_get, bool all) {
+    size_t offset = sizeof(T) * (*start_element_idx);
+    size_t bytes = ring_.Peek(data, sizeof(T) * element_num, offset);
+    int num_shift = (int)(bytes / sizeof(T));
+    if (all && num_shift != element_num) {
+      return 0;
+    }
+    *start_array_idx = 0;
+    if (is_delete_after_get) {
+      ring_.Skip(offset + sizeof(T) * num_shift);
+      *start_element_idx = 0;
+    } else {
+      *start_element_idx += num_shift;
+    }
+    return num_shift;
+  }
+
+  ByteRing ring_;
 };
 
 }  // namespace AlibabaNls
 
 #endif  // NLS_SDK_THREAD_DATA_H_
-
@@ -22,6 +22,9 @@
 #include <Ws2tcpip.h>
 #else
 #include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
 #endif
 
 namespace AlibabaNls {
@@ -35,5 +38,31 @@ int getLastErrorCode() {
 #endif
 }
 
+uint64_t getMonotonicUs() {
+#ifdef _MSC_VER
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)(counter.QuadPart / (frequency.QuadPart / 1000000.0));
+#elif defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+void sleepOneMs() {
+#ifdef _MSC_VER
+  Sleep(1);
+#else
+  usleep(1000);
+#endif
+}
+
 }  // namespace utility
 }  // namespace AlibabaNls
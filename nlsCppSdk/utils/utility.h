@@ -17,6 +17,8 @@
 #ifndef NLS_SDK_UTILITY_H
 #define NLS_SDK_UTILITY_H
 
+#include <stdint.h>
+
 namespace AlibabaNls {
 namespace utility {
 
@@ -41,6 +43,16 @@ namespace utility {
 
 int getLastErrorCode();
 
+/*
+ * @brief 获取单调递增时钟, 单位微秒, 仅用于计算耗时
+ */
+uint64_t getMonotonicUs();
+
+/*
+ * @brief 当前线程休眠约1ms, 用于等待其他线程的短暂轮询
+ */
+void sleepOneMs();
+
 }  // namespace utility
 }  // namespace AlibabaNls
 
@@ -198,7 +198,9 @@ echo "搬动头文件和库文件..."
 mkdir -p $sdk_install_folder/include
 cp $git_root_path/nlsCppSdk/framework/feature/sr/speechRecognizerRequest.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/feature/st/speechTranscriberRequest.h $sdk_install_folder/include/
+cp $git_root_path/nlsCppSdk/framework/feature/st/speechTranscriberMultiChannel.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/feature/sy/speechSynthesizerRequest.h $sdk_install_folder/include/
+cp $git_root_path/nlsCppSdk/framework/feature/sy/speechSynthesizerLongText.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/feature/da/dialogAssistantRequest.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/item/iNlsRequest.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/common/nlsClient.h $sdk_install_folder/include/
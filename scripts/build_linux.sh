@@ -102,7 +102,9 @@ echo "搬动头文件和库文件..."
 mkdir -p $sdk_install_folder/include
 cp $git_root_path/nlsCppSdk/framework/feature/sr/speechRecognizerRequest.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/feature/st/speechTranscriberRequest.h $sdk_install_folder/include/
+cp $git_root_path/nlsCppSdk/framework/feature/st/speechTranscriberMultiChannel.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/feature/sy/speechSynthesizerRequest.h $sdk_install_folder/include/
+cp $git_root_path/nlsCppSdk/framework/feature/sy/speechSynthesizerLongText.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/feature/da/dialogAssistantRequest.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/item/iNlsRequest.h $sdk_install_folder/include/
 cp $git_root_path/nlsCppSdk/framework/common/nlsClient.h $sdk_install_folder/include/
@@ -130,6 +132,8 @@ cp $git_root_path/demo/Linux/build_linux_demo.sh $sdk_install_folder/demo
 cp $git_root_path/version $sdk_install_folder/
 cp $git_root_path/README.md $sdk_install_folder/
 cp $git_root_path/build/demo/*Demo $sdk_install_folder/bin
+cp $build_folder/nlsCppSdk/nlsLogDecode $sdk_install_folder/bin
+cp $build_folder/nlsCppSdk/nlsMockGateway $sdk_install_folder/bin
 cp -r $git_root_path/resource $sdk_install_folder/demo/
 cur_date=$(date +%Y%m%d%H%M)
 
@@ -569,7 +569,9 @@ rem 拷贝头文件
 copy /y %project_folder%\nlsCppSdk\framework\feature\da\dialogAssistantRequest.h %install_include_folder%\
 copy /y %project_folder%\nlsCppSdk\framework\feature\sr\speechRecognizerRequest.h %install_include_folder%\
 copy /y %project_folder%\nlsCppSdk\framework\feature\st\speechTranscriberRequest.h %install_include_folder%\
+copy /y %project_folder%\nlsCppSdk\framework\feature\st\speechTranscriberMultiChannel.h %install_include_folder%\
 copy /y %project_folder%\nlsCppSdk\framework\feature\sy\speechSynthesizerRequest.h %install_include_folder%\
+copy /y %project_folder%\nlsCppSdk\framework\feature\sy\speechSynthesizerLongText.h %install_include_folder%\
 copy /y %project_folder%\nlsCppSdk\framework\common\nlsClient.h %install_include_folder%\
 copy /y %project_folder%\nlsCppSdk\framework\common\nlsEvent.h %install_include_folder%\
 copy /y %project_folder%\nlsCppSdk\framework\common\nlsGlobal.h %install_include_folder%\